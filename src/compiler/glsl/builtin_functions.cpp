@@ -39,7 +39,8 @@
  *
  *    The builtin_builder::create_builtins() function contains lists of all
  *    built-in function signatures, where they're available, what types they
- *    take, and so on.
+ *    take, and so on.  Built-ins are only created when a shader first looks
+ *    them up by name.
  *
  * 4. Implementations of built-in function signatures
  *
@@ -87,6 +88,7 @@
 #include <math.h>
 #include "builtin_functions.h"
 #include "util/hash_table.h"
+#include "util/set.h"
 
 #ifndef M_PIf
 #define M_PIf   ((float) M_PI)
@@ -992,22 +994,34 @@ public:
    void release();
    ir_function_signature *find(_mesa_glsl_parse_state *state,
                                const char *name, exec_list *actual_parameters);
+   ir_function *find_function(const char *name);
 
    /**
     * A shader to hold all the built-in signatures; created by this module.
     *
-    * This includes signatures for every built-in, regardless of version or
-    * enabled extensions.  The availability predicate associated with each
-    * signature allows matching_signature() to filter out the irrelevant ones.
+    * This includes every signature of the intrinsics and of each built-in
+    * that has been looked up so far, regardless of version or enabled
+    * extensions.  The availability predicate associated with each signature
+    * allows matching_signature() to filter out the irrelevant ones.
     */
    gl_shader *shader;
 
 private:
    void *mem_ctx;
 
+   /**
+    * The only function create_builtins() creates, or NULL to create all of
+    * them.
+    */
+   const char *lazy_name;
+
+   /** Names create_builtins() has already run for */
+   struct set *lazy_done;
+
    void create_shader();
    void create_intrinsics();
    void create_builtins();
+   bool skip_function(const char *name);
 
    /**
     * IR builder helpers:
@@ -1393,7 +1407,7 @@ enum image_function_flags {
  *  @{
  */
 builtin_builder::builtin_builder()
-   : shader(NULL)
+   : shader(NULL), lazy_name(NULL), lazy_done(NULL)
 {
    mem_ctx = NULL;
 }
@@ -1424,7 +1438,7 @@ builtin_builder::find(_mesa_glsl_parse_state *state,
     */
    state->uses_builtin_functions = true;
 
-   ir_function *f = shader->symbols->get_function(name);
+   ir_function *f = find_function(name);
    if (f == NULL)
       return NULL;
 
@@ -1436,6 +1450,39 @@ builtin_builder::find(_mesa_glsl_parse_state *state,
    return sig;
 }
 
+/**
+ * Look up a built-in function by name, creating it on first use.
+ *
+ * Building the IR for every built-in is a large part of the startup time and
+ * memory use of a GL context, and most shaders only call a handful of them.
+ * So create_builtins() runs once for each new name, and only evaluates the
+ * add_function() call for that name.
+ */
+ir_function *
+builtin_builder::find_function(const char *name)
+{
+   ir_function *f = shader->symbols->get_function(name);
+   if (f != NULL)
+      return f;
+
+   /* Names that don't exist only need to be searched for once, too. */
+   if (_mesa_set_search(lazy_done, name))
+      return NULL;
+   _mesa_set_add(lazy_done, ralloc_strdup(mem_ctx, name));
+
+   lazy_name = name;
+   create_builtins();
+   lazy_name = NULL;
+
+   return shader->symbols->get_function(name);
+}
+
+bool
+builtin_builder::skip_function(const char *name)
+{
+   return lazy_name != NULL && strcmp(name, lazy_name) != 0;
+}
+
 void
 builtin_builder::initialize()
 {
@@ -1446,9 +1493,10 @@ builtin_builder::initialize()
    glsl_type_singleton_init_or_ref();
 
    mem_ctx = ralloc_context(NULL);
+   lazy_done = _mesa_set_create(mem_ctx, _mesa_hash_string,
+                                _mesa_key_string_equal);
    create_shader();
    create_intrinsics();
-   create_builtins();
 }
 
 void
@@ -1456,6 +1504,7 @@ builtin_builder::release()
 {
    ralloc_free(mem_ctx);
    mem_ctx = NULL;
+   lazy_done = NULL;
 
    ralloc_free(shader);
    shader = NULL;
@@ -1731,6 +1780,10 @@ builtin_builder::create_intrinsics()
  *
  * Contains a list of every available built-in.
  */
+/* Skipping an add_function() call also skips building its signatures. */
+#define add_function(name, ...) \
+   (skip_function(name) ? (void)0 : add_function(name, __VA_ARGS__))
+
 void
 builtin_builder::create_builtins()
 {
@@ -5437,6 +5490,8 @@ builtin_builder::create_builtins()
 #undef FIU2_MIXED
 }
 
+#undef add_function
+
 void
 builtin_builder::add_function(const char *name, ...)
 {
@@ -5507,6 +5562,9 @@ builtin_builder::add_image_function(const char *name,
       glsl_type::uimage2DMSArray_type
    };
 
+   if (skip_function(name))
+      return;
+
    ir_function *f = new(mem_ctx) ir_function(name);
 
    for (unsigned i = 0; i < ARRAY_SIZE(types); ++i) {
@@ -8594,7 +8652,7 @@ _mesa_glsl_has_builtin_function(_mesa_glsl_parse_state *state, const char *name)
    ir_function *f;
    bool ret = false;
    simple_mtx_lock(&builtins_lock);
-   f = builtins.shader->symbols->get_function(name);
+   f = builtins.find_function(name);
    if (f != NULL) {
       foreach_in_list(ir_function_signature, sig, &f->signatures) {
          if (sig->is_builtin_available(state)) {
@@ -8608,10 +8666,15 @@ _mesa_glsl_has_builtin_function(_mesa_glsl_parse_state *state, const char *name)
    return ret;
 }
 
-gl_shader *
-_mesa_glsl_get_builtin_function_shader()
+ir_function *
+_mesa_glsl_find_builtin_function_by_name(const char *name)
 {
-   return builtins.shader;
+   ir_function *f;
+   simple_mtx_lock(&builtins_lock);
+   f = builtins.find_function(name);
+   simple_mtx_unlock(&builtins_lock);
+
+   return f;
 }
 
 
@@ -89,6 +89,8 @@ static const struct debug_named_value nir_debug_control[] = {
      "Print const value near each use of const SSA variable" },
    { "print_internal", NIR_DEBUG_PRINT_INTERNAL,
      "Print shaders even if they are marked as internal" },
+   { "profile", NIR_DEBUG_PROFILE,
+     "Print the time, progress and instruction count change of each pass at exit" },
    DEBUG_NAMED_VALUE_END
 };
 
@@ -89,6 +89,7 @@ extern bool nir_debug_print_shader[MESA_SHADER_KERNEL + 1];
 #define NIR_DEBUG_PRINT_KS               (1u << 19)
 #define NIR_DEBUG_PRINT_CONSTS           (1u << 20)
 #define NIR_DEBUG_PRINT_INTERNAL         (1u << 21)
+#define NIR_DEBUG_PROFILE                (1u << 22)
 
 #define NIR_DEBUG_PRINT (NIR_DEBUG_PRINT_VS  | \
                          NIR_DEBUG_PRINT_TCS | \
@@ -4516,6 +4517,12 @@ void nir_shader_replace(nir_shader *dest, nir_shader *src);
 
 void nir_shader_serialize_deserialize(nir_shader *s);
 
+/** State of one pass invocation profiled with NIR_DEBUG=profile */
+typedef struct {
+   int64_t start_ns;
+   unsigned num_instrs;
+} nir_pass_profile;
+
 #ifndef NDEBUG
 void nir_validate_shader(nir_shader *shader, const char *when);
 void nir_validate_ssa_dominance(nir_shader *shader, const char *when);
@@ -4549,6 +4556,10 @@ should_print_nir(nir_shader *shader)
 
    return unlikely(nir_debug_print_shader[shader->info.stage]);
 }
+
+void nir_pass_profile_begin(nir_pass_profile *prof, nir_shader *shader);
+void nir_pass_profile_end(nir_pass_profile *prof, nir_shader *shader,
+                          const char *pass_name, bool progress);
 #else
 static inline void nir_validate_shader(nir_shader *shader, const char *when) { (void) shader; (void)when; }
 static inline void nir_validate_ssa_dominance(nir_shader *shader, const char *when) { (void) shader; (void)when; }
@@ -4556,6 +4567,9 @@ static inline void nir_metadata_set_validation_flag(nir_shader *shader) { (void)
 static inline void nir_metadata_check_validation_flag(nir_shader *shader) { (void) shader; }
 static inline bool should_skip_nir(UNUSED const char *pass_name) { return false; }
 static inline bool should_print_nir(UNUSED nir_shader *shader) { return false; }
+static inline void nir_pass_profile_begin(UNUSED nir_pass_profile *prof, UNUSED nir_shader *shader) { }
+static inline void nir_pass_profile_end(UNUSED nir_pass_profile *prof, UNUSED nir_shader *shader,
+                                        UNUSED const char *pass_name, UNUSED bool progress) { }
 #endif /* NDEBUG */
 
 #define _PASS(pass, nir, do_pass) do {                               \
@@ -4577,7 +4591,13 @@ static inline bool should_print_nir(UNUSED nir_shader *shader) { return false; }
    nir_metadata_set_validation_flag(nir);                            \
    if (should_print_nir(nir))                                        \
       printf("%s\n", #pass);                                         \
-   if (pass(nir, ##__VA_ARGS__)) {                                   \
+   nir_pass_profile _prof;                                           \
+   if (NIR_DEBUG(PROFILE))                                           \
+      nir_pass_profile_begin(&_prof, nir);                           \
+   bool _progress = pass(nir, ##__VA_ARGS__);                        \
+   if (NIR_DEBUG(PROFILE))                                           \
+      nir_pass_profile_end(&_prof, nir, #pass, _progress);           \
+   if (_progress) {                                                  \
       nir_validate_shader(nir, "after " #pass " in " __FILE__);      \
       UNUSED bool _;                                                 \
       progress = true;                                               \
@@ -4590,7 +4610,12 @@ static inline bool should_print_nir(UNUSED nir_shader *shader) { return false; }
 #define NIR_PASS_V(nir, pass, ...) _PASS(pass, nir,                  \
    if (should_print_nir(nir))                                        \
       printf("%s\n", #pass);                                         \
+   nir_pass_profile _prof;                                           \
+   if (NIR_DEBUG(PROFILE))                                           \
+      nir_pass_profile_begin(&_prof, nir);                           \
    pass(nir, ##__VA_ARGS__);                                         \
+   if (NIR_DEBUG(PROFILE))                                           \
+      nir_pass_profile_end(&_prof, nir, #pass, false);               \
    nir_validate_shader(nir, "after " #pass " in " __FILE__);         \
    if (should_print_nir(nir))                                        \
       nir_print_shader(nir, stdout);                                 \
@@ -4598,6 +4623,59 @@ static inline bool should_print_nir(UNUSED nir_shader *shader) { return false; }
 
 #define NIR_SKIP(name) should_skip_nir(#name)
 
+#define NIR_PASS_LOOP_MAX_PASSES 64
+
+/** Scheduler for do { ... } while (progress) optimization loops
+ *
+ * Every pass run through NIR_LOOP_PASS remembers the shader generation at
+ * which it last made no progress.  The generation changes whenever any pass
+ * in the loop makes progress, so a pass whose generation is still current
+ * would see exactly the shader it already found nothing to do on, and is
+ * skipped.  This gives the same result as running every pass in every
+ * iteration, as long as all passes that change the shader inside the loop
+ * go through NIR_LOOP_PASS or are followed by nir_pass_loop_invalidate().
+ */
+typedef struct nir_pass_loop {
+   nir_shader *shader;
+
+   /** Bumped every time a pass in the loop makes progress */
+   unsigned generation;
+
+   unsigned num_passes;
+   struct {
+      const void *site;
+      unsigned clean_generation;
+   } passes[NIR_PASS_LOOP_MAX_PASSES];
+
+   /* Statistics */
+   unsigned iterations;
+   unsigned passes_run;
+   unsigned passes_skipped;
+} nir_pass_loop;
+
+void nir_pass_loop_init(nir_pass_loop *loop, nir_shader *shader);
+bool nir_pass_loop_should_run(nir_pass_loop *loop, const void *site);
+void nir_pass_loop_pass_done(nir_pass_loop *loop, const void *site,
+                            bool progress);
+bool nir_pass_loop_continue(nir_pass_loop *loop, bool progress);
+void nir_pass_loop_finish(nir_pass_loop *loop);
+
+static inline void
+nir_pass_loop_invalidate(nir_pass_loop *loop)
+{
+   loop->generation++;
+}
+
+#define NIR_LOOP_PASS(progress, loop, pass, ...) do {                \
+   static const char _site = 0;                                      \
+   if (nir_pass_loop_should_run(loop, &_site)) {                      \
+      bool _loop_progress = false;                                   \
+      NIR_PASS(_loop_progress, (loop)->shader, pass, ##__VA_ARGS__); \
+      nir_pass_loop_pass_done(loop, &_site, _loop_progress);          \
+      progress |= _loop_progress;                                    \
+   }                                                                 \
+} while (0)
+
 /** An instruction filtering callback with writemask
  *
  * Returns true if the instruction should be processed with the associated
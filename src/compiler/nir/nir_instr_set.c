@@ -801,27 +801,28 @@ cmp_func(const void *data1, const void *data2)
    return nir_instrs_equal(data1, data2);
 }
 
-struct set *
+struct swiss_set *
 nir_instr_set_create(void *mem_ctx)
 {
-   return _mesa_set_create(mem_ctx, hash_instr, cmp_func);
+   return _mesa_swiss_set_create(mem_ctx, hash_instr, cmp_func);
 }
 
 void
-nir_instr_set_destroy(struct set *instr_set)
+nir_instr_set_destroy(struct swiss_set *instr_set)
 {
-   _mesa_set_destroy(instr_set, NULL);
+   _mesa_swiss_set_destroy(instr_set, NULL);
 }
 
 bool
-nir_instr_set_add_or_rewrite(struct set *instr_set, nir_instr *instr,
+nir_instr_set_add_or_rewrite(struct swiss_set *instr_set, nir_instr *instr,
                              bool (*cond_function) (const nir_instr *a,
                                                     const nir_instr *b))
 {
    if (!instr_can_rewrite(instr))
       return false;
 
-   struct set_entry *e = _mesa_set_search_or_add(instr_set, instr, NULL);
+   struct swiss_set_entry *e =
+      _mesa_swiss_set_search_or_add(instr_set, instr, NULL);
    nir_instr *match = (nir_instr *) e->key;
    if (match == instr)
       return false;
@@ -852,13 +853,13 @@ nir_instr_set_add_or_rewrite(struct set *instr_set, nir_instr *instr,
 }
 
 void
-nir_instr_set_remove(struct set *instr_set, nir_instr *instr)
+nir_instr_set_remove(struct swiss_set *instr_set, nir_instr *instr)
 {
    if (!instr_can_rewrite(instr))
       return;
 
-   struct set_entry *entry = _mesa_set_search(instr_set, instr);
+   struct swiss_set_entry *entry = _mesa_swiss_set_search(instr_set, instr);
    if (entry)
-      _mesa_set_remove(instr_set, entry);
+      _mesa_swiss_set_remove(instr_set, entry);
 }
 
@@ -25,6 +25,7 @@
 #define NIR_INSTR_SET_H
 
 #include "nir.h"
+#include "util/swiss_set.h"
 
 /**
  * This file defines functions for creating, destroying, and manipulating an
@@ -40,10 +41,10 @@
 /*@{*/
 
 /** Creates an instruction set, using a given ralloc mem_ctx */
-struct set *nir_instr_set_create(void *mem_ctx);
+struct swiss_set *nir_instr_set_create(void *mem_ctx);
 
 /** Destroys an instruction set. */
-void nir_instr_set_destroy(struct set *instr_set);
+void nir_instr_set_destroy(struct swiss_set *instr_set);
 
 /**
  * Adds an instruction to an instruction set if it doesn't exist. If it
@@ -55,7 +56,8 @@ void nir_instr_set_destroy(struct set *instr_set);
  * If cond_function() is given, only rewrites uses if
  * cond_function(old_instr, new_instr) returns true.
  */
-bool nir_instr_set_add_or_rewrite(struct set *instr_set, nir_instr *instr,
+bool nir_instr_set_add_or_rewrite(struct swiss_set *instr_set,
+                                  nir_instr *instr,
                                   bool (*cond_function)(const nir_instr *a,
                                                         const nir_instr *b));
 
@@ -63,7 +65,7 @@ bool nir_instr_set_add_or_rewrite(struct set *instr_set, nir_instr *instr,
  * Removes an instruction from an instruction set, so that other instructions
  * won't be merged with it.
  */
-void nir_instr_set_remove(struct set *instr_set, nir_instr *instr);
+void nir_instr_set_remove(struct swiss_set *instr_set, nir_instr *instr);
 
 /*@}*/
 
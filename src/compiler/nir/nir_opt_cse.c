@@ -36,9 +36,9 @@ dominates(const nir_instr *old_instr, const nir_instr *new_instr)
 static bool
 nir_opt_cse_impl(nir_function_impl *impl)
 {
-   struct set *instr_set = nir_instr_set_create(NULL);
+   struct swiss_set *instr_set = nir_instr_set_create(NULL);
 
-   _mesa_set_resize(instr_set, impl->ssa_alloc);
+   _mesa_swiss_set_resize(instr_set, impl->ssa_alloc);
 
    nir_metadata_require(impl, nir_metadata_dominance);
 
@@ -840,7 +840,7 @@ opt_gcm_impl(nir_shader *shader, nir_function_impl *impl, bool value_number)
     * on both sides of the same if/else block, we allow them to be moved.
     * This cleans up a lot of mess without being -too- aggressive.
     */
-   struct set *gvn_set = nir_instr_set_create(NULL);
+   struct swiss_set *gvn_set = nir_instr_set_create(NULL);
    foreach_list_typed_safe(nir_instr, instr, node, &state.instrs) {
       if (instr->pass_flags & GCM_INSTR_PINNED)
          continue;
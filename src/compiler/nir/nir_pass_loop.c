@@ -0,0 +1,95 @@
+/*
+ * Copyright © 2023 Sietium Semiconductor
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * \file nir_pass_loop.c
+ *
+ * Skips passes in driver optimization loops that can't make progress.
+ *
+ * A typical loop runs a fixed list of passes until none of them makes
+ * progress.  Most passes find nothing to do in most iterations, and in the
+ * last iteration all of them do.  NIR passes are deterministic, so a pass
+ * that made no progress will make none again until something else changes
+ * the shader.  nir_pass_loop counts changes with a generation number and
+ * only runs a pass if the generation moved since the pass last came up
+ * empty.
+ */
+
+#include <stdio.h>
+
+#include "nir.h"
+
+void
+nir_pass_loop_init(nir_pass_loop *loop, nir_shader *shader)
+{
+   memset(loop, 0, sizeof(*loop));
+   loop->shader = shader;
+}
+
+static int
+find_pass(const nir_pass_loop *loop, const void *site)
+{
+   for (unsigned i = 0; i < loop->num_passes; i++) {
+      if (loop->passes[i].site == site)
+         return i;
+   }
+
+   return -1;
+}
+
+bool
+nir_pass_loop_should_run(nir_pass_loop *loop, const void *site)
+{
+   int idx = find_pass(loop, site);
+
+   if (idx >= 0 && loop->passes[idx].clean_generation == loop->generation) {
+      loop->passes_skipped++;
+      return false;
+   }
+
+   loop->passes_run++;
+   return true;
+}
+
+void
+nir_pass_loop_pass_done(nir_pass_loop *loop, const void *site, bool progress)
+{
+   if (progress) {
+      loop->generation++;
+      return;
+   }
+
+   int idx = find_pass(loop, site);
+   if (idx < 0) {
+      /* Loops with more passes than we track just run the rest every time */
+      if (loop->num_passes == NIR_PASS_LOOP_MAX_PASSES)
+         return;
+
+      idx = loop->num_passes++;
+      loop->passes[idx].site = site;
+   }
+
+   loop->passes[idx].clean_generation = loop->generation;
+}
+
+bool
+nir_pass_loop_continue(nir_pass_loop *loop, bool progress)
+{
+   loop->iterations++;
+   return progress;
+}
+
+void
+nir_pass_loop_finish(nir_pass_loop *loop)
+{
+   if (NIR_DEBUG(PROFILE)) {
+      fprintf(stderr, "NIR pass loop: %s shader %s: %u iterations, "
+                      "%u passes run, %u skipped\n",
+              _mesa_shader_stage_to_abbrev(loop->shader->info.stage),
+              loop->shader->info.name ? loop->shader->info.name : "",
+              loop->iterations, loop->passes_run, loop->passes_skipped);
+   }
+}
@@ -0,0 +1,195 @@
+/*
+ * Copyright © 2023 Sietium Semiconductor
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * \file nir_profile.c
+ *
+ * Per-pass profiling for NIR_DEBUG=profile.
+ *
+ * NIR_PASS and NIR_PASS_V time every pass they run and count the
+ * instructions in the shader before and after it.  The numbers are summed
+ * per pass name over the whole process and printed to stderr as a table at
+ * exit, sorted by total time.  If NIR_PROFILE_JSON names a file, the same
+ * data is also written there as JSON.
+ *
+ * Only the pass itself is timed, not the validation, printing, cloning or
+ * serialization that the macros do around it.  NIR_PASS_V can't see whether
+ * the pass made progress, so those calls never count as progress.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nir.h"
+#include "util/hash_table.h"
+#include "util/os_time.h"
+#include "util/simple_mtx.h"
+#include "util/u_debug.h"
+
+#ifndef NDEBUG
+
+struct pass_stats {
+   const char *name;
+   uint64_t calls;
+   uint64_t progress;
+   uint64_t time_ns;
+   int64_t instr_delta;
+};
+
+static simple_mtx_t profile_mtx = SIMPLE_MTX_INITIALIZER;
+static struct hash_table *profile_passes;
+
+static unsigned
+count_instrs(nir_shader *shader)
+{
+   unsigned count = 0;
+
+   nir_foreach_function(func, shader) {
+      if (!func->impl)
+         continue;
+
+      nir_foreach_block(block, func->impl)
+         count += exec_list_length(&block->instr_list);
+   }
+
+   return count;
+}
+
+static int
+compare_time(const void *a, const void *b)
+{
+   const struct pass_stats *pa = *(const struct pass_stats *const *)a;
+   const struct pass_stats *pb = *(const struct pass_stats *const *)b;
+
+   if (pa->time_ns != pb->time_ns)
+      return pa->time_ns < pb->time_ns ? 1 : -1;
+
+   return strcmp(pa->name, pb->name);
+}
+
+static void
+print_json(const char *path, struct pass_stats **passes, unsigned num_passes)
+{
+   FILE *fp = fopen(path, "w");
+   if (!fp) {
+      fprintf(stderr, "NIR: failed to open %s for the pass profile\n", path);
+      return;
+   }
+
+   fprintf(fp, "[\n");
+   for (unsigned i = 0; i < num_passes; i++) {
+      const struct pass_stats *p = passes[i];
+
+      fprintf(fp, "  {\"pass\": \"%s\", \"calls\": %" PRIu64
+                  ", \"progress\": %" PRIu64 ", \"time_ns\": %" PRIu64
+                  ", \"instr_delta\": %" PRId64 "}%s\n",
+              p->name, p->calls, p->progress, p->time_ns, p->instr_delta,
+              i + 1 < num_passes ? "," : "");
+   }
+   fprintf(fp, "]\n");
+
+   fclose(fp);
+}
+
+static void
+print_profile(void)
+{
+   simple_mtx_lock(&profile_mtx);
+
+   unsigned num_passes = profile_passes->entries;
+   struct pass_stats **passes = malloc(num_passes * sizeof(*passes));
+   if (!passes) {
+      simple_mtx_unlock(&profile_mtx);
+      return;
+   }
+
+   unsigned i = 0;
+   uint64_t total_ns = 0;
+   hash_table_foreach(profile_passes, entry) {
+      struct pass_stats *stats = entry->data;
+
+      passes[i++] = stats;
+      total_ns += stats->time_ns;
+   }
+
+   qsort(passes, num_passes, sizeof(*passes), compare_time);
+
+   fprintf(stderr, "NIR pass profile, %.3f ms in total:\n",
+           total_ns / 1000000.0);
+   fprintf(stderr, "%-40s %10s %10s %12s %7s %10s %12s\n", "pass", "calls",
+           "progress", "time (ms)", "%", "avg (us)", "instr delta");
+   for (i = 0; i < num_passes; i++) {
+      const struct pass_stats *p = passes[i];
+
+      fprintf(stderr, "%-40s %10" PRIu64 " %10" PRIu64 " %12.3f %6.2f%% "
+                      "%10.2f %12" PRId64 "\n",
+              p->name, p->calls, p->progress, p->time_ns / 1000000.0,
+              total_ns ? p->time_ns * 100.0 / total_ns : 0.0,
+              p->time_ns / 1000.0 / p->calls, p->instr_delta);
+   }
+
+   const char *json = debug_get_option("NIR_PROFILE_JSON", NULL);
+   if (json)
+      print_json(json, passes, num_passes);
+
+   free(passes);
+
+   simple_mtx_unlock(&profile_mtx);
+}
+
+void
+nir_pass_profile_begin(nir_pass_profile *prof, nir_shader *shader)
+{
+   prof->num_instrs = count_instrs(shader);
+   prof->start_ns = os_time_get_nano();
+}
+
+void
+nir_pass_profile_end(nir_pass_profile *prof, nir_shader *shader,
+                     const char *pass_name, bool progress)
+{
+   int64_t time_ns = os_time_get_nano() - prof->start_ns;
+   int64_t instr_delta = (int64_t)count_instrs(shader) - prof->num_instrs;
+
+   simple_mtx_lock(&profile_mtx);
+
+   if (!profile_passes) {
+      profile_passes = _mesa_hash_table_create(NULL, _mesa_hash_string,
+                                               _mesa_key_string_equal);
+      if (!profile_passes) {
+         simple_mtx_unlock(&profile_mtx);
+         return;
+      }
+      atexit(print_profile);
+   }
+
+   struct pass_stats *stats;
+   struct hash_entry *entry =
+      _mesa_hash_table_search(profile_passes, pass_name);
+   if (entry) {
+      stats = entry->data;
+   } else {
+      stats = rzalloc(profile_passes, struct pass_stats);
+      if (!stats) {
+         simple_mtx_unlock(&profile_mtx);
+         return;
+      }
+      /* The name may live in a driver that is unloaded before exit. */
+      stats->name = ralloc_strdup(stats, pass_name);
+      _mesa_hash_table_insert(profile_passes, stats->name, stats);
+   }
+
+   stats->calls++;
+   stats->progress += progress;
+   stats->time_ns += time_ns;
+   stats->instr_delta += instr_delta;
+
+   simple_mtx_unlock(&profile_mtx);
+}
+
+#endif /* NDEBUG */
@@ -2253,6 +2253,53 @@ nir_deserialize(void *mem_ctx,
    return ctx.nir;
 }
 
+/**
+ * Serializes a shader so that copies of it can be made with nir_shader_fork().
+ *
+ * Deserializing walks the shader once and looks everything up by index,
+ * whereas nir_shader_clone() goes through a pointer hash table for every
+ * SSA def, variable and block, so forking is the cheaper way to make many
+ * variants of one shader.  The snapshot is taken once: changes made to the
+ * shader afterwards are not seen by later forks.
+ */
+nir_shader_snapshot *
+nir_shader_snapshot_create(void *mem_ctx, const nir_shader *nir)
+{
+   struct blob blob;
+   blob_init(&blob);
+   nir_serialize(&blob, nir, false);
+
+   nir_shader_snapshot *snapshot = NULL;
+   if (!blob.out_of_memory)
+      snapshot = ralloc(mem_ctx, nir_shader_snapshot);
+
+   if (snapshot) {
+      void *data = ralloc_size(snapshot, blob.size);
+      if (data) {
+         memcpy(data, blob.data, blob.size);
+         snapshot->options = nir->options;
+         snapshot->data = data;
+         snapshot->size = blob.size;
+      } else {
+         ralloc_free(snapshot);
+         snapshot = NULL;
+      }
+   }
+
+   blob_finish(&blob);
+
+   return snapshot;
+}
+
+/** Creates a new shader from a snapshot taken by nir_shader_snapshot_create. */
+nir_shader *
+nir_shader_fork(void *mem_ctx, const nir_shader_snapshot *snapshot)
+{
+   struct blob_reader reader;
+   blob_reader_init(&reader, snapshot->data, snapshot->size);
+   return nir_deserialize(mem_ctx, snapshot->options, &reader);
+}
+
 void
 nir_shader_serialize_deserialize(nir_shader *shader)
 {
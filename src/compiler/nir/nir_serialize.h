@@ -36,6 +36,18 @@ nir_shader *nir_deserialize(void *mem_ctx,
                             const struct nir_shader_compiler_options *options,
                             struct blob_reader *blob);
 
+/** A serialized copy of a shader that variants can be forked from. */
+typedef struct nir_shader_snapshot {
+   const struct nir_shader_compiler_options *options;
+   const void *data;
+   size_t size;
+} nir_shader_snapshot;
+
+nir_shader_snapshot *nir_shader_snapshot_create(void *mem_ctx,
+                                                const nir_shader *nir);
+nir_shader *nir_shader_fork(void *mem_ctx,
+                            const nir_shader_snapshot *snapshot);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
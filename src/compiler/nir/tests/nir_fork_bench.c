@@ -0,0 +1,158 @@
+/*
+ * Copyright © 2023 Sietium Semiconductor
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Cost of making shader variants with nir_shader_clone() and with
+ * nir_shader_fork().
+ *
+ * A base shader with a few hundred instructions is built once, then many
+ * variants are made from it the way the inline uniform paths in lavapipe and
+ * rvgpu do: copy the base, replace one uniform load with a constant and keep
+ * the result.  Every variant is kept alive so that the heap they use can be
+ * compared as well.
+ *
+ * Usage: nir_fork_bench [num_variants] [num_blocks]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include "util/os_time.h"
+
+#include "nir.h"
+#include "nir_builder.h"
+#include "nir_serialize.h"
+
+static const nir_shader_compiler_options options = { 0 };
+
+static size_t
+heap_used(void)
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+   return mallinfo2().uordblks;
+#else
+   return 0;
+#endif
+}
+
+static nir_shader *
+build_shader(unsigned num_blocks)
+{
+   nir_builder b = nir_builder_init_simple_shader(MESA_SHADER_COMPUTE,
+                                                  &options, "fork bench");
+
+   nir_ssa_def *val = nir_u2f32(&b, nir_load_local_invocation_index(&b));
+
+   for (unsigned i = 0; i < num_blocks; i++) {
+      nir_ssa_def *u = nir_load_ubo(&b, 1, 32, nir_imm_int(&b, 0),
+                                    nir_imm_int(&b, (i % 64) * 4),
+                                    .align_mul = 4, .range = ~0);
+      val = nir_ffma(&b, val, nir_u2f32(&b, u), nir_imm_float(&b, i));
+
+      if (i % 16 == 0) {
+         nir_push_if(&b, nir_flt(&b, val, nir_imm_float(&b, 0.0)));
+         nir_ssa_def *then_val = nir_fneg(&b, val);
+         nir_push_else(&b, NULL);
+         nir_ssa_def *else_val = nir_fabs(&b, val);
+         nir_pop_if(&b, NULL);
+         val = nir_if_phi(&b, then_val, else_val);
+      }
+   }
+
+   nir_store_global(&b, nir_imm_int64(&b, 0), 4, val, 0x1);
+
+   return b.shader;
+}
+
+/* Stands in for the inline uniform pass: the first UBO load becomes a
+ * constant that is different for every variant.
+ */
+static void
+make_variant(nir_shader *nir, unsigned index)
+{
+   nir_function_impl *impl = nir_shader_get_entrypoint(nir);
+
+   nir_foreach_block(block, impl) {
+      nir_foreach_instr(instr, block) {
+         if (instr->type != nir_instr_type_intrinsic ||
+             nir_instr_as_intrinsic(instr)->intrinsic != nir_intrinsic_load_ubo)
+            continue;
+
+         nir_intrinsic_instr *intrin = nir_instr_as_intrinsic(instr);
+         nir_builder b;
+         nir_builder_init(&b, impl);
+         b.cursor = nir_before_instr(instr);
+         nir_ssa_def_rewrite_uses(&intrin->dest.ssa, nir_imm_int(&b, index));
+         nir_instr_remove(instr);
+         return;
+      }
+   }
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned num_variants = argc > 1 ? atoi(argv[1]) : 1024;
+   unsigned num_blocks = argc > 2 ? atoi(argv[2]) : 64;
+
+   glsl_type_singleton_init_or_ref();
+
+   size_t heap_start = heap_used();
+   nir_shader *base = build_shader(num_blocks);
+   size_t base_size = heap_used() - heap_start;
+
+   nir_shader **variants = calloc(num_variants, sizeof(*variants));
+   if (!variants)
+      return EXIT_FAILURE;
+
+   printf("%u variants of a shader with %u blocks, %zu KiB\n", num_variants,
+          num_blocks, base_size / 1024);
+   printf("%-8s %12s %12s %14s\n", "method", "setup (us)", "us/variant",
+          "KiB/variant");
+
+   for (unsigned fork = 0; fork < 2; fork++) {
+      int64_t start = os_time_get_nano();
+
+      nir_shader_snapshot *snapshot = NULL;
+      if (fork) {
+         snapshot = nir_shader_snapshot_create(NULL, base);
+         if (!snapshot)
+            return EXIT_FAILURE;
+      }
+
+      int64_t setup = os_time_get_nano();
+      size_t heap_setup = heap_used();
+
+      for (unsigned i = 0; i < num_variants; i++) {
+         variants[i] = fork ? nir_shader_fork(NULL, snapshot)
+                            : nir_shader_clone(NULL, base);
+         make_variant(variants[i], i);
+      }
+
+      int64_t end = os_time_get_nano();
+      size_t heap_end = heap_used();
+
+      printf("%-8s %12.1f %12.1f %14.1f\n", fork ? "fork" : "clone",
+             (setup - start) / 1000.0,
+             (end - setup) / 1000.0 / num_variants,
+             (double)(heap_end - heap_setup) / 1024 / num_variants);
+      if (fork)
+         printf("snapshot: %zu KiB\n", snapshot->size / 1024);
+
+      for (unsigned i = 0; i < num_variants; i++)
+         ralloc_free(variants[i]);
+      ralloc_free(snapshot);
+   }
+
+   free(variants);
+   ralloc_free(base);
+   glsl_type_singleton_decref();
+
+   return EXIT_SUCCESS;
+}
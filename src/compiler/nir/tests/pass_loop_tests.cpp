@@ -0,0 +1,136 @@
+/*
+ * Copyright © 2023 Sietium Semiconductor
+ *
+ * SPDX-License-Identifier: MIT
+ */
+#include <gtest/gtest.h>
+#include "nir.h"
+#include "nir_builder.h"
+
+class nir_pass_loop_test : public ::testing::Test {
+protected:
+   nir_pass_loop_test();
+   ~nir_pass_loop_test();
+
+   nir_builder bld;
+};
+
+nir_pass_loop_test::nir_pass_loop_test()
+{
+   glsl_type_singleton_init_or_ref();
+
+   static const nir_shader_compiler_options options = { };
+   bld = nir_builder_init_simple_shader(MESA_SHADER_VERTEX, &options, "pass loop test");
+}
+
+nir_pass_loop_test::~nir_pass_loop_test()
+{
+   ralloc_free(bld.shader);
+   glsl_type_singleton_decref();
+}
+
+/* The passes of both loops, in the same order. */
+static unsigned
+run_open_coded_loop(nir_shader *nir)
+{
+   unsigned iterations = 0;
+   bool progress;
+
+   do {
+      progress = false;
+      NIR_PASS(progress, nir, nir_lower_vars_to_ssa);
+      NIR_PASS(progress, nir, nir_copy_prop);
+      NIR_PASS(progress, nir, nir_opt_dce);
+      NIR_PASS(progress, nir, nir_opt_cse);
+      NIR_PASS(progress, nir, nir_opt_peephole_select, 8, true, true);
+      NIR_PASS(progress, nir, nir_opt_algebraic);
+      NIR_PASS(progress, nir, nir_opt_constant_folding);
+      NIR_PASS(progress, nir, nir_opt_dead_cf);
+      NIR_PASS(progress, nir, nir_opt_remove_phis);
+      iterations++;
+   } while (progress);
+
+   return iterations;
+}
+
+static void
+run_pass_loop(nir_pass_loop *loop)
+{
+   bool progress;
+
+   do {
+      progress = false;
+      NIR_LOOP_PASS(progress, loop, nir_lower_vars_to_ssa);
+      NIR_LOOP_PASS(progress, loop, nir_copy_prop);
+      NIR_LOOP_PASS(progress, loop, nir_opt_dce);
+      NIR_LOOP_PASS(progress, loop, nir_opt_cse);
+      NIR_LOOP_PASS(progress, loop, nir_opt_peephole_select, 8, true, true);
+      NIR_LOOP_PASS(progress, loop, nir_opt_algebraic);
+      NIR_LOOP_PASS(progress, loop, nir_opt_constant_folding);
+      NIR_LOOP_PASS(progress, loop, nir_opt_dead_cf);
+      NIR_LOOP_PASS(progress, loop, nir_opt_remove_phis);
+   } while (nir_pass_loop_continue(loop, progress));
+   nir_pass_loop_finish(loop);
+}
+
+TEST_F(nir_pass_loop_test, same_result_as_open_coded_loop)
+{
+   /* Something for most passes to do.  There is nothing for nir_opt_cse
+    * until constant folding turns 3 + 3 into a second 6, so a loop that
+    * skipped passes too eagerly would leave a and b apart:
+    *
+    *    tmp = in;
+    *    if (2 + 3 == 5)
+    *       tmp = tmp * 1;
+    *    else
+    *       tmp = tmp + 7;
+    *    a = tmp + (3 + 3);
+    *    b = tmp + 6;
+    *    out = a + b;
+    */
+   nir_variable *in_var = nir_variable_create(bld.shader, nir_var_shader_in,
+                                              glsl_int_type(), "in");
+   nir_variable *out_var = nir_variable_create(bld.shader, nir_var_shader_out,
+                                               glsl_int_type(), "out");
+   nir_variable *tmp_var = nir_local_variable_create(bld.impl, glsl_int_type(),
+                                                     "tmp");
+
+   nir_store_var(&bld, tmp_var, nir_load_var(&bld, in_var), 1);
+
+   nir_ssa_def *three = nir_imm_int(&bld, 3);
+   nir_ssa_def *cond = nir_ieq(&bld, nir_iadd(&bld, nir_imm_int(&bld, 2), three),
+                               nir_imm_int(&bld, 5));
+   nir_push_if(&bld, cond);
+   nir_store_var(&bld, tmp_var,
+                 nir_imul(&bld, nir_load_var(&bld, tmp_var), nir_imm_int(&bld, 1)), 1);
+   nir_push_else(&bld, NULL);
+   nir_store_var(&bld, tmp_var,
+                 nir_iadd(&bld, nir_load_var(&bld, tmp_var), nir_imm_int(&bld, 7)), 1);
+   nir_pop_if(&bld, NULL);
+
+   nir_ssa_def *tmp = nir_load_var(&bld, tmp_var);
+   nir_ssa_def *a = nir_iadd(&bld, tmp, nir_iadd(&bld, three, three));
+   nir_ssa_def *b = nir_iadd(&bld, tmp, nir_imm_int(&bld, 6));
+   nir_store_var(&bld, out_var, nir_iadd(&bld, a, b), 1);
+
+   nir_validate_shader(bld.shader, NULL);
+
+   nir_shader *open_coded = nir_shader_clone(bld.shader, bld.shader);
+
+   unsigned iterations = run_open_coded_loop(open_coded);
+
+   nir_pass_loop loop;
+   nir_pass_loop_init(&loop, bld.shader);
+   run_pass_loop(&loop);
+
+   EXPECT_STREQ(nir_shader_as_str(open_coded, bld.shader),
+                nir_shader_as_str(bld.shader, bld.shader));
+
+   /* Progress is the same in every iteration, and at least the passes that
+    * came up empty in the last iteration weren't run again.
+    */
+   EXPECT_GT(iterations, 2);
+   EXPECT_EQ(loop.iterations, iterations);
+   EXPECT_GT(loop.passes_skipped, 0);
+   EXPECT_EQ(loop.passes_run + loop.passes_skipped, 9 * iterations);
+}
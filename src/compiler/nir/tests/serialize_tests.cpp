@@ -279,3 +279,27 @@ TEST_P(nir_serialize_all_but_one_test, single_channel)
 
    ASSERT_SWIZZLE_EQ(vec_alu, vec_alu_dup, 1, 0);
 }
+
+TEST_P(nir_serialize_all_test, fork)
+{
+   nir_ssa_def *undef = nir_ssa_undef(b, GetParam(), 32);
+   nir_ffma(b, undef, undef, undef);
+
+   nir_shader_snapshot *snapshot = nir_shader_snapshot_create(b->shader, b->shader);
+   ASSERT_NE(snapshot, nullptr);
+
+   /* Later changes to the shader must not show up in the forks. */
+   nir_fmul(b, undef, undef);
+
+   nir_shader *fork0 = nir_shader_fork(b->shader, snapshot);
+   nir_shader *fork1 = nir_shader_fork(b->shader, snapshot);
+   dup = fork0;
+
+   nir_alu_instr *alu0 = get_last_alu(fork0);
+   nir_alu_instr *alu1 = get_last_alu(fork1);
+   ASSERT_NE(alu0, alu1);
+   ASSERT_EQ(alu0->op, nir_op_ffma);
+   ASSERT_EQ(alu1->op, nir_op_ffma);
+   ASSERT_EQ(alu0->dest.dest.ssa.num_components, GetParam());
+   ASSERT_EQ(get_last_alu(b->shader)->op, nir_op_fmul);
+}
@@ -163,6 +163,9 @@ draw_pt_arrays(struct draw_context *draw,
          draw->pt.user.drawid++;
    }
 
+   /* The vertex buffers are only mapped for the duration of the draw. */
+   middle->finish(middle);
+
    return TRUE;
 }
 
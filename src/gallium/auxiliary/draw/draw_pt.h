@@ -124,6 +124,9 @@ struct draw_pt_middle_end {
 
    int (*get_max_vertex_count)(struct draw_pt_middle_end *);
 
+   /* Complete all outstanding work.  Called at the end of every draw and
+    * before state changes.
+    */
    void (*finish)(struct draw_pt_middle_end *);
    void (*destroy)(struct draw_pt_middle_end *);
 };
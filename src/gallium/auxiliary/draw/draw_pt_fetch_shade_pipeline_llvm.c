@@ -25,9 +25,11 @@
  *
  **************************************************************************/
 
+#include "util/u_debug.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_prim.h"
+#include "util/u_queue.h"
 #include "draw/draw_context.h"
 #include "draw/draw_gs.h"
 #include "draw/draw_tess.h"
@@ -41,6 +43,13 @@
 #include "gallivm/lp_bld_debug.h"
 
 
+/** Max number of runs whose vertices are shaded on the worker threads */
+#define LLVM_MAX_PENDING_RUNS 16
+
+
+struct llvm_vs_run;
+
+
 struct llvm_middle_end {
    struct draw_pt_middle_end base;
    struct draw_context *draw;
@@ -58,9 +67,23 @@ struct llvm_middle_end {
 
    struct draw_llvm *llvm;
    struct draw_llvm_variant *current_variant;
+
+   /* Vertex fetch and shading on worker threads, see DRAW_VS_THREADS.
+    * Runs are queued in a ring and go through the rest of the pipeline in
+    * the order they were queued.
+    */
+   struct util_queue vs_queue;
+   unsigned vs_chunk_size;
+   unsigned max_pending;
+   unsigned first_pending, num_pending;
+   struct llvm_vs_run *pending[LLVM_MAX_PENDING_RUNS];
 };
 
 
+static void
+llvm_pipeline_drain(struct llvm_middle_end *fpme);
+
+
 /** cast wrapper */
 static inline struct llvm_middle_end *
 llvm_middle_end(struct draw_pt_middle_end *middle)
@@ -292,6 +315,8 @@ llvm_middle_end_prepare(struct draw_pt_middle_end *middle,
    unsigned point_clip = draw->rasterizer->fill_front == PIPE_POLYGON_MODE_POINT ||
                          out_prim == PIPE_PRIM_POINTS;
 
+   llvm_pipeline_drain(fpme);
+
    fpme->input_prim = in_prim;
    fpme->opt = opt;
 
@@ -430,6 +455,9 @@ llvm_middle_end_bind_parameters(struct draw_pt_middle_end *middle)
    struct draw_llvm *llvm = fpme->llvm;
    unsigned i;
 
+   /* Queued runs read the jit context from the worker threads. */
+   llvm_pipeline_drain(fpme);
+
    for (i = 0; i < ARRAY_SIZE(llvm->jit_context.constants); ++i) {
       /*
        * There could be a potential issue with rounding this up, as the
@@ -542,12 +570,44 @@ emit(struct pt_emit *emit,
 }
 
 
+static struct vertex_header *
+llvm_alloc_verts(struct llvm_middle_end *fpme, unsigned count)
+{
+   return (struct vertex_header *)
+      MALLOC(fpme->vertex_size *
+             align(count, lp_native_vector_width / 32) +
+             DRAW_EXTRA_VERTICES_PADDING);
+}
+
+
 static void
-llvm_pipeline_generic(struct draw_pt_middle_end *middle,
-                      const struct draw_fetch_info *fetch_info,
-                      const struct draw_prim_info *in_prim_info)
+llvm_collect_statistics(struct draw_context *draw,
+                        const struct draw_fetch_info *fetch_info,
+                        const struct draw_prim_info *prim_info)
+{
+   if (draw->collect_statistics) {
+      draw->statistics.ia_vertices += prim_info->count;
+      if (prim_info->prim == PIPE_PRIM_PATCHES)
+         draw->statistics.ia_primitives +=
+            prim_info->count / draw->pt.vertices_per_patch;
+      else
+         draw->statistics.ia_primitives +=
+            u_decomposed_prims_for_vertices(prim_info->prim, prim_info->count);
+      draw->statistics.vs_invocations += fetch_info->count;
+   }
+}
+
+
+/**
+ * Run everything after vertex fetch and shading: tessellation, geometry
+ * shader, stream output, clipping and emit.  Frees vs_vert_info->verts.
+ */
+static void
+llvm_pipeline_post_vs(struct llvm_middle_end *fpme,
+                      struct draw_vertex_info *vs_vert_info,
+                      const struct draw_prim_info *in_prim_info,
+                      boolean clipped)
 {
-   struct llvm_middle_end *fpme = llvm_middle_end(middle);
    struct draw_context *draw = fpme->draw;
    struct draw_geometry_shader *gshader = draw->gs.geometry_shader;
    struct draw_tess_ctrl_shader *tcs_shader = draw->tcs.tess_ctrl_shader;
@@ -555,77 +615,16 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
    struct draw_prim_info tcs_prim_info;
    struct draw_prim_info tes_prim_info;
    struct draw_prim_info gs_prim_info[TGSI_MAX_VERTEX_STREAMS];
-   struct draw_vertex_info llvm_vert_info;
    struct draw_vertex_info tcs_vert_info;
    struct draw_vertex_info tes_vert_info;
-   struct draw_vertex_info *vert_info;
+   struct draw_vertex_info *vert_info = vs_vert_info;
    struct draw_prim_info ia_prim_info;
    struct draw_vertex_info ia_vert_info;
    const struct draw_prim_info *prim_info = in_prim_info;
    boolean free_prim_info = FALSE;
    unsigned opt = fpme->opt;
-   boolean clipped = 0;
    ushort *tes_elts_out = NULL;
 
-   assert(fetch_info->count > 0);
-
-   llvm_vert_info.count = fetch_info->count;
-   llvm_vert_info.vertex_size = fpme->vertex_size;
-   llvm_vert_info.stride = fpme->vertex_size;
-   llvm_vert_info.verts = (struct vertex_header *)
-      MALLOC(fpme->vertex_size *
-             align(fetch_info->count, lp_native_vector_width / 32) +
-             DRAW_EXTRA_VERTICES_PADDING);
-   if (!llvm_vert_info.verts) {
-      assert(0);
-      return;
-   }
-
-   if (draw->collect_statistics) {
-      draw->statistics.ia_vertices += prim_info->count;
-      if (prim_info->prim == PIPE_PRIM_PATCHES)
-         draw->statistics.ia_primitives +=
-            prim_info->count / draw->pt.vertices_per_patch;
-      else
-         draw->statistics.ia_primitives +=
-            u_decomposed_prims_for_vertices(prim_info->prim, prim_info->count);
-      draw->statistics.vs_invocations += fetch_info->count;
-   }
-
-   {
-      unsigned start, vertex_id_offset;
-      const unsigned *elts;
-
-      if (fetch_info->linear) {
-         start = fetch_info->start;
-         vertex_id_offset = draw->start_index;
-         elts = NULL;
-      } else {
-         start = draw->pt.user.eltMax;
-         vertex_id_offset = draw->pt.user.eltBias;
-         elts = fetch_info->elts;
-      }
-      /* Run vertex fetch shader */
-      clipped = fpme->current_variant->jit_func(&fpme->llvm->jit_context,
-                                                llvm_vert_info.verts,
-                                                draw->pt.user.vbuffer,
-                                                fetch_info->count,
-                                                start,
-                                                fpme->vertex_size,
-                                                draw->pt.vertex_buffer,
-                                                draw->instance_id,
-                                                vertex_id_offset,
-                                                draw->start_instance,
-                                                elts,
-                                                draw->pt.user.drawid,
-                                                draw->pt.user.viewid);
-
-      /* Finished with fetch and vs */
-      fetch_info = NULL;
-      vert_info = &llvm_vert_info;
-   }
-
-
    if (opt & PT_SHADE) {
       struct draw_vertex_shader *vshader = draw->vs.vertex_shader;
       if (tcs_shader) {
@@ -773,6 +772,276 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
 }
 
 
+/**
+ * A middle end run whose vertices are fetched and shaded on the worker
+ * threads, in chunks of vs_chunk_size vertices.  Everything the shader
+ * reads from the draw context that can change between runs of one draw is
+ * latched here.
+ */
+struct llvm_vs_run {
+   struct llvm_middle_end *fpme;
+
+   struct draw_vertex_info vert_info;
+   struct draw_prim_info prim_info;
+   unsigned draw_count;          /**< backs prim_info.primitive_lengths */
+
+   unsigned *fetch_elts;         /**< NULL for linear fetches */
+   ushort *draw_elts;            /**< NULL for linear prims */
+   unsigned start;
+   unsigned vertex_id_offset;
+   unsigned instance_id;
+   unsigned start_instance;
+   unsigned draw_id;
+   unsigned view_id;
+
+   unsigned num_chunks;
+   struct llvm_vs_chunk *chunks;
+};
+
+
+struct llvm_vs_chunk {
+   struct llvm_vs_run *run;
+   unsigned first;
+   unsigned count;
+   boolean clipped;
+   struct util_queue_fence fence;
+};
+
+
+static void
+llvm_vs_chunk_execute(void *data, void *gdata, int thread_index)
+{
+   struct llvm_vs_chunk *chunk = (struct llvm_vs_chunk *)data;
+   const struct llvm_vs_run *run = chunk->run;
+   const struct llvm_middle_end *fpme = run->fpme;
+   struct draw_context *draw = fpme->draw;
+
+   /* Chunks start on a multiple of the vector length, so the vertices the
+    * shader writes past the end of a chunk are never shared with another.
+    */
+   chunk->clipped =
+      fpme->current_variant->jit_func(&fpme->llvm->jit_context,
+                                      (struct vertex_header *)
+                                      ((char *)run->vert_info.verts +
+                                       chunk->first * fpme->vertex_size),
+                                      draw->pt.user.vbuffer,
+                                      chunk->count,
+                                      run->fetch_elts ? run->start :
+                                                        run->start + chunk->first,
+                                      fpme->vertex_size,
+                                      draw->pt.vertex_buffer,
+                                      run->instance_id,
+                                      run->vertex_id_offset,
+                                      run->start_instance,
+                                      run->fetch_elts ? run->fetch_elts + chunk->first
+                                                      : NULL,
+                                      run->draw_id,
+                                      run->view_id);
+}
+
+
+static void
+llvm_vs_run_destroy(struct llvm_vs_run *run)
+{
+   FREE(run->chunks);
+   FREE(run->fetch_elts);
+   FREE(run->draw_elts);
+   FREE(run);
+}
+
+
+/**
+ * Wait for the oldest queued run and send it down the rest of the pipeline.
+ */
+static void
+llvm_pipeline_retire(struct llvm_middle_end *fpme)
+{
+   struct llvm_vs_run *run = fpme->pending[fpme->first_pending];
+   boolean clipped = FALSE;
+
+   fpme->first_pending = (fpme->first_pending + 1) % LLVM_MAX_PENDING_RUNS;
+   fpme->num_pending--;
+
+   for (unsigned i = 0; i < run->num_chunks; i++) {
+      util_queue_fence_wait(&run->chunks[i].fence);
+      util_queue_fence_destroy(&run->chunks[i].fence);
+      clipped |= run->chunks[i].clipped;
+   }
+
+   llvm_pipeline_post_vs(fpme, &run->vert_info, &run->prim_info, clipped);
+   llvm_vs_run_destroy(run);
+}
+
+
+static void
+llvm_pipeline_drain(struct llvm_middle_end *fpme)
+{
+   while (fpme->num_pending)
+      llvm_pipeline_retire(fpme);
+}
+
+
+/**
+ * Hand vertex fetch and shading of a run to the worker threads.  Returns
+ * FALSE if the run has to be done right away instead.
+ */
+static boolean
+llvm_pipeline_queue(struct llvm_middle_end *fpme,
+                    const struct draw_fetch_info *fetch_info,
+                    const struct draw_prim_info *prim_info)
+{
+   struct draw_context *draw = fpme->draw;
+
+   /* The later stages read per-instance state from the draw context, so
+    * they have to run before the next instance is set up.
+    */
+   if (!fpme->max_pending ||
+       !(fpme->opt & PT_SHADE) ||
+       draw->gs.geometry_shader ||
+       draw->tcs.tess_ctrl_shader ||
+       draw->tes.tess_eval_shader)
+      return FALSE;
+
+   assert(prim_info->primitive_count == 1);
+
+   struct llvm_vs_run *run = CALLOC_STRUCT(llvm_vs_run);
+   if (!run)
+      return FALSE;
+
+   run->fpme = fpme;
+   run->num_chunks = DIV_ROUND_UP(fetch_info->count, fpme->vs_chunk_size);
+   run->chunks = CALLOC(run->num_chunks, sizeof(*run->chunks));
+   run->vert_info.count = fetch_info->count;
+   run->vert_info.vertex_size = fpme->vertex_size;
+   run->vert_info.stride = fpme->vertex_size;
+   run->vert_info.verts = llvm_alloc_verts(fpme, fetch_info->count);
+
+   /* The frontend reuses its element buffers for the next run. */
+   if (!fetch_info->linear) {
+      run->fetch_elts = MALLOC(fetch_info->count * sizeof(unsigned));
+      if (run->fetch_elts)
+         memcpy(run->fetch_elts, fetch_info->elts,
+                fetch_info->count * sizeof(unsigned));
+   }
+   if (!prim_info->linear) {
+      run->draw_elts = MALLOC(prim_info->count * sizeof(ushort));
+      if (run->draw_elts)
+         memcpy(run->draw_elts, prim_info->elts,
+                prim_info->count * sizeof(ushort));
+   }
+
+   if (!run->chunks || !run->vert_info.verts ||
+       (!fetch_info->linear && !run->fetch_elts) ||
+       (!prim_info->linear && !run->draw_elts)) {
+      FREE(run->vert_info.verts);
+      llvm_vs_run_destroy(run);
+      return FALSE;
+   }
+
+   run->prim_info = *prim_info;
+   run->prim_info.elts = run->draw_elts;
+   run->draw_count = prim_info->count;
+   run->prim_info.primitive_lengths = &run->draw_count;
+
+   if (fetch_info->linear) {
+      run->start = fetch_info->start;
+      run->vertex_id_offset = draw->start_index;
+   } else {
+      run->start = draw->pt.user.eltMax;
+      run->vertex_id_offset = draw->pt.user.eltBias;
+   }
+   run->instance_id = draw->instance_id;
+   run->start_instance = draw->start_instance;
+   run->draw_id = draw->pt.user.drawid;
+   run->view_id = draw->pt.user.viewid;
+
+   llvm_collect_statistics(draw, fetch_info, prim_info);
+
+   if (fpme->num_pending == fpme->max_pending)
+      llvm_pipeline_retire(fpme);
+
+   for (unsigned i = 0; i < run->num_chunks; i++) {
+      struct llvm_vs_chunk *chunk = &run->chunks[i];
+
+      chunk->run = run;
+      chunk->first = i * fpme->vs_chunk_size;
+      chunk->count = MIN2(fpme->vs_chunk_size,
+                          fetch_info->count - chunk->first);
+      util_queue_fence_init(&chunk->fence);
+      util_queue_add_job(&fpme->vs_queue, chunk, &chunk->fence,
+                         llvm_vs_chunk_execute, NULL, 0);
+   }
+
+   fpme->pending[(fpme->first_pending + fpme->num_pending) %
+                 LLVM_MAX_PENDING_RUNS] = run;
+   fpme->num_pending++;
+
+   return TRUE;
+}
+
+
+static void
+llvm_pipeline_generic(struct draw_pt_middle_end *middle,
+                      const struct draw_fetch_info *fetch_info,
+                      const struct draw_prim_info *prim_info)
+{
+   struct llvm_middle_end *fpme = llvm_middle_end(middle);
+   struct draw_context *draw = fpme->draw;
+   struct draw_vertex_info llvm_vert_info;
+   boolean clipped;
+
+   assert(fetch_info->count > 0);
+
+   if (llvm_pipeline_queue(fpme, fetch_info, prim_info))
+      return;
+
+   /* Keep primitive order with whatever is still queued. */
+   llvm_pipeline_drain(fpme);
+
+   llvm_vert_info.count = fetch_info->count;
+   llvm_vert_info.vertex_size = fpme->vertex_size;
+   llvm_vert_info.stride = fpme->vertex_size;
+   llvm_vert_info.verts = llvm_alloc_verts(fpme, fetch_info->count);
+   if (!llvm_vert_info.verts) {
+      assert(0);
+      return;
+   }
+
+   llvm_collect_statistics(draw, fetch_info, prim_info);
+
+   {
+      unsigned start, vertex_id_offset;
+      const unsigned *elts;
+
+      if (fetch_info->linear) {
+         start = fetch_info->start;
+         vertex_id_offset = draw->start_index;
+         elts = NULL;
+      } else {
+         start = draw->pt.user.eltMax;
+         vertex_id_offset = draw->pt.user.eltBias;
+         elts = fetch_info->elts;
+      }
+      /* Run vertex fetch shader */
+      clipped = fpme->current_variant->jit_func(&fpme->llvm->jit_context,
+                                                llvm_vert_info.verts,
+                                                draw->pt.user.vbuffer,
+                                                fetch_info->count,
+                                                start,
+                                                fpme->vertex_size,
+                                                draw->pt.vertex_buffer,
+                                                draw->instance_id,
+                                                vertex_id_offset,
+                                                draw->start_instance,
+                                                elts,
+                                                draw->pt.user.drawid,
+                                                draw->pt.user.viewid);
+   }
+
+   llvm_pipeline_post_vs(fpme, &llvm_vert_info, prim_info, clipped);
+}
+
+
 static inline enum pipe_prim_type
 prim_type(enum pipe_prim_type prim, unsigned flags)
 {
@@ -876,7 +1145,7 @@ llvm_middle_end_linear_run_elts(struct draw_pt_middle_end *middle,
 static void
 llvm_middle_end_finish(struct draw_pt_middle_end *middle)
 {
-   /* nothing to do */
+   llvm_pipeline_drain(llvm_middle_end(middle));
 }
 
 
@@ -885,6 +1154,11 @@ llvm_middle_end_destroy(struct draw_pt_middle_end *middle)
 {
    struct llvm_middle_end *fpme = llvm_middle_end(middle);
 
+   if (util_queue_is_initialized(&fpme->vs_queue)) {
+      llvm_pipeline_drain(fpme);
+      util_queue_destroy(&fpme->vs_queue);
+   }
+
    if (fpme->fetch)
       draw_pt_fetch_destroy(fpme->fetch);
 
@@ -945,6 +1219,19 @@ draw_pt_fetch_pipeline_or_emit_llvm(struct draw_context *draw)
 
    fpme->current_variant = NULL;
 
+   /* Chunks have to start on a multiple of the shader's vector length. */
+   unsigned num_threads = MIN2(debug_get_num_option("DRAW_VS_THREADS", 0),
+                               LLVM_MAX_PENDING_RUNS);
+   if (num_threads) {
+      const unsigned vector_length = lp_native_vector_width / 32;
+      unsigned chunk_size = debug_get_num_option("DRAW_VS_CHUNK", 256);
+
+      fpme->vs_chunk_size = align(MAX2(chunk_size, 1), vector_length);
+      if (util_queue_init(&fpme->vs_queue, "draw_vs", 4 * LLVM_MAX_PENDING_RUNS,
+                          num_threads, 0, NULL))
+         fpme->max_pending = MIN2(2 * num_threads, LLVM_MAX_PENDING_RUNS);
+   }
+
    return &fpme->base;
 
  fail:
@@ -1918,6 +1918,21 @@ lp_build_iround_nearest_sse2(struct lp_build_context *bld,
       res = lp_build_intrinsic_unary(builder, intrinsic,
                                      ret_type, arg);
    }
+   else if (type.width * type.length == 512) {
+      assert(util_get_cpu_caps()->has_avx512f);
+
+      /* Unmasked, with the rounding mode from MXCSR
+       * (_MM_FROUND_CUR_DIRECTION).
+       */
+      LLVMValueRef args[4] = {
+         a,
+         LLVMGetUndef(ret_type),
+         LLVMConstAllOnes(LLVMInt16TypeInContext(bld->gallivm->context)),
+         LLVMConstInt(i32t, 4, 0),
+      };
+      res = lp_build_intrinsic(builder, "llvm.x86.avx512.mask.cvtps2dq.512",
+                               ret_type, args, 4, 0);
+   }
    else {
       if (type.width* type.length == 128) {
          intrinsic = "llvm.x86.sse2.cvtps2dq";
@@ -2359,7 +2374,8 @@ lp_build_iround(struct lp_build_context *bld,
 
    if ((util_get_cpu_caps()->has_sse2 &&
        ((type.width == 32) && (type.length == 1 || type.length == 4))) ||
-       (util_get_cpu_caps()->has_avx && type.width == 32 && type.length == 8)) {
+       (util_get_cpu_caps()->has_avx && type.width == 32 && type.length == 8) ||
+       (util_get_cpu_caps()->has_avx512f && type.width == 32 && type.length == 16)) {
       return lp_build_iround_nearest_sse2(bld, a);
    }
    if (arch_rounding_available(type)) {
@@ -2766,7 +2782,8 @@ lp_build_fast_rsqrt_available(struct lp_type type)
    assert(type.floating);
 
    if ((util_get_cpu_caps()->has_sse && type.width == 32 && type.length == 4) ||
-       (util_get_cpu_caps()->has_avx && type.width == 32 && type.length == 8)) {
+       (util_get_cpu_caps()->has_avx && type.width == 32 && type.length == 8) ||
+       (util_get_cpu_caps()->has_avx512f && type.width == 32 && type.length == 16)) {
       return true;
    }
    return false;
@@ -2791,7 +2808,17 @@ lp_build_fast_rsqrt(struct lp_build_context *bld,
    if (lp_build_fast_rsqrt_available(type)) {
       const char *intrinsic = NULL;
 
-      if (type.length == 4) {
+      if (type.length == 16) {
+         /* vrsqrt14ps, unmasked. */
+         LLVMValueRef args[3] = {
+            a,
+            bld->undef,
+            LLVMConstAllOnes(LLVMInt16TypeInContext(bld->gallivm->context)),
+         };
+         return lp_build_intrinsic(builder, "llvm.x86.avx512.rsqrt14.ps.512",
+                                   bld->vec_type, args, 3, 0);
+      }
+      else if (type.length == 4) {
          intrinsic = "llvm.x86.sse.rsqrt.ps";
       }
       else {
@@ -109,6 +109,20 @@ lp_build_half_to_float(struct gallivm_state *gallivm,
    LLVMTypeRef int_vec_type = lp_build_vec_type(gallivm, i32_type);
    LLVMValueRef h;
 
+   if (util_get_cpu_caps()->has_f16c && src_length == 16) {
+      /* Convert 512bit vectors in two halves rather than falling back to the
+       * integer arithmetic below.
+       */
+      struct lp_type half_type = lp_type_float_vec(32, 32 * 8);
+      LLVMValueRef halves[2];
+
+      for (unsigned i = 0; i < 2; i++) {
+         halves[i] = lp_build_half_to_float(gallivm,
+                        lp_build_extract_range(gallivm, src, i * 8, 8));
+      }
+      return lp_build_concat(gallivm, halves, half_type, 2);
+   }
+
    if (util_get_cpu_caps()->has_f16c &&
        (src_length == 4 || src_length == 8)) {
       if (LLVM_VERSION_MAJOR < 11) {
@@ -177,6 +191,17 @@ lp_build_float_to_half(struct gallivm_state *gallivm,
     * useless.
     */
 
+   if (util_get_cpu_caps()->has_f16c && length == 16) {
+      struct lp_type half_type = lp_type_float_vec(16, 16 * 8);
+      LLVMValueRef halves[2];
+
+      for (unsigned i = 0; i < 2; i++) {
+         halves[i] = lp_build_float_to_half(gallivm,
+                        lp_build_extract_range(gallivm, src, i * 8, 8));
+      }
+      return lp_build_concat(gallivm, halves, half_type, 2);
+   }
+
    if (util_get_cpu_caps()->has_f16c &&
        (length == 4 || length == 8)) {
       struct lp_type i168_type = lp_type_int_vec(16, 16 * 8);
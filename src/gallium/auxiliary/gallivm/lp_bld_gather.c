@@ -491,6 +491,23 @@ lp_build_gather(struct gallivm_state *gallivm,
               src_width == 32 && (length == 4 || length == 8)) {
       return lp_build_gather_avx2(gallivm, length, src_width, dst_type,
                                   base_ptr, offsets);
+   } else if (util_get_cpu_caps()->has_avx2 && !need_expansion &&
+              src_width == 32 && length == 16) {
+      /*
+       * 16-wide (512bit vectors). Two 8-wide gathers are still a lot
+       * cheaper than 16 scalar fetches, and the avx512 gather intrinsics
+       * changed signature between llvm versions.
+       */
+      struct lp_type half_type = dst_type;
+      LLVMValueRef halves[2];
+
+      half_type.length *= 8;
+      for (unsigned i = 0; i < 2; i++) {
+         LLVMValueRef offs = lp_build_extract_range(gallivm, offsets, i * 8, 8);
+         halves[i] = lp_build_gather_avx2(gallivm, 8, src_width, dst_type,
+                                          base_ptr, offs);
+      }
+      return lp_build_concat(gallivm, halves, half_type, 2);
    /*
     * This looks bad on paper wrt throughtput/latency on Haswell.
     * Even on Broadwell it doesn't look stellar.
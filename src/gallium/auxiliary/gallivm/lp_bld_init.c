@@ -440,12 +440,26 @@ lp_build_init(void)
 
    lp_set_target_options();
 
-   // Default to 256 until we're confident llvmpipe with 512 is as correct and not slower than 256
+   /* Default to 256 until we're confident llvmpipe with 512 is as correct
+    * and not slower than 256.  The sampling code (lp_bld_sample_soa.c) in
+    * particular hasn't been audited for 16-wide vectors.
+    */
    lp_native_vector_width = MIN2(util_get_cpu_caps()->max_vector_bits, 256);
 
    lp_native_vector_width = debug_get_num_option("LP_NATIVE_VECTOR_WIDTH",
                                                  lp_native_vector_width);
 
+   /*
+    * 512bit vectors are opt-in, and only with the avx512 subsets every
+    * skylake-server or later cpu has. Without bw/dq/vl (Xeon Phi) llvm has
+    * to split much of the 8/16bit integer and mask work.
+    */
+   if (lp_native_vector_width > 256 &&
+       !(util_get_cpu_caps()->has_avx512bw &&
+         util_get_cpu_caps()->has_avx512dq &&
+         util_get_cpu_caps()->has_avx512vl))
+      lp_native_vector_width = 256;
+
 #if DETECT_ARCH_PPC_64
    /* Set the NJ bit in VSCR to 0 so denormalized values are handled as
     * specified by IEEE standard (PowerISA 2.06 - Section 6.3). This guarantees
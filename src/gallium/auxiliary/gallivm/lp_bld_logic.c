@@ -350,6 +350,18 @@ lp_build_select(struct lp_build_context *bld,
 
       res = LLVMBuildSelect(builder, mask, a, b, "");
    }
+   else if (util_get_cpu_caps()->has_avx512f &&
+            type.width * type.length == 512 &&
+            (type.width >= 32 || util_get_cpu_caps()->has_avx512bw)) {
+      /*
+       * There is no blendv for 512bit vectors. Turning the mask into a
+       * compare against zero lets llvm put it in a mask register and use
+       * a masked move, instead of the and/andnot/or sequence below.
+       */
+      mask = LLVMBuildICmp(builder, LLVMIntNE, mask,
+                           LLVMConstNull(LLVMTypeOf(mask)), "");
+      res = LLVMBuildSelect(builder, mask, a, b, "");
+   }
    else if (((util_get_cpu_caps()->has_sse4_1 &&
               type.width * type.length == 128) ||
              (util_get_cpu_caps()->has_avx &&
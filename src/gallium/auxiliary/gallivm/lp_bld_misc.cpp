@@ -433,6 +433,11 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
    MAttrs.push_back(util_get_cpu_caps()->has_avx512bw ? "+avx512bw"  : "-avx512bw");
    MAttrs.push_back(util_get_cpu_caps()->has_avx512dq ? "+avx512dq"  : "-avx512dq");
    MAttrs.push_back(util_get_cpu_caps()->has_avx512vl ? "+avx512vl"  : "-avx512vl");
+#if LLVM_VERSION_MAJOR >= 18
+   /* Otherwise llvm 18+ won't use zmm registers for the 512bit vectors. */
+   if (util_get_cpu_caps()->has_avx512f)
+      MAttrs.push_back("+evex512");
+#endif
 #endif
 #if DETECT_ARCH_ARM
    if (!util_get_cpu_caps()->has_neon) {
@@ -2336,6 +2336,10 @@ static void emit_shuffle(struct lp_build_nir_context *bld_base, LLVMValueRef src
       /* freeze `src` in case inactive invocations contain poison */
       src = LLVMBuildFreeze(builder, src, "");
       result[0] = lp_build_intrinsic_binary(builder, "llvm.x86.avx2.permd", int_bld->vec_type, src, index);
+   } else if (util_get_cpu_caps()->has_avx512f && bit_size == 32 && index_bit_size == 32 && int_bld->type.length == 16) {
+      /* freeze `src` in case inactive invocations contain poison */
+      src = LLVMBuildFreeze(builder, src, "");
+      result[0] = lp_build_intrinsic_binary(builder, "llvm.x86.avx512.permvar.si.512", int_bld->vec_type, src, index);
    } else {
       LLVMValueRef res_store = lp_build_alloca(gallivm, int_bld->vec_type, "");
       struct lp_build_loop_state loop_state;
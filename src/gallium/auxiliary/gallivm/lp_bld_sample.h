@@ -722,6 +722,48 @@ lp_build_sample_soa(const struct lp_static_texture_state *static_texture_state,
                     const struct lp_sampler_params *params);
 
 
+boolean
+lp_build_sample_soa_use_func(const struct lp_static_texture_state *static_texture_state,
+                             const struct lp_static_sampler_state *static_sampler_state,
+                             unsigned sample_key);
+
+
+LLVMTypeRef
+lp_build_sample_func_type(struct gallivm_state *gallivm,
+                          enum pipe_texture_target target,
+                          struct lp_type type,
+                          unsigned sample_key,
+                          LLVMTypeRef context_ptr_type,
+                          boolean has_aniso_filter_table);
+
+
+void
+lp_build_sample_soa_shared_func(struct gallivm_state *gallivm,
+                                const struct lp_static_texture_state *static_texture_state,
+                                const struct lp_static_sampler_state *static_sampler_state,
+                                struct lp_sampler_dynamic_state *dynamic_state,
+                                struct lp_type type,
+                                unsigned sample_key,
+                                LLVMTypeRef context_type,
+                                boolean has_aniso_filter_table,
+                                LLVMValueRef function);
+
+
+boolean
+lp_build_sample_soa_shared_can_call(const struct lp_static_texture_state *static_texture_state,
+                                    const struct lp_sampler_params *params,
+                                    LLVMTypeRef function_type);
+
+
+void
+lp_build_sample_soa_shared_call(struct gallivm_state *gallivm,
+                                const struct lp_static_texture_state *static_texture_state,
+                                const struct lp_sampler_params *params,
+                                LLVMTypeRef function_type,
+                                LLVMValueRef function,
+                                LLVMValueRef context_ptr);
+
+
 void
 lp_build_coord_repeat_npot_linear(struct lp_build_sample_context *bld,
                                   LLVMValueRef coord_f,
@@ -4117,23 +4117,17 @@ lp_build_sample_gen_func(struct gallivm_state *gallivm,
 
 
 /**
- * Call the matching function for texture sampling.
- * If there's no match, generate a new one.
+ * Collect the arguments of a texture sampling function call, in the order
+ * lp_build_sample_gen_func() unpacks them.
  */
-static void
-lp_build_sample_soa_func(struct gallivm_state *gallivm,
-                         const struct lp_static_texture_state *static_texture_state,
-                         const struct lp_static_sampler_state *static_sampler_state,
-                         struct lp_sampler_dynamic_state *dynamic_state,
-                         const struct lp_sampler_params *params,
-                         unsigned texture_index, unsigned sampler_index,
-                         LLVMValueRef *tex_ret)
+static unsigned
+lp_build_sample_func_args(const struct lp_static_texture_state *static_texture_state,
+                          const struct lp_sampler_params *params,
+                          LLVMValueRef context_ptr,
+                          boolean need_cache,
+                          LLVMValueRef *args)
 {
-   LLVMBuilderRef builder = gallivm->builder;
-   LLVMModuleRef module = LLVMGetGlobalParent(LLVMGetBasicBlockParent(
-                             LLVMGetInsertBlock(builder)));
-   LLVMValueRef args[LP_MAX_TEX_FUNC_ARGS];
-   unsigned sample_key = params->sample_key;
+   const unsigned sample_key = params->sample_key;
    const LLVMValueRef *coords = params->coords;
    const LLVMValueRef *offsets = params->offsets;
    const struct lp_derivatives *derivs = params->derivs;
@@ -4153,6 +4147,70 @@ lp_build_sample_soa_func(struct gallivm_state *gallivm,
    if (layer && op_type == LP_SAMPLER_OP_LODQ)
       layer = 0;
 
+   unsigned num_args = 0;
+   args[num_args++] = context_ptr;
+   if (params->aniso_filter_table)
+      args[num_args++] = params->aniso_filter_table;
+   if (need_cache) {
+      args[num_args++] = params->thread_data_ptr;
+   }
+   for (unsigned i = 0; i < num_coords; i++) {
+      args[num_args++] = coords[i];
+      assert(LLVMTypeOf(coords[0]) == LLVMTypeOf(coords[i]));
+   }
+   if (layer) {
+      args[num_args++] = coords[layer];
+      assert(LLVMTypeOf(coords[0]) == LLVMTypeOf(coords[layer]));
+   }
+   if (sample_key & LP_SAMPLER_SHADOW) {
+      args[num_args++] = coords[4];
+   }
+   if (sample_key & LP_SAMPLER_FETCH_MS) {
+      args[num_args++] = params->ms_index;
+   }
+   if (sample_key & LP_SAMPLER_OFFSETS) {
+      for (unsigned i = 0; i < num_offsets; i++) {
+         args[num_args++] = offsets[i];
+         assert(LLVMTypeOf(offsets[0]) == LLVMTypeOf(offsets[i]));
+      }
+   }
+   if (lod_control == LP_SAMPLER_LOD_BIAS ||
+       lod_control == LP_SAMPLER_LOD_EXPLICIT) {
+      args[num_args++] = params->lod;
+   } else if (lod_control == LP_SAMPLER_LOD_DERIVATIVES) {
+      for (unsigned i = 0; i < num_derivs; i++) {
+         args[num_args++] = derivs->ddx[i];
+         args[num_args++] = derivs->ddy[i];
+         assert(LLVMTypeOf(derivs->ddx[0]) == LLVMTypeOf(derivs->ddx[i]));
+         assert(LLVMTypeOf(derivs->ddy[0]) == LLVMTypeOf(derivs->ddy[i]));
+      }
+   }
+
+   assert(num_args <= LP_MAX_TEX_FUNC_ARGS);
+
+   return num_args;
+}
+
+
+/**
+ * Call the matching function for texture sampling.
+ * If there's no match, generate a new one.
+ */
+static void
+lp_build_sample_soa_func(struct gallivm_state *gallivm,
+                         const struct lp_static_texture_state *static_texture_state,
+                         const struct lp_static_sampler_state *static_sampler_state,
+                         struct lp_sampler_dynamic_state *dynamic_state,
+                         const struct lp_sampler_params *params,
+                         unsigned texture_index, unsigned sampler_index,
+                         LLVMValueRef *tex_ret)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMModuleRef module = LLVMGetGlobalParent(LLVMGetBasicBlockParent(
+                             LLVMGetInsertBlock(builder)));
+   LLVMValueRef args[LP_MAX_TEX_FUNC_ARGS];
+   unsigned sample_key = params->sample_key;
+
    boolean need_cache = FALSE;
    if (dynamic_state->cache_ptr) {
       const struct util_format_description *format_desc;
@@ -4177,48 +4235,17 @@ lp_build_sample_soa_func(struct gallivm_state *gallivm,
    LLVMTypeRef arg_types[LP_MAX_TEX_FUNC_ARGS];
    LLVMTypeRef ret_type;
    LLVMTypeRef val_type[4];
-   unsigned num_param = 0;
+   unsigned num_param;
 
    /*
     * Generate the function prototype.
     */
 
-   arg_types[num_param++] = LLVMTypeOf(params->context_ptr);
-   if (params->aniso_filter_table)
-      arg_types[num_param++] = LLVMTypeOf(params->aniso_filter_table);
-   if (need_cache) {
-      arg_types[num_param++] = LLVMTypeOf(params->thread_data_ptr);
-   }
-   for (unsigned i = 0; i < num_coords; i++) {
-      arg_types[num_param++] = LLVMTypeOf(coords[0]);
-      assert(LLVMTypeOf(coords[0]) == LLVMTypeOf(coords[i]));
-   }
-   if (layer) {
-      arg_types[num_param++] = LLVMTypeOf(coords[layer]);
-      assert(LLVMTypeOf(coords[0]) == LLVMTypeOf(coords[layer]));
-   }
-   if (sample_key & LP_SAMPLER_SHADOW) {
-      arg_types[num_param++] = LLVMTypeOf(coords[0]);
-   }
-   if (sample_key & LP_SAMPLER_FETCH_MS) {
-      arg_types[num_param++] = LLVMTypeOf(params->ms_index);
-   }
-   if (sample_key & LP_SAMPLER_OFFSETS) {
-      for (unsigned i = 0; i < num_offsets; i++) {
-         arg_types[num_param++] = LLVMTypeOf(offsets[0]);
-         assert(LLVMTypeOf(offsets[0]) == LLVMTypeOf(offsets[i]));
-      }
-   }
-   if (lod_control == LP_SAMPLER_LOD_BIAS ||
-       lod_control == LP_SAMPLER_LOD_EXPLICIT) {
-      arg_types[num_param++] = LLVMTypeOf(params->lod);
-   } else if (lod_control == LP_SAMPLER_LOD_DERIVATIVES) {
-      for (unsigned i = 0; i < num_derivs; i++) {
-         arg_types[num_param++] = LLVMTypeOf(derivs->ddx[i]);
-         arg_types[num_param++] = LLVMTypeOf(derivs->ddy[i]);
-         assert(LLVMTypeOf(derivs->ddx[0]) == LLVMTypeOf(derivs->ddx[i]));
-         assert(LLVMTypeOf(derivs->ddy[0]) == LLVMTypeOf(derivs->ddy[i]));
-      }
+   num_param = lp_build_sample_func_args(static_texture_state, params,
+                                         params->context_ptr, need_cache,
+                                         args);
+   for (unsigned i = 0; i < num_param; i++) {
+      arg_types[i] = LLVMTypeOf(args[i]);
    }
 
    val_type[0] = val_type[1] = val_type[2] = val_type[3] =
@@ -4254,62 +4281,202 @@ lp_build_sample_soa_func(struct gallivm_state *gallivm,
                                params->aniso_filter_table ? true : false);
    }
 
-   unsigned num_args = 0;
-   args[num_args++] = params->context_ptr;
-   if (params->aniso_filter_table)
-      args[num_args++] = params->aniso_filter_table;
-   if (need_cache) {
-      args[num_args++] = params->thread_data_ptr;
-   }
+   *tex_ret = LLVMBuildCall2(builder, function_type, function, args, num_param, "");
+   LLVMBasicBlockRef bb = LLVMGetInsertBlock(builder);
+   LLVMValueRef inst = LLVMGetLastInstruction(bb);
+   LLVMSetInstructionCallConv(inst, LLVMFastCallConv);
+}
+
+
+/**
+ * Return the type of a texture sampling function which is shared between
+ * shaders (see lp_build_sample_soa_shared_func()).
+ *
+ * Unlike the per-module functions above the prototype can't be taken from
+ * the call site, so it is derived from the sample key instead: texel fetches
+ * take integer coords and lod, everything else is float.
+ */
+LLVMTypeRef
+lp_build_sample_func_type(struct gallivm_state *gallivm,
+                          enum pipe_texture_target target,
+                          struct lp_type type,
+                          unsigned sample_key,
+                          LLVMTypeRef context_ptr_type,
+                          boolean has_aniso_filter_table)
+{
+   LLVMTypeRef arg_types[LP_MAX_TEX_FUNC_ARGS];
+   LLVMTypeRef val_type[4];
+   unsigned num_param = 0;
+
+   const enum lp_sampler_lod_control lod_control =
+      (sample_key & LP_SAMPLER_LOD_CONTROL_MASK) >>
+      LP_SAMPLER_LOD_CONTROL_SHIFT;
+
+   const enum lp_sampler_op_type op_type =
+      (sample_key & LP_SAMPLER_OP_TYPE_MASK) >> LP_SAMPLER_OP_TYPE_SHIFT;
+
+   LLVMTypeRef float_vec_type = lp_build_vec_type(gallivm, type);
+   LLVMTypeRef int_vec_type = lp_build_int_vec_type(gallivm, type);
+   LLVMTypeRef coord_type =
+      op_type == LP_SAMPLER_OP_FETCH ? int_vec_type : float_vec_type;
+
+   unsigned num_coords, num_derivs, num_offsets, layer;
+   get_target_info(target, &num_coords, &num_derivs, &num_offsets, &layer);
+
+   /* lod query doesn't take a layer */
+   if (layer && op_type == LP_SAMPLER_OP_LODQ)
+      layer = 0;
+
+   arg_types[num_param++] = context_ptr_type;
+   if (has_aniso_filter_table)
+      arg_types[num_param++] =
+         LLVMPointerType(LLVMFloatTypeInContext(gallivm->context), 0);
    for (unsigned i = 0; i < num_coords; i++) {
-      args[num_args++] = coords[i];
+      arg_types[num_param++] = coord_type;
    }
    if (layer) {
-      args[num_args++] = coords[layer];
+      arg_types[num_param++] = coord_type;
    }
    if (sample_key & LP_SAMPLER_SHADOW) {
-      args[num_args++] = coords[4];
+      arg_types[num_param++] = float_vec_type;
    }
    if (sample_key & LP_SAMPLER_FETCH_MS) {
-      args[num_args++] = params->ms_index;
+      arg_types[num_param++] = int_vec_type;
    }
    if (sample_key & LP_SAMPLER_OFFSETS) {
       for (unsigned i = 0; i < num_offsets; i++) {
-         args[num_args++] = offsets[i];
+         arg_types[num_param++] = int_vec_type;
       }
    }
    if (lod_control == LP_SAMPLER_LOD_BIAS ||
        lod_control == LP_SAMPLER_LOD_EXPLICIT) {
-      args[num_args++] = params->lod;
+      arg_types[num_param++] = coord_type;
    } else if (lod_control == LP_SAMPLER_LOD_DERIVATIVES) {
       for (unsigned i = 0; i < num_derivs; i++) {
-         args[num_args++] = derivs->ddx[i];
-         args[num_args++] = derivs->ddy[i];
+         arg_types[num_param++] = float_vec_type;
+         arg_types[num_param++] = float_vec_type;
       }
    }
 
-   assert(num_args <= LP_MAX_TEX_FUNC_ARGS);
+   val_type[0] = val_type[1] = val_type[2] = val_type[3] = float_vec_type;
+   LLVMTypeRef ret_type =
+      LLVMStructTypeInContext(gallivm->context, val_type, 4, 0);
 
-   *tex_ret = LLVMBuildCall2(builder, function_type, function, args, num_args, "");
-   LLVMBasicBlockRef bb = LLVMGetInsertBlock(builder);
-   LLVMValueRef inst = LLVMGetLastInstruction(bb);
-   LLVMSetInstructionCallConv(inst, LLVMFastCallConv);
+   return LLVMFunctionType(ret_type, arg_types, num_param, 0);
 }
 
 
 /**
- * Build texture sampling code.
- * Either via a function call or inline it directly.
+ * Generate the body of a texture sampling function which is compiled on
+ * its own and shared between shaders.
+ *
+ * The function has the type returned by lp_build_sample_func_type(), and
+ * the dynamic state callbacks are expected to find the texture and sampler
+ * through context_ptr alone, so the unit indices passed to them are
+ * meaningless. No texture cache is used.
  */
 void
-lp_build_sample_soa(const struct lp_static_texture_state *static_texture_state,
-                    const struct lp_static_sampler_state *static_sampler_state,
-                    struct lp_sampler_dynamic_state *dynamic_state,
-                    struct gallivm_state *gallivm,
-                    const struct lp_sampler_params *params)
+lp_build_sample_soa_shared_func(struct gallivm_state *gallivm,
+                                const struct lp_static_texture_state *static_texture_state,
+                                const struct lp_static_sampler_state *static_sampler_state,
+                                struct lp_sampler_dynamic_state *dynamic_state,
+                                struct lp_type type,
+                                unsigned sample_key,
+                                LLVMTypeRef context_type,
+                                boolean has_aniso_filter_table,
+                                LLVMValueRef function)
+{
+   assert(!dynamic_state->cache_ptr);
+
+   lp_build_sample_gen_func(gallivm,
+                            static_texture_state,
+                            static_sampler_state,
+                            dynamic_state,
+                            type,
+                            context_type,
+                            NULL,
+                            0, 0,
+                            function,
+                            LLVMCountParams(function),
+                            sample_key,
+                            has_aniso_filter_table);
+}
+
+
+/**
+ * Whether the arguments of a call site match the type of a shared texture
+ * sampling function.  Emits no code, so callers can check before building
+ * anything else for the call.
+ */
+boolean
+lp_build_sample_soa_shared_can_call(const struct lp_static_texture_state *static_texture_state,
+                                    const struct lp_sampler_params *params,
+                                    LLVMTypeRef function_type)
+{
+   LLVMValueRef args[LP_MAX_TEX_FUNC_ARGS];
+   LLVMTypeRef arg_types[LP_MAX_TEX_FUNC_ARGS];
+
+   unsigned num_params = LLVMCountParamTypes(function_type);
+   if (!num_params || num_params > LP_MAX_TEX_FUNC_ARGS)
+      return FALSE;
+
+   LLVMGetParamTypes(function_type, arg_types);
+
+   /* the context pointer is built by the caller, it always matches */
+   unsigned num_args = lp_build_sample_func_args(static_texture_state, params,
+                                                 LLVMGetUndef(arg_types[0]),
+                                                 FALSE, args);
+   if (num_args != num_params)
+      return FALSE;
+
+   for (unsigned i = 1; i < num_args; i++) {
+      if (LLVMTypeOf(args[i]) != arg_types[i])
+         return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Emit a call to a shared texture sampling function.
+ *
+ * The call site must have been checked with
+ * lp_build_sample_soa_shared_can_call().
+ */
+void
+lp_build_sample_soa_shared_call(struct gallivm_state *gallivm,
+                                const struct lp_static_texture_state *static_texture_state,
+                                const struct lp_sampler_params *params,
+                                LLVMTypeRef function_type,
+                                LLVMValueRef function,
+                                LLVMValueRef context_ptr)
 {
-   boolean use_tex_func = FALSE;
+   LLVMValueRef args[LP_MAX_TEX_FUNC_ARGS];
+
+   assert(lp_build_sample_soa_shared_can_call(static_texture_state, params,
+                                              function_type));
 
+   unsigned num_args = lp_build_sample_func_args(static_texture_state, params,
+                                                 context_ptr, FALSE, args);
+
+   LLVMValueRef tex_ret = LLVMBuildCall2(gallivm->builder, function_type,
+                                         function, args, num_args, "");
+   for (unsigned i = 0; i < 4; i++) {
+      params->texel[i] =
+         LLVMBuildExtractValue(gallivm->builder, tex_ret, i, "");
+   }
+}
+
+
+/**
+ * Whether texture sampling is done via a function call rather than inlined.
+ */
+boolean
+lp_build_sample_soa_use_func(const struct lp_static_texture_state *static_texture_state,
+                             const struct lp_static_sampler_state *static_sampler_state,
+                             unsigned sample_key)
+{
    /*
     * Do not use a function call if the sampling is "simple enough".
     * We define this by
@@ -4325,25 +4492,41 @@ lp_build_sample_soa(const struct lp_static_texture_state *static_texture_state,
     * Ideally we'd let llvm recognize this stuff by doing IPO passes.
     */
 
-   if (USE_TEX_FUNC_CALL) {
-      const struct util_format_description *format_desc =
-         util_format_description(static_texture_state->format);
-      const boolean simple_format =
-         (util_format_is_rgba8_variant(format_desc) &&
-         format_desc->colorspace == UTIL_FORMAT_COLORSPACE_RGB);
-      const enum lp_sampler_op_type op_type =
-         (params->sample_key & LP_SAMPLER_OP_TYPE_MASK) >>
-         LP_SAMPLER_OP_TYPE_SHIFT;
-      const boolean simple_tex =
-         op_type != LP_SAMPLER_OP_TEXTURE ||
-           ((static_sampler_state->min_mip_filter == PIPE_TEX_MIPFILTER_NONE ||
-             static_texture_state->level_zero_only == TRUE) &&
-            static_sampler_state->min_img_filter == static_sampler_state->mag_img_filter);
-
-      use_tex_func = !(simple_format && simple_tex);
-   }
-
-   if (use_tex_func) {
+   if (!USE_TEX_FUNC_CALL)
+      return FALSE;
+
+   const struct util_format_description *format_desc =
+      util_format_description(static_texture_state->format);
+   const boolean simple_format =
+      (util_format_is_rgba8_variant(format_desc) &&
+      format_desc->colorspace == UTIL_FORMAT_COLORSPACE_RGB);
+   const enum lp_sampler_op_type op_type =
+      (sample_key & LP_SAMPLER_OP_TYPE_MASK) >>
+      LP_SAMPLER_OP_TYPE_SHIFT;
+   const boolean simple_tex =
+      op_type != LP_SAMPLER_OP_TEXTURE ||
+        ((static_sampler_state->min_mip_filter == PIPE_TEX_MIPFILTER_NONE ||
+          static_texture_state->level_zero_only == TRUE) &&
+         static_sampler_state->min_img_filter == static_sampler_state->mag_img_filter);
+
+   return !(simple_format && simple_tex);
+}
+
+
+/**
+ * Build texture sampling code.
+ * Either via a function call or inline it directly.
+ */
+void
+lp_build_sample_soa(const struct lp_static_texture_state *static_texture_state,
+                    const struct lp_static_sampler_state *static_sampler_state,
+                    struct lp_sampler_dynamic_state *dynamic_state,
+                    struct gallivm_state *gallivm,
+                    const struct lp_sampler_params *params)
+{
+   if (lp_build_sample_soa_use_func(static_texture_state,
+                                    static_sampler_state,
+                                    params->sample_key)) {
       LLVMValueRef tex_ret;
       lp_build_sample_soa_func(gallivm,
                                static_texture_state,
@@ -0,0 +1,120 @@
+/*
+ * Copyright © 2023 Sietium Semiconductor
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Dispatch overhead of the compute thread pool.
+ *
+ * Queues tasks with near empty iterations, as small workgroup dispatches
+ * do, and waits for each before queuing the next one.  The "pairs" column
+ * queues two independent tasks before waiting for either, so the second
+ * can start while the first is finishing.  Every iteration must run
+ * exactly once, which is checked as well.
+ *
+ * Usage: lp_bench_cs_tpool [num_threads] [num_dispatches]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/os_time.h"
+#include "util/u_atomic.h"
+#include "util/u_cpu_detect.h"
+
+#include "lp_cs_tpool.h"
+
+#define MAX_ITERS 4096
+
+struct bench_job {
+   unsigned counts[MAX_ITERS];
+};
+
+static void
+bench_work(void *data, int iter_idx, struct lp_cs_local_mem *lmem)
+{
+   struct bench_job *job = data;
+
+   p_atomic_inc(&job->counts[iter_idx]);
+}
+
+static bool
+check_job(struct bench_job *job, unsigned num_iters, unsigned expected)
+{
+   for (unsigned i = 0; i < num_iters; i++) {
+      if (job->counts[i] != expected)
+         return false;
+   }
+   return true;
+}
+
+/* Returns ns per dispatch. */
+static double
+run(struct lp_cs_tpool *pool, struct bench_job jobs[2], unsigned num_iters,
+    unsigned num_dispatches, bool pairs)
+{
+   int64_t start = os_time_get_nano();
+
+   for (unsigned d = 0; d < num_dispatches; d += pairs ? 2 : 1) {
+      struct lp_cs_tpool_task *tasks[2] = { NULL, NULL };
+
+      tasks[0] = lp_cs_tpool_queue_task(pool, bench_work, &jobs[0], num_iters);
+      if (pairs) {
+         tasks[1] = lp_cs_tpool_queue_task(pool, bench_work, &jobs[1],
+                                           num_iters);
+      } else {
+         lp_cs_tpool_wait_for_task(pool, &tasks[0]);
+      }
+      lp_cs_tpool_wait_for_task(pool, &tasks[0]);
+      lp_cs_tpool_wait_for_task(pool, &tasks[1]);
+   }
+
+   return (double)(os_time_get_nano() - start) / num_dispatches;
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned num_threads = argc > 1 ? atoi(argv[1]) :
+      util_get_cpu_caps()->nr_cpus;
+   unsigned num_dispatches = argc > 2 ? atoi(argv[2]) : 20000;
+   static const unsigned iters[] = { 1, 4, 16, 64, 256, 1024, MAX_ITERS };
+
+   num_threads = MIN2(num_threads, LP_MAX_THREADS);
+   num_dispatches = MAX2(num_dispatches & ~1, 2);
+
+   struct lp_cs_tpool *pool = lp_cs_tpool_create(num_threads);
+   if (!pool)
+      return EXIT_FAILURE;
+
+   struct bench_job *jobs = calloc(2, sizeof(*jobs));
+   if (!jobs)
+      return EXIT_FAILURE;
+
+   printf("%u threads, %u dispatches\n", pool->num_threads, num_dispatches);
+   printf("%-8s %14s %14s %14s\n", "iters", "ns/dispatch", "ns/iter",
+          "pairs ns/disp");
+
+   int ret = EXIT_SUCCESS;
+   for (unsigned i = 0; i < ARRAY_SIZE(iters); i++) {
+      unsigned n = iters[i];
+
+      memset(jobs, 0, 2 * sizeof(*jobs));
+      double single = run(pool, jobs, n, num_dispatches, false);
+      double pairs = run(pool, jobs, n, num_dispatches, true);
+
+      printf("%-8u %14.0f %14.1f %14.0f\n", n, single, single / n, pairs);
+
+      if (!check_job(&jobs[0], n, num_dispatches + num_dispatches / 2) ||
+          !check_job(&jobs[1], n, num_dispatches / 2)) {
+         fprintf(stderr, "iterations of %u were lost or run twice\n", n);
+         ret = EXIT_FAILURE;
+      }
+   }
+
+   free(jobs);
+   lp_cs_tpool_destroy(pool);
+
+   return ret;
+}
@@ -0,0 +1,260 @@
+/*
+ * Copyright © 2023 Sietium Semiconductor
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Scaling of draw module vertex processing with DRAW_VS_THREADS.
+ *
+ * Draws a large list of small triangles with an ALU heavy vertex shader on
+ * llvmpipe, once with vertex shading on the calling thread and then with
+ * 1, 2, 4, ... worker threads.  A new context is created for every thread
+ * count, since the draw module reads DRAW_VS_THREADS when it is created.
+ *
+ * Usage: lp_bench_draw_vs [max_threads] [num_vertices] [vs_alu_instrs]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pipe/p_context.h"
+#include "pipe/p_defines.h"
+#include "pipe/p_screen.h"
+#include "pipe/p_state.h"
+#include "cso_cache/cso_context.h"
+#include "tgsi/tgsi_text.h"
+#include "util/os_time.h"
+#include "util/u_draw.h"
+#include "util/u_inlines.h"
+#include "util/u_memory.h"
+#include "util/u_simple_shaders.h"
+#include "sw/null/null_sw_winsys.h"
+
+#include "lp_public.h"
+
+#define WIDTH 256
+#define HEIGHT 256
+#define NUM_DRAWS 8
+
+static void *
+create_vs(struct pipe_context *pipe, unsigned num_alu)
+{
+   size_t size = 512 + num_alu * 64;
+   unsigned num_tokens = 256 + num_alu * 8;
+   char *text = malloc(size);
+   struct tgsi_token *tokens = malloc(num_tokens * sizeof(*tokens));
+   struct pipe_shader_state state;
+   void *vs = NULL;
+   int len;
+
+   if (!text || !tokens)
+      goto out;
+
+   len = snprintf(text, size,
+                  "VERT\n"
+                  "DCL IN[0]\n"
+                  "DCL OUT[0], POSITION\n"
+                  "DCL OUT[1], GENERIC[0]\n"
+                  "DCL TEMP[0]\n"
+                  "IMM[0] FLT32 { 0.999, 0.001, 0.5, 1.0 }\n"
+                  "MOV TEMP[0], IN[0]\n");
+   for (unsigned i = 0; i < num_alu; i++)
+      len += snprintf(text + len, size - len,
+                      "MAD TEMP[0], TEMP[0], IMM[0].xxxx, IMM[0].yyyy\n");
+   snprintf(text + len, size - len,
+            "MOV OUT[0], IN[0]\n"
+            "MOV OUT[1], TEMP[0]\n"
+            "END\n");
+
+   if (tgsi_text_translate(text, tokens, num_tokens)) {
+      pipe_shader_state_from_tgsi(&state, tokens);
+      vs = pipe->create_vs_state(pipe, &state);
+   }
+
+out:
+   free(tokens);
+   free(text);
+   return vs;
+}
+
+static double
+run(struct pipe_screen *screen, struct pipe_resource *target,
+    const float *verts, unsigned num_verts, unsigned num_alu)
+{
+   struct pipe_context *pipe = screen->context_create(screen, NULL, 0);
+   if (!pipe)
+      return 0.0;
+
+   struct cso_context *cso = cso_create_context(pipe, 0);
+
+   struct pipe_surface surf_tmpl = {
+      .format = target->format,
+   };
+   struct pipe_framebuffer_state fb = {
+      .width = WIDTH,
+      .height = HEIGHT,
+      .nr_cbufs = 1,
+   };
+   fb.cbufs[0] = pipe->create_surface(pipe, target, &surf_tmpl);
+
+   struct pipe_blend_state blend = { 0 };
+   blend.rt[0].colormask = PIPE_MASK_RGBA;
+
+   struct pipe_depth_stencil_alpha_state dsa = { 0 };
+
+   struct pipe_rasterizer_state rast = {
+      .cull_face = PIPE_FACE_NONE,
+      .half_pixel_center = 1,
+      .bottom_edge_rule = 1,
+      .depth_clip_near = 1,
+      .depth_clip_far = 1,
+   };
+
+   struct pipe_viewport_state vp = {
+      .scale = { WIDTH / 2.0f, HEIGHT / 2.0f, 0.5f },
+      .translate = { WIDTH / 2.0f, HEIGHT / 2.0f, 0.5f },
+      .swizzle_x = PIPE_VIEWPORT_SWIZZLE_POSITIVE_X,
+      .swizzle_y = PIPE_VIEWPORT_SWIZZLE_POSITIVE_Y,
+      .swizzle_z = PIPE_VIEWPORT_SWIZZLE_POSITIVE_Z,
+      .swizzle_w = PIPE_VIEWPORT_SWIZZLE_POSITIVE_W,
+   };
+
+   struct cso_velems_state velem = { .count = 1 };
+   velem.velems[0].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+
+   struct pipe_resource *vbuf =
+      pipe_buffer_create(screen, PIPE_BIND_VERTEX_BUFFER, PIPE_USAGE_DEFAULT,
+                         num_verts * 4 * sizeof(float));
+   pipe_buffer_write(pipe, vbuf, 0, num_verts * 4 * sizeof(float), verts);
+
+   struct pipe_vertex_buffer vb = {
+      .stride = 4 * sizeof(float),
+      .buffer.resource = vbuf,
+   };
+
+   void *vs = create_vs(pipe, num_alu);
+   void *fs = util_make_fragment_passthrough_shader(pipe,
+                                                    TGSI_SEMANTIC_GENERIC,
+                                                    TGSI_INTERPOLATE_LINEAR,
+                                                    TRUE);
+   if (!vs || !fs) {
+      fprintf(stderr, "failed to create shaders\n");
+      exit(EXIT_FAILURE);
+   }
+
+   cso_set_framebuffer(cso, &fb);
+   cso_set_blend(cso, &blend);
+   cso_set_depth_stencil_alpha(cso, &dsa);
+   cso_set_rasterizer(cso, &rast);
+   cso_set_viewport(cso, &vp);
+   cso_set_vertex_shader_handle(cso, vs);
+   cso_set_fragment_shader_handle(cso, fs);
+   cso_set_vertex_elements(cso, &velem);
+   cso_set_vertex_buffers(cso, 0, 1, 0, false, &vb);
+
+   /* Warm up: compiles the shader variants. */
+   util_draw_arrays(pipe, PIPE_PRIM_TRIANGLES, 0, 3);
+   pipe->flush(pipe, NULL, 0);
+
+   struct pipe_fence_handle *fence = NULL;
+   int64_t start = os_time_get_nano();
+
+   for (unsigned i = 0; i < NUM_DRAWS; i++)
+      util_draw_arrays(pipe, PIPE_PRIM_TRIANGLES, 0, num_verts);
+
+   pipe->flush(pipe, &fence, 0);
+   screen->fence_finish(screen, NULL, fence, PIPE_TIMEOUT_INFINITE);
+   screen->fence_reference(screen, &fence, NULL);
+
+   double secs = (os_time_get_nano() - start) / 1e9;
+
+   cso_destroy_context(cso);
+   pipe->delete_vs_state(pipe, vs);
+   pipe->delete_fs_state(pipe, fs);
+   pipe_surface_reference(&fb.cbufs[0], NULL);
+   pipe_resource_reference(&vbuf, NULL);
+   pipe->destroy(pipe);
+
+   return (double)num_verts * NUM_DRAWS / secs;
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned max_threads = argc > 1 ? atoi(argv[1]) : 16;
+   unsigned num_verts = argc > 2 ? atoi(argv[2]) : 3 * 100000;
+   unsigned num_alu = argc > 3 ? atoi(argv[3]) : 64;
+
+   num_verts -= num_verts % 3;
+   if (!num_verts)
+      return EXIT_FAILURE;
+
+   /* Tiny triangles all over the framebuffer, so that setup and
+    * rasterization are cheap next to vertex shading.
+    */
+   float *verts = malloc(num_verts * 4 * sizeof(float));
+   if (!verts)
+      return EXIT_FAILURE;
+
+   uint32_t rng = 1;
+   for (unsigned i = 0; i < num_verts; i += 3) {
+      rng ^= rng << 13;
+      rng ^= rng >> 17;
+      rng ^= rng << 5;
+
+      float x = (rng % WIDTH) * (2.0f / WIDTH) - 1.0f;
+      float y = (rng / WIDTH % HEIGHT) * (2.0f / HEIGHT) - 1.0f;
+      const float d = 2.0f / WIDTH;
+      const float tri[3][4] = {
+         { x, y, 0.5f, 1.0f },
+         { x + d, y, 0.5f, 1.0f },
+         { x, y + d, 0.5f, 1.0f },
+      };
+      memcpy(&verts[i * 4], tri, sizeof(tri));
+   }
+
+   struct pipe_screen *screen = llvmpipe_create_screen(null_sw_create());
+   if (!screen)
+      return EXIT_FAILURE;
+
+   struct pipe_resource tmpl = {
+      .target = PIPE_TEXTURE_2D,
+      .format = PIPE_FORMAT_B8G8R8A8_UNORM,
+      .width0 = WIDTH,
+      .height0 = HEIGHT,
+      .depth0 = 1,
+      .array_size = 1,
+      .bind = PIPE_BIND_RENDER_TARGET,
+   };
+   struct pipe_resource *target = screen->resource_create(screen, &tmpl);
+   if (!target)
+      return EXIT_FAILURE;
+
+   printf("%u vertices per draw, %u VS instructions, chunk %s\n", num_verts,
+          num_alu + 3, getenv("DRAW_VS_CHUNK") ? getenv("DRAW_VS_CHUNK")
+                                               : "default");
+   printf("%-8s %16s %10s\n", "threads", "Mvertices/s", "speedup");
+
+   double base = 0.0;
+   for (unsigned num_threads = 0; num_threads <= max_threads;
+        num_threads = num_threads ? num_threads * 2 : 1) {
+      char value[16];
+
+      snprintf(value, sizeof(value), "%u", num_threads);
+      setenv("DRAW_VS_THREADS", value, 1);
+
+      double verts_per_sec = run(screen, target, verts, num_verts, num_alu);
+      if (!num_threads)
+         base = verts_per_sec;
+
+      printf("%-8u %16.2f %9.2fx\n", num_threads, verts_per_sec / 1e6,
+             base ? verts_per_sec / base : 0.0);
+   }
+
+   pipe_resource_reference(&target, NULL);
+   screen->destroy(screen);
+   free(verts);
+
+   return EXIT_SUCCESS;
+}
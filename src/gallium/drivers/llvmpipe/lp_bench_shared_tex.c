@@ -0,0 +1,259 @@
+/*
+ * Copyright © 2023 Sietium Semiconductor
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Compile time and IR size of texture heavy shaders with LP_DEBUG=shared_tex.
+ *
+ * Compiles two compute shaders doing trilinear lookups on a number of
+ * mipmapped textures, first with the sampling code generated in every
+ * shader and then with calls to the per-screen shared sampling functions.
+ * The second shader samples the same textures differently, so with shared
+ * functions it mostly reuses those compiled for the first one.  The IR
+ * counts are those of the shaders themselves.  LP_PERF is read when the
+ * screen is created, so a new screen is created for each mode.
+ *
+ * Usage: lp_bench_shared_tex [num_textures] [lookups_per_texture]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pipe/p_context.h"
+#include "pipe/p_defines.h"
+#include "pipe/p_screen.h"
+#include "pipe/p_state.h"
+#include "util/os_time.h"
+#include "util/u_inlines.h"
+#include "util/u_sampler.h"
+#include "sw/null/null_sw_winsys.h"
+#include "nir_builder.h"
+
+#include "lp_context.h"
+#include "lp_public.h"
+
+#define TEX_SIZE 64
+#define CS_BLOCK 64
+
+static nir_ssa_def *
+build_txl(nir_builder *b, unsigned unit, nir_ssa_def *coord, nir_ssa_def *lod)
+{
+   nir_tex_instr *tex = nir_tex_instr_create(b->shader, 2);
+
+   tex->op = nir_texop_txl;
+   tex->sampler_dim = GLSL_SAMPLER_DIM_2D;
+   tex->dest_type = nir_type_float32;
+   tex->coord_components = 2;
+   tex->texture_index = unit;
+   tex->sampler_index = unit;
+   tex->src[0].src_type = nir_tex_src_coord;
+   tex->src[0].src = nir_src_for_ssa(coord);
+   tex->src[1].src_type = nir_tex_src_lod;
+   tex->src[1].src = nir_src_for_ssa(lod);
+   nir_ssa_dest_init(&tex->instr, &tex->dest, 4, 32, NULL);
+   nir_builder_instr_insert(b, &tex->instr);
+
+   return &tex->dest.ssa;
+}
+
+static void *
+create_cs(struct pipe_context *pipe, unsigned num_textures,
+          unsigned num_lookups, float scale)
+{
+   struct pipe_screen *screen = pipe->screen;
+   const nir_shader_compiler_options *options =
+      screen->get_compiler_options(screen, PIPE_SHADER_IR_NIR,
+                                   PIPE_SHADER_COMPUTE);
+   nir_builder b = nir_builder_init_simple_shader(MESA_SHADER_COMPUTE,
+                                                  options, "shared tex");
+
+   b.shader->info.workgroup_size[0] = CS_BLOCK;
+   b.shader->info.workgroup_size[1] = 1;
+   b.shader->info.workgroup_size[2] = 1;
+   b.shader->info.num_ssbos = 1;
+
+   nir_ssa_def *id =
+      nir_iadd(&b, nir_imul_imm(&b, nir_channel(&b, nir_load_workgroup_id(&b, 32), 0),
+                                CS_BLOCK),
+               nir_channel(&b, nir_load_local_invocation_id(&b), 0));
+   nir_ssa_def *s = nir_fmul_imm(&b, nir_u2f32(&b, id), scale);
+   nir_ssa_def *sum = nir_imm_vec4(&b, 0.0f, 0.0f, 0.0f, 0.0f);
+
+   for (unsigned unit = 0; unit < num_textures; unit++) {
+      for (unsigned i = 0; i < num_lookups; i++) {
+         nir_ssa_def *t = nir_fadd_imm(&b, s, (float)i / num_lookups);
+         nir_ssa_def *coord = nir_vec2(&b, s, t);
+         nir_ssa_def *lod = nir_fmul_imm(&b, t, 4.0f);
+
+         sum = nir_fadd(&b, sum, build_txl(&b, unit, coord, lod));
+      }
+      BITSET_SET(b.shader->info.textures_used, unit);
+      BITSET_SET(b.shader->info.samplers_used, unit);
+   }
+
+   nir_store_ssbo(&b, sum, nir_imm_int(&b, 0), nir_imul_imm(&b, id, 16),
+                  .align_mul = 16);
+
+   screen->finalize_nir(screen, b.shader);
+
+   struct pipe_compute_state state = {
+      .ir_type = PIPE_SHADER_IR_NIR,
+      .prog = b.shader,
+   };
+   return pipe->create_compute_state(pipe, &state);
+}
+
+/* Compiles and runs one shader, returns the compile time in ms. */
+static double
+run_cs(struct pipe_context *pipe, struct pipe_shader_buffer *sb,
+       unsigned num_textures, unsigned num_lookups, float scale,
+       unsigned *num_instrs)
+{
+   struct llvmpipe_context *lp = llvmpipe_context(pipe);
+   struct pipe_grid_info info = {
+      .work_dim = 1,
+      .block = { CS_BLOCK, 1, 1 },
+      .grid = { 1, 1, 1 },
+   };
+   unsigned instrs_before = lp->nr_cs_instrs;
+   int64_t start = os_time_get_nano();
+
+   void *cs = create_cs(pipe, num_textures, num_lookups, scale);
+   if (!cs) {
+      fprintf(stderr, "failed to create compute shader\n");
+      exit(EXIT_FAILURE);
+   }
+
+   pipe->bind_compute_state(pipe, cs);
+   pipe->set_shader_buffers(pipe, PIPE_SHADER_COMPUTE, 0, 1, sb, 0x1);
+
+   /* The variant is compiled on the first launch. */
+   pipe->launch_grid(pipe, &info);
+   pipe->flush(pipe, NULL, 0);
+   pipe_buffer_read(pipe, sb->buffer, 0, sizeof(float), &(float){ 0 });
+
+   double ms = (os_time_get_nano() - start) / 1e6;
+   *num_instrs = lp->nr_cs_instrs - instrs_before;
+
+   pipe->set_shader_buffers(pipe, PIPE_SHADER_COMPUTE, 0, 1, NULL, 0);
+   pipe->bind_compute_state(pipe, NULL);
+   pipe->delete_compute_state(pipe, cs);
+
+   return ms;
+}
+
+static void
+run_mode(bool shared, unsigned num_textures, unsigned num_lookups,
+         double ms[2], unsigned instrs[2])
+{
+   setenv("LP_DEBUG", shared ? "shared_tex" : "", 1);
+
+   struct pipe_screen *screen = llvmpipe_create_screen(null_sw_create());
+   if (!screen)
+      exit(EXIT_FAILURE);
+
+   struct pipe_context *pipe = screen->context_create(screen, NULL, 0);
+   if (!pipe)
+      exit(EXIT_FAILURE);
+
+   struct pipe_resource tmpl = {
+      .target = PIPE_TEXTURE_2D,
+      .format = PIPE_FORMAT_R16G16B16A16_FLOAT,
+      .width0 = TEX_SIZE,
+      .height0 = TEX_SIZE,
+      .depth0 = 1,
+      .array_size = 1,
+      .last_level = util_logbase2(TEX_SIZE),
+      .bind = PIPE_BIND_SAMPLER_VIEW,
+   };
+   struct pipe_sampler_state samp = {
+      .wrap_s = PIPE_TEX_WRAP_REPEAT,
+      .wrap_t = PIPE_TEX_WRAP_MIRROR_REPEAT,
+      .wrap_r = PIPE_TEX_WRAP_CLAMP_TO_EDGE,
+      .min_img_filter = PIPE_TEX_FILTER_LINEAR,
+      .mag_img_filter = PIPE_TEX_FILTER_LINEAR,
+      .min_mip_filter = PIPE_TEX_MIPFILTER_LINEAR,
+      .max_lod = 16.0f,
+   };
+   struct pipe_sampler_view *views[PIPE_MAX_SHADER_SAMPLER_VIEWS];
+   void *samplers[PIPE_MAX_SAMPLERS];
+
+   for (unsigned i = 0; i < num_textures; i++) {
+      struct pipe_resource *tex = screen->resource_create(screen, &tmpl);
+      struct pipe_sampler_view view_tmpl;
+
+      if (!tex)
+         exit(EXIT_FAILURE);
+      u_sampler_view_default_template(&view_tmpl, tex, tex->format);
+      views[i] = pipe->create_sampler_view(pipe, tex, &view_tmpl);
+      samplers[i] = pipe->create_sampler_state(pipe, &samp);
+      pipe_resource_reference(&tex, NULL);
+   }
+   pipe->set_sampler_views(pipe, PIPE_SHADER_COMPUTE, 0, num_textures, 0,
+                           false, views);
+   pipe->bind_sampler_states(pipe, PIPE_SHADER_COMPUTE, 0, num_textures,
+                             samplers);
+
+   struct pipe_shader_buffer sb = {
+      .buffer = pipe_buffer_create(screen, PIPE_BIND_SHADER_BUFFER,
+                                   PIPE_USAGE_DEFAULT, CS_BLOCK * 16),
+      .buffer_size = CS_BLOCK * 16,
+   };
+
+   ms[0] = run_cs(pipe, &sb, num_textures, num_lookups, 1.0f / CS_BLOCK,
+                  &instrs[0]);
+   ms[1] = run_cs(pipe, &sb, num_textures, num_lookups, 0.5f / CS_BLOCK,
+                  &instrs[1]);
+
+   pipe->set_sampler_views(pipe, PIPE_SHADER_COMPUTE, 0, 0, num_textures,
+                           false, NULL);
+   for (unsigned i = 0; i < num_textures; i++) {
+      pipe_sampler_view_reference(&views[i], NULL);
+      pipe->delete_sampler_state(pipe, samplers[i]);
+   }
+   pipe_resource_reference(&sb.buffer, NULL);
+   pipe->destroy(pipe);
+   screen->destroy(screen);
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned num_textures = argc > 1 ? atoi(argv[1]) : 8;
+   unsigned num_lookups = argc > 2 ? atoi(argv[2]) : 4;
+
+   num_textures = CLAMP(num_textures, 1, PIPE_MAX_SAMPLERS);
+   num_lookups = MAX2(num_lookups, 1);
+
+   /* Compile every time. */
+   setenv("MESA_SHADER_CACHE_DISABLE", "true", 1);
+
+   glsl_type_singleton_init_or_ref();
+
+   printf("%u textures, %u trilinear lookups each\n",
+          num_textures, num_lookups);
+   printf("%-8s %-8s %12s %12s\n", "mode", "shader", "compile ms",
+          "IR instrs");
+
+   double ms[2][2];
+   unsigned instrs[2][2];
+   for (unsigned mode = 0; mode < 2; mode++) {
+      run_mode(mode == 1, num_textures, num_lookups, ms[mode], instrs[mode]);
+
+      for (unsigned i = 0; i < 2; i++) {
+         printf("%-8s %-8u %12.1f %12u\n", mode ? "shared" : "inline",
+                i, ms[mode][i], instrs[mode][i]);
+      }
+   }
+
+   printf("shared/inline: compile %.2fx, IR %.2fx\n",
+          (ms[1][0] + ms[1][1]) / (ms[0][0] + ms[0][1]),
+          (double)(instrs[1][0] + instrs[1][1]) /
+          MAX2(instrs[0][0] + instrs[0][1], 1));
+
+   glsl_type_singleton_decref();
+
+   return EXIT_SUCCESS;
+}
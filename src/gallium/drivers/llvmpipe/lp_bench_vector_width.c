@@ -0,0 +1,338 @@
+/*
+ * Copyright © 2023 Sietium Semiconductor
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Fragment and compute shader throughput at each SIMD width.
+ *
+ * Runs an ALU heavy fragment shader over full screen quads and an ALU heavy
+ * compute shader writing to an SSBO, once for every vector width from 128
+ * bits up to the widest the CPU supports.  lp_native_vector_width is only
+ * read when shader variants and draw contexts are created, so a new context
+ * is created for every width.
+ *
+ * Usage: lp_bench_vector_width [alu_instrs] [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pipe/p_context.h"
+#include "pipe/p_defines.h"
+#include "pipe/p_screen.h"
+#include "pipe/p_state.h"
+#include "cso_cache/cso_context.h"
+#include "gallivm/lp_bld_type.h"
+#include "tgsi/tgsi_text.h"
+#include "util/os_time.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_draw.h"
+#include "util/u_inlines.h"
+#include "util/u_simple_shaders.h"
+#include "sw/null/null_sw_winsys.h"
+#include "nir_builder.h"
+
+#include "lp_public.h"
+
+#define WIDTH 1024
+#define HEIGHT 1024
+#define CS_BLOCK 64
+#define CS_INVOCATIONS (1024 * 1024)
+
+static void *
+create_fs(struct pipe_context *pipe, unsigned num_alu)
+{
+   size_t size = 512 + num_alu * 64;
+   unsigned num_tokens = 256 + num_alu * 8;
+   char *text = malloc(size);
+   struct tgsi_token *tokens = malloc(num_tokens * sizeof(*tokens));
+   struct pipe_shader_state state;
+   void *fs = NULL;
+   int len;
+
+   if (!text || !tokens)
+      goto out;
+
+   len = snprintf(text, size,
+                  "FRAG\n"
+                  "DCL IN[0], GENERIC[0], PERSPECTIVE\n"
+                  "DCL OUT[0], COLOR\n"
+                  "DCL TEMP[0]\n"
+                  "IMM[0] FLT32 { 0.999, 0.001, 0.5, 1.0 }\n"
+                  "MOV TEMP[0], IN[0]\n");
+   for (unsigned i = 0; i < num_alu; i++)
+      len += snprintf(text + len, size - len,
+                      "MAD TEMP[0], TEMP[0], IMM[0].xxxx, IMM[0].yyyy\n");
+   snprintf(text + len, size - len,
+            "MOV OUT[0], TEMP[0]\n"
+            "END\n");
+
+   if (tgsi_text_translate(text, tokens, num_tokens)) {
+      pipe_shader_state_from_tgsi(&state, tokens);
+      fs = pipe->create_fs_state(pipe, &state);
+   }
+
+out:
+   free(tokens);
+   free(text);
+   return fs;
+}
+
+static void *
+create_cs(struct pipe_context *pipe, unsigned num_alu)
+{
+   struct pipe_screen *screen = pipe->screen;
+   const nir_shader_compiler_options *options =
+      screen->get_compiler_options(screen, PIPE_SHADER_IR_NIR,
+                                   PIPE_SHADER_COMPUTE);
+   nir_builder b = nir_builder_init_simple_shader(MESA_SHADER_COMPUTE,
+                                                  options, "vector width");
+
+   b.shader->info.workgroup_size[0] = CS_BLOCK;
+   b.shader->info.workgroup_size[1] = 1;
+   b.shader->info.workgroup_size[2] = 1;
+   b.shader->info.num_ssbos = 1;
+
+   nir_ssa_def *id =
+      nir_iadd(&b, nir_imul_imm(&b, nir_channel(&b, nir_load_workgroup_id(&b, 32), 0),
+                                CS_BLOCK),
+               nir_channel(&b, nir_load_local_invocation_id(&b), 0));
+   nir_ssa_def *val = nir_u2f32(&b, id);
+
+   for (unsigned i = 0; i < num_alu; i++)
+      val = nir_ffma(&b, val, nir_imm_float(&b, 0.999f), nir_imm_float(&b, 0.001f));
+
+   nir_store_ssbo(&b, val, nir_imm_int(&b, 0), nir_imul_imm(&b, id, 4),
+                  .align_mul = 4);
+
+   screen->finalize_nir(screen, b.shader);
+
+   struct pipe_compute_state state = {
+      .ir_type = PIPE_SHADER_IR_NIR,
+      .prog = b.shader,
+   };
+   return pipe->create_compute_state(pipe, &state);
+}
+
+/* Returns Mpixels/s. */
+static double
+run_fs(struct pipe_context *pipe, struct pipe_resource *target,
+       unsigned num_alu, unsigned iterations)
+{
+   struct pipe_screen *screen = pipe->screen;
+   struct cso_context *cso = cso_create_context(pipe, 0);
+
+   struct pipe_surface surf_tmpl = {
+      .format = target->format,
+   };
+   struct pipe_framebuffer_state fb = {
+      .width = WIDTH,
+      .height = HEIGHT,
+      .nr_cbufs = 1,
+   };
+   fb.cbufs[0] = pipe->create_surface(pipe, target, &surf_tmpl);
+
+   struct pipe_blend_state blend = { 0 };
+   blend.rt[0].colormask = PIPE_MASK_RGBA;
+
+   struct pipe_depth_stencil_alpha_state dsa = { 0 };
+
+   struct pipe_rasterizer_state rast = {
+      .cull_face = PIPE_FACE_NONE,
+      .half_pixel_center = 1,
+      .bottom_edge_rule = 1,
+      .depth_clip_near = 1,
+      .depth_clip_far = 1,
+   };
+
+   struct pipe_viewport_state vp = {
+      .scale = { WIDTH / 2.0f, HEIGHT / 2.0f, 0.5f },
+      .translate = { WIDTH / 2.0f, HEIGHT / 2.0f, 0.5f },
+      .swizzle_x = PIPE_VIEWPORT_SWIZZLE_POSITIVE_X,
+      .swizzle_y = PIPE_VIEWPORT_SWIZZLE_POSITIVE_Y,
+      .swizzle_z = PIPE_VIEWPORT_SWIZZLE_POSITIVE_Z,
+      .swizzle_w = PIPE_VIEWPORT_SWIZZLE_POSITIVE_W,
+   };
+
+   /* position, generic[0] */
+   static const float verts[6][2][4] = {
+      { { -1, -1, 0, 1 }, { 0, 0, 0, 1 } },
+      { {  1, -1, 0, 1 }, { 1, 0, 0, 1 } },
+      { { -1,  1, 0, 1 }, { 0, 1, 0, 1 } },
+      { {  1, -1, 0, 1 }, { 1, 0, 0, 1 } },
+      { {  1,  1, 0, 1 }, { 1, 1, 0, 1 } },
+      { { -1,  1, 0, 1 }, { 0, 1, 0, 1 } },
+   };
+
+   struct cso_velems_state velem = { .count = 2 };
+   velem.velems[0].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+   velem.velems[1].src_offset = 4 * sizeof(float);
+   velem.velems[1].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+
+   struct pipe_resource *vbuf =
+      pipe_buffer_create_with_data(pipe, PIPE_BIND_VERTEX_BUFFER,
+                                   PIPE_USAGE_DEFAULT, sizeof(verts), verts);
+   struct pipe_vertex_buffer vb = {
+      .stride = sizeof(verts[0]),
+      .buffer.resource = vbuf,
+   };
+
+   const enum tgsi_semantic semantic_names[] = { TGSI_SEMANTIC_POSITION,
+                                                 TGSI_SEMANTIC_GENERIC };
+   const uint semantic_indexes[] = { 0, 0 };
+   void *vs = util_make_vertex_passthrough_shader(pipe, 2, semantic_names,
+                                                  semantic_indexes, false);
+   void *fs = create_fs(pipe, num_alu);
+   if (!vs || !fs) {
+      fprintf(stderr, "failed to create shaders\n");
+      exit(EXIT_FAILURE);
+   }
+
+   cso_set_framebuffer(cso, &fb);
+   cso_set_blend(cso, &blend);
+   cso_set_depth_stencil_alpha(cso, &dsa);
+   cso_set_rasterizer(cso, &rast);
+   cso_set_viewport(cso, &vp);
+   cso_set_vertex_shader_handle(cso, vs);
+   cso_set_fragment_shader_handle(cso, fs);
+   cso_set_vertex_elements(cso, &velem);
+   cso_set_vertex_buffers(cso, 0, 1, 0, false, &vb);
+
+   /* Warm up: compiles the shader variants. */
+   util_draw_arrays(pipe, PIPE_PRIM_TRIANGLES, 0, 6);
+   pipe->flush(pipe, NULL, 0);
+
+   struct pipe_fence_handle *fence = NULL;
+   int64_t start = os_time_get_nano();
+
+   for (unsigned i = 0; i < iterations; i++)
+      util_draw_arrays(pipe, PIPE_PRIM_TRIANGLES, 0, 6);
+
+   pipe->flush(pipe, &fence, 0);
+   screen->fence_finish(screen, NULL, fence, PIPE_TIMEOUT_INFINITE);
+   screen->fence_reference(screen, &fence, NULL);
+
+   double secs = (os_time_get_nano() - start) / 1e9;
+
+   cso_destroy_context(cso);
+   pipe->delete_vs_state(pipe, vs);
+   pipe->delete_fs_state(pipe, fs);
+   pipe_surface_reference(&fb.cbufs[0], NULL);
+   pipe_resource_reference(&vbuf, NULL);
+
+   return (double)WIDTH * HEIGHT * iterations / secs / 1e6;
+}
+
+/* Returns Minvocations/s. */
+static double
+run_cs(struct pipe_context *pipe, unsigned num_alu, unsigned iterations)
+{
+   struct pipe_resource *ssbo =
+      pipe_buffer_create(pipe->screen, PIPE_BIND_SHADER_BUFFER,
+                         PIPE_USAGE_DEFAULT, CS_INVOCATIONS * sizeof(float));
+   struct pipe_shader_buffer sb = {
+      .buffer = ssbo,
+      .buffer_size = CS_INVOCATIONS * sizeof(float),
+   };
+   struct pipe_grid_info info = {
+      .work_dim = 1,
+      .block = { CS_BLOCK, 1, 1 },
+      .grid = { CS_INVOCATIONS / CS_BLOCK, 1, 1 },
+   };
+
+   void *cs = create_cs(pipe, num_alu);
+   if (!cs) {
+      fprintf(stderr, "failed to create compute shader\n");
+      exit(EXIT_FAILURE);
+   }
+
+   pipe->bind_compute_state(pipe, cs);
+   pipe->set_shader_buffers(pipe, PIPE_SHADER_COMPUTE, 0, 1, &sb, 0x1);
+
+   /* Warm up: compiles the shader variant. */
+   pipe->launch_grid(pipe, &info);
+
+   int64_t start = os_time_get_nano();
+
+   for (unsigned i = 0; i < iterations; i++)
+      pipe->launch_grid(pipe, &info);
+
+   pipe->flush(pipe, NULL, 0);
+   pipe_buffer_read(pipe, ssbo, 0, sizeof(float), &(float){ 0 });
+
+   double secs = (os_time_get_nano() - start) / 1e9;
+
+   pipe->set_shader_buffers(pipe, PIPE_SHADER_COMPUTE, 0, 1, NULL, 0);
+   pipe->bind_compute_state(pipe, NULL);
+   pipe->delete_compute_state(pipe, cs);
+   pipe_resource_reference(&ssbo, NULL);
+
+   return (double)CS_INVOCATIONS * iterations / secs / 1e6;
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned num_alu = argc > 1 ? atoi(argv[1]) : 64;
+   unsigned iterations = argc > 2 ? atoi(argv[2]) : 20;
+
+   glsl_type_singleton_init_or_ref();
+
+   struct pipe_screen *screen = llvmpipe_create_screen(null_sw_create());
+   if (!screen)
+      return EXIT_FAILURE;
+
+   struct pipe_resource tmpl = {
+      .target = PIPE_TEXTURE_2D,
+      .format = PIPE_FORMAT_B8G8R8A8_UNORM,
+      .width0 = WIDTH,
+      .height0 = HEIGHT,
+      .depth0 = 1,
+      .array_size = 1,
+      .bind = PIPE_BIND_RENDER_TARGET,
+   };
+   struct pipe_resource *target = screen->resource_create(screen, &tmpl);
+   if (!target)
+      return EXIT_FAILURE;
+
+   const unsigned default_width = lp_native_vector_width;
+   const unsigned max_width = util_get_cpu_caps()->max_vector_bits;
+
+   printf("%u ALU instructions per shader, default width %u bits\n",
+          num_alu, default_width);
+   printf("%-8s %14s %8s %18s %8s\n", "bits", "FS Mpixels/s", "vs 256",
+          "CS Minvocations/s", "vs 256");
+
+   double fs[3] = { 0 }, cs[3] = { 0 };
+   unsigned num_widths = 0;
+   for (unsigned width = 128; width <= max_width && num_widths < 3;
+        width *= 2, num_widths++) {
+      lp_native_vector_width = width;
+
+      struct pipe_context *pipe = screen->context_create(screen, NULL, 0);
+      if (!pipe)
+         return EXIT_FAILURE;
+
+      fs[num_widths] = run_fs(pipe, target, num_alu, iterations);
+      cs[num_widths] = run_cs(pipe, num_alu, iterations);
+
+      pipe->destroy(pipe);
+   }
+
+   /* Relative to 256 bits, the index 1 entry. */
+   for (unsigned i = 0; i < num_widths; i++) {
+      printf("%-8u %14.1f %7.2fx %18.1f %7.2fx\n", 128 << i,
+             fs[i], num_widths > 1 ? fs[i] / fs[1] : 0.0,
+             cs[i], num_widths > 1 ? cs[i] / cs[1] : 0.0);
+   }
+
+   lp_native_vector_width = default_width;
+
+   pipe_resource_reference(&target, NULL);
+   screen->destroy(screen);
+   glsl_type_singleton_decref();
+
+   return EXIT_SUCCESS;
+}
@@ -447,6 +447,17 @@ lp_build_occlusion_count(struct gallivm_state *gallivm,
                                        LLVMInt32TypeInContext(context), bits);
       count = LLVMBuildZExt(builder, count, LLVMIntTypeInContext(context, 64), "");
    }
+   else if (util_get_cpu_caps()->has_avx512f && type.length == 16) {
+      /* Compare into a mask register, then kmov + popcnt. */
+      LLVMTypeRef i16t = LLVMInt16TypeInContext(context);
+      LLVMValueRef bits = LLVMBuildBitCast(builder, maskvalue,
+                                           lp_build_int_vec_type(gallivm, type), "");
+      bits = LLVMBuildICmp(builder, LLVMIntNE, bits,
+                           LLVMConstNull(LLVMTypeOf(bits)), "");
+      bits = LLVMBuildBitCast(builder, bits, i16t, "");
+      count = lp_build_intrinsic_unary(builder, "llvm.ctpop.i16", i16t, bits);
+      count = LLVMBuildZExt(builder, count, LLVMIntTypeInContext(context, 64), "");
+   }
    else if (util_get_cpu_caps()->has_avx && type.length == 8) {
       const char *movmskintr = "llvm.x86.avx.movmsk.ps.256";
       const char *popcntintr = "llvm.ctpop.i32";
@@ -549,6 +560,30 @@ lp_build_depth_stencil_load_swizzled(struct gallivm_state *gallivm,
 
    LLVMTypeRef zs_dst_type = lp_build_vec_type(gallivm, zs_load_type);
 
+   if (z_src_type.length == 16) {
+      /* The whole 4x4 block, loaded as two 8-wide halves (rows 0-1 and
+       * rows 2-3), which is also the order of the quads in the vector.
+       */
+      struct lp_type half_type = z_src_type;
+      LLVMValueRef z_half[2], s_half[2];
+
+      half_type.length = 8;
+      for (unsigned i = 0; i < (is_1d ? 1 : 2); i++) {
+         lp_build_depth_stencil_load_swizzled(gallivm, half_type, format_desc,
+                                              is_1d, depth_ptr, depth_stride,
+                                              &z_half[i], &s_half[i],
+                                              lp_build_const_int32(gallivm, i));
+      }
+      /* 1D resources have a single row, don't load past it */
+      if (is_1d) {
+         z_half[1] = LLVMGetUndef(LLVMTypeOf(z_half[0]));
+         s_half[1] = LLVMGetUndef(LLVMTypeOf(s_half[0]));
+      }
+      *z_fb = lp_build_concat(gallivm, z_half, half_type, 2);
+      *s_fb = lp_build_concat(gallivm, s_half, half_type, 2);
+      return;
+   }
+
    if (z_src_type.length == 4) {
       LLVMValueRef looplsb = LLVMBuildAnd(builder, loop_counter,
                                           lp_build_const_int32(gallivm, 1), "");
@@ -648,6 +683,15 @@ lp_build_depth_stencil_load_swizzled(struct gallivm_state *gallivm,
 }
 
 
+static LLVMValueRef
+extract_half(struct gallivm_state *gallivm, LLVMValueRef v, unsigned half)
+{
+   if (!v)
+      return NULL;
+   return lp_build_extract_range(gallivm, v, half * 8, 8);
+}
+
+
 /**
  * Store depth/stencil values.
  * Incoming values are swizzled (typically n 2x2 quads), stored linear.
@@ -691,6 +735,25 @@ lp_build_depth_stencil_write_swizzled(struct gallivm_state *gallivm,
    struct lp_type z_type = zs_type;
    struct lp_type zs_load_type = zs_type;
 
+   if (z_src_type.length == 16) {
+      /* Two 8-wide halves, see lp_build_depth_stencil_load_swizzled(). */
+      struct lp_type half_type = z_src_type;
+
+      half_type.length = 8;
+      for (unsigned i = 0; i < (is_1d ? 1 : 2); i++) {
+         lp_build_depth_stencil_write_swizzled(gallivm, half_type, format_desc,
+                                               is_1d,
+                                               extract_half(gallivm, mask_value, i),
+                                               extract_half(gallivm, z_fb, i),
+                                               extract_half(gallivm, s_fb, i),
+                                               lp_build_const_int32(gallivm, i),
+                                               depth_ptr, depth_stride,
+                                               extract_half(gallivm, z_value, i),
+                                               extract_half(gallivm, s_value, i));
+      }
+      return;
+   }
+
    zs_load_type.length = zs_load_type.length / 2;
    load_ptr_type = LLVMPointerType(lp_build_vec_type(gallivm, zs_load_type), 0);
 
@@ -58,6 +58,8 @@ llvmpipe_clear(struct pipe_context *pipe,
    if (!llvmpipe_check_render_cond(llvmpipe))
       return;
 
+   llvmpipe_cs_wait(llvmpipe);
+
    llvmpipe_update_derived_clear(llvmpipe);
 
    if (LP_PERF & PERF_NO_DEPTH)
@@ -62,6 +62,7 @@ llvmpipe_destroy(struct pipe_context *pipe)
    lp_print_counters();
 
    if (llvmpipe->csctx) {
+      llvmpipe_cs_wait(llvmpipe);
       lp_csctx_destroy(llvmpipe->csctx);
    }
    if (llvmpipe->blitter) {
@@ -28,14 +28,71 @@
  * based on threadpool.c but modified heavily to be compute shader tuned.
  */
 
+#include "util/u_atomic.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_debug.h"
 #include "util/u_thread.h"
 #include "util/u_memory.h"
 #include "lp_cs_tpool.h"
 
+/* Number of chunks a thread's range is split into.  More chunks balance
+ * uneven iterations better, fewer mean less atomics.
+ */
+#define LP_CS_TPOOL_CHUNKS_PER_RANGE 4
+
+/* Takes the next chunk of a range, returns false if it is used up. */
+static inline bool
+lp_cs_tpool_claim(struct lp_cs_tpool_task *task,
+                  struct lp_cs_tpool_range *range,
+                  unsigned *first, unsigned *count)
+{
+   if (p_atomic_read(&range->next) >= range->end)
+      return false;
+
+   unsigned next = p_atomic_fetch_add(&range->next, task->iter_chunk);
+   if (next >= range->end)
+      return false;
+
+   *first = next;
+   *count = MIN2(task->iter_chunk, range->end - next);
+   return true;
+}
+
+/* Runs chunks from the thread's own range, then from the other ranges,
+ * starting with those of the next threads, until nothing is left.
+ */
+static void
+lp_cs_tpool_run(struct lp_cs_tpool_task *task, unsigned index,
+                struct lp_cs_local_mem *lmem)
+{
+   for (unsigned r = 0; r < task->num_ranges; r++) {
+      struct lp_cs_tpool_range *range =
+         &task->ranges[(index + r) % task->num_ranges];
+      unsigned first, count;
+
+      while (lp_cs_tpool_claim(task, range, &first, &count)) {
+         for (unsigned i = 0; i < count; i++)
+            task->work(task->data, first + i, lmem);
+         p_atomic_add(&task->iter_finished, count);
+      }
+   }
+}
+
+/* Called with the pool mutex held. */
+static inline void
+lp_cs_tpool_dequeue(struct lp_cs_tpool_task *task)
+{
+   if (task->queued) {
+      list_del(&task->list);
+      task->queued = false;
+   }
+}
+
 static int
 lp_cs_tpool_worker(void *data)
 {
-   struct lp_cs_tpool *pool = data;
+   struct lp_cs_tpool_thread *thread = data;
+   struct lp_cs_tpool *pool = thread->pool;
    struct lp_cs_local_mem lmem;
 
    memset(&lmem, 0, sizeof(lmem));
@@ -43,7 +100,6 @@ lp_cs_tpool_worker(void *data)
 
    while (!pool->shutdown) {
       struct lp_cs_tpool_task *task;
-      unsigned iter_per_thread;
 
       while (list_is_empty(&pool->workqueue) && !pool->shutdown)
          cnd_wait(&pool->new_work, &pool->m);
@@ -53,29 +109,19 @@ lp_cs_tpool_worker(void *data)
 
       task = list_first_entry(&pool->workqueue, struct lp_cs_tpool_task,
                               list);
-
-      unsigned this_iter = task->iter_start;
-
-      iter_per_thread = task->iter_per_thread;
-
-      if (task->iter_remainder &&
-          task->iter_start + task->iter_remainder == task->iter_total) {
-         task->iter_remainder--;
-         iter_per_thread = 1;
-      }
-
-      task->iter_start += iter_per_thread;
-
-      if (task->iter_start == task->iter_total)
-         list_del(&task->list);
-
+      task->active++;
       mtx_unlock(&pool->m);
-      for (unsigned i = 0; i < iter_per_thread; i++)
-         task->work(task->data, this_iter + i, &lmem);
 
+      lp_cs_tpool_run(task, thread->index, &lmem);
+
+      /* Everything is claimed, so the next queued task can start while the
+       * other threads finish their last chunks of this one.
+       */
       mtx_lock(&pool->m);
-      task->iter_finished += iter_per_thread;
-      if (task->iter_finished == task->iter_total)
+      lp_cs_tpool_dequeue(task);
+      task->active--;
+      if (task->active == 0 &&
+          p_atomic_read(&task->iter_finished) == task->iter_total)
          cnd_broadcast(&task->finish);
    }
    mtx_unlock(&pool->m);
@@ -83,6 +129,28 @@ lp_cs_tpool_worker(void *data)
    return 0;
 }
 
+/* With LP_CS_AFFINITY set, keep each worker on the CPUs of one L3 cache,
+ * with neighbouring workers sharing a cache, so the first ranges a thread
+ * steals from belong to a thread on the same cache.
+ */
+static void
+lp_cs_tpool_set_affinity(struct lp_cs_tpool *pool)
+{
+   const struct util_cpu_caps_t *caps = util_get_cpu_caps();
+
+   if (!debug_get_bool_option("LP_CS_AFFINITY", false) ||
+       caps->num_L3_caches < 2 || !pool->num_threads)
+      return;
+
+   for (unsigned i = 0; i < pool->num_threads; i++) {
+      unsigned L3 = i * caps->num_L3_caches / pool->num_threads;
+
+      util_set_thread_affinity(pool->threads[i],
+                               caps->L3_affinity_mask[L3], NULL,
+                               caps->num_cpu_mask_bits);
+   }
+}
+
 struct lp_cs_tpool *
 lp_cs_tpool_create(unsigned num_threads)
 {
@@ -97,12 +165,16 @@ lp_cs_tpool_create(unsigned num_threads)
    list_inithead(&pool->workqueue);
    assert (num_threads <= LP_MAX_THREADS);
    for (unsigned i = 0; i < num_threads; i++) {
-      if (thrd_success != u_thread_create(pool->threads + i, lp_cs_tpool_worker, pool)) {
+      pool->thread_data[i].pool = pool;
+      pool->thread_data[i].index = i;
+      if (thrd_success != u_thread_create(pool->threads + i, lp_cs_tpool_worker,
+                                          &pool->thread_data[i])) {
          num_threads = i;  /* previous thread is max */
          break;
       }
    }
    pool->num_threads = num_threads;
+   lp_cs_tpool_set_affinity(pool);
    return pool;
 }
 
@@ -142,7 +214,11 @@ lp_cs_tpool_queue_task(struct lp_cs_tpool *pool,
       FREE(lmem.local_mem_ptr);
       return NULL;
    }
-   task = CALLOC_STRUCT(lp_cs_tpool_task);
+
+   const unsigned num_ranges = pool->num_threads + 1;
+   task = align_calloc(sizeof(*task) +
+                       num_ranges * sizeof(struct lp_cs_tpool_range),
+                       CACHE_LINE_SIZE);
    if (!task) {
       return NULL;
    }
@@ -150,17 +226,28 @@ lp_cs_tpool_queue_task(struct lp_cs_tpool *pool,
    task->work = work;
    task->data = data;
    task->iter_total = num_iters;
+   task->num_ranges = num_ranges;
+   task->iter_chunk = MAX2(num_iters / (num_ranges * LP_CS_TPOOL_CHUNKS_PER_RANGE), 1);
 
-   task->iter_per_thread = num_iters / pool->num_threads;
-   task->iter_remainder = num_iters % pool->num_threads;
+   for (unsigned r = 0; r < num_ranges; r++) {
+      task->ranges[r].next = (uint64_t)num_iters * r / num_ranges;
+      task->ranges[r].end = (uint64_t)num_iters * (r + 1) / num_ranges;
+   }
 
    cnd_init(&task->finish);
 
    mtx_lock(&pool->m);
 
    list_addtail(&task->list, &pool->workqueue);
-
-   cnd_broadcast(&pool->new_work);
+   task->queued = true;
+
+   /* Small tasks don't need every thread woken. */
+   if (num_iters >= pool->num_threads) {
+      cnd_broadcast(&pool->new_work);
+   } else {
+      for (unsigned i = 0; i < num_iters; i++)
+         cnd_signal(&pool->new_work);
+   }
    mtx_unlock(&pool->m);
    return task;
 }
@@ -174,12 +261,23 @@ lp_cs_tpool_wait_for_task(struct lp_cs_tpool *pool,
    if (!pool || !task)
       return;
 
+   /* Help out rather than sleep, small tasks are often done before any
+    * worker has woken up.
+    */
+   struct lp_cs_local_mem lmem;
+
+   memset(&lmem, 0, sizeof(lmem));
+   lp_cs_tpool_run(task, task->num_ranges - 1, &lmem);
+   FREE(lmem.local_mem_ptr);
+
    mtx_lock(&pool->m);
-   while (task->iter_finished < task->iter_total)
+   lp_cs_tpool_dequeue(task);
+   while (task->active ||
+          p_atomic_read(&task->iter_finished) < task->iter_total)
       cnd_wait(&task->finish, &pool->m);
    mtx_unlock(&pool->m);
 
    cnd_destroy(&task->finish);
-   FREE(task);
+   align_free(task);
    *task_handle = NULL;
 }
@@ -30,22 +30,37 @@
  * structs with just unique indexes in them.
  * It also supports a local memory support struct to be passed from
  * outside the thread exec function.
+ *
+ * The iterations are split into per-thread ranges when the task is
+ * queued.  Threads take chunks of iterations from their own range with an
+ * atomic add and then steal chunks from the ranges of the other threads,
+ * so the pool mutex is only taken when a thread picks up or leaves a task.
+ * The thread waiting for a task works on it too.
  */
 #ifndef LP_CS_QUEUE
 #define LP_CS_QUEUE
 
 #include "pipe/p_compiler.h"
 
+#include "util/u_memory.h"
 #include "util/u_thread.h"
 #include "util/list.h"
 
 #include "lp_limits.h"
 
+struct lp_cs_tpool;
+
+struct lp_cs_tpool_thread {
+   struct lp_cs_tpool *pool;
+   unsigned index;
+};
+
 struct lp_cs_tpool {
    mtx_t m;
    cnd_t new_work;
 
    thrd_t threads[LP_MAX_THREADS];
+   struct lp_cs_tpool_thread thread_data[LP_MAX_THREADS];
    unsigned num_threads;
    struct list_head workqueue;
    bool shutdown;
@@ -58,18 +73,32 @@ struct lp_cs_local_mem {
 
 typedef void (*lp_cs_tpool_task_func)(void *data, int iter_idx, struct lp_cs_local_mem *lmem);
 
+/* The iterations a thread starts with.  Other threads steal chunks from
+ * the front of it once their own range is used up, so next may run past
+ * end.  Each range sits in its own cache line.
+ */
+struct lp_cs_tpool_range {
+   EXCLUSIVE_CACHELINE(struct {
+      unsigned next;
+      unsigned end;
+   });
+};
+
 struct lp_cs_tpool_task {
    lp_cs_tpool_task_func work;
    void *data;
    struct list_head list;
    cnd_t finish;
+   bool queued;
+   unsigned active;
    unsigned iter_total;
-   unsigned iter_start;
-   unsigned iter_finished;
-   unsigned iter_per_thread;
-   unsigned iter_remainder;
-};
+   unsigned iter_chunk;
+   EXCLUSIVE_CACHELINE(unsigned iter_finished);
 
+   /* One per worker thread plus one for the thread waiting on the task. */
+   unsigned num_ranges;
+   struct lp_cs_tpool_range ranges[];
+};
 struct lp_cs_tpool *lp_cs_tpool_create(unsigned num_threads);
 void lp_cs_tpool_destroy(struct lp_cs_tpool *);
 
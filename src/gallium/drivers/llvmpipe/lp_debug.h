@@ -46,12 +46,13 @@
 #define DEBUG_FS            0x8000
 #define DEBUG_CS            0x10000
 #define DEBUG_TGSI_IR       0x20000
-// unused                   0x40000
+#define DEBUG_TIMELINE      0x40000
 #define DEBUG_NO_FASTPATH   0x80000
 #define DEBUG_LINEAR        0x100000
 #define DEBUG_LINEAR2       0x200000
 #define DEBUG_SHOW_DEPTH    0x400000
 #define DEBUG_ACCURATE_A0   0x800000 /* verbose */
+#define DEBUG_SHARED_TEX    0x1000000 /* sample via shared functions */
 
 /* Performance flags.  These are active even on release builds.
  */
@@ -65,6 +66,8 @@
 #define PERF_NO_ALPHATEST   0x80  	/* disable alpha testing */
 #define PERF_NO_RAST_LINEAR 0x100  	/* disable linear rast */
 #define PERF_NO_SHADE       0x200  	/* disable fragment shaders */
+#define PERF_NO_BIN_ORDER   0x400  	/* rasterize bins in raster order */
+#define PERF_NO_HIZ         0x800  	/* disable hierarchical Z culling */
 
 
 extern int LP_PERF;
@@ -68,6 +68,8 @@ llvmpipe_draw_vbo(struct pipe_context *pipe, const struct pipe_draw_info *info,
    if (!llvmpipe_check_render_cond(lp))
       return;
 
+   llvmpipe_cs_wait(lp);
+
    if (indirect && indirect->buffer) {
       util_draw_indirect(pipe, info, indirect);
       return;
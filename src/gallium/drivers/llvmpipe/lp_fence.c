@@ -30,6 +30,7 @@
 #include "util/u_memory.h"
 #include "lp_debug.h"
 #include "lp_fence.h"
+#include "lp_timeline.h"
 
 
 #include "util/timespec.h"
@@ -121,12 +122,14 @@ lp_fence_wait(struct lp_fence *f)
    if (LP_DEBUG & DEBUG_FENCE)
       debug_printf("%s %d\n", __func__, f->id);
 
+   int64_t timeline_start = lp_timeline_begin();
    mtx_lock(&f->mutex);
    assert(f->issued);
    while (f->count < f->rank) {
       cnd_wait(&f->signalled, &f->mutex);
    }
    mtx_unlock(&f->mutex);
+   lp_timeline_end(LP_TIMELINE_FENCE_WAIT, timeline_start, f->id, 0, 0);
 }
 
 
@@ -142,6 +145,7 @@ lp_fence_timedwait(struct lp_fence *f, uint64_t timeout)
    if (LP_DEBUG & DEBUG_FENCE)
       debug_printf("%s %d\n", __func__, f->id);
 
+   int64_t timeline_start = lp_timeline_begin();
    mtx_lock(&f->mutex);
    assert(f->issued);
    while (f->count < f->rank) {
@@ -156,6 +160,9 @@ lp_fence_timedwait(struct lp_fence *f, uint64_t timeout)
 
    const boolean result = (f->count >= f->rank);
    mtx_unlock(&f->mutex);
+   /* Zero timeouts are polls, not waits. */
+   if (timeout)
+      lp_timeline_end(LP_TIMELINE_FENCE_WAIT, timeline_start, f->id, 0, 0);
 
    return result;
 }
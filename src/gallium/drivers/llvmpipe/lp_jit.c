@@ -140,6 +140,42 @@ create_jit_sampler_type(struct gallivm_state *gallivm)
    return sampler_type;
 }
 
+/**
+ * Create the type of struct lp_jit_sample_context, and optionally return
+ * the types of the structures it points to.
+ */
+LLVMTypeRef
+lp_jit_create_sample_context_type(struct gallivm_state *gallivm,
+                                  LLVMTypeRef *texture_type,
+                                  LLVMTypeRef *sampler_type)
+{
+   LLVMTypeRef tex_type = create_jit_texture_type(gallivm);
+   LLVMTypeRef samp_type = create_jit_sampler_type(gallivm);
+   LLVMTypeRef elem_types[LP_JIT_SAMPLE_CTX_COUNT];
+   LLVMTypeRef context_type;
+
+   elem_types[LP_JIT_SAMPLE_CTX_TEXTURE] = LLVMPointerType(tex_type, 0);
+   elem_types[LP_JIT_SAMPLE_CTX_SAMPLER] = LLVMPointerType(samp_type, 0);
+
+   context_type = LLVMStructTypeInContext(gallivm->context, elem_types,
+                                          ARRAY_SIZE(elem_types), 0);
+
+   LP_CHECK_MEMBER_OFFSET(struct lp_jit_sample_context, texture,
+                          gallivm->target, context_type,
+                          LP_JIT_SAMPLE_CTX_TEXTURE);
+   LP_CHECK_MEMBER_OFFSET(struct lp_jit_sample_context, sampler,
+                          gallivm->target, context_type,
+                          LP_JIT_SAMPLE_CTX_SAMPLER);
+   LP_CHECK_STRUCT_SIZE(struct lp_jit_sample_context,
+                        gallivm->target, context_type);
+
+   if (texture_type)
+      *texture_type = tex_type;
+   if (sampler_type)
+      *sampler_type = samp_type;
+   return context_type;
+}
+
 static LLVMTypeRef
 create_jit_image_type(struct gallivm_state *gallivm)
 {
@@ -122,6 +122,27 @@ enum {
 };
 
 
+/**
+ * This structure is passed to the texture sampling functions shared
+ * between shaders (see lp_sample_func_cache_get()).
+ *
+ * It points straight at the descriptors, so those functions depend neither
+ * on the layout of the shader's context nor on the unit being sampled.
+ */
+struct lp_jit_sample_context
+{
+   const struct lp_jit_texture *texture;
+   const struct lp_jit_sampler *sampler;
+};
+
+
+enum {
+   LP_JIT_SAMPLE_CTX_TEXTURE = 0,
+   LP_JIT_SAMPLE_CTX_SAMPLER,
+   LP_JIT_SAMPLE_CTX_COUNT
+};
+
+
 enum {
    LP_JIT_VIEWPORT_MIN_DEPTH,
    LP_JIT_VIEWPORT_MAX_DEPTH,
@@ -512,5 +533,10 @@ lp_jit_init_types(struct lp_fragment_shader_variant *lp);
 void
 lp_jit_init_cs_types(struct lp_compute_shader_variant *lp);
 
+LLVMTypeRef
+lp_jit_create_sample_context_type(struct gallivm_state *gallivm,
+                                  LLVMTypeRef *texture_type,
+                                  LLVMTypeRef *sampler_type);
+
 
 #endif /* LP_JIT_H */
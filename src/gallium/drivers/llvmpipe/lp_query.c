@@ -41,6 +41,7 @@
 #include "lp_screen.h"
 #include "lp_state.h"
 #include "lp_rast.h"
+#include "lp_texture.h"
 
 
 static struct llvmpipe_query *
@@ -233,6 +234,10 @@ llvmpipe_get_query_result_resource(struct pipe_context *pipe,
    struct llvmpipe_resource *lpr = llvmpipe_resource(resource);
    bool unsignalled = false;
 
+   /* the result is written to the resource on the cpu */
+   if (llvmpipe_cs_is_resource_referenced(llvmpipe_context(pipe), resource))
+      llvmpipe_cs_wait(llvmpipe_context(pipe));
+
    if (pq->fence) {
       /* only have a fence if there was a scene */
       if (!lp_fence_signalled(pq->fence)) {
@@ -544,6 +549,10 @@ llvmpipe_check_render_cond(struct llvmpipe_context *lp)
    struct pipe_context *pipe = &lp->pipe;
 
    if (lp->render_cond_buffer) {
+      if (llvmpipe_cs_is_resource_referenced(lp, &lp->render_cond_buffer->base) &
+          LP_REFERENCED_FOR_WRITE)
+         llvmpipe_cs_wait(lp);
+
       uint32_t data = *(uint32_t *)((char *)lp->render_cond_buffer->data
                                     + lp->render_cond_offset);
       return (!data) == lp->render_cond_cond;
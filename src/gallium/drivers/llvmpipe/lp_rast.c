@@ -25,6 +25,7 @@
  *
  **************************************************************************/
 
+#include <inttypes.h>
 #include <limits.h>
 #include "util/u_memory.h"
 #include "util/u_math.h"
@@ -49,6 +50,7 @@
 #include "lp_scene.h"
 #include "lp_screen.h"
 #include "lp_tex_sample.h"
+#include "lp_timeline.h"
 
 #ifdef _WIN32
 #include <windows.h>
@@ -126,6 +128,19 @@ lp_rast_tile_begin(struct lp_rasterizer_task *task,
                          scene->zsbuf.stride * task->y +
                          scene->zsbuf.format_bytes * task->x;
    }
+
+   /* Nothing is known about the depth of the tile until it is cleared or
+    * drawn over.  Layered depth buffers are left alone, the bounds would
+    * have to be kept per layer.
+    */
+   task->hiz_enabled =
+      scene->fb.zsbuf &&
+      scene->fb_max_layer == 0 &&
+      util_format_has_depth(util_format_description(scene->fb.zsbuf->format)) &&
+      !(LP_PERF & PERF_NO_HIZ);
+   task->hiz_raising = FALSE;
+   if (task->hiz_enabled)
+      lp_rast_hiz_invalidate(task);
 }
 
 
@@ -286,6 +301,37 @@ lp_rast_clear_zstencil(struct lp_rasterizer_task *task,
          }
       }
    }
+
+   /* A clear of all depth bits gives every block an exact bound, unless
+    * the current state may raise it again.
+    */
+   if (task->hiz_enabled) {
+      const enum pipe_format format = scene->fb.zsbuf->format;
+      const uint64_t depth_mask64 = util_pack64_mask_z(format, 0xffffffff);
+
+      if ((clear_mask64 & depth_mask64) == depth_mask64 &&
+          !task->hiz_raising) {
+         const uint16_t value16 = (uint16_t) clear_value64;
+         const uint32_t value32 = (uint32_t) clear_value64;
+         float depth;
+
+         switch (util_format_get_blocksize(format)) {
+         case 2:
+            util_format_unpack_z_float(format, &depth, &value16, 1);
+            break;
+         case 4:
+            util_format_unpack_z_float(format, &depth, &value32, 1);
+            break;
+         default:
+            util_format_unpack_z_float(format, &depth, &clear_value64, 1);
+            break;
+         }
+         for (unsigned i = 0; i < LP_HIZ_BLOCKS; i++)
+            task->hiz_zmax[i] = depth + LP_HIZ_EPSILON;
+      } else if (clear_mask64 & depth_mask64) {
+         lp_rast_hiz_invalidate(task);
+      }
+   }
 }
 
 
@@ -317,6 +363,13 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
 
    const struct lp_fragment_shader_variant *variant = state->variant;
 
+   if (lp_rast_hiz_occluded(task, inputs, tile_x, tile_y,
+                            task->width, task->height,
+                            DIV_ROUND_UP(task->width, 4) *
+                            DIV_ROUND_UP(task->height, 4))) {
+      return;
+   }
+
    /* render the whole 64x64 tile in 4x4 chunks */
    for (unsigned y = 0; y < task->height; y += 4){
       for (unsigned x = 0; x < task->width; x += 4) {
@@ -377,6 +430,14 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
          END_JIT_CALL();
       }
    }
+
+   task->shaded_blocks += DIV_ROUND_UP(task->width, 4) *
+                          DIV_ROUND_UP(task->height, 4);
+
+   for (unsigned y = 0; y < task->height; y += LP_HIZ_BLOCK_SIZE) {
+      for (unsigned x = 0; x < task->width; x += LP_HIZ_BLOCK_SIZE)
+         lp_rast_hiz_update(task, inputs, tile_x + x, tile_y + y);
+   }
 }
 
 
@@ -464,6 +525,7 @@ lp_rast_shade_quads_mask_sample(struct lp_rasterizer_task *task,
       /* Propagate non-interpolated raster state. */
       task->thread_data.raster_state.viewport_index = inputs->viewport_index;
       task->thread_data.raster_state.view_index = inputs->view_index;
+      task->shaded_blocks++;
 
       /* run shader on 4x4 block */
       BEGIN_JIT_CALL(state, task);
@@ -683,6 +745,11 @@ lp_rast_set_state(struct lp_rasterizer_task *task,
                   const union lp_rast_cmd_arg arg)
 {
    task->state = arg.set_state;
+
+   /* Primitives that can raise depth values make the bounds useless. */
+   task->hiz_raising = task->state->variant->hiz_raise;
+   if (task->hiz_enabled && task->hiz_raising)
+      lp_rast_hiz_invalidate(task);
 }
 
 
@@ -985,6 +1052,7 @@ static void
 rasterize_bin(struct lp_rasterizer_task *task,
               const struct cmd_bin *bin, int x, int y)
 {
+   int64_t timeline_start = lp_timeline_begin();
    struct lp_bin_info info = lp_characterize_bin(bin);
 
    lp_rast_tile_begin(task, bin, x, y);
@@ -1003,6 +1071,13 @@ rasterize_bin(struct lp_rasterizer_task *task,
 
    lp_rast_tile_end(task);
 
+   if (lp_timeline_enabled()) {
+      unsigned num_cmds = 0;
+      for (const struct cmd_block *block = bin->head; block; block = block->next)
+         num_cmds += block->count;
+      lp_timeline_end(LP_TIMELINE_RASTERIZE_BIN, timeline_start, x, y, num_cmds);
+   }
+
 #ifdef DEBUG
    /* Debug/Perf flags:
     */
@@ -1018,20 +1093,6 @@ rasterize_bin(struct lp_rasterizer_task *task,
 }
 
 
-/* An empty bin is one that just loads the contents of the tile and
- * stores them again unchanged.  This typically happens when bins have
- * been flushed for some reason in the middle of a frame, or when
- * incremental updates are being made to a render target.
- *
- * Try to avoid doing pointless work in this case.
- */
-static boolean
-is_empty_bin(const struct cmd_bin *bin)
-{
-   return bin->head == NULL;
-}
-
-
 /**
  * Rasterize/execute all bins within a scene.
  * Called per thread.
@@ -1040,6 +1101,9 @@ static void
 rasterize_scene(struct lp_rasterizer_task *task,
                 struct lp_scene *scene)
 {
+   int64_t timeline_start = lp_timeline_begin();
+   unsigned num_bins = 0;
+
    task->scene = scene;
 
    /* Clear the cache tags. This should not always be necessary but
@@ -1059,13 +1123,23 @@ rasterize_scene(struct lp_rasterizer_task *task,
       struct cmd_bin *bin;
       int i, j;
 
+      /* Empty bins are never handed out; see lp_scene_bin_iter_begin(). */
       assert(scene);
       while ((bin = lp_scene_bin_iter_next(scene, &i, &j))) {
-         if (!is_empty_bin(bin))
+         if (LP_DEBUG & DEBUG_COUNTERS) {
+            int64_t start = os_time_get_nano();
             rasterize_bin(task, bin, i, j);
+            task->busy_ns += os_time_get_nano() - start;
+            task->num_bins++;
+         } else {
+            rasterize_bin(task, bin, i, j);
+         }
+         num_bins++;
       }
    }
 
+   lp_timeline_end(LP_TIMELINE_RASTERIZE_SCENE, timeline_start, num_bins, 0, 0);
+
 #if LP_BUILD_FORMAT_CACHE_DEBUG
    {
       uint64_t total, miss;
@@ -1164,6 +1238,7 @@ thread_function(void *init_data)
 
    snprintf(thread_name, sizeof thread_name, "llvmpipe-%u", task->thread_index);
    u_thread_setname(thread_name);
+   lp_timeline_set_thread_name(thread_name);
 
    /* Make sure that denorms are treated like zeros. This is
     * the behavior required by D3D10. OpenGL doesn't care.
@@ -1197,11 +1272,19 @@ thread_function(void *init_data)
       if (debug)
          debug_printf("thread %d doing work\n", task->thread_index);
 
+      int64_t start = 0, busy = task->busy_ns;
+      if (LP_DEBUG & DEBUG_COUNTERS)
+         start = os_time_get_nano();
+
       rasterize_scene(task, rast->curr_scene);
 
       /* wait for all threads to finish with this scene */
       util_barrier_wait(&rast->barrier);
 
+      /* Whatever wasn't spent on bins was spent waiting for the others. */
+      if (LP_DEBUG & DEBUG_COUNTERS)
+         task->idle_ns += os_time_get_nano() - start - (task->busy_ns - busy);
+
       /* XXX: shouldn't be necessary:
        */
       if (task->thread_index == 0) {
@@ -1306,6 +1389,29 @@ no_rast:
 void
 lp_rast_destroy(struct lp_rasterizer *rast)
 {
+   if (LP_DEBUG & DEBUG_COUNTERS) {
+      for (unsigned i = 0; i < MAX2(1, rast->num_threads); i++) {
+         const struct lp_rasterizer_task *task = &rast->tasks[i];
+         int64_t total_ns = task->busy_ns + task->idle_ns;
+
+         debug_printf("llvmpipe: thread %2u: %9u bins, busy %10.3f ms, "
+                      "idle %10.3f ms (%3.0f%% busy)\n",
+                      i, task->num_bins, task->busy_ns / 1000000.0,
+                      task->idle_ns / 1000000.0,
+                      total_ns ? 100.0 * task->busy_ns / total_ns : 0.0);
+      }
+
+      uint64_t shaded = 0, rejected = 0;
+      for (unsigned i = 0; i < MAX2(1, rast->num_threads); i++) {
+         shaded += rast->tasks[i].shaded_blocks;
+         rejected += rast->tasks[i].hiz_rejected_blocks;
+      }
+      debug_printf("llvmpipe: hiz: %" PRIu64 " of %" PRIu64 " 4x4 blocks "
+                   "rejected (%.1f%%)\n", rejected, shaded + rejected,
+                   shaded + rejected ? 100.0 * rejected / (shaded + rejected)
+                                     : 0.0);
+   }
+
    /* Set exit_flag and signal each thread's work_ready semaphore.
     * Each thread will be woken up, notice that the exit_flag is set and
     * break out of its main loop.  The thread will then exit.
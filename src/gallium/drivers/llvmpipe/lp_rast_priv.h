@@ -42,6 +42,14 @@
 #define TILE_VECTOR_HEIGHT 4
 #define TILE_VECTOR_WIDTH 4
 
+/** Hierarchical Z keeps a depth bound for each 16x16 block of a tile */
+#define LP_HIZ_BLOCK_SIZE 16
+#define LP_HIZ_BLOCKS_X (TILE_SIZE / LP_HIZ_BLOCK_SIZE)
+#define LP_HIZ_BLOCKS (LP_HIZ_BLOCKS_X * LP_HIZ_BLOCKS_X)
+
+/** Slack for depth values being rounded to the depth buffer format */
+#define LP_HIZ_EPSILON (1.0f / 16384.0f)
+
 /* If we crash in a jitted function, we can examine jit_line and jit_state
  * to get some info.  This is not thread-safe, however.
  */
@@ -100,6 +108,22 @@ struct lp_rasterizer_task
    /** Non-interpolated passthru state and occlude counter for visible pixels */
    struct lp_jit_thread_data thread_data;
 
+   /** LP_DEBUG=counters: bins rasterized, and time spent on them and
+    * waiting for the other threads to finish the scene.
+    */
+   unsigned num_bins;
+   int64_t busy_ns, idle_ns;
+
+   /** Hierarchical Z: upper bound of the depth values in each 16x16 block
+    * of the current tile, INFINITY when nothing is known.
+    */
+   float hiz_zmax[LP_HIZ_BLOCKS];
+   boolean hiz_enabled;
+   boolean hiz_raising;   /**< the current state may raise depth values */
+
+   /** LP_DEBUG=counters: 4x4 blocks shaded, and rejected by hierarchical Z */
+   uint64_t shaded_blocks, hiz_rejected_blocks;
+
    util_semaphore work_ready;
    util_semaphore work_done;
 };
@@ -215,6 +239,118 @@ lp_rast_get_depth_block_pointer(struct lp_rasterizer_task *task,
 }
 
 
+/**
+ * Forget the depth bounds of all blocks of the current tile.
+ */
+static inline void
+lp_rast_hiz_invalidate(struct lp_rasterizer_task *task)
+{
+   for (unsigned i = 0; i < LP_HIZ_BLOCKS; i++)
+      task->hiz_zmax[i] = INFINITY;
+}
+
+
+/**
+ * Range of the interpolated depth of a primitive over the w x h pixels at
+ * x, y (window coords), including all sample positions.
+ */
+static inline void
+lp_rast_hiz_depth_range(const struct lp_rast_shader_inputs *inputs,
+                        unsigned x, unsigned y, unsigned w, unsigned h,
+                        float *zmin, float *zmax)
+{
+   const float dzdx = GET_DADX(inputs)[0][2];
+   const float dzdy = GET_DADY(inputs)[0][2];
+   /* The polygon offset lives in the X component of a0, see lp_setup_tri.c */
+   const float z = GET_A0(inputs)[0][2] + GET_A0(inputs)[0][0] +
+                   dzdx * (float)x + dzdy * (float)y;
+   const float zx = dzdx * (float)w;
+   const float zy = dzdy * (float)h;
+
+   *zmin = z + MIN2(zx, 0.0f) + MIN2(zy, 0.0f);
+   *zmax = z + MAX2(zx, 0.0f) + MAX2(zy, 0.0f);
+}
+
+
+/**
+ * Check whether all pixels of the w x h region at x, y (window coords) of a
+ * primitive are known to fail the depth test against the depth bounds of the
+ * blocks the region touches, in which case they need not be shaded.
+ * \param num_blocks  number of 4x4 blocks the caller would have shaded
+ */
+static inline boolean
+lp_rast_hiz_occluded(struct lp_rasterizer_task *task,
+                     const struct lp_rast_shader_inputs *inputs,
+                     unsigned x, unsigned y, unsigned w, unsigned h,
+                     unsigned num_blocks)
+{
+   if (!task->hiz_enabled || !task->state->variant->hiz_test)
+      return FALSE;
+
+   /* Regions of the small triangle paths can reach past the tile, but those
+    * pixels are never shaded.
+    */
+   const unsigned bx0 = (x - task->x) / LP_HIZ_BLOCK_SIZE;
+   const unsigned by0 = (y - task->y) / LP_HIZ_BLOCK_SIZE;
+   const unsigned bx1 = MIN2((x - task->x + w - 1) / LP_HIZ_BLOCK_SIZE,
+                             LP_HIZ_BLOCKS_X - 1);
+   const unsigned by1 = MIN2((y - task->y + h - 1) / LP_HIZ_BLOCK_SIZE,
+                             LP_HIZ_BLOCKS_X - 1);
+   float bound = -INFINITY;
+
+   for (unsigned by = by0; by <= by1; by++) {
+      for (unsigned bx = bx0; bx <= bx1; bx++)
+         bound = MAX2(bound, task->hiz_zmax[by * LP_HIZ_BLOCKS_X + bx]);
+   }
+
+   if (bound == INFINITY)
+      return FALSE;
+
+   float zmin, zmax;
+   lp_rast_hiz_depth_range(inputs, x, y, w, h, &zmin, &zmax);
+
+   /* Depth may be clamped to 1.0.  The operand order keeps a NaN zmin, which
+    * then never compares as occluded.
+    */
+   zmin = MIN2(1.0f, zmin);
+   if (zmin > bound + LP_HIZ_EPSILON) {
+      task->hiz_rejected_blocks += num_blocks;
+      return TRUE;
+   }
+
+   return FALSE;
+}
+
+
+/**
+ * Lower the depth bound of the 16x16 block at x, y (window coords) after a
+ * primitive has been drawn over all of it: every pixel now holds either the
+ * primitive's depth or something smaller.
+ */
+static inline void
+lp_rast_hiz_update(struct lp_rasterizer_task *task,
+                   const struct lp_rast_shader_inputs *inputs,
+                   unsigned x, unsigned y)
+{
+   if (!task->hiz_enabled || !task->state->variant->hiz_update)
+      return;
+
+   float zmin, zmax;
+   lp_rast_hiz_depth_range(inputs, x, y,
+                           LP_HIZ_BLOCK_SIZE, LP_HIZ_BLOCK_SIZE,
+                           &zmin, &zmax);
+
+   /* Depth may be clamped to 0.0, NaN is kept as above. */
+   zmax = MAX2(0.0f, zmax) + LP_HIZ_EPSILON;
+
+   float *bound = &task->hiz_zmax[(y - task->y) / LP_HIZ_BLOCK_SIZE *
+                                  LP_HIZ_BLOCKS_X +
+                                  (x - task->x) / LP_HIZ_BLOCK_SIZE];
+   if (zmax < *bound)
+      *bound = zmax;
+}
+
+
 /**
  * Shade all pixels in a 4x4 block.  The fragment code omits the
  * triangle in/out tests.
@@ -267,6 +403,7 @@ lp_rast_shade_quads_all(struct lp_rasterizer_task *task,
       /* Propagate non-interpolated raster state. */
       task->thread_data.raster_state.viewport_index = inputs->viewport_index;
       task->thread_data.raster_state.view_index = inputs->view_index;
+      task->shaded_blocks++;
 
       /* run shader on 4x4 block */
       BEGIN_JIT_CALL(state, task);
@@ -392,6 +392,9 @@ lp_rast_triangle_32_3_16(struct lp_rasterizer_task *task,
       c = _mm_add_epi32(c, _mm_slli_epi32(dcdy, 2));
    }
 
+   if (lp_rast_hiz_occluded(task, &tri->inputs, x, y, 16, 16, nr))
+      return;
+
    for (unsigned i = 0; i < nr; i++)
       lp_rast_shade_quads_mask(task,
                                &tri->inputs,
@@ -473,7 +476,8 @@ lp_rast_triangle_32_3_4(struct lp_rasterizer_task *task,
 
       unsigned mask = _mm_movemask_epi8(c_0123);
 
-      if (mask != 0xffff)
+      if (mask != 0xffff &&
+          !lp_rast_hiz_occluded(task, &tri->inputs, x, y, 4, 4, 1))
          lp_rast_shade_quads_mask(task,
                                   &tri->inputs,
                                   x,
@@ -689,6 +693,9 @@ lp_rast_triangle_32_3_16(struct lp_rasterizer_task *task,
       c = vec_add_epi32(c, vec_slli_epi32(dcdy, 2));
    }
 
+   if (lp_rast_hiz_occluded(task, &tri->inputs, x, y, 16, 16, nr))
+      return;
+
    for (unsigned i = 0; i < nr; i++)
       lp_rast_shade_quads_mask(task,
                                &tri->inputs,
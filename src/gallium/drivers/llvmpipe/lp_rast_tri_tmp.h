@@ -148,6 +148,10 @@ TAG(do_block_16)(struct lp_rasterizer_task *task,
 
    LP_COUNT_ADD(nr_empty_4, util_bitcount(0xffff & ~(partial_mask | inmask)));
 
+   if (lp_rast_hiz_occluded(task, &tri->inputs, x, y, 16, 16,
+                            util_bitcount(partial_mask | inmask)))
+      return;
+
    /* Iterate over partials:
     */
    while (partial_mask) {
@@ -338,7 +342,11 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
       inmask &= ~(1 << i);
 
       LP_COUNT(nr_fully_covered_16);
+      if (lp_rast_hiz_occluded(task, &tri->inputs, px, py, 16, 16, 16))
+         continue;
+
       block_full_16(task, tri, px, py);
+      lp_rast_hiz_update(task, &tri->inputs, px, py);
    }
 }
 
@@ -400,6 +408,10 @@ TRI_16(struct lp_rasterizer_task *task,
     */
    unsigned partial_mask = 0xffff & ~outmask;
 
+   if (lp_rast_hiz_occluded(task, &tri->inputs, x, y, 16, 16,
+                            util_bitcount(partial_mask)))
+      return;
+
    /* Iterate over partials:
     */
    while (partial_mask) {
@@ -465,7 +477,7 @@ TRI_4(struct lp_rasterizer_task *task,
       mask &= ~_mm_movemask_epi8(result);
    }
 
-   if (mask)
+   if (mask && !lp_rast_hiz_occluded(task, &tri->inputs, x, y, 4, 4, 1))
       lp_rast_shade_quads_mask(task, &tri->inputs, x, y, mask);
 }
 #endif
@@ -26,6 +26,7 @@
  **************************************************************************/
 
 #include "util/u_framebuffer.h"
+#include "util/u_atomic.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/reallocarray.h"
@@ -73,8 +74,6 @@ lp_scene_create(struct lp_setup_context *setup)
    scene->setup = setup;
    scene->data.head = &scene->data.first;
 
-   (void) mtx_init(&scene->mutex, mtx_plain);
-
 #ifdef DEBUG
    /* Do some scene limit sanity checks here */
    {
@@ -101,8 +100,8 @@ void
 lp_scene_destroy(struct lp_scene *scene)
 {
    lp_scene_end_rasterization(scene);
-   mtx_destroy(&scene->mutex);
    free(scene->tiles);
+   free(scene->bin_order);
    assert(scene->data.head == &scene->data.first);
    slab_free_st(&scene->setup->scene_slab, scene);
 }
@@ -531,60 +530,89 @@ lp_scene_is_resource_referenced(const struct lp_scene *scene,
 }
 
 
-/** advance curr_x,y to the next bin */
-static boolean
-next_bin(struct lp_scene *scene)
+/**
+ * Estimated cost of rasterizing a bin.  Only the number of commands is
+ * counted; that is cheap and good enough to tell the heavy bins apart.
+ */
+static unsigned
+bin_cost(const struct cmd_bin *bin)
 {
-   scene->curr_x++;
-   if (scene->curr_x >= scene->tiles_x) {
-      scene->curr_x = 0;
-      scene->curr_y++;
-   }
-   if (scene->curr_y >= scene->tiles_y) {
-      /* no more bins */
-      return FALSE;
-   }
-   return TRUE;
+   unsigned count = 0;
+
+   for (const struct cmd_block *block = bin->head; block; block = block->next)
+      count += block->count;
+
+   return count;
 }
 
 
+/**
+ * Decide in which order the bins are handed out by lp_scene_bin_iter_next().
+ * Called by one thread before rasterization starts.
+ *
+ * Empty bins would only load and store their tile unchanged, so they are
+ * left out altogether.  The rest are sorted by the log2 of their cost, most
+ * expensive first, so that a few heavy bins don't end up running on their
+ * own at the end of the scene while the other threads sit idle.  Bins of
+ * similar cost stay in raster order.
+ */
 void
 lp_scene_bin_iter_begin(struct lp_scene *scene)
 {
-   scene->curr_x = scene->curr_y = -1;
+   unsigned num_bins = scene->tiles_x * scene->tiles_y;
+   unsigned bucket_start[32] = { 0 };
+   unsigned num_ordered = 0;
+
+   if (LP_PERF & PERF_NO_BIN_ORDER) {
+      for (unsigned i = 0; i < num_bins; i++) {
+         if (scene->tiles[i].head)
+            scene->bin_order[num_ordered++] = i;
+      }
+   } else {
+      /* Count the bins of each cost, then turn the counts into the start
+       * of each bucket, most expensive bucket first.
+       */
+      for (unsigned i = 0; i < num_bins; i++) {
+         if (scene->tiles[i].head)
+            bucket_start[util_logbase2(bin_cost(&scene->tiles[i]))]++;
+      }
+      for (int b = 31; b >= 0; b--) {
+         unsigned count = bucket_start[b];
+         bucket_start[b] = num_ordered;
+         num_ordered += count;
+      }
+
+      for (unsigned i = 0; i < num_bins; i++) {
+         if (scene->tiles[i].head) {
+            unsigned b = util_logbase2(bin_cost(&scene->tiles[i]));
+            scene->bin_order[bucket_start[b]++] = i;
+         }
+      }
+   }
+
+   scene->num_ordered_bins = num_ordered;
+   scene->curr_bin = 0;
 }
 
 
 /**
- * Return pointer to next bin to be rendered.
- * The lp_scene::curr_x and ::curr_y fields will be advanced.
+ * Return pointer to next bin to be rendered, or NULL when all bins have
+ * been handed out.
  * Multiple rendering threads will call this function to get a chunk
  * of work (a bin) to work on.
  */
 struct cmd_bin *
-lp_scene_bin_iter_next(struct lp_scene *scene , int *x, int *y)
+lp_scene_bin_iter_next(struct lp_scene *scene, int *x, int *y)
 {
-   struct cmd_bin *bin = NULL;
-
-   mtx_lock(&scene->mutex);
-
-   if (scene->curr_x < 0) {
-      /* first bin */
-      scene->curr_x = 0;
-      scene->curr_y = 0;
-   } else if (!next_bin(scene)) {
-      /* no more bins left */
-      goto end;
-   }
+   unsigned i = p_atomic_inc_return(&scene->curr_bin) - 1;
+   if (i >= scene->num_ordered_bins)
+      return NULL;
 
-   bin = lp_scene_get_bin(scene, scene->curr_x, scene->curr_y);
-   *x = scene->curr_x;
-   *y = scene->curr_y;
+   unsigned idx = scene->bin_order[i];
+   *x = idx % scene->tiles_x;
+   *y = idx / scene->tiles_x;
 
-end:
-   /*printf("return bin %p at %d, %d\n", (void *) bin, *bin_x, *bin_y);*/
-   mtx_unlock(&scene->mutex);
-   return bin;
+   return &scene->tiles[idx];
 }
 
 
@@ -605,7 +633,9 @@ lp_scene_begin_binning(struct lp_scene *scene,
    if (scene->num_alloced_tiles < num_required_tiles) {
       scene->tiles = reallocarray(scene->tiles, num_required_tiles,
                                   sizeof(struct cmd_bin));
-      if (!scene->tiles)
+      scene->bin_order = reallocarray(scene->bin_order, num_required_tiles,
+                                      sizeof(*scene->bin_order));
+      if (!scene->tiles || !scene->bin_order)
          return;
       memset(scene->tiles, 0, sizeof(struct cmd_bin) * num_required_tiles);
       scene->num_alloced_tiles = num_required_tiles;
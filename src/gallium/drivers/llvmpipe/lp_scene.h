@@ -195,11 +195,16 @@ struct lp_scene {
     */
    unsigned tiles_x, tiles_y;
 
-   int curr_x, curr_y;  /**< for iterating over bins */
-   mtx_t mutex;
+   /** When binning started, for LP_DEBUG=timeline */
+   int64_t timeline_start;
 
    unsigned num_alloced_tiles;
    struct cmd_bin *tiles;
+
+   /** Non-empty bins in the order they are rasterized, as tile indices */
+   unsigned *bin_order;
+   unsigned num_ordered_bins;
+   unsigned curr_bin;  /**< next entry of bin_order to hand out */
    struct data_block_list data;
 };
 
@@ -52,6 +52,8 @@
 #include "lp_limits.h"
 #include "lp_rast.h"
 #include "lp_cs_tpool.h"
+#include "lp_tex_sample.h"
+#include "lp_timeline.h"
 #include "lp_flush.h"
 
 #include "frontend/sw_winsys.h"
@@ -80,6 +82,8 @@ static const struct debug_named_value lp_debug_flags[] = {
    { "cs", DEBUG_CS, NULL },
    { "tgsi_ir", DEBUG_TGSI_IR, NULL },
    { "accurate_a0", DEBUG_ACCURATE_A0 },
+   { "timeline", DEBUG_TIMELINE, NULL },
+   { "shared_tex", DEBUG_SHARED_TEX, NULL },
    DEBUG_NAMED_VALUE_END
 };
 
@@ -95,6 +99,8 @@ static const struct debug_named_value lp_perf_flags[] = {
    { "no_alphatest",   PERF_NO_ALPHATEST, NULL },
    { "no_rast_linear", PERF_NO_RAST_LINEAR, NULL },
    { "no_shade",       PERF_NO_SHADE, NULL },
+   { "no_bin_order",   PERF_NO_BIN_ORDER, NULL },
+   { "no_hiz",         PERF_NO_HIZ, NULL },
    DEBUG_NAMED_VALUE_END
 };
 
@@ -867,6 +873,11 @@ llvmpipe_destroy_screen(struct pipe_screen *_screen)
    if (screen->rast)
       lp_rast_destroy(screen->rast);
 
+   /* The rasterizer threads are done, so their rings are complete. */
+   lp_timeline_write();
+
+   lp_sample_func_cache_destroy(screen->sample_funcs);
+
    lp_jit_screen_cleanup(screen);
 
    disk_cache_destroy(screen->disk_shader_cache);
@@ -1104,6 +1115,7 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    llvmpipe_init_screen_resource_funcs(&screen->base);
 
    screen->allow_cl = !!getenv("LP_CL");
+   screen->parallel_bin = debug_get_bool_option("LP_PARALLEL_BIN", false);
    screen->use_tgsi = (LP_DEBUG & DEBUG_TGSI_IR);
    screen->num_threads = util_get_cpu_caps()->nr_cpus > 1
       ? util_get_cpu_caps()->nr_cpus : 0;
@@ -1113,6 +1125,9 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
 
    lp_build_init(); /* get lp_native_vector_width initialised */
 
+   if (LP_DEBUG & DEBUG_SHARED_TEX)
+      screen->sample_funcs = lp_sample_func_cache_create();
+
    snprintf(screen->renderer_string, sizeof(screen->renderer_string),
             "llvmpipe (LLVM " MESA_LLVM_VERSION_STRING ", %u bits)",
             lp_native_vector_width );
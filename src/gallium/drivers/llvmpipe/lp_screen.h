@@ -64,6 +64,7 @@ struct llvmpipe_screen
 
    bool use_tgsi;
    bool allow_cl;
+   bool parallel_bin;
 
    mtx_t late_mutex;
    bool late_init_done;
@@ -74,6 +75,9 @@ struct llvmpipe_screen
    char renderer_string[100];
 
    struct disk_cache *disk_shader_cache;
+
+   /* Texture sampling functions shared between shaders, see LP_PERF */
+   struct lp_sample_func_cache *sample_funcs;
 };
 
 
@@ -55,6 +55,7 @@
 #include "lp_screen.h"
 #include "lp_state.h"
 #include "lp_jit.h"
+#include "lp_timeline.h"
 #include "frontend/sw_winsys.h"
 
 #include "draw/draw_context.h"
@@ -208,10 +209,15 @@ lp_setup_rasterize_scene(struct lp_setup_context *setup)
           scene->num_active_queries * sizeof(scene->active_queries[0]));
 
    lp_scene_end_binning(scene);
+   lp_timeline_end(LP_TIMELINE_BIN_SCENE, scene->timeline_start,
+                   scene->tiles_x, scene->tiles_y, 0);
 
+   int64_t timeline_start = lp_timeline_begin();
+   const unsigned fence_id = scene->fence->id;
    mtx_lock(&screen->rast_mutex);
    lp_rast_queue_scene(screen->rast, scene);
    mtx_unlock(&screen->rast_mutex);
+   lp_timeline_end(LP_TIMELINE_QUEUE_SCENE, timeline_start, fence_id, 0, 0);
 
    lp_setup_reset(setup);
 
@@ -227,6 +233,8 @@ begin_binning(struct lp_setup_context *setup)
    assert(scene);
    assert(scene->fence == NULL);
 
+   scene->timeline_start = lp_timeline_begin();
+
    /* Always create a fence:
     */
    scene->fence = lp_fence_create(MAX2(1, setup->num_threads));
@@ -84,6 +84,10 @@ struct lp_setup_context
    uint vertex_buffer_size;
    void *vertex_buffer;
 
+   /** Triangles set up by worker threads, see lp_setup_parallel_triangles() */
+   uint8_t *tri_slots;
+   size_t tri_slots_size;
+
    /* Final pipeline stage for draw module.  Draw module should
     * create/install this itself now.
     */
@@ -286,6 +290,13 @@ struct lp_rast_rectangle *
 lp_setup_alloc_rectangle(struct lp_scene *scene,
                          unsigned nr_inputs);
 
+boolean
+lp_setup_parallel_triangles(struct lp_setup_context *setup,
+                            const void *vertex_buffer,
+                            unsigned stride,
+                            const ushort *indices,
+                            unsigned nr);
+
 boolean
 lp_setup_analyse_triangles(struct lp_setup_context *setup,
                            const void *vb,
@@ -39,6 +39,8 @@
 #include "lp_state_fs.h"
 #include "lp_state_setup.h"
 #include "lp_context.h"
+#include "lp_screen.h"
+#include "lp_cs_tpool.h"
 
 #include <inttypes.h>
 
@@ -71,6 +73,26 @@ struct fixed_position {
 };
 
 
+/**
+ * A triangle set up on a worker thread by lp_setup_parallel_triangles(),
+ * with what lp_setup_bin_triangle() needs to bin it later.  The triangle
+ * itself follows the slot, see GET_SLOT_TRI().
+ */
+struct tri_slot {
+   struct u_rect bbox;
+   unsigned tri_bytes;  /**< zero if the triangle was culled */
+   unsigned nr_planes;
+   unsigned viewport_index;
+   boolean use_32bits;
+   boolean opaque;
+};
+
+#define TRI_SLOT_HEADER align(sizeof(struct tri_slot), 16)
+
+#define GET_SLOT_TRI(slot) \
+   ((struct lp_rast_triangle *)((char *)(slot) + TRI_SLOT_HEADER))
+
+
 /**
  * Alloc space for a new triangle plus the input.a0/dadx/dady arrays
  * immediately after it.
@@ -112,6 +134,29 @@ lp_setup_alloc_triangle(struct lp_scene *scene,
 }
 
 
+/**
+ * As lp_setup_alloc_triangle(), but the triangle goes into a slot, which
+ * must have room for tri_slot_size(nr_inputs) bytes.
+ */
+static struct lp_rast_triangle *
+alloc_slot_triangle(struct tri_slot *slot,
+                    unsigned nr_inputs,
+                    unsigned nr_planes)
+{
+   unsigned input_array_sz = (nr_inputs + 1) * sizeof(float[4]);
+   struct lp_rast_triangle *tri = GET_SLOT_TRI(slot);
+
+   slot->tri_bytes = (sizeof(struct lp_rast_triangle) +
+                      3 * input_array_sz +
+                      nr_planes * sizeof(struct lp_rast_plane));
+   slot->nr_planes = nr_planes;
+
+   tri->inputs.stride = input_array_sz;
+
+   return tri;
+}
+
+
 void
 lp_setup_print_vertex(struct lp_setup_context *setup,
                       const char *name,
@@ -261,6 +306,10 @@ check_opaque(const struct lp_setup_context *setup,
  * Do basic setup for triangle rasterization and determine which
  * framebuffer tiles are touched.  Put the triangle in the scene's
  * bins for the tiles which we overlap.
+ *
+ * If slot is not NULL, the triangle is set up into the slot instead and
+ * neither the scene nor the bins are touched.  This is what worker
+ * threads do in lp_setup_parallel_triangles().
  */
 static boolean
 do_triangle_ccw(struct lp_setup_context *setup,
@@ -268,7 +317,8 @@ do_triangle_ccw(struct lp_setup_context *setup,
                 const float (*v0)[4],
                 const float (*v1)[4],
                 const float (*v2)[4],
-                boolean frontfacing)
+                boolean frontfacing,
+                struct tri_slot *slot)
 {
    struct lp_scene *scene = setup->scene;
 
@@ -348,7 +398,8 @@ do_triangle_ccw(struct lp_setup_context *setup,
 
    unsigned tri_bytes;
    const struct lp_setup_variant_key *key = &setup->setup.variant->key;
-   struct lp_rast_triangle *tri =
+   struct lp_rast_triangle *tri = slot ?
+      alloc_slot_triangle(slot, key->num_inputs, nr_planes) :
       lp_setup_alloc_triangle(scene, key->num_inputs, nr_planes, &tri_bytes);
    if (!tri)
       return FALSE;
@@ -735,6 +786,14 @@ do_triangle_ccw(struct lp_setup_context *setup,
                                   s_planes, setup->multisample);
    }
 
+   if (slot) {
+      slot->bbox = bbox;
+      slot->viewport_index = viewport_index;
+      slot->use_32bits = use_32bits;
+      slot->opaque = check_opaque(setup, v0, v1, v2);
+      return TRUE;
+   }
+
    return lp_setup_bin_triangle(setup, tri, use_32bits,
                                 check_opaque(setup, v0, v1, v2),
                                 &bbox, nr_planes, viewport_index);
@@ -1008,11 +1067,11 @@ retry_triangle_ccw(struct lp_setup_context *setup,
       return;
    }
 
-   if (!do_triangle_ccw(setup, position, v0, v1, v2, front)) {
+   if (!do_triangle_ccw(setup, position, v0, v1, v2, front, NULL)) {
       if (!lp_setup_flush_and_restart(setup))
          return;
 
-      if (!do_triangle_ccw(setup, position, v0, v1, v2, front))
+      if (!do_triangle_ccw(setup, position, v0, v1, v2, front, NULL))
          return;
    }
 }
@@ -1265,3 +1324,209 @@ lp_setup_choose_triangle(struct lp_setup_context *setup)
       break;
    }
 }
+
+
+/**
+ * Triangles a draw call must have before its setup is spread over the
+ * thread pool.  Below this, queueing the work costs more than it saves.
+ *
+ * The draw module hands over vbuf segments of at most about a thousand
+ * vertices, so this must stay well below 341 triangles for whole segments
+ * to qualify.  Setting up a small triangle takes ~130ns, copying it out of
+ * its slot ~20ns and a pool dispatch 0.5-2us, so the break-even is around
+ * 10-20 triangles; the margin covers waking up idle workers.
+ */
+#define PARALLEL_SETUP_MIN_TRIS 64
+
+
+/** Size of a tri_slot with room for a triangle with any number of planes */
+static unsigned
+tri_slot_size(unsigned nr_inputs)
+{
+   return align(TRI_SLOT_HEADER +
+                sizeof(struct lp_rast_triangle) +
+                3 * (nr_inputs + 1) * sizeof(float[4]) +
+                MAX_PLANES * sizeof(struct lp_rast_plane), 16);
+}
+
+
+/**
+ * As triangle_cw/ccw/both(), but set the triangle up into the slot
+ * instead of binning it.
+ */
+static void
+setup_slot_triangle(struct lp_setup_context *setup,
+                    const float (*v0)[4],
+                    const float (*v1)[4],
+                    const float (*v2)[4],
+                    struct tri_slot *slot)
+{
+   alignas(16) struct fixed_position position;
+
+   slot->tri_bytes = 0;
+
+   int8_t area_sign = calc_fixed_position(setup, &position, v0, v1, v2);
+
+   if (area_sign > 0 && setup->triangle != triangle_cw) {
+      do_triangle_ccw(setup, &position, v0, v1, v2,
+                      setup->ccw_is_frontface, slot);
+   } else if (area_sign < 0 && setup->triangle != triangle_ccw) {
+      if (setup->flatshade_first) {
+         rotate_fixed_position_12(&position);
+         do_triangle_ccw(setup, &position, v0, v2, v1,
+                         !setup->ccw_is_frontface, slot);
+      } else {
+         rotate_fixed_position_01(&position);
+         do_triangle_ccw(setup, &position, v1, v0, v2,
+                         !setup->ccw_is_frontface, slot);
+      }
+   }
+}
+
+
+/**
+ * Copy a triangle from its slot into the scene and bin it.
+ */
+static boolean
+bin_slot_triangle(struct lp_setup_context *setup,
+                  const struct tri_slot *slot)
+{
+   struct lp_rast_triangle *tri =
+      lp_scene_alloc_aligned(setup->scene, slot->tri_bytes, 16);
+   if (!tri)
+      return FALSE;
+
+   memcpy(tri, GET_SLOT_TRI(slot), slot->tri_bytes);
+
+   return lp_setup_bin_triangle(setup, tri, slot->use_32bits, slot->opaque,
+                                &slot->bbox, slot->nr_planes,
+                                slot->viewport_index);
+}
+
+
+struct parallel_setup_job {
+   struct lp_setup_context *setup;
+   const char *vertex_buffer;
+   const ushort *indices;
+   unsigned stride;
+   unsigned nr_tris;
+   unsigned tris_per_task;
+   unsigned slot_size;
+};
+
+
+static void
+parallel_setup_task(void *data, int iter_idx, struct lp_cs_local_mem *lmem)
+{
+   const struct parallel_setup_job *job = data;
+   const unsigned start = iter_idx * job->tris_per_task;
+   const unsigned end = MIN2(start + job->tris_per_task, job->nr_tris);
+
+   for (unsigned i = start; i < end; i++) {
+      unsigned i0 = 3 * i, i1 = 3 * i + 1, i2 = 3 * i + 2;
+
+      if (job->indices) {
+         i0 = job->indices[i0];
+         i1 = job->indices[i1];
+         i2 = job->indices[i2];
+      }
+
+      setup_slot_triangle(job->setup,
+                          (const float (*)[4])(job->vertex_buffer + i0 * job->stride),
+                          (const float (*)[4])(job->vertex_buffer + i1 * job->stride),
+                          (const float (*)[4])(job->vertex_buffer + i2 * job->stride),
+                          (struct tri_slot *)(job->setup->tri_slots +
+                                              (size_t)i * job->slot_size));
+   }
+}
+
+
+/**
+ * Draw a large triangle list with the triangle setup spread over the
+ * screen's thread pool (LP_PARALLEL_BIN).
+ *
+ * Setup (snapping, culling, interpolants and edge planes) is most of the
+ * work of binning a small triangle.  Each worker sets up a contiguous range
+ * of the triangles into setup->tri_slots.  This thread then copies them
+ * into the scene and bins them one after the other in submission order, so
+ * the bins end up exactly as they would with serial binning, and running
+ * out of scene memory is handled the same way too.
+ *
+ * \param indices  vertex indices, or NULL for consecutive vertices
+ * \return FALSE if nothing was drawn and the caller must draw the
+ *         triangles itself
+ */
+boolean
+lp_setup_parallel_triangles(struct lp_setup_context *setup,
+                            const void *vertex_buffer,
+                            unsigned stride,
+                            const ushort *indices,
+                            unsigned nr)
+{
+   struct llvmpipe_context *lp_context = llvmpipe_context(setup->pipe);
+   struct llvmpipe_screen *screen = llvmpipe_screen(setup->pipe->screen);
+   const unsigned nr_tris = nr / 3;
+
+   if (!screen->parallel_bin ||
+       screen->cs_tpool->num_threads < 2 ||
+       nr_tris < PARALLEL_SETUP_MIN_TRIS ||
+       setup->triangle == triangle_noop ||
+       setup->permit_linear_rasterizer ||
+       lp_setup_zero_sample_mask(setup))
+      return FALSE;
+
+   const unsigned slot_size =
+      tri_slot_size(setup->setup.variant->key.num_inputs);
+   const size_t slots_size = (size_t)nr_tris * slot_size;
+
+   if (setup->tri_slots_size < slots_size) {
+      align_free(setup->tri_slots);
+      setup->tri_slots = align_malloc(slots_size, 16);
+      if (!setup->tri_slots) {
+         setup->tri_slots_size = 0;
+         return FALSE;
+      }
+      setup->tri_slots_size = slots_size;
+   }
+
+   struct parallel_setup_job job = {
+      .setup = setup,
+      .vertex_buffer = vertex_buffer,
+      .indices = indices,
+      .stride = stride,
+      .nr_tris = nr_tris,
+      .tris_per_task = DIV_ROUND_UP(nr_tris, screen->cs_tpool->num_threads),
+      .slot_size = slot_size,
+   };
+
+   struct lp_cs_tpool_task *task;
+   mtx_lock(&screen->cs_mutex);
+   task = lp_cs_tpool_queue_task(screen->cs_tpool, parallel_setup_task, &job,
+                                 DIV_ROUND_UP(nr_tris, job.tris_per_task));
+   mtx_unlock(&screen->cs_mutex);
+   if (!task)
+      return FALSE;
+
+   lp_cs_tpool_wait_for_task(screen->cs_tpool, &task);
+
+   if (lp_context->active_statistics_queries) {
+      lp_context->pipeline_statistics.c_primitives += nr_tris;
+   }
+
+   for (unsigned i = 0; i < nr_tris; i++) {
+      const struct tri_slot *slot =
+         (const struct tri_slot *)(setup->tri_slots + (size_t)i * slot_size);
+
+      if (!slot->tri_bytes)
+         continue;
+
+      if (!bin_slot_triangle(setup, slot)) {
+         if (!lp_setup_flush_and_restart(setup))
+            continue;
+
+         bin_slot_triangle(setup, slot);
+      }
+   }
+
+   return TRUE;
+}
@@ -223,7 +223,10 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
       break;
 
    case PIPE_PRIM_TRIANGLES:
-      if (nr % 6 == 0 && !uses_constant_interp) {
+      if (lp_setup_parallel_triangles(setup, vertex_buffer, stride,
+                                      indices, nr)) {
+         /* Already set up and binned. */
+      } else if (nr % 6 == 0 && !uses_constant_interp) {
          for (i = 5; i < nr; i += 6) {
             rect(setup,
                  get_vert(vertex_buffer, indices[i-5], stride),
@@ -431,7 +434,10 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
       break;
 
    case PIPE_PRIM_TRIANGLES:
-      if (nr % 6 == 0 && !uses_constant_interp) {
+      if (lp_setup_parallel_triangles(setup, vertex_buffer, stride,
+                                      NULL, nr)) {
+         /* Already set up and binned. */
+      } else if (nr % 6 == 0 && !uses_constant_interp) {
          for (i = 5; i < nr; i += 6) {
             rect(setup,
                  get_vert(vertex_buffer, i-5, stride),
@@ -643,6 +649,10 @@ lp_setup_vbuf_destroy(struct vbuf_render *vbr)
       align_free(setup->vertex_buffer);
       setup->vertex_buffer = NULL;
    }
+   if (setup->tri_slots) {
+      align_free(setup->tri_slots);
+      setup->tri_slots = NULL;
+   }
    lp_setup_destroy(setup);
 }
 
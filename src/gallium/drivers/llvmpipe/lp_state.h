@@ -137,6 +137,13 @@ llvmpipe_init_draw_funcs(struct llvmpipe_context *llvmpipe);
 void
 llvmpipe_init_compute_funcs(struct llvmpipe_context *llvmpipe);
 
+void
+llvmpipe_cs_wait(struct llvmpipe_context *llvmpipe);
+
+unsigned
+llvmpipe_cs_is_resource_referenced(struct llvmpipe_context *llvmpipe,
+                                   const struct pipe_resource *resource);
+
 void
 llvmpipe_init_clip_funcs(struct llvmpipe_context *llvmpipe);
 
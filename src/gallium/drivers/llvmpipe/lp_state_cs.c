@@ -24,6 +24,7 @@
  **************************************************************************/
 
 #include "util/u_memory.h"
+#include "util/u_dynarray.h"
 #include "util/os_time.h"
 #include "util/u_dump.h"
 #include "util/u_string.h"
@@ -45,6 +46,7 @@
 #include "lp_memory.h"
 #include "lp_query.h"
 #include "lp_cs_tpool.h"
+#include "lp_timeline.h"
 #include "frontend/sw_winsys.h"
 #include "nir/nir_to_tgsi_info.h"
 #include "util/mesa-sha1.h"
@@ -54,6 +56,19 @@
 /** Fragment shader number (for debugging) */
 static unsigned cs_no = 0;
 
+struct lp_cs_job_resource {
+   struct pipe_resource *resource;
+   bool write;
+};
+
+/**
+ * A dispatch and a copy of the state it runs with.  It holds references to
+ * everything the shader can access, so the bindings may change and the
+ * resources be released while it is still running.
+ *
+ * Only the texture, sampler and image slots the shader uses are copied into
+ * current.jit_context, the others are stale.
+ */
 struct lp_cs_job_info {
    unsigned grid_size[3];
    unsigned grid_base[3];
@@ -61,7 +76,17 @@ struct lp_cs_job_info {
    unsigned req_local_mem;
    unsigned work_dim;
    bool zero_initialize_shared_memory;
-   struct lp_cs_exec *current;
+   struct lp_cs_exec current;
+
+   struct lp_cs_tpool_task *task;
+   struct util_dynarray resources; /**< struct lp_cs_job_resource */
+
+   /** Can't run past the end of launch_grid, wait for it there */
+   bool sync;
+
+   /** Copy of pipe_grid_info::input, input_size bytes are allocated */
+   unsigned input_size;
+   uint8_t input[];
 };
 
 
@@ -183,7 +208,8 @@ generate_compute(struct llvmpipe_context *lp,
    LLVMPositionBuilderAtEnd(builder, block);
    sampler = lp_llvm_sampler_soa_create(lp_cs_variant_key_samplers(key),
                                         MAX2(key->nr_samplers,
-                                             key->nr_sampler_views));
+                                             key->nr_sampler_views),
+                                        llvmpipe_screen(lp->pipe.screen)->sample_funcs);
    image = lp_llvm_image_soa_create(lp_cs_variant_key_images(key), key->nr_images);
 
    struct lp_build_loop_state loop_state[4];
@@ -497,6 +523,7 @@ llvmpipe_create_compute_state(struct pipe_context *pipe,
 
    shader->no = cs_no++;
 
+   shader->req_input_mem = templ->req_input_mem;
    shader->base.type = templ->ir_type;
    if (templ->ir_type == PIPE_SHADER_IR_NIR_SERIALIZED) {
       struct blob_reader reader;
@@ -579,6 +606,10 @@ llvmpipe_remove_cs_shader_variant(struct llvmpipe_context *lp,
                    lp->nr_cs_variants, variant->nr_instrs, lp->nr_cs_instrs);
    }
 
+   /* the last dispatch may still be running it */
+   if (lp->csctx->pending && lp->csctx->pending->current.variant == variant)
+      llvmpipe_cs_wait(lp);
+
    gallivm_destroy(variant->gallivm);
 
    /* remove from shader's list */
@@ -794,6 +825,7 @@ generate_variant(struct llvmpipe_context *lp,
                  struct lp_compute_shader *shader,
                  const struct lp_compute_shader_variant_key *key)
 {
+   int64_t timeline_start = lp_timeline_begin();
    struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
 
    struct lp_compute_shader_variant *variant =
@@ -850,6 +882,10 @@ generate_variant(struct llvmpipe_context *lp,
       lp_disk_cache_insert_shader(screen, &cached, ir_sha1_cache_key);
    }
    gallivm_free_ir(variant->gallivm);
+
+   lp_timeline_end(LP_TIMELINE_CS_VARIANT, timeline_start,
+                   shader->no, variant->no,
+                   shader->base.ir.nir && !needs_caching);
    return variant;
 }
 
@@ -1409,8 +1445,8 @@ cs_exec_fn(void *init_data, int iter_idx, struct lp_cs_local_mem *lmem)
    grid_z += job_info->grid_base[2];
    grid_y += job_info->grid_base[1];
    grid_x += job_info->grid_base[0];
-   struct lp_compute_shader_variant *variant = job_info->current->variant;
-   variant->jit_function(&job_info->current->jit_context,
+   struct lp_compute_shader_variant *variant = job_info->current.variant;
+   variant->jit_function(&job_info->current.jit_context,
                          job_info->block_size[0], job_info->block_size[1], job_info->block_size[2],
                          grid_x, grid_y, grid_z,
                          job_info->grid_size[0], job_info->grid_size[1], job_info->grid_size[2], job_info->work_dim,
@@ -1447,42 +1483,242 @@ fill_grid_size(struct pipe_context *pipe,
 }
 
 
+static void
+lp_cs_job_add_resource(struct lp_cs_job_info *job,
+                       struct pipe_resource *resource,
+                       bool write)
+{
+   if (!resource)
+      return;
+
+   struct lp_cs_job_resource *res =
+      util_dynarray_grow(&job->resources, struct lp_cs_job_resource, 1);
+   if (!res) {
+      job->sync = true;
+      return;
+   }
+
+   res->resource = NULL;
+   pipe_resource_reference(&res->resource, resource);
+   res->write = write;
+
+   /* display target mappings are dropped when the views are rebound */
+   if (llvmpipe_resource(resource)->dt)
+      job->sync = true;
+}
+
+
+static void
+lp_cs_job_destroy(struct lp_cs_job_info *job)
+{
+   util_dynarray_fini(&job->resources);
+   FREE(job);
+}
+
+
+/**
+ * Drops the job's references and keeps it for the next dispatch, at most
+ * two are in use at a time.
+ */
+static void
+lp_cs_job_release(struct lp_cs_context *csctx, struct lp_cs_job_info *job)
+{
+   util_dynarray_foreach(&job->resources, struct lp_cs_job_resource, res)
+      pipe_resource_reference(&res->resource, NULL);
+   util_dynarray_clear(&job->resources);
+
+   if (csctx->free_job)
+      lp_cs_job_destroy(csctx->free_job);
+   csctx->free_job = job;
+}
+
+
+static struct lp_cs_job_info *
+lp_cs_job_create(struct llvmpipe_context *llvmpipe,
+                 const struct pipe_grid_info *info)
+{
+   struct lp_cs_context *csctx = llvmpipe->csctx;
+   struct lp_compute_shader *cs = llvmpipe->cs;
+   const struct lp_jit_cs_context *jit_context = &csctx->cs.current.jit_context;
+   const struct lp_compute_shader_variant_key *key =
+      &csctx->cs.current.variant->key;
+   const unsigned input_size = info->input ? cs->req_input_mem : 0;
+   struct lp_cs_job_info *job = csctx->free_job;
+   unsigned i;
+
+   if (job && job->input_size >= input_size) {
+      csctx->free_job = NULL;
+   } else {
+      job = MALLOC(sizeof(*job) + input_size);
+      if (!job)
+         return NULL;
+      util_dynarray_init(&job->resources, NULL);
+      job->input_size = input_size;
+   }
+
+   job->grid_base[0] = info->grid_base[0];
+   job->grid_base[1] = info->grid_base[1];
+   job->grid_base[2] = info->grid_base[2];
+   job->block_size[0] = info->block[0];
+   job->block_size[1] = info->block[1];
+   job->block_size[2] = info->block[2];
+   job->work_dim = info->work_dim;
+   job->req_local_mem = cs->req_local_mem + info->variable_shared_mem;
+   job->zero_initialize_shared_memory = cs->zero_initialize_shared_memory;
+   job->task = NULL;
+   job->sync = false;
+
+   /* The full texture and image arrays are most of the jit context, copy
+    * only the slots the variant was built for.
+    */
+   job->current.variant = csctx->cs.current.variant;
+   memcpy(job->current.jit_context.constants, jit_context->constants,
+          sizeof(jit_context->constants));
+   memcpy(job->current.jit_context.textures, jit_context->textures,
+          key->nr_sampler_views * sizeof(jit_context->textures[0]));
+   memcpy(job->current.jit_context.samplers, jit_context->samplers,
+          key->nr_samplers * sizeof(jit_context->samplers[0]));
+   memcpy(job->current.jit_context.images, jit_context->images,
+          key->nr_images * sizeof(jit_context->images[0]));
+   memcpy(job->current.jit_context.ssbos, jit_context->ssbos,
+          sizeof(jit_context->ssbos));
+   job->current.jit_context.kernel_args = jit_context->kernel_args;
+   job->current.jit_context.shared_size = jit_context->shared_size;
+   job->current.jit_context.aniso_filter_table = jit_context->aniso_filter_table;
+
+   if (input_size) {
+      memcpy(job->input, info->input, input_size);
+      job->current.jit_context.kernel_args = job->input;
+   } else if (info->input) {
+      /* unknown size, only valid during this call */
+      job->sync = true;
+   }
+
+   for (i = 0; i < ARRAY_SIZE(csctx->constants); i++)
+      lp_cs_job_add_resource(job, csctx->constants[i].current.buffer, false);
+   for (i = 0; i < ARRAY_SIZE(csctx->ssbos); i++)
+      lp_cs_job_add_resource(job, csctx->ssbos[i].current.buffer, true);
+   for (i = 0; i < key->nr_images; i++) {
+      const struct pipe_image_view *image = &csctx->images[i].current;
+      lp_cs_job_add_resource(job, image->resource,
+                             (image->access | image->shader_access) &
+                             PIPE_IMAGE_ACCESS_WRITE);
+   }
+   for (i = 0; i < MIN2(key->nr_sampler_views, csctx->cs.current_tex_num); i++)
+      lp_cs_job_add_resource(job, csctx->cs.current_tex[i], false);
+   for (i = 0; i < cs->max_global_buffers; i++)
+      lp_cs_job_add_resource(job, cs->global_buffers[i], true);
+
+   return job;
+}
+
+
+/**
+ * Whether job has to wait for pending, because one of them writes
+ * something the other one accesses.
+ */
+static bool
+lp_cs_job_depends(const struct lp_cs_job_info *job,
+                  const struct lp_cs_job_info *pending)
+{
+   util_dynarray_foreach(&job->resources, struct lp_cs_job_resource, res) {
+      util_dynarray_foreach(&pending->resources, struct lp_cs_job_resource,
+                            prev) {
+         if (res->resource == prev->resource && (res->write || prev->write))
+            return true;
+      }
+   }
+   return false;
+}
+
+
+/**
+ * Wait for the last dispatch, launch_grid returns without waiting for it.
+ */
+void
+llvmpipe_cs_wait(struct llvmpipe_context *llvmpipe)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(llvmpipe->pipe.screen);
+   struct lp_cs_job_info *job = llvmpipe->csctx->pending;
+
+   if (!job)
+      return;
+
+   llvmpipe->csctx->pending = NULL;
+   lp_cs_tpool_wait_for_task(screen->cs_tpool, &job->task);
+   lp_cs_job_release(llvmpipe->csctx, job);
+}
+
+
+/**
+ * Returns LP_REFERENCED_FOR_READ/WRITE if the last dispatch may still
+ * access the resource.
+ */
+unsigned
+llvmpipe_cs_is_resource_referenced(struct llvmpipe_context *llvmpipe,
+                                   const struct pipe_resource *resource)
+{
+   const struct lp_cs_job_info *job = llvmpipe->csctx->pending;
+   unsigned referenced = LP_UNREFERENCED;
+
+   if (!job)
+      return LP_UNREFERENCED;
+
+   util_dynarray_foreach(&job->resources, struct lp_cs_job_resource, res) {
+      if (res->resource == resource)
+         referenced |= res->write ? LP_REFERENCED_FOR_WRITE :
+                                    LP_REFERENCED_FOR_READ;
+   }
+   return referenced;
+}
+
+
 static void
 llvmpipe_launch_grid(struct pipe_context *pipe,
                      const struct pipe_grid_info *info)
 {
    struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
    struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
-   struct lp_cs_job_info job_info;
+   struct lp_cs_context *csctx = llvmpipe->csctx;
+   uint32_t grid_size[3] = { 0 };
 
    if (!llvmpipe_check_render_cond(llvmpipe))
       return;
 
-   memset(&job_info, 0, sizeof(job_info));
-
    llvmpipe_cs_update_derived(llvmpipe, info->input);
 
-   fill_grid_size(pipe, info, job_info.grid_size);
-
-   job_info.grid_base[0] = info->grid_base[0];
-   job_info.grid_base[1] = info->grid_base[1];
-   job_info.grid_base[2] = info->grid_base[2];
-   job_info.block_size[0] = info->block[0];
-   job_info.block_size[1] = info->block[1];
-   job_info.block_size[2] = info->block[2];
-   job_info.work_dim = info->work_dim;
-   job_info.req_local_mem = llvmpipe->cs->req_local_mem + info->variable_shared_mem;
-   job_info.zero_initialize_shared_memory = llvmpipe->cs->zero_initialize_shared_memory;
-   job_info.current = &llvmpipe->csctx->cs.current;
+   fill_grid_size(pipe, info, grid_size);
 
-   int num_tasks = job_info.grid_size[2] * job_info.grid_size[1] * job_info.grid_size[0];
+   int num_tasks = grid_size[2] * grid_size[1] * grid_size[0];
    if (num_tasks) {
-      struct lp_cs_tpool_task *task;
+      struct lp_cs_job_info *job_info = lp_cs_job_create(llvmpipe, info);
+      if (!job_info)
+         return;
+
+      job_info->grid_size[0] = grid_size[0];
+      job_info->grid_size[1] = grid_size[1];
+      job_info->grid_size[2] = grid_size[2];
+
+      if (csctx->pending && lp_cs_job_depends(job_info, csctx->pending))
+         llvmpipe_cs_wait(llvmpipe);
+
       mtx_lock(&screen->cs_mutex);
-      task = lp_cs_tpool_queue_task(screen->cs_tpool, cs_exec_fn, &job_info, num_tasks);
+      job_info->task = lp_cs_tpool_queue_task(screen->cs_tpool, cs_exec_fn,
+                                              job_info, num_tasks);
       mtx_unlock(&screen->cs_mutex);
 
-      lp_cs_tpool_wait_for_task(screen->cs_tpool, &task);
+      /* The previous dispatch has been running alongside this one.  Finish
+       * it and leave this one running until something depends on it: the
+       * next dispatch touching what it writes, a draw or clear, a flush,
+       * a barrier or a map of one of its resources.
+       */
+      llvmpipe_cs_wait(llvmpipe);
+      if (job_info->task && !job_info->sync) {
+         csctx->pending = job_info;
+      } else {
+         lp_cs_tpool_wait_for_task(screen->cs_tpool, &job_info->task);
+         lp_cs_job_release(csctx, job_info);
+      }
    }
    if (!llvmpipe->queries_disabled)
       llvmpipe->pipeline_statistics.cs_invocations += num_tasks * info->block[0] * info->block[1] * info->block[2];
@@ -1568,6 +1804,8 @@ lp_csctx_destroy(struct lp_cs_context *csctx)
    for (i = 0; i < ARRAY_SIZE(csctx->images); i++) {
       pipe_resource_reference(&csctx->images[i].current.resource, NULL);
    }
+   if (csctx->free_job)
+      lp_cs_job_destroy(csctx->free_job);
    FREE(csctx);
 }
 
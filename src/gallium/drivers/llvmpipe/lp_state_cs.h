@@ -109,6 +109,7 @@ struct lp_compute_shader {
    struct lp_tgsi_info info;
 
    uint32_t req_local_mem;
+   uint32_t req_input_mem;
 
    /* For debugging/profiling purposes */
    unsigned variant_key_size;
@@ -152,6 +153,12 @@ struct lp_cs_context {
    } images[LP_MAX_TGSI_SHADER_IMAGES];
 
    const void *input;
+
+   /** The last dispatch, which may still be running */
+   struct lp_cs_job_info *pending;
+
+   /** A finished job kept for the next dispatch */
+   struct lp_cs_job_info *free_job;
 };
 
 struct lp_cs_context *lp_csctx_create(struct pipe_context *pipe);
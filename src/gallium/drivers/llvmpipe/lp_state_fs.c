@@ -104,6 +104,7 @@
 #include "lp_flush.h"
 #include "lp_state_fs.h"
 #include "lp_rast.h"
+#include "lp_timeline.h"
 #include "nir/nir_to_tgsi_info.h"
 
 #include "lp_screen.h"
@@ -3281,14 +3282,28 @@ generate_fragment(struct llvmpipe_context *lp,
    struct lp_build_sampler_soa *sampler =
       lp_llvm_sampler_soa_create(lp_fs_variant_key_samplers(key),
                                  MAX2(key->nr_samplers,
-                                      key->nr_sampler_views));
+                                      key->nr_sampler_views),
+                                 llvmpipe_screen(lp->pipe.screen)->sample_funcs);
    struct lp_build_image_soa *image =
       lp_llvm_image_soa_create(lp_fs_variant_key_images(key), key->nr_images);
 
    unsigned num_fs = 16 / fs_type.length; /* number of loops per 4x4 stamp */
    /* for 1d resources only run "upper half" of stamp */
    if (key->resource_1d)
-      num_fs /= 2;
+      num_fs = MAX2(num_fs / 2, 1);
+
+   /*
+    * The blend code works on at most 8-wide vectors. A 16-wide result is
+    * handed to it as two 8-wide halves (rows 0-1 and rows 2-3 of the
+    * stamp), which is exactly what two iterations of the 8-wide loop would
+    * have produced.
+    */
+   struct lp_type blend_fs_type = fs_type;
+   blend_fs_type.length = MIN2(fs_type.length, 8);
+   const unsigned blend_split = fs_type.length / blend_fs_type.length;
+   unsigned blend_num_fs = 16 / blend_fs_type.length;
+   if (key->resource_1d)
+      blend_num_fs /= 2;
 
    {
       LLVMValueRef num_loop = lp_build_const_int32(gallivm, num_fs);
@@ -3423,25 +3438,35 @@ generate_fragment(struct llvmpipe_context *lp,
                        variant->jit_thread_data_type,
                        thread_data_ptr);
 
-      LLVMTypeRef fs_vec_type = lp_build_vec_type(gallivm, fs_type);
-      for (unsigned i = 0; i < num_fs; i++) {
+      LLVMTypeRef fs_vec_type = lp_build_vec_type(gallivm, blend_fs_type);
+      LLVMTypeRef blend_mask_type =
+         lp_build_int_vec_type(gallivm, blend_fs_type);
+      LLVMValueRef blend_mask_store =
+         LLVMBuildBitCast(builder, mask_store,
+                          LLVMPointerType(blend_mask_type, 0), "");
+      for (unsigned i = 0; i < blend_num_fs; i++) {
          LLVMValueRef ptr;
          for (unsigned s = 0; s < key->coverage_samples; s++) {
-            int idx = (i + (s * num_fs));
-            LLVMValueRef sindexi = lp_build_const_int32(gallivm, idx);
-            ptr = LLVMBuildGEP2(builder, mask_type, mask_store, &sindexi, 1, "");
-
-            fs_mask[idx] = LLVMBuildLoad2(builder, mask_type, ptr, "smask");
+            int idx = (i + (s * blend_num_fs));
+            LLVMValueRef sindexi =
+               lp_build_const_int32(gallivm, i + s * num_fs * blend_split);
+            ptr = LLVMBuildGEP2(builder, blend_mask_type, blend_mask_store,
+                                &sindexi, 1, "");
+
+            fs_mask[idx] = LLVMBuildLoad2(builder, blend_mask_type, ptr,
+                                          "smask");
          }
 
          for (unsigned s = 0; s < key->min_samples; s++) {
             /* This is fucked up need to reorganize things */
-            int idx = s * num_fs + i;
+            int idx = s * num_fs * blend_split + i;
             LLVMValueRef sindexi = lp_build_const_int32(gallivm, idx);
             for (unsigned cbuf = 0; cbuf < key->nr_cbufs; cbuf++) {
                for (unsigned chan = 0; chan < TGSI_NUM_CHANNELS; ++chan) {
-                  ptr = LLVMBuildGEP2(builder, fs_vec_type,
-                                      color_store[cbuf * !cbuf0_write_all][chan],
+                  ptr = LLVMBuildBitCast(builder,
+                                         color_store[cbuf * !cbuf0_write_all][chan],
+                                         LLVMPointerType(fs_vec_type, 0), "");
+                  ptr = LLVMBuildGEP2(builder, fs_vec_type, ptr,
                                       &sindexi, 1, "");
                   fs_out_color[s][cbuf][chan][i] = ptr;
                }
@@ -3451,8 +3476,9 @@ generate_fragment(struct llvmpipe_context *lp,
                 * output 1
                 */
                for (unsigned chan = 0; chan < TGSI_NUM_CHANNELS; ++chan) {
-                  ptr = LLVMBuildGEP2(builder, fs_vec_type,
-                                      color_store[1][chan],
+                  ptr = LLVMBuildBitCast(builder, color_store[1][chan],
+                                         LLVMPointerType(fs_vec_type, 0), "");
+                  ptr = LLVMBuildGEP2(builder, fs_vec_type, ptr,
                                       &sindexi, 1, "");
                   fs_out_color[s][1][chan][i] = ptr;
                }
@@ -3497,7 +3523,7 @@ generate_fragment(struct llvmpipe_context *lp,
                                                          &index, 1, ""), "");
 
          for (unsigned s = 0; s < key->cbuf_nr_samples[cbuf]; s++) {
-            unsigned mask_idx = num_fs * (key->multisample ? s : 0);
+            unsigned mask_idx = blend_num_fs * (key->multisample ? s : 0);
             unsigned out_idx = key->min_samples == 1 ? 0 : s;
             LLVMValueRef out_ptr = color_ptr;
 
@@ -3514,7 +3540,8 @@ generate_fragment(struct llvmpipe_context *lp,
 
             generate_unswizzled_blend(gallivm, cbuf, variant,
                                       key->cbuf_format[cbuf],
-                                      num_fs, fs_type, &fs_mask[mask_idx],
+                                      blend_num_fs, blend_fs_type,
+                                      &fs_mask[mask_idx],
                                       fs_out_color[out_idx],
                                       variant->jit_context_type,
                                       context_ptr, blend_vec_type, out_ptr, stride,
@@ -3684,6 +3711,8 @@ lp_debug_fs_variant(struct lp_fragment_shader_variant *variant)
    debug_printf("variant->opaque = %u\n", variant->opaque);
    debug_printf("variant->potentially_opaque = %u\n", variant->potentially_opaque);
    debug_printf("variant->blit = %u\n", variant->blit);
+   debug_printf("variant->hiz_test = %u\n", variant->hiz_test);
+   debug_printf("variant->hiz_update = %u\n", variant->hiz_update);
    debug_printf("shader->kind = %s\n", lp_debug_fs_kind(variant->shader->kind));
    debug_printf("\n");
 }
@@ -3721,6 +3750,7 @@ generate_variant(struct llvmpipe_context *lp,
                  struct lp_fragment_shader *shader,
                  const struct lp_fragment_shader_variant_key *key)
 {
+   int64_t timeline_start = lp_timeline_begin();
    struct lp_fragment_shader_variant *variant =
       MALLOC(sizeof *variant + shader->variant_key_size - sizeof variant->key);
    if (!variant)
@@ -3807,6 +3837,40 @@ generate_variant(struct llvmpipe_context *lp,
          shader->info.cbuf[0][3].file != TGSI_FILE_NULL
          ? TRUE : FALSE;
 
+   /* Primitives can only be rejected early if failing the depth test has no
+    * side effects and the depth they are tested with is the interpolated
+    * one.  Stored depth values then only ever decrease.
+    */
+   const unsigned depth_func = key->depth.func;
+   variant->hiz_test =
+         key->depth.enabled &&
+         (depth_func == PIPE_FUNC_LESS || depth_func == PIPE_FUNC_LEQUAL) &&
+         !key->stencil[0].enabled &&
+         !key->stencil[1].enabled &&
+         !key->depth_clamp &&
+         !shader->info.base.writes_z &&
+         !shader->info.base.writes_memory;
+
+   /* A covered block is only known to hold the primitive's depth or less if
+    * every pixel of it is written.
+    */
+   variant->hiz_update =
+         variant->hiz_test &&
+         key->depth.writemask &&
+         !key->alpha.enabled &&
+         !key->multisample &&
+         !key->blend.alpha_to_coverage &&
+         !shader->info.base.uses_kill &&
+         !shader->info.base.writes_samplemask;
+
+   variant->hiz_raise =
+         key->depth.enabled &&
+         key->depth.writemask &&
+         depth_func != PIPE_FUNC_NEVER &&
+         depth_func != PIPE_FUNC_LESS &&
+         depth_func != PIPE_FUNC_LEQUAL &&
+         depth_func != PIPE_FUNC_EQUAL;
+
    /* We only care about opaque blits for now */
    if (variant->opaque &&
        (shader->kind == LP_FS_KIND_BLIT_RGBA ||
@@ -3946,6 +4010,10 @@ generate_variant(struct llvmpipe_context *lp,
 
    gallivm_free_ir(variant->gallivm);
 
+   lp_timeline_end(LP_TIMELINE_FS_VARIANT, timeline_start,
+                   shader->no, variant->no,
+                   shader->base.ir.nir && !needs_caching);
+
    return variant;
 }
 
@@ -168,6 +168,15 @@ struct lp_fragment_shader_variant
 
    unsigned opaque:1;
    unsigned blit:1;
+
+   /*
+    * Hierarchical Z, see lp_rast_hiz_occluded(): whether primitives can be
+    * rejected against the per-block depth bounds, whether they lower those
+    * bounds when they cover a block, and whether they can raise depth values.
+    */
+   unsigned hiz_test:1;
+   unsigned hiz_update:1;
+   unsigned hiz_raise:1;
    unsigned linear_input_mask:16;
    struct pipe_reference reference;
 
@@ -47,6 +47,7 @@
 #include "lp_state.h"
 #include "lp_state_fs.h"
 #include "lp_state_setup.h"
+#include "lp_timeline.h"
 
 
 /** Setup shader number (for debugging) */
@@ -636,6 +637,7 @@ generate_setup_variant(struct lp_setup_variant_key *key,
                        struct llvmpipe_context *lp)
 {
    int64_t t0 = 0, t1;
+   int64_t timeline_start = lp_timeline_begin();
 
    if (0)
       goto fail;
@@ -746,6 +748,9 @@ generate_setup_variant(struct lp_setup_variant_key *key,
       LP_COUNT_ADD(nr_llvm_compiles, 1);
    }
 
+   lp_timeline_end(LP_TIMELINE_SETUP_VARIANT, timeline_start,
+                   variant->no, 0, 0);
+
    return variant;
 
 fail:
@@ -47,6 +47,15 @@
 #include "gallivm/lp_bld_type.h"
 #include "gallivm/lp_bld_sample.h"
 #include "gallivm/lp_bld_tgsi.h"
+#include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_flow.h"
+#include "gallivm/lp_bld_intr.h"
+#include "gallivm/lp_bld_misc.h"
+#include "gallivm/lp_bld_struct.h"
+#include "c11/threads.h"
+#include "util/format/u_format.h"
+#include "util/hash_table.h"
+#include "util/u_pointer.h"
 #include "lp_jit.h"
 #include "lp_tex_sample.h"
 #include "lp_state_fs.h"
@@ -77,6 +86,45 @@ struct lp_llvm_sampler_soa
 
    struct llvmpipe_sampler_dynamic_state dynamic_state;
    unsigned nr_samplers;
+
+   struct lp_sample_func_cache *funcs;
+};
+
+
+/**
+ * Everything a shared texture sampling function is specialized for.
+ */
+struct lp_sample_func_key
+{
+   struct lp_static_texture_state texture_state;
+   struct lp_static_sampler_state sampler_state;
+   struct lp_type type;
+   unsigned sample_key;
+   boolean has_aniso_filter_table;
+};
+
+
+struct lp_sample_func
+{
+   struct lp_sample_func_key key;
+   struct gallivm_state *gallivm;
+   func_pointer code;
+};
+
+
+/**
+ * Per-screen cache of texture sampling functions shared between shaders.
+ *
+ * Each function is compiled in its own module, in a LLVM context of its own
+ * since shaders are compiled concurrently on the contexts of the pipe
+ * contexts.
+ */
+struct lp_sample_func_cache
+{
+   mtx_t mutex;
+   LLVMContextRef context;
+   struct hash_table *funcs;
+   unsigned num_funcs;
 };
 
 
@@ -285,6 +333,286 @@ LP_LLVM_SAMPLER_MEMBER(border_color, LP_JIT_SAMPLER_BORDER_COLOR, FALSE)
 LP_LLVM_SAMPLER_MEMBER(max_aniso, LP_JIT_SAMPLER_MAX_ANISO, TRUE)
 
 
+/**
+ * Fetch the specified member of the lp_jit_texture or lp_jit_sampler
+ * structure a lp_jit_sample_context points to.
+ *
+ * This is used by the shared texture sampling functions, which get the
+ * descriptors they sample from the caller rather than from the context
+ * of a particular shader, so the unit is not needed.
+ */
+static LLVMValueRef
+lp_llvm_sample_func_member(struct gallivm_state *gallivm,
+                           LLVMTypeRef context_type,
+                           LLVMValueRef context_ptr,
+                           unsigned descriptor,
+                           unsigned member_index,
+                           const char *member_name,
+                           boolean emit_load,
+                           LLVMTypeRef *out_type)
+{
+   LLVMTypeRef texture_type, sampler_type;
+   lp_jit_create_sample_context_type(gallivm, &texture_type, &sampler_type);
+   LLVMTypeRef struct_type = descriptor == LP_JIT_SAMPLE_CTX_TEXTURE ?
+                             texture_type : sampler_type;
+
+   /* context->texture or context->sampler */
+   LLVMValueRef ptr = lp_build_struct_get2(gallivm, context_type, context_ptr,
+                                           descriptor, "");
+
+   LLVMValueRef res;
+   if (emit_load)
+      res = lp_build_struct_get2(gallivm, struct_type, ptr,
+                                 member_index, member_name);
+   else
+      res = lp_build_struct_get_ptr2(gallivm, struct_type, ptr,
+                                     member_index, member_name);
+
+   if (out_type)
+      *out_type = LLVMStructGetTypeAtIndex(struct_type, member_index);
+
+   return res;
+}
+
+
+#define LP_LLVM_SAMPLE_FUNC_TEXTURE_MEMBER(_name, _index, _emit_load)  \
+   static LLVMValueRef \
+   lp_llvm_sample_func_texture_##_name(struct gallivm_state *gallivm, \
+                                       LLVMTypeRef context_type, \
+                                       LLVMValueRef context_ptr, \
+                                       unsigned texture_unit,    \
+                                       LLVMValueRef texture_unit_offset) \
+   { \
+      return lp_llvm_sample_func_member(gallivm, context_type, context_ptr, \
+                                        LP_JIT_SAMPLE_CTX_TEXTURE,  \
+                                        _index, #_name, _emit_load, NULL); \
+   }
+
+#define LP_LLVM_SAMPLE_FUNC_TEXTURE_MEMBER_OUTTYPE(_name, _index, _emit_load)  \
+   static LLVMValueRef \
+   lp_llvm_sample_func_texture_##_name(struct gallivm_state *gallivm, \
+                                       LLVMTypeRef context_type, \
+                                       LLVMValueRef context_ptr, \
+                                       unsigned texture_unit,    \
+                                       LLVMValueRef texture_unit_offset, \
+                                       LLVMTypeRef *out_type)            \
+   { \
+      return lp_llvm_sample_func_member(gallivm, context_type, context_ptr, \
+                                        LP_JIT_SAMPLE_CTX_TEXTURE,  \
+                                        _index, #_name, _emit_load, out_type); \
+   }
+
+#define LP_LLVM_SAMPLE_FUNC_SAMPLER_MEMBER(_name, _index, _emit_load)  \
+   static LLVMValueRef \
+   lp_llvm_sample_func_sampler_##_name(struct gallivm_state *gallivm, \
+                                       LLVMTypeRef context_type, \
+                                       LLVMValueRef context_ptr, \
+                                       unsigned sampler_unit) \
+   { \
+      return lp_llvm_sample_func_member(gallivm, context_type, context_ptr, \
+                                        LP_JIT_SAMPLE_CTX_SAMPLER,  \
+                                        _index, #_name, _emit_load, NULL); \
+   }
+
+
+LP_LLVM_SAMPLE_FUNC_TEXTURE_MEMBER(width,      LP_JIT_TEXTURE_WIDTH, TRUE)
+LP_LLVM_SAMPLE_FUNC_TEXTURE_MEMBER(height,     LP_JIT_TEXTURE_HEIGHT, TRUE)
+LP_LLVM_SAMPLE_FUNC_TEXTURE_MEMBER(depth,      LP_JIT_TEXTURE_DEPTH, TRUE)
+LP_LLVM_SAMPLE_FUNC_TEXTURE_MEMBER(first_level, LP_JIT_TEXTURE_FIRST_LEVEL, TRUE)
+LP_LLVM_SAMPLE_FUNC_TEXTURE_MEMBER(last_level, LP_JIT_TEXTURE_LAST_LEVEL, TRUE)
+LP_LLVM_SAMPLE_FUNC_TEXTURE_MEMBER(base_ptr,   LP_JIT_TEXTURE_BASE, TRUE)
+LP_LLVM_SAMPLE_FUNC_TEXTURE_MEMBER_OUTTYPE(row_stride, LP_JIT_TEXTURE_ROW_STRIDE, FALSE)
+LP_LLVM_SAMPLE_FUNC_TEXTURE_MEMBER_OUTTYPE(img_stride, LP_JIT_TEXTURE_IMG_STRIDE, FALSE)
+LP_LLVM_SAMPLE_FUNC_TEXTURE_MEMBER_OUTTYPE(mip_offsets, LP_JIT_TEXTURE_MIP_OFFSETS, FALSE)
+LP_LLVM_SAMPLE_FUNC_TEXTURE_MEMBER(num_samples, LP_JIT_TEXTURE_NUM_SAMPLES, TRUE)
+LP_LLVM_SAMPLE_FUNC_TEXTURE_MEMBER(sample_stride, LP_JIT_TEXTURE_SAMPLE_STRIDE, TRUE)
+
+LP_LLVM_SAMPLE_FUNC_SAMPLER_MEMBER(min_lod,    LP_JIT_SAMPLER_MIN_LOD, TRUE)
+LP_LLVM_SAMPLE_FUNC_SAMPLER_MEMBER(max_lod,    LP_JIT_SAMPLER_MAX_LOD, TRUE)
+LP_LLVM_SAMPLE_FUNC_SAMPLER_MEMBER(lod_bias,   LP_JIT_SAMPLER_LOD_BIAS, TRUE)
+LP_LLVM_SAMPLE_FUNC_SAMPLER_MEMBER(border_color, LP_JIT_SAMPLER_BORDER_COLOR, FALSE)
+LP_LLVM_SAMPLE_FUNC_SAMPLER_MEMBER(max_aniso, LP_JIT_SAMPLER_MAX_ANISO, TRUE)
+
+
+static uint32_t
+lp_sample_func_key_hash(const void *key)
+{
+   return _mesa_hash_data(key, sizeof(struct lp_sample_func_key));
+}
+
+
+static bool
+lp_sample_func_key_equal(const void *a, const void *b)
+{
+   return memcmp(a, b, sizeof(struct lp_sample_func_key)) == 0;
+}
+
+
+struct lp_sample_func_cache *
+lp_sample_func_cache_create(void)
+{
+   struct lp_sample_func_cache *cache = CALLOC_STRUCT(lp_sample_func_cache);
+   if (!cache)
+      return NULL;
+
+   cache->context = LLVMContextCreate();
+   if (!cache->context) {
+      FREE(cache);
+      return NULL;
+   }
+
+#if LLVM_VERSION_MAJOR == 15
+   LLVMContextSetOpaquePointers(cache->context, false);
+#endif
+
+   cache->funcs = _mesa_hash_table_create(NULL, lp_sample_func_key_hash,
+                                          lp_sample_func_key_equal);
+   (void) mtx_init(&cache->mutex, mtx_plain);
+   return cache;
+}
+
+
+void
+lp_sample_func_cache_destroy(struct lp_sample_func_cache *cache)
+{
+   if (!cache)
+      return;
+
+   hash_table_foreach(cache->funcs, entry) {
+      struct lp_sample_func *func = entry->data;
+      gallivm_destroy(func->gallivm);
+      FREE(func);
+   }
+   _mesa_hash_table_destroy(cache->funcs, NULL);
+
+   LLVMContextDispose(cache->context);
+   mtx_destroy(&cache->mutex);
+   FREE(cache);
+}
+
+
+/**
+ * Build and compile the shared sampling function for the given key.
+ */
+static struct lp_sample_func *
+lp_sample_func_compile(struct lp_sample_func_cache *cache,
+                       const struct lp_sample_func_key *key)
+{
+   struct lp_sample_func *func = CALLOC_STRUCT(lp_sample_func);
+   if (!func)
+      return NULL;
+
+   char name[32];
+   snprintf(name, sizeof(name), "texfunc%u", cache->num_funcs);
+
+   struct gallivm_state *gallivm = gallivm_create(name, cache->context, NULL);
+   if (!gallivm) {
+      FREE(func);
+      return NULL;
+   }
+
+   LLVMTypeRef context_type =
+      lp_jit_create_sample_context_type(gallivm, NULL, NULL);
+   LLVMTypeRef function_type =
+      lp_build_sample_func_type(gallivm, key->texture_state.target,
+                                key->type, key->sample_key,
+                                LLVMPointerType(context_type, 0),
+                                key->has_aniso_filter_table);
+   LLVMValueRef function = LLVMAddFunction(gallivm->module, name,
+                                           function_type);
+   LLVMSetFunctionCallConv(function, LLVMCCallConv);
+   for (unsigned i = 0; i < LLVMCountParams(function); i++) {
+      if (LLVMGetTypeKind(LLVMTypeOf(LLVMGetParam(function, i))) ==
+          LLVMPointerTypeKind)
+         lp_add_function_attr(function, i + 1, LP_FUNC_ATTR_NOALIAS);
+   }
+
+   struct lp_sampler_dynamic_state dynamic_state = {
+      .width = lp_llvm_sample_func_texture_width,
+      .height = lp_llvm_sample_func_texture_height,
+      .depth = lp_llvm_sample_func_texture_depth,
+      .first_level = lp_llvm_sample_func_texture_first_level,
+      .last_level = lp_llvm_sample_func_texture_last_level,
+      .base_ptr = lp_llvm_sample_func_texture_base_ptr,
+      .row_stride = lp_llvm_sample_func_texture_row_stride,
+      .img_stride = lp_llvm_sample_func_texture_img_stride,
+      .mip_offsets = lp_llvm_sample_func_texture_mip_offsets,
+      .num_samples = lp_llvm_sample_func_texture_num_samples,
+      .sample_stride = lp_llvm_sample_func_texture_sample_stride,
+      .min_lod = lp_llvm_sample_func_sampler_min_lod,
+      .max_lod = lp_llvm_sample_func_sampler_max_lod,
+      .lod_bias = lp_llvm_sample_func_sampler_lod_bias,
+      .border_color = lp_llvm_sample_func_sampler_border_color,
+      .max_aniso = lp_llvm_sample_func_sampler_max_aniso,
+   };
+
+   lp_build_sample_soa_shared_func(gallivm,
+                                   &key->texture_state,
+                                   &key->sampler_state,
+                                   &dynamic_state,
+                                   key->type,
+                                   key->sample_key,
+                                   context_type,
+                                   key->has_aniso_filter_table,
+                                   function);
+
+   gallivm_compile_module(gallivm);
+   func->code = gallivm_jit_function(gallivm, function);
+   gallivm_free_ir(gallivm);
+
+   if (LP_DEBUG & DEBUG_TEX)
+      debug_printf("llvmpipe: compiled shared sampling function %s "
+                   "(format %s, target %u, sample key 0x%x)\n", name,
+                   util_format_short_name(key->texture_state.format),
+                   key->texture_state.target, key->sample_key);
+
+   memcpy(&func->key, key, sizeof(*key));
+   func->gallivm = gallivm;
+   cache->num_funcs++;
+   return func;
+}
+
+
+/**
+ * Return the shared sampling function for the given static state and
+ * sample key, compiling it on the first use.
+ *
+ * The function has the type returned by lp_build_sample_func_type() for a
+ * pointer to struct lp_jit_sample_context.
+ */
+static func_pointer
+lp_sample_func_cache_get(struct lp_sample_func_cache *cache,
+                         const struct lp_static_texture_state *texture_state,
+                         const struct lp_static_sampler_state *sampler_state,
+                         struct lp_type type,
+                         unsigned sample_key,
+                         boolean has_aniso_filter_table)
+{
+   struct lp_sample_func_key key;
+   struct lp_sample_func *func;
+
+   memset(&key, 0, sizeof(key));
+   memcpy(&key.texture_state, texture_state, sizeof(key.texture_state));
+   memcpy(&key.sampler_state, sampler_state, sizeof(key.sampler_state));
+   key.type = type;
+   key.sample_key = sample_key;
+   key.has_aniso_filter_table = has_aniso_filter_table;
+
+   mtx_lock(&cache->mutex);
+   struct hash_entry *entry = _mesa_hash_table_search(cache->funcs, &key);
+   if (entry) {
+      func = entry->data;
+   } else {
+      func = lp_sample_func_compile(cache, &key);
+      if (func)
+         _mesa_hash_table_insert(cache->funcs, &func->key, func);
+   }
+   mtx_unlock(&cache->mutex);
+
+   return func ? func->code : NULL;
+}
+
+
 /**
  * Fetch the specified member of the lp_jit_image structure.
  * \param emit_load  if TRUE, emit the LLVM load instruction to actually
@@ -399,6 +727,148 @@ lp_llvm_texture_cache_ptr(struct gallivm_state *gallivm,
 }
 #endif
 
+/**
+ * Sample through the shared texture sampling functions.
+ *
+ * The shader only passes pointers to the texture and sampler descriptors,
+ * so with dynamic indexing a single indirect call through a table with the
+ * function of every unit replaces the switch with a sampling function per
+ * unit. Returns FALSE if the shared functions can't be used.
+ */
+static boolean
+lp_llvm_sampler_soa_emit_shared(const struct lp_llvm_sampler_soa *sampler,
+                                struct gallivm_state *gallivm,
+                                const struct lp_sampler_params *params)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   const struct lp_sampler_static_state *static_state =
+      sampler->dynamic_state.static_state;
+   const boolean has_aniso_filter_table = params->aniso_filter_table != NULL;
+   LLVMValueRef funcs[PIPE_MAX_SHADER_SAMPLER_VIEWS];
+   LLVMValueRef texture_unit, sampler_unit;
+   unsigned first, count;
+
+   if (params->texture_index_offset) {
+      /* like the switch, use texture and sampler unit idx for index idx */
+      first = 0;
+      count = MIN2(sampler->nr_samplers, PIPE_MAX_SHADER_SAMPLER_VIEWS);
+      if (!count)
+         return FALSE;
+   } else {
+      const struct lp_sampler_static_state *state =
+         &static_state[params->texture_index];
+
+      /* keep inlining what lp_build_sample_soa() inlines */
+      if (!lp_build_sample_soa_use_func(&state->texture_state,
+                                        &static_state[params->sampler_index].sampler_state,
+                                        params->sample_key))
+         return FALSE;
+
+      first = params->texture_index;
+      count = 1;
+   }
+
+   /* all the functions must be callable through the same pointer type */
+   LLVMTypeRef context_type =
+      lp_jit_create_sample_context_type(gallivm, NULL, NULL);
+   LLVMTypeRef function_type = NULL;
+   for (unsigned i = 0; i < count; i++) {
+      LLVMTypeRef type =
+         lp_build_sample_func_type(gallivm,
+                                   static_state[first + i].texture_state.target,
+                                   params->type, params->sample_key,
+                                   LLVMPointerType(context_type, 0),
+                                   has_aniso_filter_table);
+      if (function_type && type != function_type)
+         return FALSE;
+      function_type = type;
+   }
+
+   /* Everything that can make us fall back is checked before any code is
+    * emitted, the fallback path must start from a clean slate.
+    */
+   if (!lp_build_sample_soa_shared_can_call(&static_state[first].texture_state,
+                                            params, function_type))
+      return FALSE;
+
+   LLVMTypeRef func_ptr_type = LLVMPointerType(function_type, 0);
+   LLVMTypeRef int_ptr_type =
+      LLVMIntTypeInContext(gallivm->context, 8 * sizeof(void *));
+   for (unsigned i = 0; i < count; i++) {
+      const unsigned sampler_index = params->texture_index_offset ?
+                                     first + i : params->sampler_index;
+      func_pointer code =
+         lp_sample_func_cache_get(sampler->funcs,
+                                  &static_state[first + i].texture_state,
+                                  &static_state[sampler_index].sampler_state,
+                                  params->type, params->sample_key,
+                                  has_aniso_filter_table);
+      if (!code)
+         return FALSE;
+
+      funcs[i] = LLVMConstIntToPtr(LLVMConstInt(int_ptr_type,
+                                                (uintptr_t)func_to_pointer(code), 0),
+                                   func_ptr_type);
+   }
+
+   LLVMValueRef function;
+   if (params->texture_index_offset) {
+      LLVMValueRef unit =
+         LLVMBuildAdd(builder, params->texture_index_offset,
+                      lp_build_const_int32(gallivm, params->texture_index), "");
+      LLVMValueRef cond =
+         LLVMBuildICmp(builder, LLVMIntULT, unit,
+                       lp_build_const_int32(gallivm, count), "");
+      unit = LLVMBuildSelect(builder, cond, unit,
+                             lp_build_const_int32(gallivm, 0), "");
+
+      LLVMTypeRef table_type = LLVMArrayType(func_ptr_type, count);
+      LLVMValueRef table = LLVMAddGlobal(gallivm->module, table_type,
+                                         "texfunc_table");
+      LLVMSetInitializer(table, LLVMConstArray(func_ptr_type, funcs, count));
+      LLVMSetGlobalConstant(table, TRUE);
+      LLVMSetLinkage(table, LLVMPrivateLinkage);
+
+      function = lp_build_array_get2(gallivm, table_type, table, unit);
+      texture_unit = sampler_unit = unit;
+   } else {
+      function = funcs[0];
+      texture_unit = lp_build_const_int32(gallivm, params->texture_index);
+      sampler_unit = lp_build_const_int32(gallivm, params->sampler_index);
+   }
+
+   /* point the sample context at context->textures[unit], samplers[unit] */
+   LLVMValueRef sample_ctx = lp_build_alloca(gallivm, context_type,
+                                             "sample_context");
+   LLVMValueRef indices[3];
+   indices[0] = lp_build_const_int32(gallivm, 0);
+   indices[1] = lp_build_const_int32(gallivm, LP_JIT_CTX_TEXTURES);
+   indices[2] = texture_unit;
+   LLVMBuildStore(builder,
+                  LLVMBuildGEP2(builder, params->context_type,
+                                params->context_ptr, indices, 3, ""),
+                  lp_build_struct_get_ptr2(gallivm, context_type, sample_ctx,
+                                           LP_JIT_SAMPLE_CTX_TEXTURE, ""));
+   indices[1] = lp_build_const_int32(gallivm, LP_JIT_CTX_SAMPLERS);
+   indices[2] = sampler_unit;
+   LLVMBuildStore(builder,
+                  LLVMBuildGEP2(builder, params->context_type,
+                                params->context_ptr, indices, 3, ""),
+                  lp_build_struct_get_ptr2(gallivm, context_type, sample_ctx,
+                                           LP_JIT_SAMPLE_CTX_SAMPLER, ""));
+
+   lp_build_sample_soa_shared_call(gallivm, &static_state[first].texture_state,
+                                   params, function_type, function,
+                                   sample_ctx);
+
+   /* The shader now embeds the addresses of the functions. */
+   if (gallivm->cache)
+      gallivm->cache->dont_cache = true;
+
+   return TRUE;
+}
+
+
 /**
  * Fetch filtered values from texture.
  * The 'texel' parameter returns four vectors corresponding to R, G, B, A.
@@ -420,6 +890,10 @@ lp_llvm_sampler_soa_emit_fetch_texel(const struct lp_build_sampler_soa *base,
       return;
    }
 
+   if (sampler->funcs &&
+       lp_llvm_sampler_soa_emit_shared(sampler, gallivm, params))
+      return;
+
    if (params->texture_index_offset) {
       LLVMValueRef unit =
          LLVMBuildAdd(gallivm->builder, params->texture_index_offset,
@@ -467,7 +941,8 @@ lp_llvm_sampler_soa_emit_size_query(const struct lp_build_sampler_soa *base,
 
 struct lp_build_sampler_soa *
 lp_llvm_sampler_soa_create(const struct lp_sampler_static_state *static_state,
-                           unsigned nr_samplers)
+                           unsigned nr_samplers,
+                           struct lp_sample_func_cache *funcs)
 {
    assert(static_state);
 
@@ -501,6 +976,7 @@ lp_llvm_sampler_soa_create(const struct lp_sampler_static_state *static_state,
    sampler->dynamic_state.static_state = static_state;
 
    sampler->nr_samplers = nr_samplers;
+   sampler->funcs = funcs;
    return &sampler->base;
 }
 
@@ -34,6 +34,7 @@
 
 struct lp_sampler_static_state;
 struct lp_image_static_state;
+struct lp_sample_func_cache;
 
 /**
  * Whether texture cache is used for s3tc textures.
@@ -43,10 +44,13 @@ struct lp_image_static_state;
 /**
  * Pure-LLVM texture sampling code generator.
  *
+ * If funcs is not NULL, texture sampling calls the shared functions from
+ * that cache where possible instead of generating the code in the shader.
  */
 struct lp_build_sampler_soa *
 lp_llvm_sampler_soa_create(const struct lp_sampler_static_state *key,
-                           unsigned nr_samplers);
+                           unsigned nr_samplers,
+                           struct lp_sample_func_cache *funcs);
 
 static inline void
 lp_llvm_sampler_soa_destroy(struct lp_build_sampler_soa *sampler)
@@ -54,6 +58,12 @@ lp_llvm_sampler_soa_destroy(struct lp_build_sampler_soa *sampler)
    FREE(sampler);
 }
 
+struct lp_sample_func_cache *
+lp_sample_func_cache_create(void);
+
+void
+lp_sample_func_cache_destroy(struct lp_sample_func_cache *cache);
+
 struct lp_build_image_soa *
 lp_llvm_image_soa_create(const struct lp_image_static_state *key,
                          unsigned nr_images);
@@ -0,0 +1,178 @@
+/*
+ * Copyright © 2023 Sietium Semiconductor
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include "util/simple_mtx.h"
+#include "util/u_debug.h"
+#include "util/u_dynarray.h"
+#include "util/u_memory.h"
+#include "util/u_thread.h"
+
+#include "lp_timeline.h"
+
+/* 32 bytes per event, so 1MB per thread. */
+#define LP_TIMELINE_RING_SIZE (1 << 15)
+
+struct lp_timeline_event {
+   int64_t start;
+   int64_t end;
+   int32_t args[3];
+   uint32_t type;
+};
+
+struct lp_timeline_ring {
+   unsigned tid;
+   char name[16];
+   /* Events ever recorded, the ring holds the last LP_TIMELINE_RING_SIZE. */
+   uint64_t count;
+   struct lp_timeline_event events[LP_TIMELINE_RING_SIZE];
+};
+
+static const struct {
+   const char *name;
+   const char *cat;
+   const char *args[3];
+} lp_timeline_event_info[LP_TIMELINE_NUM_EVENT_TYPES] = {
+   [LP_TIMELINE_BIN_SCENE]       = { "bin scene", "setup", { "tiles_x", "tiles_y" } },
+   [LP_TIMELINE_QUEUE_SCENE]     = { "queue scene", "setup", { "fence" } },
+   [LP_TIMELINE_RASTERIZE_SCENE] = { "rasterize scene", "rast", { "bins" } },
+   [LP_TIMELINE_RASTERIZE_BIN]   = { "rasterize bin", "rast", { "x", "y", "cmds" } },
+   [LP_TIMELINE_FS_VARIANT]      = { "fs variant", "jit", { "shader", "variant", "cached" } },
+   [LP_TIMELINE_CS_VARIANT]      = { "cs variant", "jit", { "shader", "variant", "cached" } },
+   [LP_TIMELINE_SETUP_VARIANT]   = { "setup variant", "jit", { "variant" } },
+   [LP_TIMELINE_FENCE_WAIT]      = { "fence wait", "fence", { "fence" } },
+};
+
+static __THREAD_INITIAL_EXEC struct lp_timeline_ring *lp_timeline_thread_ring;
+
+/* All rings ever created.  Rings belong to their thread and are never
+ * freed, as the thread may still record events after a screen is gone.
+ */
+static simple_mtx_t lp_timeline_mutex = SIMPLE_MTX_INITIALIZER;
+static struct util_dynarray lp_timeline_rings;
+
+static struct lp_timeline_ring *
+lp_timeline_get_ring(void)
+{
+   struct lp_timeline_ring *ring = lp_timeline_thread_ring;
+
+   if (likely(ring))
+      return ring;
+
+   ring = CALLOC_STRUCT(lp_timeline_ring);
+   if (!ring)
+      return NULL;
+
+   simple_mtx_lock(&lp_timeline_mutex);
+   ring->tid = util_dynarray_num_elements(&lp_timeline_rings,
+                                          struct lp_timeline_ring *) + 1;
+   snprintf(ring->name, sizeof(ring->name), "thread %u", ring->tid);
+   util_dynarray_append(&lp_timeline_rings, struct lp_timeline_ring *, ring);
+   simple_mtx_unlock(&lp_timeline_mutex);
+
+   lp_timeline_thread_ring = ring;
+   return ring;
+}
+
+void
+lp_timeline_record(enum lp_timeline_event_type type, int64_t start,
+                   int32_t arg0, int32_t arg1, int32_t arg2)
+{
+   struct lp_timeline_ring *ring = lp_timeline_get_ring();
+
+   if (!ring)
+      return;
+
+   struct lp_timeline_event *event =
+      &ring->events[ring->count % LP_TIMELINE_RING_SIZE];
+   event->start = start;
+   event->end = os_time_get_nano();
+   event->args[0] = arg0;
+   event->args[1] = arg1;
+   event->args[2] = arg2;
+   event->type = type;
+   ring->count++;
+}
+
+void
+lp_timeline_set_thread_name(const char *name)
+{
+   if (!lp_timeline_enabled())
+      return;
+
+   struct lp_timeline_ring *ring = lp_timeline_get_ring();
+   if (ring)
+      snprintf(ring->name, sizeof(ring->name), "%s", name);
+}
+
+/**
+ * Writes all the recorded events to LP_TIMELINE_FILE.  Threads of other
+ * screens may still be recording, their latest events can be torn.
+ */
+void
+lp_timeline_write(void)
+{
+   if (!lp_timeline_enabled())
+      return;
+
+   const char *filename = debug_get_option("LP_TIMELINE_FILE",
+                                           "llvmpipe_timeline.json");
+   FILE *f = fopen(filename, "w");
+   if (!f) {
+      debug_printf("llvmpipe: could not write the timeline to %s\n",
+                   filename);
+      return;
+   }
+
+   simple_mtx_lock(&lp_timeline_mutex);
+
+   fprintf(f, "{\"traceEvents\":[\n");
+   fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+              "\"args\":{\"name\":\"llvmpipe\"}}");
+
+   util_dynarray_foreach(&lp_timeline_rings, struct lp_timeline_ring *, r) {
+      const struct lp_timeline_ring *ring = *r;
+      uint64_t count = ring->count;
+      uint64_t first = count > LP_TIMELINE_RING_SIZE ?
+         count - LP_TIMELINE_RING_SIZE : 0;
+
+      fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                 "\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+              ring->tid, ring->name);
+
+      for (uint64_t i = first; i < count; i++) {
+         const struct lp_timeline_event *event =
+            &ring->events[i % LP_TIMELINE_RING_SIZE];
+         const unsigned type = MIN2(event->type, LP_TIMELINE_NUM_EVENT_TYPES - 1);
+
+         /* Timestamps are in microseconds. */
+         fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\","
+                    "\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{",
+                 lp_timeline_event_info[type].name,
+                 lp_timeline_event_info[type].cat, ring->tid,
+                 event->start / 1000.0, (event->end - event->start) / 1000.0);
+
+         for (unsigned a = 0; a < ARRAY_SIZE(event->args); a++) {
+            const char *arg = lp_timeline_event_info[type].args[a];
+            if (arg)
+               fprintf(f, "%s\"%s\":%d", a ? "," : "", arg, event->args[a]);
+         }
+         fprintf(f, "}}");
+      }
+
+      if (first) {
+         debug_printf("llvmpipe: timeline of %s dropped %" PRIu64
+                      " oldest events\n", ring->name, first);
+      }
+   }
+
+   simple_mtx_unlock(&lp_timeline_mutex);
+
+   fprintf(f, "\n],\"displayTimeUnit\":\"ns\"}\n");
+   fclose(f);
+}
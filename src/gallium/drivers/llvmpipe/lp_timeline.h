@@ -0,0 +1,69 @@
+/*
+ * Copyright © 2023 Sietium Semiconductor
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * Timeline of the scene and rasterizer pipeline, enabled with
+ * LP_DEBUG=timeline.
+ *
+ * Each thread records complete events into its own ring buffer, so
+ * recording takes no locks.  The rings are written out as Chrome trace
+ * JSON, which Perfetto and chrome://tracing load, when a screen is
+ * destroyed.  Once a ring is full the oldest events are overwritten.
+ */
+
+#ifndef LP_TIMELINE_H
+#define LP_TIMELINE_H
+
+#include "util/os_time.h"
+#include "lp_debug.h"
+
+enum lp_timeline_event_type {
+   LP_TIMELINE_BIN_SCENE,
+   LP_TIMELINE_QUEUE_SCENE,
+   LP_TIMELINE_RASTERIZE_SCENE,
+   LP_TIMELINE_RASTERIZE_BIN,
+   LP_TIMELINE_FS_VARIANT,
+   LP_TIMELINE_CS_VARIANT,
+   LP_TIMELINE_SETUP_VARIANT,
+   LP_TIMELINE_FENCE_WAIT,
+   LP_TIMELINE_NUM_EVENT_TYPES
+};
+
+static inline bool
+lp_timeline_enabled(void)
+{
+   return unlikely(LP_DEBUG & DEBUG_TIMELINE);
+}
+
+/** Returns the start time to pass to lp_timeline_end(). */
+static inline int64_t
+lp_timeline_begin(void)
+{
+   return lp_timeline_enabled() ? os_time_get_nano() : 0;
+}
+
+void
+lp_timeline_record(enum lp_timeline_event_type type, int64_t start,
+                   int32_t arg0, int32_t arg1, int32_t arg2);
+
+/** Records an event from start until now, see the event types in
+ * lp_timeline.c for what the arguments are.
+ */
+static inline void
+lp_timeline_end(enum lp_timeline_event_type type, int64_t start,
+                int32_t arg0, int32_t arg1, int32_t arg2)
+{
+   if (lp_timeline_enabled())
+      lp_timeline_record(type, start, arg0, arg1, arg2);
+}
+
+void
+lp_timeline_set_thread_name(const char *name);
+
+void
+lp_timeline_write(void);
+
+#endif /* LP_TIMELINE_H */
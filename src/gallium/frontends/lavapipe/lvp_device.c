@@ -256,6 +256,7 @@ lvp_physical_device_init(struct lvp_physical_device *device,
 
    device->max_images = device->pscreen->get_shader_param(device->pscreen, MESA_SHADER_FRAGMENT, PIPE_SHADER_CAP_MAX_SHADER_IMAGES);
    device->vk.supported_extensions = lvp_device_extensions_supported;
+   device->vk.pipeline_cache_import_ops = lvp_pipeline_cache_import_ops;
 
    VkSampleCountFlags sample_counts = VK_SAMPLE_COUNT_1_BIT | VK_SAMPLE_COUNT_4_BIT;
 
@@ -1655,6 +1656,13 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDevice(
       return result;
    }
 
+   /* llvmpipe creates its disk cache with the first context. */
+   if (!physical_device->vk.disk_cache && device->pscreen->get_disk_shader_cache)
+      physical_device->vk.disk_cache = device->pscreen->get_disk_shader_cache(device->pscreen);
+
+   struct vk_pipeline_cache_create_info pcc_info = { };
+   device->mem_cache = vk_pipeline_cache_create(&device->vk, &pcc_info, NULL);
+
    nir_builder b = nir_builder_init_simple_shader(MESA_SHADER_FRAGMENT, NULL, "dummy_frag");
    struct pipe_shader_state shstate = {0};
    shstate.type = PIPE_SHADER_IR_NIR;
@@ -1675,6 +1683,9 @@ VKAPI_ATTR void VKAPI_CALL lvp_DestroyDevice(
 
    device->queue.ctx->delete_fs_state(device->queue.ctx, device->noop_fs);
 
+   if (device->mem_cache)
+      vk_pipeline_cache_destroy(device->mem_cache, NULL);
+
    if (device->queue.last_fence)
       device->pscreen->fence_reference(device->pscreen, &device->queue.last_fence, NULL);
    lvp_queue_finish(&device->queue);
@@ -290,10 +290,10 @@ update_inline_shader_state(struct rendering_state *state, enum pipe_shader_type
    struct lvp_inline_variant v;
    v.mask = shader->inlines.can_inline;
    /* these buffers have already been flushed in llvmpipe, so they're safe to read */
-   nir_shader *base_nir = shader->pipeline_nir->nir;
+   struct lvp_pipeline_nir *base = shader->pipeline_nir;
    if (stage == MESA_SHADER_TESS_EVAL && state->tess_ccw)
-      base_nir = shader->tess_ccw->nir;
-   nir_function_impl *impl = nir_shader_get_entrypoint(base_nir);
+      base = shader->tess_ccw;
+   nir_function_impl *impl = nir_shader_get_entrypoint(base->nir);
    unsigned ssa_alloc = impl->ssa_alloc;
    unsigned count = shader->inlines.count[0];
    if (count && pcbuf_dirty) {
@@ -346,7 +346,7 @@ update_inline_shader_state(struct rendering_state *state, enum pipe_shader_type
       const struct lvp_inline_variant *variant = entry->key;
       shader_state = variant->cso;
    } else {
-      nir_shader *nir = nir_shader_clone(NULL, base_nir);
+      nir_shader *nir = lvp_pipeline_nir_fork(base);
       NIR_PASS_V(nir, lvp_inline_uniforms, shader, v.vals[0], 0);
       if (constbuf_dirty) {
          u_foreach_bit(slot, shader->inlines.can_inline)
@@ -359,7 +359,7 @@ update_inline_shader_state(struct rendering_state *state, enum pipe_shader_type
          /* not enough change; don't inline further */
          shader->inlines.can_inline = 0;
          ralloc_free(nir);
-         shader->shader_cso = lvp_shader_compile(state->device, shader, nir_shader_clone(NULL, shader->pipeline_nir->nir));
+         shader->shader_cso = lvp_shader_compile(state->device, shader, lvp_pipeline_nir_fork(shader->pipeline_nir));
          _mesa_set_remove(&shader->inlines.variants, entry);
          shader_state = shader->shader_cso;
       } else {
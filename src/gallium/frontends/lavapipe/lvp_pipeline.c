@@ -378,6 +378,7 @@ create_pipeline_nir(nir_shader *nir)
    struct lvp_pipeline_nir *pipeline_nir = ralloc(NULL, struct lvp_pipeline_nir);
    pipeline_nir->nir = nir;
    pipeline_nir->ref_cnt = 1;
+   pipeline_nir->snapshot = NULL;
    return pipeline_nir;
 }
 
@@ -545,24 +546,133 @@ lvp_shader_lower(struct lvp_device *pdevice, nir_shader *nir, struct lvp_shader
    nir_function_impl *impl = nir_shader_get_entrypoint(nir);
    if (impl->ssa_alloc > 100) //skip for small shaders
       shader->inlines.must_inline = lvp_find_inlinable_uniforms(shader, nir);
+}
+
+static void
+lvp_shader_init_nir(struct lvp_shader *shader, nir_shader *nir)
+{
    shader->pipeline_nir = create_pipeline_nir(nir);
    if (shader->inlines.can_inline)
       _mesa_set_init(&shader->inlines.variants, NULL, NULL, inline_variant_equals);
 }
 
+/* The lowered NIR depends on the stage and on the descriptor layout, the
+ * rest of the pipeline state is only applied when compiling it.
+ */
+static void
+lvp_shader_hash(const VkPipelineShaderStageCreateInfo *sinfo,
+                const struct lvp_pipeline_layout *layout,
+                unsigned char *sha1)
+{
+   struct mesa_sha1 ctx;
+   unsigned char stage_sha1[SHA1_DIGEST_LENGTH];
+
+   vk_pipeline_hash_shader_stage(sinfo, NULL, stage_sha1);
+
+   _mesa_sha1_init(&ctx);
+   _mesa_sha1_update(&ctx, stage_sha1, sizeof(stage_sha1));
+   if (layout) {
+      _mesa_sha1_update(&ctx, &layout->push_constant_size,
+                        sizeof(layout->push_constant_size));
+      _mesa_sha1_update(&ctx, &layout->push_constant_stages,
+                        sizeof(layout->push_constant_stages));
+      _mesa_sha1_update(&ctx, layout->stage, sizeof(layout->stage));
+      _mesa_sha1_update(&ctx, &layout->vk.set_count,
+                        sizeof(layout->vk.set_count));
+
+      /* Same fields as layouts_equal(), set layouts are zero-allocated. */
+      const uint32_t set_start = sizeof(struct vk_descriptor_set_layout);
+      const uint32_t binding_offset =
+         offsetof(struct lvp_descriptor_set_layout, binding);
+      for (unsigned s = 0; s < layout->vk.set_count; s++) {
+         if (!layout->vk.set_layouts[s]) {
+            _mesa_sha1_update(&ctx, &s, sizeof(s));
+            continue;
+         }
+
+         const struct lvp_descriptor_set_layout *set_layout =
+            vk_to_lvp_descriptor_set_layout(layout->vk.set_layouts[s]);
+         _mesa_sha1_update(&ctx, (const uint8_t *)set_layout + set_start,
+                           binding_offset - set_start);
+         for (unsigned b = 0; b < set_layout->binding_count; b++) {
+            _mesa_sha1_update(&ctx, &set_layout->binding[b],
+                              offsetof(struct lvp_descriptor_set_binding_layout,
+                                       immutable_samplers));
+         }
+      }
+   }
+   _mesa_sha1_final(&ctx, sha1);
+}
+
 static VkResult
 lvp_shader_compile_to_ir(struct lvp_pipeline *pipeline,
-                         const VkPipelineShaderStageCreateInfo *sinfo)
+                         struct vk_pipeline_cache *cache,
+                         const VkPipelineShaderStageCreateInfo *sinfo,
+                         VkPipelineCreationFeedback *stage_feedback)
 {
    struct lvp_device *pdevice = pipeline->device;
    gl_shader_stage stage = vk_to_mesa_shader_stage(sinfo->stage);
    assert(stage <= MESA_SHADER_COMPUTE && stage != MESA_SHADER_NONE);
    struct lvp_shader *shader = &pipeline->shaders[stage];
-   nir_shader *nir;
-   VkResult result = compile_spirv(pdevice, sinfo, &nir);
-   if (result == VK_SUCCESS)
+   int64_t t0 = os_time_get_nano();
+   unsigned char sha1[SHA1_DIGEST_LENGTH];
+   bool cache_hit;
+
+   lvp_shader_hash(sinfo, pipeline->layout, sha1);
+   nir_shader *nir =
+      lvp_pipeline_cache_lookup_shader(cache, sha1,
+                                       pdevice->physical_device->drv_options[stage],
+                                       shader, &cache_hit);
+   if (!nir) {
+      VkResult result = compile_spirv(pdevice, sinfo, &nir);
+      if (result != VK_SUCCESS)
+         return result;
       lvp_shader_lower(pdevice, nir, shader, pipeline->layout);
-   return result;
+      lvp_pipeline_cache_add_shader(cache, sha1, shader, nir);
+   }
+   lvp_shader_init_nir(shader, nir);
+
+   if (stage_feedback) {
+      stage_feedback->flags = VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT;
+      /* Only hits in the application's cache count, not the disk cache. */
+      if (cache_hit && cache != pdevice->mem_cache)
+         stage_feedback->flags |= VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT;
+      stage_feedback->duration = os_time_get_nano() - t0;
+   }
+   return VK_SUCCESS;
+}
+
+/* Fills in the pipeline feedback, which is a cache hit if every stage
+ * compiled by the pipeline was.
+ */
+static void
+lvp_pipeline_feedback(const VkPipelineCreationFeedbackCreateInfo *feedback,
+                      const VkPipelineCreationFeedback *stage_feedbacks,
+                      uint32_t stage_count, int64_t duration)
+{
+   if (!feedback)
+      return;
+
+   VkPipelineCreationFeedbackFlags flags = VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT;
+   bool all_hit = false;
+   for (uint32_t i = 0; i < stage_count; i++) {
+      if (!(stage_feedbacks[i].flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT))
+         continue;
+      if (!(stage_feedbacks[i].flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT)) {
+         all_hit = false;
+         break;
+      }
+      all_hit = true;
+   }
+   if (all_hit)
+      flags |= VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT;
+
+   feedback->pPipelineCreationFeedback->flags = flags;
+   feedback->pPipelineCreationFeedback->duration = duration;
+   for (uint32_t i = 0; i < feedback->pipelineStageCreationFeedbackCount; i++) {
+      feedback->pPipelineStageCreationFeedbacks[i] =
+         i < stage_count ? stage_feedbacks[i] : (VkPipelineCreationFeedback){0};
+   }
 }
 
 static void
@@ -809,8 +919,9 @@ copy_shader_sanitized(struct lvp_shader *dst, const struct lvp_shader *src)
 static VkResult
 lvp_graphics_pipeline_init(struct lvp_pipeline *pipeline,
                            struct lvp_device *device,
-                           struct lvp_pipeline_cache *cache,
-                           const VkGraphicsPipelineCreateInfo *pCreateInfo)
+                           struct vk_pipeline_cache *cache,
+                           const VkGraphicsPipelineCreateInfo *pCreateInfo,
+                           VkPipelineCreationFeedback *stage_feedbacks)
 {
    VkResult result;
 
@@ -897,7 +1008,8 @@ lvp_graphics_pipeline_init(struct lvp_pipeline *pipeline,
          if (!(pipeline->stages & VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT))
             continue;
       }
-      result = lvp_shader_compile_to_ir(pipeline, sinfo);
+      result = lvp_shader_compile_to_ir(pipeline, cache, sinfo,
+                                        &stage_feedbacks[i]);
       if (result != VK_SUCCESS)
          goto fail;
 
@@ -962,6 +1074,17 @@ fail:
    return result;
 }
 
+/* Shaders from a pipeline library are compiled again for every pipeline
+ * linked against the library, so fork those instead of cloning them.
+ */
+static nir_shader *
+pipeline_nir_copy(struct lvp_pipeline_nir *pipeline_nir)
+{
+   if (p_atomic_read(&pipeline_nir->ref_cnt) > 1)
+      return lvp_pipeline_nir_fork(pipeline_nir);
+   return nir_shader_clone(NULL, pipeline_nir->nir);
+}
+
 void
 lvp_pipeline_shaders_compile(struct lvp_pipeline *pipeline)
 {
@@ -976,10 +1099,10 @@ lvp_pipeline_shaders_compile(struct lvp_pipeline *pipeline)
 
       if (!pipeline->shaders[stage].inlines.can_inline) {
          pipeline->shaders[stage].shader_cso = lvp_shader_compile(pipeline->device, &pipeline->shaders[stage],
-                                                            nir_shader_clone(NULL, pipeline->shaders[stage].pipeline_nir->nir));
+                                                            pipeline_nir_copy(pipeline->shaders[stage].pipeline_nir));
          if (pipeline->shaders[MESA_SHADER_TESS_EVAL].tess_ccw)
             pipeline->shaders[MESA_SHADER_TESS_EVAL].tess_ccw_cso = lvp_shader_compile(pipeline->device, &pipeline->shaders[stage],
-                                                          nir_shader_clone(NULL, pipeline->shaders[MESA_SHADER_TESS_EVAL].tess_ccw->nir));
+                                                          pipeline_nir_copy(pipeline->shaders[MESA_SHADER_TESS_EVAL].tess_ccw));
       }
    }
    pipeline->compiled = true;
@@ -993,12 +1116,15 @@ lvp_graphics_pipeline_create(
    VkPipeline *pPipeline)
 {
    LVP_FROM_HANDLE(lvp_device, device, _device);
-   LVP_FROM_HANDLE(lvp_pipeline_cache, cache, _cache);
+   VK_FROM_HANDLE(vk_pipeline_cache, cache, _cache);
    struct lvp_pipeline *pipeline;
    VkResult result;
 
    assert(pCreateInfo->sType == VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO);
 
+   if (!cache)
+      cache = device->mem_cache;
+
    pipeline = vk_zalloc(&device->vk.alloc, sizeof(*pipeline), 8,
                          VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
    if (pipeline == NULL)
@@ -1006,19 +1132,19 @@ lvp_graphics_pipeline_create(
 
    vk_object_base_init(&device->vk, &pipeline->base,
                        VK_OBJECT_TYPE_PIPELINE);
+   VkPipelineCreationFeedback stage_feedbacks[MESA_SHADER_STAGES] = {0};
+   assert(pCreateInfo->stageCount <= ARRAY_SIZE(stage_feedbacks));
    uint64_t t0 = os_time_get_nano();
-   result = lvp_graphics_pipeline_init(pipeline, device, cache, pCreateInfo);
+   result = lvp_graphics_pipeline_init(pipeline, device, cache, pCreateInfo,
+                                       stage_feedbacks);
    if (result != VK_SUCCESS) {
       vk_free(&device->vk.alloc, pipeline);
       return result;
    }
 
-   VkPipelineCreationFeedbackCreateInfo *feedback = (void*)vk_find_struct_const(pCreateInfo->pNext, PIPELINE_CREATION_FEEDBACK_CREATE_INFO);
-   if (feedback) {
-      feedback->pPipelineCreationFeedback->duration = os_time_get_nano() - t0;
-      feedback->pPipelineCreationFeedback->flags = VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT;
-      memset(feedback->pPipelineStageCreationFeedbacks, 0, sizeof(VkPipelineCreationFeedback) * feedback->pipelineStageCreationFeedbackCount);
-   }
+   const VkPipelineCreationFeedbackCreateInfo *feedback = (void*)vk_find_struct_const(pCreateInfo->pNext, PIPELINE_CREATION_FEEDBACK_CREATE_INFO);
+   lvp_pipeline_feedback(feedback, stage_feedbacks, pCreateInfo->stageCount,
+                         os_time_get_nano() - t0);
 
    *pPipeline = lvp_pipeline_to_handle(pipeline);
 
@@ -1061,8 +1187,9 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateGraphicsPipelines(
 static VkResult
 lvp_compute_pipeline_init(struct lvp_pipeline *pipeline,
                           struct lvp_device *device,
-                          struct lvp_pipeline_cache *cache,
-                          const VkComputePipelineCreateInfo *pCreateInfo)
+                          struct vk_pipeline_cache *cache,
+                          const VkComputePipelineCreateInfo *pCreateInfo,
+                          VkPipelineCreationFeedback *stage_feedback)
 {
    pipeline->device = device;
    pipeline->layout = lvp_pipeline_layout_from_handle(pCreateInfo->layout);
@@ -1071,7 +1198,8 @@ lvp_compute_pipeline_init(struct lvp_pipeline *pipeline,
 
    pipeline->is_compute_pipeline = true;
 
-   VkResult result = lvp_shader_compile_to_ir(pipeline, &pCreateInfo->stage);
+   VkResult result = lvp_shader_compile_to_ir(pipeline, cache, &pCreateInfo->stage,
+                                              stage_feedback);
    if (result != VK_SUCCESS)
       return result;
 
@@ -1090,12 +1218,15 @@ lvp_compute_pipeline_create(
    VkPipeline *pPipeline)
 {
    LVP_FROM_HANDLE(lvp_device, device, _device);
-   LVP_FROM_HANDLE(lvp_pipeline_cache, cache, _cache);
+   VK_FROM_HANDLE(vk_pipeline_cache, cache, _cache);
    struct lvp_pipeline *pipeline;
    VkResult result;
 
    assert(pCreateInfo->sType == VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO);
 
+   if (!cache)
+      cache = device->mem_cache;
+
    pipeline = vk_zalloc(&device->vk.alloc, sizeof(*pipeline), 8,
                          VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
    if (pipeline == NULL)
@@ -1103,19 +1234,18 @@ lvp_compute_pipeline_create(
 
    vk_object_base_init(&device->vk, &pipeline->base,
                        VK_OBJECT_TYPE_PIPELINE);
+   VkPipelineCreationFeedback stage_feedback = {0};
    uint64_t t0 = os_time_get_nano();
-   result = lvp_compute_pipeline_init(pipeline, device, cache, pCreateInfo);
+   result = lvp_compute_pipeline_init(pipeline, device, cache, pCreateInfo,
+                                      &stage_feedback);
    if (result != VK_SUCCESS) {
       vk_free(&device->vk.alloc, pipeline);
       return result;
    }
 
    const VkPipelineCreationFeedbackCreateInfo *feedback = (void*)vk_find_struct_const(pCreateInfo->pNext, PIPELINE_CREATION_FEEDBACK_CREATE_INFO);
-   if (feedback) {
-      feedback->pPipelineCreationFeedback->duration = os_time_get_nano() - t0;
-      feedback->pPipelineCreationFeedback->flags = VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT;
-      memset(feedback->pPipelineStageCreationFeedbacks, 0, sizeof(VkPipelineCreationFeedback) * feedback->pipelineStageCreationFeedbackCount);
-   }
+   lvp_pipeline_feedback(feedback, &stage_feedback, 1,
+                         os_time_get_nano() - t0);
 
    *pPipeline = lvp_pipeline_to_handle(pipeline);
 
@@ -1243,6 +1373,7 @@ create_shader_object(struct lvp_device *device, const VkShaderCreateInfoEXT *pCr
    };
    shader->layout = lvp_pipeline_layout_create(device, &pci, pAllocator);
    lvp_shader_lower(device, nir, shader, shader->layout);
+   lvp_shader_init_nir(shader, nir);
    lvp_shader_xfb_init(shader);
    if (stage == MESA_SHADER_TESS_EVAL) {
       /* spec requires that all tess modes are set in both shaders */
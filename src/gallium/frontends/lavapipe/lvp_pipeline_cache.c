@@ -21,82 +21,172 @@
  * IN THE SOFTWARE.
  */
 
+/* Pipeline cache objects: the lowered NIR of a shader stage, along with the
+ * lvp_shader info gathered while lowering it, keyed by the stage and the
+ * pipeline layout.  Caches are the common vk_pipeline_cache, backed by the
+ * screen's disk cache, which also holds llvmpipe's compiled shader code.
+ */
+
 #include "lvp_private.h"
+#include "util/blob.h"
+
+struct lvp_cached_shader {
+   struct vk_pipeline_cache_object base;
+   uint8_t sha1[SHA1_DIGEST_LENGTH];
+   const void *data;
+   size_t size;
+};
+
+static const struct vk_pipeline_cache_object_ops lvp_cached_shader_ops;
 
-VKAPI_ATTR VkResult VKAPI_CALL lvp_CreatePipelineCache(
-    VkDevice                                    _device,
-    const VkPipelineCacheCreateInfo*            pCreateInfo,
-    const VkAllocationCallbacks*                pAllocator,
-    VkPipelineCache*                            pPipelineCache)
+static struct vk_pipeline_cache_object *
+lvp_cached_shader_create(struct vk_device *device, const void *sha1,
+                         const void *data, size_t size)
 {
-   LVP_FROM_HANDLE(lvp_device, device, _device);
-   struct lvp_pipeline_cache *cache;
+   VK_MULTIALLOC(ma);
+   VK_MULTIALLOC_DECL(&ma, struct lvp_cached_shader, cached, 1);
+   VK_MULTIALLOC_DECL(&ma, uint8_t, copy, size);
 
-   assert(pCreateInfo->sType == VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO);
+   if (!vk_multialloc_alloc(&ma, &device->alloc,
+                            VK_SYSTEM_ALLOCATION_SCOPE_DEVICE))
+      return NULL;
 
-   cache = vk_alloc2(&device->vk.alloc, pAllocator,
-                       sizeof(*cache), 8,
-                       VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
-   if (cache == NULL)
-      return vk_error(device, VK_ERROR_OUT_OF_HOST_MEMORY);
+   memcpy(cached->sha1, sha1, sizeof(cached->sha1));
+   vk_pipeline_cache_object_init(device, &cached->base, &lvp_cached_shader_ops,
+                                 cached->sha1, sizeof(cached->sha1));
+   memcpy(copy, data, size);
+   cached->data = copy;
+   cached->size = size;
 
-   vk_object_base_init(&device->vk, &cache->base,
-                       VK_OBJECT_TYPE_PIPELINE_CACHE);
-   if (pAllocator)
-     cache->alloc = *pAllocator;
-   else
-     cache->alloc = device->vk.alloc;
+   return &cached->base;
+}
 
-   cache->device = device;
-   *pPipelineCache = lvp_pipeline_cache_to_handle(cache);
+static bool
+lvp_cached_shader_serialize(struct vk_pipeline_cache_object *object,
+                            struct blob *blob)
+{
+   struct lvp_cached_shader *cached =
+      container_of(object, struct lvp_cached_shader, base);
 
-   return VK_SUCCESS;
+   blob_write_bytes(blob, cached->data, cached->size);
+   return true;
 }
 
-VKAPI_ATTR void VKAPI_CALL lvp_DestroyPipelineCache(
-    VkDevice                                    _device,
-    VkPipelineCache                             _cache,
-    const VkAllocationCallbacks*                pAllocator)
+static struct vk_pipeline_cache_object *
+lvp_cached_shader_deserialize(struct vk_pipeline_cache *cache,
+                              const void *key_data, size_t key_size,
+                              struct blob_reader *blob)
 {
-   LVP_FROM_HANDLE(lvp_device, device, _device);
-   LVP_FROM_HANDLE(lvp_pipeline_cache, cache, _cache);
+   size_t size = blob->end - blob->current;
 
-   if (!_cache)
-      return;
-//   lvp_pipeline_cache_finish(cache);
-   vk_object_base_finish(&cache->base);
-   vk_free2(&device->vk.alloc, pAllocator, cache);
+   assert(key_size == SHA1_DIGEST_LENGTH);
+   return lvp_cached_shader_create(cache->base.device, key_data,
+                                   blob_read_bytes(blob, size), size);
 }
 
-VKAPI_ATTR VkResult VKAPI_CALL lvp_GetPipelineCacheData(
-        VkDevice                                    _device,
-        VkPipelineCache                             _cache,
-        size_t*                                     pDataSize,
-        void*                                       pData)
+static void
+lvp_cached_shader_destroy(struct vk_device *device,
+                          struct vk_pipeline_cache_object *object)
 {
-   VkResult result = VK_SUCCESS;
-   if (pData) {
-      if (*pDataSize < 32) {
-         *pDataSize = 0;
-         result = VK_INCOMPLETE;
-      } else {
-         uint32_t *hdr = (uint32_t *)pData;
-         hdr[0] = 32;
-         hdr[1] = 1;
-         hdr[2] = VK_VENDOR_ID_MESA;
-         hdr[3] = 0;
-         lvp_device_get_cache_uuid(&hdr[4]);
-      }
-   } else
-      *pDataSize = 32;
-   return result;
+   struct lvp_cached_shader *cached =
+      container_of(object, struct lvp_cached_shader, base);
+
+   vk_pipeline_cache_object_finish(&cached->base);
+   vk_free(&device->alloc, cached);
+}
+
+static const struct vk_pipeline_cache_object_ops lvp_cached_shader_ops = {
+   .serialize = lvp_cached_shader_serialize,
+   .deserialize = lvp_cached_shader_deserialize,
+   .destroy = lvp_cached_shader_destroy,
+};
+
+const struct vk_pipeline_cache_object_ops *const lvp_pipeline_cache_import_ops[] = {
+   &lvp_cached_shader_ops,
+   NULL,
+};
+
+nir_shader *
+lvp_pipeline_cache_lookup_shader(struct vk_pipeline_cache *cache,
+                                 const unsigned char *sha1,
+                                 const nir_shader_compiler_options *options,
+                                 struct lvp_shader *shader, bool *cache_hit)
+{
+   *cache_hit = false;
+   if (!cache)
+      return NULL;
+
+   struct vk_pipeline_cache_object *object =
+      vk_pipeline_cache_lookup_object(cache, sha1, SHA1_DIGEST_LENGTH,
+                                      &lvp_cached_shader_ops, cache_hit);
+   if (!object)
+      return NULL;
+
+   struct lvp_cached_shader *cached =
+      container_of(object, struct lvp_cached_shader, base);
+   struct blob_reader blob;
+   struct lvp_access_info access;
+   uint32_t uniform_offsets[PIPE_MAX_CONSTANT_BUFFERS][MAX_INLINABLE_UNIFORMS];
+   uint8_t count[PIPE_MAX_CONSTANT_BUFFERS];
+
+   blob_reader_init(&blob, cached->data, cached->size);
+   blob_copy_bytes(&blob, &access, sizeof(access));
+   blob_copy_bytes(&blob, uniform_offsets, sizeof(uniform_offsets));
+   blob_copy_bytes(&blob, count, sizeof(count));
+   bool must_inline = blob_read_uint8(&blob);
+   uint32_t can_inline = blob_read_uint32(&blob);
+   nir_shader *nir = nir_deserialize(NULL, options, &blob);
+
+   vk_pipeline_cache_object_unref(cache->base.device, object);
+
+   if (blob.overrun) {
+      ralloc_free(nir);
+      *cache_hit = false;
+      return NULL;
+   }
+
+   shader->access = access;
+   memcpy(shader->inlines.uniform_offsets, uniform_offsets,
+          sizeof(uniform_offsets));
+   memcpy(shader->inlines.count, count, sizeof(count));
+   shader->inlines.must_inline = must_inline;
+   shader->inlines.can_inline = can_inline;
+
+   return nir;
 }
 
-VKAPI_ATTR VkResult VKAPI_CALL lvp_MergePipelineCaches(
-        VkDevice                                    _device,
-        VkPipelineCache                             destCache,
-        uint32_t                                    srcCacheCount,
-        const VkPipelineCache*                      pSrcCaches)
+void
+lvp_pipeline_cache_add_shader(struct vk_pipeline_cache *cache,
+                              const unsigned char *sha1,
+                              const struct lvp_shader *shader,
+                              const nir_shader *nir)
 {
-   return VK_SUCCESS;
+   if (!cache)
+      return;
+
+   struct blob blob;
+
+   blob_init(&blob);
+   blob_write_bytes(&blob, &shader->access, sizeof(shader->access));
+   blob_write_bytes(&blob, shader->inlines.uniform_offsets,
+                    sizeof(shader->inlines.uniform_offsets));
+   blob_write_bytes(&blob, shader->inlines.count,
+                    sizeof(shader->inlines.count));
+   blob_write_uint8(&blob, shader->inlines.must_inline);
+   blob_write_uint32(&blob, shader->inlines.can_inline);
+   nir_serialize(&blob, nir, false);
+
+   if (blob.out_of_memory) {
+      blob_finish(&blob);
+      return;
+   }
+
+   struct vk_pipeline_cache_object *object =
+      lvp_cached_shader_create(cache->base.device, sha1, blob.data, blob.size);
+   blob_finish(&blob);
+   if (!object)
+      return;
+
+   object = vk_pipeline_cache_add_object(cache, object);
+   vk_pipeline_cache_object_unref(cache->base.device, object);
 }
@@ -43,6 +43,7 @@
 #include "pipe/p_state.h"
 #include "cso_cache/cso_context.h"
 #include "nir.h"
+#include "nir/nir_serialize.h"
 
 /* Pre-declarations needed for WSI entrypoints */
 struct wl_surface;
@@ -69,6 +70,7 @@ typedef uint32_t xcb_window_t;
 #include "vk_command_pool.h"
 #include "vk_descriptor_set_layout.h"
 #include "vk_graphics_state.h"
+#include "vk_pipeline_cache.h"
 #include "vk_pipeline_layout.h"
 #include "vk_queue.h"
 #include "vk_sync.h"
@@ -166,12 +168,6 @@ struct lvp_queue {
    simple_mtx_t pipeline_lock;
 };
 
-struct lvp_pipeline_cache {
-   struct vk_object_base                        base;
-   struct lvp_device *                          device;
-   VkAllocationCallbacks                        alloc;
-};
-
 struct lvp_device {
    struct vk_device vk;
 
@@ -180,6 +176,8 @@ struct lvp_device {
    struct lvp_physical_device *physical_device;
    struct pipe_screen *pscreen;
    void *noop_fs;
+   /* Used when no pipeline cache is passed, so the disk cache still is. */
+   struct vk_pipeline_cache *mem_cache;
    bool poison_mem;
    bool print_cmds;
 };
@@ -414,6 +412,8 @@ struct lvp_access_info {
 struct lvp_pipeline_nir {
    int ref_cnt;
    nir_shader *nir;
+   /* taken on the first lvp_pipeline_nir_fork() */
+   nir_shader_snapshot *snapshot;
 };
 
 static inline void
@@ -424,6 +424,7 @@ lvp_pipeline_nir_ref(struct lvp_pipeline_nir **dst, struct lvp_pipeline_nir *src
       return;
 
    if (old_dst && p_atomic_dec_zero(&old_dst->ref_cnt)) {
+      ralloc_free(old_dst->snapshot);
       ralloc_free(old_dst->nir);
       ralloc_free(old_dst);
    }
@@ -432,6 +433,33 @@ lvp_pipeline_nir_ref(struct lvp_pipeline_nir **dst, struct lvp_pipeline_nir *src
    *dst = src;
 }
 
+/* Returns a copy of pipeline_nir->nir to compile a variant from.
+ *
+ * The first call takes a snapshot of the shader and every call deserializes
+ * a copy from it, which is a lot cheaper than nir_shader_clone() once the
+ * same shader is compiled more than once.  pipeline_nir->nir must not be
+ * changed after the first fork.
+ */
+static inline nir_shader *
+lvp_pipeline_nir_fork(struct lvp_pipeline_nir *pipeline_nir)
+{
+   nir_shader_snapshot *snapshot = p_atomic_read(&pipeline_nir->snapshot);
+   if (!snapshot) {
+      snapshot = nir_shader_snapshot_create(NULL, pipeline_nir->nir);
+      if (!snapshot)
+         return nir_shader_clone(NULL, pipeline_nir->nir);
+
+      nir_shader_snapshot *old =
+         p_atomic_cmpxchg_ptr(&pipeline_nir->snapshot, NULL, snapshot);
+      if (old) {
+         ralloc_free(snapshot);
+         snapshot = old;
+      }
+   }
+
+   return nir_shader_fork(NULL, snapshot);
+}
+
 struct lvp_inline_variant {
    uint32_t mask;
    uint32_t vals[PIPE_MAX_CONSTANT_BUFFERS][MAX_INLINABLE_UNIFORMS];
@@ -480,6 +508,19 @@ struct lvp_pipeline {
 void
 lvp_pipeline_shaders_compile(struct lvp_pipeline *pipeline);
 
+extern const struct vk_pipeline_cache_object_ops *const lvp_pipeline_cache_import_ops[];
+
+nir_shader *
+lvp_pipeline_cache_lookup_shader(struct vk_pipeline_cache *cache,
+                                 const unsigned char *sha1,
+                                 const nir_shader_compiler_options *options,
+                                 struct lvp_shader *shader, bool *cache_hit);
+void
+lvp_pipeline_cache_add_shader(struct vk_pipeline_cache *cache,
+                              const unsigned char *sha1,
+                              const struct lvp_shader *shader,
+                              const nir_shader *nir);
+
 struct lvp_event {
    struct vk_object_base base;
    volatile uint64_t event_storage;
@@ -571,8 +612,6 @@ VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_event, base, VkEvent, VK_OBJECT_TYPE_EVENT)
 VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_image, vk.base, VkImage, VK_OBJECT_TYPE_IMAGE)
 VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_image_view, vk.base, VkImageView,
                                VK_OBJECT_TYPE_IMAGE_VIEW);
-VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_pipeline_cache, base, VkPipelineCache,
-                               VK_OBJECT_TYPE_PIPELINE_CACHE)
 VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_pipeline, base, VkPipeline,
                                VK_OBJECT_TYPE_PIPELINE)
 VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_shader, base, VkShaderEXT,
@@ -25,6 +25,8 @@
  * SOFTWARE.
  */
 
+#include <cinttypes>
+#include <cstring>
 #include <iostream>
 #include <iomanip>
 
@@ -64,36 +66,64 @@ void rc_disassemble(char *bytes, uint32_t bufsize) {
     LLVMDisasmDispose(D);
 }
 
-struct rc_llvm_pointer rc_build_main(struct rc_llvm_context *ctx)
+static struct rc_llvm_pointer
+rc_build_entry(struct rc_llvm_context *ctx, LLVMTypeRef *arg_types, unsigned num_args)
 {
-   // uint64_t main(uint64_t desc, uint32_t vid)
-   LLVMTypeRef arg_types[2];
-   arg_types[0] = LLVMInt64TypeInContext(ctx->context);
-   arg_types[1] = LLVMInt32TypeInContext(ctx->context);
    LLVMTypeRef ret_type;
    ret_type = LLVMInt32TypeInContext(ctx->context);
 
-   LLVMTypeRef main_function_type = LLVMFunctionType(ret_type, arg_types, 2, 0);
+   LLVMTypeRef main_function_type = LLVMFunctionType(ret_type, arg_types, num_args, 0);
    LLVMValueRef main_function = LLVMAddFunction(ctx->module, "main", main_function_type);
 
    LLVMBasicBlockRef main_function_body = LLVMAppendBasicBlockInContext(ctx->context, main_function, "main_body");
    LLVMPositionBuilderAtEnd(ctx->builder, main_function_body);
    LLVMSetFunctionCallConv(main_function, 0);
 
-   // Test Zac
-#if 0
-   LLVMValueRef a = LLVMGetParam(main_function, 0);
-   LLVMValueRef b = LLVMGetParam(main_function, 1);
-   LLVMValueRef c = LLVMBuildIntCast2(ctx->builder, b, LLVMTypeOf(a), 0, "c");
-   LLVMValueRef ret = LLVMBuildAdd(ctx->builder, a, c, "sum");
-
-   LLVMBuildRet(ctx->builder, ret);
-#endif
    ctx->main_function.value = main_function;
    ctx->main_function.pointee_type = main_function_type;
    return ctx->main_function;
 }
 
+struct rc_llvm_pointer rc_build_main(struct rc_llvm_context *ctx)
+{
+   // uint64_t main(uint64_t desc, uint32_t vid)
+   LLVMTypeRef arg_types[2];
+   arg_types[0] = LLVMInt64TypeInContext(ctx->context);
+   arg_types[1] = LLVMInt32TypeInContext(ctx->context);
+
+   return rc_build_entry(ctx, arg_types, 2);
+}
+
+struct rc_llvm_pointer rc_build_compute_main(struct rc_llvm_context *ctx)
+{
+   // uint32_t main(uint64_t desc, uint32_t workgroup_id[3], uint32_t local_id[3],
+   //               uint32_t num_workgroups[3], uint8_t *shared)
+   LLVMTypeRef arg_types[RC_CS_PARAM_COUNT];
+   arg_types[RC_CS_PARAM_DESC] = LLVMInt64TypeInContext(ctx->context);
+   for (unsigned i = 0; i < 3; i++) {
+      arg_types[RC_CS_PARAM_WORKGROUP_ID + i] = LLVMInt32TypeInContext(ctx->context);
+      arg_types[RC_CS_PARAM_LOCAL_INVOCATION_ID + i] = LLVMInt32TypeInContext(ctx->context);
+      arg_types[RC_CS_PARAM_NUM_WORKGROUPS + i] = LLVMInt32TypeInContext(ctx->context);
+   }
+   arg_types[RC_CS_PARAM_SHARED] = LLVMPointerType(LLVMInt8TypeInContext(ctx->context), 0);
+
+   return rc_build_entry(ctx, arg_types, RC_CS_PARAM_COUNT);
+}
+
+void rc_build_workgroup_barrier(struct rc_llvm_context *ctx)
+{
+   // the barrier itself is provided by the core runtime the shader is linked against
+   LLVMTypeRef barrier_type = LLVMFunctionType(ctx->voidt, NULL, 0, 0);
+   LLVMValueRef barrier = LLVMGetNamedFunction(ctx->module, RC_WORKGROUP_BARRIER_NAME);
+   if (!barrier) {
+      barrier = LLVMAddFunction(ctx->module, RC_WORKGROUP_BARRIER_NAME, barrier_type);
+      LLVMAddAttributeAtIndex(barrier, LLVMAttributeFunctionIndex,
+                              LLVMCreateEnumAttribute(ctx->context,
+                                                      LLVMGetEnumAttributeKindForName("convergent", 10), 0));
+   }
+   LLVMBuildCall2(ctx->builder, barrier_type, barrier, NULL, 0, "");
+}
+
 LLVMModuleRef rc_create_module(LLVMTargetMachineRef tm, LLVMContextRef ctx)
 {   
    llvm::TargetMachine *TM = reinterpret_cast<llvm::TargetMachine *>(tm);
@@ -104,19 +134,112 @@ LLVMModuleRef rc_create_module(LLVMTargetMachineRef tm, LLVMContextRef ctx)
    return module; 
 }
 
+static struct rc_llvm_pooled_context *
+rc_llvm_context_pool_acquire(struct rc_llvm_context_pool *pool)
+{
+   struct rc_llvm_pooled_context *empty = NULL;
+
+   /* Prefer a live context that still has room, it already holds most of
+    * the types and constants the shader will need.
+    */
+   for (unsigned i = 0; i < RC_LLVM_CONTEXT_POOL_SIZE; i++) {
+      struct rc_llvm_pooled_context *entry = &pool->entries[i];
+      if (!entry->context) {
+         if (!empty)
+            empty = entry;
+         continue;
+      }
+      if (entry->bytes < pool->memory_cap)
+         return entry;
+   }
+
+   if (!empty) {
+      /* every context is over the cap: replace an idle one */
+      for (unsigned i = 0; i < RC_LLVM_CONTEXT_POOL_SIZE; i++) {
+         struct rc_llvm_pooled_context *entry = &pool->entries[i];
+         if (!entry->users) {
+            LLVMContextDispose(entry->context);
+            pool->stats.context_bytes -= MIN2(entry->bytes, pool->stats.context_bytes);
+            pool->stats.contexts_recycled++;
+            memset(entry, 0, sizeof(*entry));
+            empty = entry;
+            break;
+         }
+      }
+   }
+
+   /* all contexts are busy with nested compiles, overshoot the cap */
+   if (!empty)
+      return &pool->entries[0];
+
+   empty->context = LLVMContextCreate();
+   pool->stats.contexts_created++;
+   return empty;
+}
+
 /* Initialize module-independent parts of the context.
  *
- * The caller is responsible for initializing ctx::module and ctx::builder.
+ * The LLVM context is borrowed from the compiler's pool and must be given
+ * back with rc_llvm_context_dispose().
  */
 void rc_llvm_context_init(struct rc_llvm_context *ctx, struct rc_llvm_compiler *compiler)
 {
-   ctx->context = LLVMContextCreate();
+   memset(ctx, 0, sizeof(*ctx));
+
+   ctx->pool = compiler->context_pool;
+   ctx->heap_start = rc_llvm_heap_in_use();
+   ctx->pooled = rc_llvm_context_pool_acquire(ctx->pool);
+   ctx->pooled->users++;
+
+   ctx->context = ctx->pooled->context;
    ctx->module = rc_create_module(compiler->tm, ctx->context);
    ctx->builder = LLVMCreateBuilderInContext(ctx->context);
 
    ctx->voidt = LLVMVoidTypeInContext(ctx->context);
 }
 
+/* Frees the module and builder and returns the LLVM context to the pool,
+ * disposing of it once it retains more than the pool's memory cap.
+ */
+void rc_llvm_context_dispose(struct rc_llvm_context *ctx)
+{
+   struct rc_llvm_context_pool *pool = ctx->pool;
+   struct rc_llvm_pooled_context *pooled = ctx->pooled;
+   size_t heap_compiled = rc_llvm_heap_in_use();
+
+   if (ctx->builder)
+      LLVMDisposeBuilder(ctx->builder);
+   if (ctx->module)
+      LLVMDisposeModule(ctx->module);
+
+   size_t heap_end = rc_llvm_heap_in_use();
+   uint64_t compile_bytes = heap_compiled > ctx->heap_start ? heap_compiled - ctx->heap_start : 0;
+   uint64_t retained = heap_end > ctx->heap_start ? heap_end - ctx->heap_start : 0;
+
+   pool->stats.compiles++;
+   pool->stats.last_compile_bytes = compile_bytes;
+   pool->stats.max_compile_bytes = MAX2(pool->stats.max_compile_bytes, compile_bytes);
+   pool->stats.total_compile_bytes += compile_bytes;
+   pool->stats.context_bytes += retained;
+   pooled->bytes += retained;
+
+   if (pool->print_stats) {
+      fprintf(stderr, "rvgpu: LLVM compile %" PRIu64 ": %" PRIu64 " KiB allocated, "
+              "context retains %" PRIu64 " KiB\n", pool->stats.compiles,
+              compile_bytes / 1024, pooled->bytes / 1024);
+   }
+
+   assert(pooled->users);
+   if (--pooled->users == 0 && pooled->bytes >= pool->memory_cap) {
+      LLVMContextDispose(pooled->context);
+      pool->stats.context_bytes -= MIN2(pooled->bytes, pool->stats.context_bytes);
+      pool->stats.contexts_recycled++;
+      memset(pooled, 0, sizeof(*pooled));
+   }
+
+   memset(ctx, 0, sizeof(*ctx));
+}
+
 static LLVMTypeRef
 build_vec_type(struct rc_llvm_context *ctx, struct rc_type type) {
     LLVMTypeRef elem_type = rc_build_elem_type(ctx, type);
@@ -59,11 +59,35 @@ struct rc_llvm_context {
    LLVMTypeRef voidt;
 
    struct rc_llvm_pointer main_function;
+
+   /* pool entry the context was borrowed from */
+   struct rc_llvm_context_pool *pool;
+   struct rc_llvm_pooled_context *pooled;
+   size_t heap_start;
 };
 
 void rc_llvm_context_init(struct rc_llvm_context *ctx, struct rc_llvm_compiler *compiler);
+void rc_llvm_context_dispose(struct rc_llvm_context *ctx);
+
+/* Arguments of the compute entry point built by rc_build_compute_main().
+ * Every invocation of a workgroup is one call; the caller passes the ids
+ * and the base of the workgroup's shared memory block.
+ */
+enum rc_cs_param {
+   RC_CS_PARAM_DESC,
+   RC_CS_PARAM_WORKGROUP_ID,
+   RC_CS_PARAM_LOCAL_INVOCATION_ID = RC_CS_PARAM_WORKGROUP_ID + 3,
+   RC_CS_PARAM_NUM_WORKGROUPS = RC_CS_PARAM_LOCAL_INVOCATION_ID + 3,
+   RC_CS_PARAM_SHARED = RC_CS_PARAM_NUM_WORKGROUPS + 3,
+   RC_CS_PARAM_COUNT,
+};
+
+#define RC_WORKGROUP_BARRIER_NAME "__rvgpu_workgroup_barrier"
 
 struct rc_llvm_pointer rc_build_main(struct rc_llvm_context *ctx);
+struct rc_llvm_pointer rc_build_compute_main(struct rc_llvm_context *ctx);
+
+void rc_build_workgroup_barrier(struct rc_llvm_context *ctx);
 
 void rc_build_context_init(struct rc_build_context *bld, struct rc_llvm_context *ctx, struct rc_type type);
 
@@ -26,7 +26,9 @@
  */
 
 // RISC-V Compiler
+#include <cinttypes>
 #include <cstring>
+#include <malloc.h>
 
 #include <llvm/Analysis/TargetLibraryInfo.h>
 #include <llvm/Analysis/TargetTransformInfo.h>
@@ -41,6 +43,7 @@
 #include <llvm-c/Target.h>
 #include <llvm-c/Core.h>
 #include <c11/threads.h>
+#include "util/u_debug.h"
 #include "rc_llvm_util.h"
 
 bool rc_is_llvm_processor_supported(LLVMTargetMachineRef tm, const char *processor)
@@ -274,6 +277,59 @@ void rc_init_llvm_once(void)
    rc_init_shared_llvm_once();
 }
 
+/* Bytes allocated from the heap, including the large blocks malloc
+ * serves with mmap, which uordblks doesn't count.
+ */
+size_t rc_llvm_heap_in_use(void)
+{
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+   struct mallinfo2 mi = mallinfo2();
+   return mi.uordblks + mi.hblkhd;
+#elif defined(__GLIBC__)
+   struct mallinfo mi = mallinfo();
+   return (size_t)(unsigned)mi.uordblks + (unsigned)mi.hblkhd;
+#else
+   return 0;
+#endif
+}
+
+void rc_llvm_get_compile_stats(const struct rc_llvm_compiler *compiler, struct rc_llvm_compile_stats *stats)
+{
+   *stats = compiler->context_pool->stats;
+}
+
+static struct rc_llvm_context_pool *rc_create_llvm_context_pool(void)
+{
+   struct rc_llvm_context_pool *pool =
+      (struct rc_llvm_context_pool *)calloc(1, sizeof(*pool));
+   if (!pool)
+      return NULL;
+
+   pool->memory_cap = debug_get_num_option("RVGPU_LLVM_CONTEXT_MEMORY_CAP", 64) * 1024 * 1024;
+   pool->print_stats = debug_get_bool_option("RVGPU_LLVM_STATS", false);
+   return pool;
+}
+
+static void rc_destroy_llvm_context_pool(struct rc_llvm_context_pool *pool)
+{
+   if (!pool)
+      return;
+
+   for (unsigned i = 0; i < RC_LLVM_CONTEXT_POOL_SIZE; i++) {
+      assert(!pool->entries[i].users);
+      if (pool->entries[i].context)
+         LLVMContextDispose(pool->entries[i].context);
+   }
+
+   if (pool->print_stats) {
+      fprintf(stderr, "rvgpu: %" PRIu64 " LLVM compiles, %" PRIu64 " contexts created, "
+              "%" PRIu64 " recycled, %" PRIu64 " KiB max per compile\n",
+              pool->stats.compiles, pool->stats.contexts_created,
+              pool->stats.contexts_recycled, pool->stats.max_compile_bytes / 1024);
+   }
+   free(pool);
+}
+
 bool rc_init_llvm_compiler(struct rc_llvm_compiler *compiler)
 {
    const char *triple;
@@ -291,6 +347,10 @@ bool rc_init_llvm_compiler(struct rc_llvm_compiler *compiler)
    if (!compiler->passmgr)
       goto fail;
 
+   compiler->context_pool = rc_create_llvm_context_pool();
+   if (!compiler->context_pool)
+      goto fail;
+
    return true;
 fail:
    rc_destroy_llvm_compiler(compiler);
@@ -302,6 +362,8 @@ void rc_destroy_llvm_compiler(struct rc_llvm_compiler *compiler)
    delete compiler->passes;
    delete compiler->low_opt_passes;
 
+   rc_destroy_llvm_context_pool(compiler->context_pool);
+
    if (compiler->passmgr)
       LLVMDisposePassManager(compiler->passmgr);
    if (compiler->target_library_info) {
@@ -29,6 +29,7 @@
 #define RC_LLVM_UTILS_H__
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <llvm-c/TargetMachine.h>
 
 #include "util/macros.h"
@@ -39,6 +40,44 @@ extern "C" {
 
 struct rc_compiler_passes;
 
+/* Maximum number of LLVM contexts kept alive per compiler. */
+#define RC_LLVM_CONTEXT_POOL_SIZE 2
+
+/* Counters of a compiler's context pool.  Heap figures are sampled from the
+ * process-wide malloc statistics, so compiles running concurrently on other
+ * threads show up in them.
+ */
+struct rc_llvm_compile_stats {
+   uint64_t compiles;
+   uint64_t contexts_created;
+   uint64_t contexts_recycled;
+
+   /* heap growth between context init and module disposal */
+   uint64_t last_compile_bytes;
+   uint64_t max_compile_bytes;
+   uint64_t total_compile_bytes;
+
+   /* heap still held by the pooled contexts */
+   uint64_t context_bytes;
+};
+
+struct rc_llvm_pooled_context {
+   LLVMContextRef context;
+   unsigned users;   /* modules currently alive in the context */
+   uint64_t bytes;   /* estimated memory retained by the context */
+};
+
+/* LLVM contexts intern every type and constant ever created in them and
+ * never give that memory back, so they are reused across compiles and
+ * recreated once they grow past memory_cap.
+ */
+struct rc_llvm_context_pool {
+   struct rc_llvm_pooled_context entries[RC_LLVM_CONTEXT_POOL_SIZE];
+   uint64_t memory_cap;
+   bool print_stats;
+   struct rc_llvm_compile_stats stats;
+};
+
 /* Per-thread persistent LLVM objects. */
 struct rc_llvm_compiler {
    LLVMTargetLibraryInfoRef target_library_info;
@@ -53,6 +92,8 @@ struct rc_llvm_compiler {
     */
    LLVMTargetMachineRef low_opt_tm; /* uses -O1 instead of -O2 */
    struct rc_compiler_passes *low_opt_passes;
+
+   struct rc_llvm_context_pool *context_pool;
 };
 
 PUBLIC void rc_init_shared_llvm_once(void); /* Do not use directly, use rc_init_llvm_once */
@@ -68,6 +109,9 @@ bool rc_compile_module_to_elf(struct rc_compiler_passes *p, LLVMModuleRef module
 
 void rc_disassemble(char *buffer, uint32_t size);
 
+size_t rc_llvm_heap_in_use(void);
+void rc_llvm_get_compile_stats(const struct rc_llvm_compiler *compiler, struct rc_llvm_compile_stats *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -10,6 +10,12 @@
 #define MAX_SHADER_OUTPUTS 80  //same with PIPE_MAX_SHADER_OUTPUTS
 struct rc_shader_abi {
     LLVMValueRef vertex_id;
+
+    /* compute */
+    LLVMValueRef workgroup_id[3];
+    LLVMValueRef local_invocation_id[3];
+    LLVMValueRef num_workgroups[3];
+    LLVMValueRef shared;
 };
 
 struct rc_nir_context {
@@ -340,6 +346,70 @@ static void visit_store_var(struct rc_nir_context *ctx, nir_intrinsic_instr *ins
               indir_index, src);
 }
 
+static LLVMValueRef shared_chan_pointer(struct rc_nir_context *ctx, LLVMValueRef offset,
+                                        unsigned const_offset, unsigned bit_size) {
+    LLVMBuilderRef builder = ctx->rc.builder;
+
+    /* shared variables were given explicit offsets by shared_var_info() */
+    if (const_offset)
+        offset = LLVMBuildAdd(builder, offset,
+                              LLVMConstInt(LLVMInt32TypeInContext(ctx->rc.context), const_offset, 0), "");
+    LLVMValueRef ptr = LLVMBuildGEP2(builder, LLVMInt8TypeInContext(ctx->rc.context),
+                                     ctx->abi.shared, &offset, 1, "");
+    return LLVMBuildBitCast(builder, ptr,
+                            LLVMPointerType(LLVMIntTypeInContext(ctx->rc.context, bit_size), 0), "");
+}
+
+static void visit_load_shared(struct rc_nir_context *ctx, nir_intrinsic_instr *instr,
+                              LLVMValueRef result[NIR_MAX_VEC_COMPONENTS]) {
+    unsigned bit_size = nir_dest_bit_size(instr->dest);
+    LLVMTypeRef chan_type = LLVMIntTypeInContext(ctx->rc.context, bit_size);
+    LLVMValueRef offset = cast_type(ctx, get_src(ctx, instr->src[0]), nir_type_uint, 32);
+
+    for (unsigned c = 0; c < instr->num_components; c++) {
+        LLVMValueRef ptr = shared_chan_pointer(ctx, offset, nir_intrinsic_base(instr) + c * bit_size / 8,
+                                               bit_size);
+        result[c] = LLVMBuildLoad2(ctx->rc.builder, chan_type, ptr, "");
+    }
+}
+
+static void visit_store_shared(struct rc_nir_context *ctx, nir_intrinsic_instr *instr) {
+    unsigned bit_size = nir_src_bit_size(instr->src[0]);
+    unsigned num_components = nir_src_num_components(instr->src[0]);
+    unsigned writemask = nir_intrinsic_write_mask(instr);
+    LLVMTypeRef chan_type = LLVMIntTypeInContext(ctx->rc.context, bit_size);
+    LLVMValueRef val = get_src(ctx, instr->src[0]);
+    LLVMValueRef offset = cast_type(ctx, get_src(ctx, instr->src[1]), nir_type_uint, 32);
+
+    for (unsigned c = 0; c < num_components; c++) {
+        if (!(writemask & (1u << c)))
+            continue;
+        LLVMValueRef chan_val = (num_components == 1) ? val :
+                                LLVMBuildExtractValue(ctx->rc.builder, val, c, "");
+        chan_val = LLVMBuildBitCast(ctx->rc.builder, chan_val, chan_type, "");
+        LLVMValueRef ptr = shared_chan_pointer(ctx, offset, nir_intrinsic_base(instr) + c * bit_size / 8,
+                                               bit_size);
+        LLVMBuildStore(ctx->rc.builder, chan_val, ptr);
+    }
+}
+
+static void visit_barrier(struct rc_nir_context *ctx, nir_intrinsic_instr *instr) {
+    bool fence = nir_intrinsic_memory_scope(instr) != NIR_SCOPE_NONE &&
+                 nir_intrinsic_memory_semantics(instr) != 0;
+
+    if (fence)
+        LLVMBuildFence(ctx->rc.builder, LLVMAtomicOrderingAcquireRelease, false, "");
+
+    /* every invocation of the workgroup has to reach the barrier before any
+     * of them continues, the core runtime parks the harts until they have.
+     */
+    if (nir_intrinsic_execution_scope(instr) >= NIR_SCOPE_WORKGROUP) {
+        rc_build_workgroup_barrier(&ctx->rc);
+        if (fence)
+            LLVMBuildFence(ctx->rc.builder, LLVMAtomicOrderingAcquireRelease, false, "");
+    }
+}
+
 static bool visit_intrinsic(struct rc_nir_context *ctx, nir_intrinsic_instr *instr) {
     LLVMValueRef result[NIR_MAX_VEC_COMPONENTS] = {0};
 
@@ -352,6 +422,27 @@ static bool visit_intrinsic(struct rc_nir_context *ctx, nir_intrinsic_instr *ins
             printf("nir: store deref \n");
             visit_store_var(ctx, instr);
             break;
+        case nir_intrinsic_load_workgroup_id:
+            for (unsigned i = 0; i < 3; i++)
+                result[i] = ctx->abi.workgroup_id[i];
+            break;
+        case nir_intrinsic_load_local_invocation_id:
+            for (unsigned i = 0; i < 3; i++)
+                result[i] = ctx->abi.local_invocation_id[i];
+            break;
+        case nir_intrinsic_load_num_workgroups:
+            for (unsigned i = 0; i < 3; i++)
+                result[i] = ctx->abi.num_workgroups[i];
+            break;
+        case nir_intrinsic_load_shared:
+            visit_load_shared(ctx, instr, result);
+            break;
+        case nir_intrinsic_store_shared:
+            visit_store_shared(ctx, instr);
+            break;
+        case nir_intrinsic_scoped_barrier:
+            visit_barrier(ctx, instr);
+            break;
         default:
             fprintf(stdout, "Unknown intrinsic: ");
             nir_print_instr(&instr->instr, stdout);
@@ -450,6 +541,9 @@ do_alu_action(struct rc_nir_context *ctx, const nir_alu_instr *instr,
             printf("iadd op \n");
             result = rc_build_add(get_int_bld(ctx, false, src_bit_size[0]), src[0], src[1]);
             break;
+        case nir_op_imul:
+            result = rc_build_mul(get_int_bld(ctx, false, src_bit_size[0]), src[0], src[1]);
+            break;
         default:
             fprintf(stdout, "Unknown alu instr op: %d\n", instr->op);
             fprintf(stdout, "\n");
@@ -898,30 +992,49 @@ bool rc_nir_translate(struct rc_llvm_context *rc, struct nir_shader *nir) {
 
     nir_print_shader(nir, stdout);
 
+    ctx.rc = *rc;
+    ctx.stage = nir->info.stage;
+
+    struct rc_type type;
+    memset(&type, 0, sizeof type);
+    type.floating = TRUE; /* floating point values */
+    type.sign = TRUE;     /* values are signed */
+    type.norm = FALSE;    /* values are not limited to [0,1] or [-1,1] */
+    type.width = 32;      /* 32-bit float */
+    type.length = MAX_VECTOR_WIDTH / 32;
+
+    rc_build_context_init(&ctx.base, rc, type);
+    rc_build_context_init(&ctx.uint_bld, rc, rc_uint_type(type));
+    rc_build_context_init(&ctx.int_bld, rc, rc_int_type(type));
+
     if (ctx.stage == MESA_SHADER_VERTEX) {
         ctx.abi.vertex_id = LLVMGetParam(rc->main_function.value, 1);
         //ctx.abi.io = LLVMGetParam(rc->main_function.value, 0);
         LLVMSetValueName(ctx.abi.vertex_id, "vertex_id");
-
-        struct rc_type vs_type;
-        memset(&vs_type, 0, sizeof vs_type);
-        vs_type.floating = TRUE; /* floating point values */
-        vs_type.sign = TRUE;     /* values are signed */
-        vs_type.norm = FALSE;    /* values are not limited to [0,1] or [-1,1] */
-        vs_type.width = 32;      /* 32-bit float */
-        vs_type.length = MAX_VECTOR_WIDTH / 32;
-
-        rc_build_context_init(&ctx.base, rc, vs_type);
-        rc_build_context_init(&ctx.uint_bld, rc, rc_uint_type(vs_type));
-        rc_build_context_init(&ctx.int_bld, rc, rc_int_type(vs_type));
+    } else if (ctx.stage == MESA_SHADER_COMPUTE) {
+        static const char *const chan_names[3] = { "x", "y", "z" };
+        char name[32];
+
+        for (unsigned i = 0; i < 3; i++) {
+            ctx.abi.workgroup_id[i] = LLVMGetParam(rc->main_function.value, RC_CS_PARAM_WORKGROUP_ID + i);
+            snprintf(name, sizeof(name), "workgroup_id.%s", chan_names[i]);
+            LLVMSetValueName(ctx.abi.workgroup_id[i], name);
+
+            ctx.abi.local_invocation_id[i] = LLVMGetParam(rc->main_function.value, RC_CS_PARAM_LOCAL_INVOCATION_ID + i);
+            snprintf(name, sizeof(name), "local_invocation_id.%s", chan_names[i]);
+            LLVMSetValueName(ctx.abi.local_invocation_id[i], name);
+
+            ctx.abi.num_workgroups[i] = LLVMGetParam(rc->main_function.value, RC_CS_PARAM_NUM_WORKGROUPS + i);
+            snprintf(name, sizeof(name), "num_workgroups.%s", chan_names[i]);
+            LLVMSetValueName(ctx.abi.num_workgroups[i], name);
+        }
+        ctx.abi.shared = LLVMGetParam(rc->main_function.value, RC_CS_PARAM_SHARED);
+        LLVMSetValueName(ctx.abi.shared, "shared");
     }
 
     nir_foreach_shader_out_variable(variable, nir)
         var_decl(&ctx, variable);
 
-    ctx.rc = *rc;
-    ctx.stage = nir->info.stage;
-
     func = (struct nir_function *) exec_list_get_head(&nir->functions);
     nir_index_ssa_defs(func->impl);
 
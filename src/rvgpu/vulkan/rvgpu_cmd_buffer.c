@@ -27,6 +27,7 @@
 
 #include "vk_command_buffer.h"
 #include "vk_command_pool.h"
+#include "vk_render_pass.h"
 
 #include "rvgpu_private.h"
 
@@ -60,11 +61,18 @@ static void
 rvgpu_reset_cmd_buffer(struct vk_command_buffer *vk_cmd_buffer,
                        UNUSED VkCommandBufferResetFlags flags)
 {
+   struct rvgpu_cmd_buffer *cmd_buffer =
+      container_of(vk_cmd_buffer, struct rvgpu_cmd_buffer, vk);
+
+   vk_command_buffer_reset(&cmd_buffer->vk);
+   memset(&cmd_buffer->inheritance, 0, sizeof(cmd_buffer->inheritance));
 }
 
 static void
 rvgpu_destroy_cmd_buffer(struct vk_command_buffer *vk_cmd_buffer)
 {
+   vk_command_buffer_finish(vk_cmd_buffer);
+   vk_free(&vk_cmd_buffer->pool->alloc, vk_cmd_buffer);
 }
 
 const struct vk_command_buffer_ops rvgpu_cmd_buffer_ops = {
@@ -81,6 +89,24 @@ rvgpu_BeginCommandBuffer(VkCommandBuffer commandBuffer, const VkCommandBufferBeg
 
    vk_command_buffer_begin(&cmd_buffer->vk, pBeginInfo);
 
+   /* Secondaries continuing a render pass are replayed in place on the
+    * primary's rendering state at submit time, so only the inherited
+    * attachment layout needs recording here.
+    */
+   if (cmd_buffer->vk.level == VK_COMMAND_BUFFER_LEVEL_SECONDARY &&
+       (pBeginInfo->flags & VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT)) {
+      const VkCommandBufferInheritanceRenderingInfo *inheritance_info =
+         vk_get_command_buffer_inheritance_rendering_info(cmd_buffer->vk.level,
+                                                          pBeginInfo);
+
+      cmd_buffer->inheritance.render_pass_continue = true;
+      if (inheritance_info) {
+         cmd_buffer->inheritance.view_mask = inheritance_info->viewMask;
+         cmd_buffer->inheritance.color_att_count = inheritance_info->colorAttachmentCount;
+         cmd_buffer->inheritance.samples = inheritance_info->rasterizationSamples;
+      }
+   }
+
    return result;
 }
 
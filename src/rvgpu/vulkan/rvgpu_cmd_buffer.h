@@ -30,10 +30,23 @@
 
 #include "vk_command_buffer.h"
 
+/* Rendering state a secondary command buffer recorded with
+ * VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT inherits from the
+ * primary it is executed in.
+ */
+struct rvgpu_cmd_inheritance {
+   bool render_pass_continue;
+   uint32_t view_mask;
+   uint32_t color_att_count;
+   VkSampleCountFlagBits samples;
+};
+
 struct rvgpu_cmd_buffer {
    struct vk_command_buffer vk;
 
    struct rvgpu_device *device;
+
+   struct rvgpu_cmd_inheritance inheritance;
 };
 
 #endif // RVGPU_CMD_BUFFER_H__
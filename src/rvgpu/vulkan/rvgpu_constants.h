@@ -73,6 +73,9 @@
  */
 #define RVGPU_MAX_MEMORY_ALLOCATION_SIZE 0xFFFFFFFCull
 
+/* Shader cores a dispatch is spread over. */
+#define RVGPU_MAX_CORES 64
+
 /* Number of invocations in each subgroup. */
 #define RVGPU_SUBGROUP_SIZE 64
 
@@ -25,12 +25,15 @@
  * SOFTWARE.
  */
 
+#include "util/os_time.h"
+
 #include "vk_common_entrypoints.h"
 #include "vk_util.h"
 #include "vk_log.h"
 
 #include "rvgpu_private.h"
 #include "rvgpu_entrypoints.h"
+#include "rvgpu_tracepoints.h"
 
 #define DEF_DRIVER(str_name)                        \
    {                                                \
@@ -43,6 +46,55 @@ rvgpu_check_status(struct vk_device *vk_device)
    return VK_SUCCESS;
 }
 
+/* Command buffers are executed by the CPU during the submit, so timestamps
+ * live in plain memory and are sampled at the moment the tracepoint runs.
+ */
+static void *
+rvgpu_trace_create_ts_buffer(struct u_trace_context *utctx, uint32_t size)
+{
+   return calloc(1, size);
+}
+
+static void
+rvgpu_trace_destroy_ts_buffer(struct u_trace_context *utctx, void *timestamps)
+{
+   free(timestamps);
+}
+
+static void
+rvgpu_trace_record_ts(struct u_trace *ut, void *cs, void *timestamps,
+                      unsigned idx, bool end_of_pipe)
+{
+   ((uint64_t *)timestamps)[idx] = os_time_get_nano();
+}
+
+static uint64_t
+rvgpu_trace_read_ts(struct u_trace_context *utctx,
+                    void *timestamps, unsigned idx, void *flush_data)
+{
+   return ((uint64_t *)timestamps)[idx];
+}
+
+static void
+rvgpu_trace_delete_flush_data(struct u_trace_context *utctx, void *flush_data)
+{
+   free(flush_data);
+}
+
+#ifdef HAVE_PERFETTO
+struct rvgpu_perfetto_state *
+rvgpu_device_get_perfetto_state(struct rvgpu_device *dev)
+{
+   return &dev->perfetto;
+}
+
+struct u_trace_context *
+rvgpu_device_get_u_trace(struct rvgpu_device *dev)
+{
+   return &dev->trace_context;
+}
+#endif
+
 
 VKAPI_ATTR VkResult VKAPI_CALL
 rvgpu_CreateDevice(VkPhysicalDevice physicalDevice, const VkDeviceCreateInfo *pCreateInfo,
@@ -70,6 +122,15 @@ rvgpu_CreateDevice(VkPhysicalDevice physicalDevice, const VkDeviceCreateInfo *pC
       return result;
    }
 
+   rvgpu_gpu_tracepoint_config_variable();
+
+   u_trace_context_init(&device->trace_context, device,
+                        rvgpu_trace_create_ts_buffer,
+                        rvgpu_trace_destroy_ts_buffer,
+                        rvgpu_trace_record_ts,
+                        rvgpu_trace_read_ts,
+                        rvgpu_trace_delete_flush_data);
+
    /* Create one context per queue priority. */
    for (unsigned i = 0; i < pCreateInfo->queueCreateInfoCount; i++) {
       const VkDeviceQueueCreateInfo *queue_create = &pCreateInfo->pQueueCreateInfos[i];
@@ -117,6 +178,8 @@ fail_queue:
       }
    }
 
+   u_trace_context_fini(&device->trace_context);
+
    return result;
 }
 
@@ -126,6 +189,8 @@ rvgpu_DestroyDevice(VkDevice _device, const VkAllocationCallbacks *pAllocator)
 {
    RVGPU_FROM_HANDLE(rvgpu_device, device, _device);
 
+   u_trace_context_fini(&device->trace_context);
+
    vk_device_finish(&device->vk);
    vk_free(&device->vk.alloc, device);
 }
@@ -30,7 +30,10 @@
 
 #include "vk_device.h"
 
+#include "util/perf/u_trace.h"
+
 #include "rvgpu_queue.h"
+#include "rvgpu_perfetto.h"
 
 struct rvgpu_device {
    struct vk_device vk;
@@ -44,6 +47,13 @@ struct rvgpu_device {
    bool poison_mem;
 
    int fd;
+
+   struct u_trace_context trace_context;
+   uint32_t submit_count;
+
+#ifdef HAVE_PERFETTO
+   struct rvgpu_perfetto_state perfetto;
+#endif
 };
 
 enum rvgpu_dispatch_table {
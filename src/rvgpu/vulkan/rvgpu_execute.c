@@ -28,11 +28,14 @@
 #include "cso_cache/cso_context.h"
 #include "util/u_upload_mgr.h"
 #include "util/u_prim.h"
+#include "util/perf/cpu_trace.h"
 
 #include "vk_cmd_enqueue_entrypoints.h"
+#include "vk_enum_to_str.h"
 #include "vk_util.h"
 
 #include "rvgpu_private.h"
+#include "rvgpu_tracepoints.h"
 
 static inline enum pipe_shader_type
 pipe_shader_type_from_mesa(gl_shader_stage stage)
@@ -186,11 +189,17 @@ struct rendering_state {
    uint32_t so_offsets[PIPE_MAX_SO_BUFFERS];
 
    struct rvgpu_shader *shaders[MESA_SHADER_STAGES];
+   const struct rvgpu_shader_binary *cs_binary;
 
    bool tess_ccw;
    void *tess_states[2];
+
+   struct u_trace *trace;
 };
 
+static void rvgpu_execute_cmd_buffer(struct rvgpu_cmd_buffer *cmd_buffer,
+                                     struct rendering_state *state, bool print_cmds);
+
 static void finish_fence(struct rendering_state *state)
 {
 #if 0
@@ -266,10 +275,10 @@ update_inline_shader_state(struct rendering_state *state, enum pipe_shader_type
     struct rvgpu_inline_variant v;
     v.mask = shader->inlines.can_inline;
     /* these buffers have already been flushed in llvmpipe, so they're safe to read */
-    nir_shader *base_nir = shader->pipeline_nir->nir;
+    struct rvgpu_pipeline_nir *base = shader->pipeline_nir;
     if (stage == MESA_SHADER_TESS_EVAL && state->tess_ccw)
-        base_nir = shader->tess_ccw->nir;
-    nir_function_impl *impl = nir_shader_get_entrypoint(base_nir);
+        base = shader->tess_ccw;
+    nir_function_impl *impl = nir_shader_get_entrypoint(base->nir);
     unsigned ssa_alloc = impl->ssa_alloc;
     unsigned count = shader->inlines.count[0];
     if (count && pcbuf_dirty) {
@@ -322,7 +331,9 @@ update_inline_shader_state(struct rendering_state *state, enum pipe_shader_type
         const struct rvgpu_inline_variant *variant = entry->key;
         shader_state = variant->cso;
     } else {
-        nir_shader *nir = nir_shader_clone(NULL, base_nir);
+        /* compiling a new variant stalls the submit */
+        MESA_TRACE_SCOPE("rvgpu_inline_variant_compile");
+        nir_shader *nir = rvgpu_pipeline_nir_fork(base);
         NIR_PASS_V(nir, rvgpu_inline_uniforms, shader, v.vals[0], 0);
         if (constbuf_dirty) {
             u_foreach_bit(slot, shader->inlines.can_inline)
@@ -335,7 +346,7 @@ update_inline_shader_state(struct rendering_state *state, enum pipe_shader_type
             /* not enough change; don't inline further */
             shader->inlines.can_inline = 0;
             ralloc_free(nir);
-            shader->shader_cso = rvgpu_shader_compile(state->device, shader, nir_shader_clone(NULL, shader->pipeline_nir->nir));
+            shader->shader_cso = rvgpu_shader_compile(state->device, shader, rvgpu_pipeline_nir_fork(shader->pipeline_nir));
             _mesa_set_remove(&shader->inlines.variants, entry);
             shader_state = shader->shader_cso;
         } else {
@@ -345,6 +356,8 @@ update_inline_shader_state(struct rendering_state *state, enum pipe_shader_type
             entry->key = variant;
         }
     }
+    if (sh == MESA_SHADER_COMPUTE)
+        state->cs_binary = shader_state;
 #if 0 // TODO.zac
     switch (sh) {
         case MESA_SHADER_VERTEX:
@@ -522,6 +535,51 @@ static void emit_state(struct rendering_state *state)
     }
 }
 
+static void emit_compute_state(struct rendering_state *state)
+{
+    if (state->iv_dirty[MESA_SHADER_COMPUTE]) {
+        // state->pctx->set_shader_images(state->pctx, MESA_SHADER_COMPUTE,
+        //                                0, state->num_shader_images[MESA_SHADER_COMPUTE],
+        //                                0, state->iv[MESA_SHADER_COMPUTE]); TODO.zac
+        state->iv_dirty[MESA_SHADER_COMPUTE] = false;
+    }
+
+    bool pcbuf_dirty = state->pcbuf_dirty[MESA_SHADER_COMPUTE];
+    if (state->pcbuf_dirty[MESA_SHADER_COMPUTE])
+        update_pcbuf(state, MESA_SHADER_COMPUTE);
+
+    bool constbuf_dirty = state->constbuf_dirty[MESA_SHADER_COMPUTE];
+    if (state->constbuf_dirty[MESA_SHADER_COMPUTE]) {
+#if 0 // TODO.zac
+        for (unsigned i = 0; i < state->num_const_bufs[MESA_SHADER_COMPUTE]; i++)
+            state->pctx->set_constant_buffer(state->pctx, MESA_SHADER_COMPUTE,
+                                             i + 1, false, &state->const_buffer[MESA_SHADER_COMPUTE][i]);
+#endif
+        state->constbuf_dirty[MESA_SHADER_COMPUTE] = false;
+    }
+
+    if (state->inlines_dirty[MESA_SHADER_COMPUTE])
+        update_inline_shader_state(state, MESA_SHADER_COMPUTE, pcbuf_dirty, constbuf_dirty);
+
+    if (state->sb_dirty[MESA_SHADER_COMPUTE]) {
+        // state->pctx->set_shader_buffers(state->pctx, MESA_SHADER_COMPUTE,
+        //                                 0, state->num_shader_buffers[MESA_SHADER_COMPUTE],
+        //                                 state->sb[MESA_SHADER_COMPUTE], state->access[MESA_SHADER_COMPUTE].buffers_written); TODO.zac
+        state->sb_dirty[MESA_SHADER_COMPUTE] = false;
+    }
+
+    if (state->sv_dirty[MESA_SHADER_COMPUTE]) {
+        // state->pctx->set_sampler_views(state->pctx, MESA_SHADER_COMPUTE, 0, state->num_sampler_views[MESA_SHADER_COMPUTE],
+        //                                0, false, state->sv[MESA_SHADER_COMPUTE]); TODO.zac
+        state->sv_dirty[MESA_SHADER_COMPUTE] = false;
+    }
+
+    if (state->ss_dirty[MESA_SHADER_COMPUTE]) {
+        // cso_set_samplers(state->cso, MESA_SHADER_COMPUTE, state->num_sampler_states[MESA_SHADER_COMPUTE], state->cso_ss_ptr[MESA_SHADER_COMPUTE]); TODO.zac
+        state->ss_dirty[MESA_SHADER_COMPUTE] = false;
+    }
+}
+
 static void
 set_viewport_depth_xform(struct rendering_state *state, unsigned idx)
 {
@@ -1009,16 +1067,50 @@ handle_pipeline_access(struct rendering_state *state, gl_shader_stage stage)
     }
 }
 
+static void
+handle_compute_shader(struct rendering_state *state, struct rvgpu_shader *shader, struct rvgpu_pipeline_layout *layout)
+{
+    state->shaders[MESA_SHADER_COMPUTE] = shader;
+
+    if ((layout->push_constant_stages & VK_SHADER_STAGE_COMPUTE_BIT) > 0)
+        state->has_pcbuf[MESA_SHADER_COMPUTE] = layout->push_constant_size > 0;
+    state->uniform_blocks[MESA_SHADER_COMPUTE].count = layout->stage[MESA_SHADER_COMPUTE].uniform_block_count;
+    for (unsigned j = 0; j < layout->stage[MESA_SHADER_COMPUTE].uniform_block_count; j++)
+        state->uniform_blocks[MESA_SHADER_COMPUTE].size[j] = layout->stage[MESA_SHADER_COMPUTE].uniform_block_sizes[j];
+    if (!state->has_pcbuf[MESA_SHADER_COMPUTE] && !layout->stage[MESA_SHADER_COMPUTE].uniform_block_count)
+        state->pcbuf_dirty[MESA_SHADER_COMPUTE] = false;
+
+    state->iv_dirty[MESA_SHADER_COMPUTE] |= state->num_shader_images[MESA_SHADER_COMPUTE] &&
+                                            (state->access[MESA_SHADER_COMPUTE].images_read != shader->access.images_read ||
+                                             state->access[MESA_SHADER_COMPUTE].images_written != shader->access.images_written);
+    state->sb_dirty[MESA_SHADER_COMPUTE] |= state->num_shader_buffers[MESA_SHADER_COMPUTE] &&
+                                            state->access[MESA_SHADER_COMPUTE].buffers_written != shader->access.buffers_written;
+    memcpy(&state->access[MESA_SHADER_COMPUTE], &shader->access, sizeof(struct rvgpu_access_info));
+
+    state->dispatch_info.block[0] = shader->pipeline_nir->nir->info.workgroup_size[0];
+    state->dispatch_info.block[1] = shader->pipeline_nir->nir->info.workgroup_size[1];
+    state->dispatch_info.block[2] = shader->pipeline_nir->nir->info.workgroup_size[2];
+    state->inlines_dirty[MESA_SHADER_COMPUTE] = shader->inlines.can_inline;
+    if (!shader->inlines.can_inline)
+        state->cs_binary = shader->shader_cso;
+}
+
+static void handle_compute_pipeline(struct vk_cmd_queue_entry *cmd,
+                                    struct rendering_state *state)
+{
+    RVGPU_FROM_HANDLE(rvgpu_pipeline, pipeline, cmd->u.bind_pipeline.pipeline);
+
+    handle_compute_shader(state, &pipeline->shaders[MESA_SHADER_COMPUTE], pipeline->layout);
+}
+
 static void handle_pipeline(struct vk_cmd_queue_entry *cmd,
                             struct rendering_state *state)
 {
     RVGPU_FROM_HANDLE(rvgpu_pipeline, pipeline, cmd->u.bind_pipeline.pipeline);
     pipeline->used = true;
     if (pipeline->is_compute_pipeline) {
-#if 0 // TODO.zac handle compute pipeline
         handle_compute_pipeline(cmd, state);
         handle_pipeline_access(state, MESA_SHADER_COMPUTE);
-#endif
     } else {
         handle_graphics_pipeline(cmd, state);
         for (unsigned i = 0; i < MESA_SHADER_COMPUTE; i++)
@@ -1061,134 +1153,131 @@ render_needs_clear(struct rendering_state *state)
     return false;
 }
 
-static void render_clear(struct rendering_state *state)
+static void
+render_att_clear(struct rendering_state *state, struct rvgpu_image_view *imgv,
+                 VkImageAspectFlags aspects, const VkClearValue *value)
 {
-#if 0
-    for (uint32_t i = 0; i < state->color_att_count; i++) {
-        if (state->color_att[i].load_op != VK_ATTACHMENT_LOAD_OP_CLEAR)
-            continue;
-
-        union pipe_color_union color_clear_val = { 0 };
-        const VkClearValue value = state->color_att[i].clear_value;
-        color_clear_val.ui[0] = value.color.uint32[0];
-        color_clear_val.ui[1] = value.color.uint32[1];
-        color_clear_val.ui[2] = value.color.uint32[2];
-        color_clear_val.ui[3] = value.color.uint32[3];
-
-        struct rvgpu_image_view *imgv = state->color_att[i].imgv;
-        assert(imgv->surface);
+    unsigned base_layer = imgv->vk.base_array_layer;
 
-        if (state->info.view_mask) {
-            u_foreach_bit(i, state->info.view_mask)
-                clear_attachment_layers(state, imgv, &state->render_area,
-                                        i, 1, 0, 0, 0, &color_clear_val);
-        } else {
-            state->pctx->clear_render_target(state->pctx,
-                                             imgv->surface,
-                                             &color_clear_val,
-                                             state->render_area.offset.x,
-                                             state->render_area.offset.y,
-                                             state->render_area.extent.width,
-                                             state->render_area.extent.height,
-                                             false);
-        }
+    if (state->info.view_mask) {
+        u_foreach_bit(view, state->info.view_mask)
+            rvgpu_image_clear(imgv->image, aspects, value, imgv->vk.base_mip_level,
+                              &state->render_area, base_layer + view, 1);
+    } else {
+        rvgpu_image_clear(imgv->image, aspects, value, imgv->vk.base_mip_level,
+                          &state->render_area, base_layer, state->framebuffer.layers);
     }
+}
 
-    uint32_t ds_clear_flags = 0;
-    double dclear_val = 0;
+/* Load-op clears only record the clear value in the images' fast clear
+ * metadata for the tiles covered by the render area; they are written out
+ * by the tile loader of the draws, at the end of the pass or by a barrier.
+ */
+static void render_clear(struct rendering_state *state)
+{
+    VkImageAspectFlags ds_aspects = 0;
+    VkClearValue ds_clear_val = {0};
     if (state->depth_att.load_op == VK_ATTACHMENT_LOAD_OP_CLEAR) {
-        ds_clear_flags |= PIPE_CLEAR_DEPTH;
-        dclear_val = state->depth_att.clear_value.depthStencil.depth;
+        ds_aspects |= VK_IMAGE_ASPECT_DEPTH_BIT;
+        ds_clear_val.depthStencil.depth = state->depth_att.clear_value.depthStencil.depth;
     }
 
-    uint32_t sclear_val = 0;
     if (state->stencil_att.load_op == VK_ATTACHMENT_LOAD_OP_CLEAR) {
-        ds_clear_flags |= PIPE_CLEAR_STENCIL;
-        sclear_val = state->stencil_att.clear_value.depthStencil.stencil;
+        ds_aspects |= VK_IMAGE_ASPECT_STENCIL_BIT;
+        ds_clear_val.depthStencil.stencil = state->stencil_att.clear_value.depthStencil.stencil;
     }
 
-    if (ds_clear_flags) {
-        if (state->info.view_mask) {
-            u_foreach_bit(i, state->info.view_mask)
-                clear_attachment_layers(state, state->ds_imgv, &state->render_area,
-                                        i, 1, ds_clear_flags, dclear_val, sclear_val, NULL);
-        } else {
-            state->pctx->clear_depth_stencil(state->pctx,
-                                             state->ds_imgv->surface,
-                                             ds_clear_flags,
-                                             dclear_val, sclear_val,
-                                             state->render_area.offset.x,
-                                             state->render_area.offset.y,
-                                             state->render_area.extent.width,
-                                             state->render_area.extent.height,
-                                             false);
-        }
-    }
-#endif
-}
-
-static void render_clear_fast(struct rendering_state *state)
-{
-    /*
-     * the state tracker clear interface only works if all the attachments have the same
-     * clear color.
-     */
-    /* llvmpipe doesn't support scissored clears yet */
-    if (state->render_area.offset.x || state->render_area.offset.y)
-        goto slow_clear;
-
-    if (state->render_area.extent.width != state->framebuffer.width ||
-        state->render_area.extent.height != state->framebuffer.height)
-        goto slow_clear;
-
-    if (state->info.view_mask)
-        goto slow_clear;
+    uint32_t color_clears = 0;
+    for (uint32_t i = 0; i < state->color_att_count; i++)
+        color_clears += state->color_att[i].load_op == VK_ATTACHMENT_LOAD_OP_CLEAR;
 
-    if (state->render_cond)
-        goto slow_clear;
+    trace_start_clear(state->trace, color_clears, ds_aspects != 0);
 
-    uint32_t buffers = 0;
-    bool has_color_value = false;
-    VkClearValue color_value = {0};
     for (uint32_t i = 0; i < state->color_att_count; i++) {
         if (state->color_att[i].load_op != VK_ATTACHMENT_LOAD_OP_CLEAR)
             continue;
 
-        buffers |= (PIPE_CLEAR_COLOR0 << i);
+        render_att_clear(state, state->color_att[i].imgv, VK_IMAGE_ASPECT_COLOR_BIT,
+                         &state->color_att[i].clear_value);
+    }
 
-        if (has_color_value) {
-            if (memcmp(&color_value, &state->color_att[i].clear_value, sizeof(VkClearValue)))
-                goto slow_clear;
-        } else {
-            memcpy(&color_value, &state->color_att[i].clear_value, sizeof(VkClearValue));
-            has_color_value = true;
+    if (ds_aspects)
+        render_att_clear(state, state->ds_imgv, ds_aspects, &ds_clear_val);
+
+    trace_end_clear(state->trace);
+}
+
+enum fast_clear_op {
+    FAST_CLEAR_EXPAND,
+    FAST_CLEAR_DISCARD,
+};
+
+static void
+render_att_fast_clear_op(struct rendering_state *state, struct rvgpu_image_view *imgv,
+                         const VkRect2D *area, enum fast_clear_op op)
+{
+    if (!imgv || !imgv->image->fast_clear || imgv->vk.base_mip_level != 0)
+        return;
+
+    unsigned base_layer = imgv->vk.base_array_layer;
+    if (state->info.view_mask) {
+        u_foreach_bit(view, state->info.view_mask) {
+            if (op == FAST_CLEAR_EXPAND)
+                rvgpu_image_fast_clear_expand(imgv->image, area, base_layer + view, 1);
+            else
+                rvgpu_image_fast_clear_discard(imgv->image, area, base_layer + view, 1);
         }
+    } else {
+        if (op == FAST_CLEAR_EXPAND)
+            rvgpu_image_fast_clear_expand(imgv->image, area, base_layer, state->framebuffer.layers);
+        else
+            rvgpu_image_fast_clear_discard(imgv->image, area, base_layer, state->framebuffer.layers);
     }
+}
 
-    double dclear_val = 0;
-    if (state->depth_att.load_op == VK_ATTACHMENT_LOAD_OP_CLEAR) {
-        buffers |= PIPE_CLEAR_DEPTH;
-        dclear_val = state->depth_att.clear_value.depthStencil.depth;
-    }
+static bool
+render_att_is_dead(const struct rvgpu_render_attachment *att, bool at_load)
+{
+    if (!att->imgv)
+        return true;
+    return at_load ? att->load_op == VK_ATTACHMENT_LOAD_OP_DONT_CARE :
+                     att->store_op == VK_ATTACHMENT_STORE_OP_DONT_CARE;
+}
 
-    uint32_t sclear_val = 0;
-    if (state->stencil_att.load_op == VK_ATTACHMENT_LOAD_OP_CLEAR) {
-        buffers |= PIPE_CLEAR_STENCIL;
-        sclear_val = state->stencil_att.clear_value.depthStencil.stencil;
+/* Attachments whose contents are undefined at load never get their pending
+ * clears written out.
+ */
+static void
+render_discard_fast_clears(struct rendering_state *state)
+{
+    for (uint32_t i = 0; i < state->color_att_count; i++) {
+        if (render_att_is_dead(&state->color_att[i], true))
+            render_att_fast_clear_op(state, state->color_att[i].imgv, &state->render_area, FAST_CLEAR_DISCARD);
     }
 
-    union pipe_color_union col_val;
-    for (unsigned i = 0; i < 4; i++)
-        col_val.ui[i] = color_value.color.uint32[i];
-#if 0
-    state->pctx->clear(state->pctx, buffers,
-                       NULL, &col_val,
-                       dclear_val, sclear_val);
-#endif
-    return;
+    /* depth and stencil share the tiles, both must be dead */
+    if (render_att_is_dead(&state->depth_att, true) &&
+        render_att_is_dead(&state->stencil_att, true))
+        render_att_fast_clear_op(state, state->ds_imgv, &state->render_area, FAST_CLEAR_DISCARD);
+}
+
+/* At the end of the pass, tiles still pending are written out for stored
+ * attachments and dropped for those whose contents become undefined.  Tiles
+ * the draws rendered to were already resolved by the tile loader.
+ */
+static void
+render_store_fast_clears(struct rendering_state *state)
+{
+    for (uint32_t i = 0; i < state->color_att_count; i++) {
+        render_att_fast_clear_op(state, state->color_att[i].imgv, &state->render_area,
+                                 render_att_is_dead(&state->color_att[i], false) ?
+                                 FAST_CLEAR_DISCARD : FAST_CLEAR_EXPAND);
+    }
 
-slow_clear:
-    render_clear(state);
+    render_att_fast_clear_op(state, state->ds_imgv, &state->render_area,
+                             render_att_is_dead(&state->depth_att, false) &&
+                             render_att_is_dead(&state->stencil_att, false) ?
+                             FAST_CLEAR_DISCARD : FAST_CLEAR_EXPAND);
 }
 
 static void render_att_init(struct rvgpu_render_attachment* att,
@@ -1317,8 +1406,43 @@ static void handle_begin_rendering(struct vk_cmd_queue_entry *cmd, struct render
     }
 
     // state->pctx->set_framebuffer_state(state->pctx, &state->framebuffer);  // TODO.zac set_framebuffer_state
-    if (!resuming && render_needs_clear(state))
-        render_clear_fast(state);
+    trace_start_render_pass(state->trace, state->framebuffer.width, state->framebuffer.height,
+                            state->framebuffer.layers, state->color_att_count,
+                            state->ds_imgv != NULL, resuming);
+    if (!resuming) {
+        render_discard_fast_clears(state);
+        if (render_needs_clear(state))
+            render_clear(state);
+    }
+}
+
+static void handle_end_rendering(struct vk_cmd_queue_entry *cmd,
+                                 struct rendering_state *state)
+{
+    /* A suspended pass is resumed by a later vkCmdBeginRendering, possibly
+     * in another command buffer of the same submission, so the attachments
+     * must not be resolved yet.
+     */
+    if (state->suspending) {
+        /* each suspended part of a pass is its own render_pass stage, so
+         * stages stay nested inside their command buffer
+         */
+        trace_end_render_pass(state->trace);
+        return;
+    }
+
+    /* resolves read the whole render area of their source */
+    for (uint32_t i = 0; i < state->color_att_count; i++) {
+        if (state->color_att[i].resolve_imgv)
+            render_att_fast_clear_op(state, state->color_att[i].imgv, &state->render_area, FAST_CLEAR_EXPAND);
+    }
+    if (state->depth_att.resolve_imgv || state->stencil_att.resolve_imgv)
+        render_att_fast_clear_op(state, state->ds_imgv, &state->render_area, FAST_CLEAR_EXPAND);
+    // render_resolve(state); TODO.zac
+
+    render_store_fast_clears(state);
+
+    trace_end_render_pass(state->trace);
 }
 
 static void set_viewport(unsigned first_viewport, unsigned viewport_count,
@@ -1382,12 +1506,177 @@ static void handle_set_scissor(struct vk_cmd_queue_entry *cmd,
                state);
 }
 
+/* Splits the grid into one contiguous run of workgroups per core and hands
+ * the runs to the winsys.  Contiguous runs keep neighbouring workgroups,
+ * which tend to touch neighbouring memory, on the same core.
+ */
+static void launch_grid(struct rendering_state *state)
+{
+    const struct pipe_grid_info *info = &state->dispatch_info;
+    const struct rvgpu_shader_binary *binary = state->cs_binary;
+    struct rvgpu_winsys *ws = state->device->ws;
+    struct rvgpu_winsys_cs_job jobs[RVGPU_MAX_CORES];
+
+    if (!binary || !binary->elf)
+        return;
+
+    uint64_t group_count = (uint64_t)info->grid[0] * info->grid[1] * info->grid[2];
+    if (!group_count)
+        return;
+
+    uint32_t job_count = MIN2(ws->num_cores, group_count);
+    uint64_t groups_per_job = group_count / job_count;
+    uint64_t remainder = group_count % job_count;
+    uint64_t first_group = 0;
+
+    MESA_TRACE_FUNC();
+
+    for (uint32_t i = 0; i < job_count; i++) {
+        struct rvgpu_winsys_cs_job *job = &jobs[i];
+
+        job->elf = binary->elf;
+        job->elf_size = binary->elf_size;
+        job->desc = 0; /* descriptors aren't uploaded yet, see update_pcbuf() */
+        memcpy(job->block, info->block, sizeof(job->block));
+        memcpy(job->grid, info->grid, sizeof(job->grid));
+        memcpy(job->grid_base, info->grid_base, sizeof(job->grid_base));
+        job->first_group = first_group;
+        job->group_count = groups_per_job + (i < remainder);
+        job->shared_size = binary->shared_size;
+        job->core = i;
+
+        first_group += job->group_count;
+    }
+    assert(first_group == group_count);
+
+    /* compute pipelines can't be created without it */
+    assert(ws->ops.cs_submit);
+
+    VkResult result = ws->ops.cs_submit(ws, jobs, job_count);
+    if (result != VK_SUCCESS) {
+        fprintf(stderr, "rvgpu: failed to submit a compute dispatch: %s\n",
+                vk_Result_to_str(result));
+        abort();
+    }
+}
+
+static void handle_dispatch(struct vk_cmd_queue_entry *cmd,
+                            struct rendering_state *state)
+{
+    state->dispatch_info.grid[0] = cmd->u.dispatch.group_count_x;
+    state->dispatch_info.grid[1] = cmd->u.dispatch.group_count_y;
+    state->dispatch_info.grid[2] = cmd->u.dispatch.group_count_z;
+    state->dispatch_info.grid_base[0] = 0;
+    state->dispatch_info.grid_base[1] = 0;
+    state->dispatch_info.grid_base[2] = 0;
+    state->dispatch_info.indirect = NULL;
+    launch_grid(state);
+}
+
+static void handle_dispatch_base(struct vk_cmd_queue_entry *cmd,
+                                 struct rendering_state *state)
+{
+    state->dispatch_info.grid[0] = cmd->u.dispatch_base.group_count_x;
+    state->dispatch_info.grid[1] = cmd->u.dispatch_base.group_count_y;
+    state->dispatch_info.grid[2] = cmd->u.dispatch_base.group_count_z;
+    state->dispatch_info.grid_base[0] = cmd->u.dispatch_base.base_group_x;
+    state->dispatch_info.grid_base[1] = cmd->u.dispatch_base.base_group_y;
+    state->dispatch_info.grid_base[2] = cmd->u.dispatch_base.base_group_z;
+    state->dispatch_info.indirect = NULL;
+    launch_grid(state);
+}
+
+static void handle_dispatch_indirect(struct vk_cmd_queue_entry *cmd,
+                                     struct rendering_state *state)
+{
+    RVGPU_FROM_HANDLE(rvgpu_buffer, buffer, cmd->u.dispatch_indirect.buffer);
+    struct rvgpu_winsys *ws = state->device->ws;
+
+    /* commands run on the host at submit time, so the group counts can be
+     * read straight out of the buffer
+     */
+    const uint8_t *map = ws->ops.bo_map(buffer->bo);
+    const VkDispatchIndirectCommand *grid =
+        (const void *)(map + buffer->offset + cmd->u.dispatch_indirect.offset);
+
+    state->dispatch_info.grid[0] = grid->x;
+    state->dispatch_info.grid[1] = grid->y;
+    state->dispatch_info.grid[2] = grid->z;
+    state->dispatch_info.grid_base[0] = 0;
+    state->dispatch_info.grid_base[1] = 0;
+    state->dispatch_info.grid_base[2] = 0;
+    state->dispatch_info.indirect = NULL;
+    ws->ops.bo_unmap(buffer->bo);
+    launch_grid(state);
+}
+
+/* Barriers are where images leave the attachment layouts, so their pending
+ * fast clears are handled even when the flush itself is skipped.
+ */
+static void handle_image_barriers(const VkDependencyInfo *dep)
+{
+    for (uint32_t i = 0; i < dep->imageMemoryBarrierCount; i++) {
+        const VkImageMemoryBarrier2 *barrier = &dep->pImageMemoryBarriers[i];
+        RVGPU_FROM_HANDLE(rvgpu_image, image, barrier->image);
+
+        rvgpu_image_fast_clear_barrier(image, barrier);
+    }
+}
+
 static void handle_pipeline_barrier(struct vk_cmd_queue_entry *cmd,
                                     struct rendering_state *state)
 {
     finish_fence(state);
 }
 
+/* Sample count a secondary continuing the current render pass must have
+ * been recorded for, 0 if the pass has no attachments to match.
+ */
+static VkSampleCountFlagBits
+render_pass_samples(const struct rendering_state *state)
+{
+    if (state->forced_sample_count)
+        return state->forced_sample_count;
+
+    for (uint32_t i = 0; i < state->color_att_count; i++) {
+        if (state->color_att[i].imgv)
+            return state->color_att[i].imgv->image->vk.samples;
+    }
+    if (state->ds_imgv)
+        return state->ds_imgv->image->vk.samples;
+
+    return 0;
+}
+
+UNUSED static bool
+secondary_matches_render_pass(const struct rvgpu_cmd_buffer *secondary_buf,
+                              const struct rendering_state *state)
+{
+    const struct rvgpu_cmd_inheritance *inheritance = &secondary_buf->inheritance;
+
+    if (!inheritance->render_pass_continue)
+        return true;
+
+    VkSampleCountFlagBits samples = render_pass_samples(state);
+    return inheritance->view_mask == state->info.view_mask &&
+           inheritance->color_att_count <= state->color_att_count &&
+           (!inheritance->samples || !samples || inheritance->samples == samples);
+}
+
+static void handle_execute_commands(struct vk_cmd_queue_entry *cmd,
+                                    struct rendering_state *state, bool print_cmds)
+{
+    /* Secondaries are replayed in place on the primary's rendering state:
+     * nothing is copied at submit time, so the cost of recording stays on
+     * the threads that recorded them.
+     */
+    for (unsigned i = 0; i < cmd->u.execute_commands.command_buffer_count; i++) {
+        RVGPU_FROM_HANDLE(rvgpu_cmd_buffer, secondary_buf, cmd->u.execute_commands.command_buffers[i]);
+        assert(secondary_matches_render_pass(secondary_buf, state));
+        rvgpu_execute_cmd_buffer(secondary_buf, state, print_cmds);
+    }
+}
+
 void rvgpu_add_enqueue_cmd_entrypoints(struct vk_device_dispatch_table *disp)
 {
    struct vk_device_dispatch_table cmd_enqueue_dispatch;
@@ -1518,6 +1807,8 @@ static void rvgpu_execute_cmd_buffer(struct rvgpu_cmd_buffer *cmd_buffer,
    bool first = true;
    bool did_flush = false;
 
+   trace_start_cmd_buffer(state->trace, cmd_buffer);
+
    LIST_FOR_EACH_ENTRY(cmd, &cmd_buffer->vk.cmd_queue.cmds, cmd_link) {
       if (print_cmds)
          fprintf(stderr, "%s\n", vk_cmd_queue_type_names[cmd->type]);
@@ -1592,16 +1883,16 @@ static void rvgpu_execute_cmd_buffer(struct rvgpu_cmd_buffer *cmd_buffer,
          // handle_draw_multi_indexed(cmd, state);
          break;
       case VK_CMD_DISPATCH:
-         // emit_compute_state(state);
-         // handle_dispatch(cmd, state);
+         emit_compute_state(state);
+         handle_dispatch(cmd, state);
          break;
       case VK_CMD_DISPATCH_BASE:
-         // emit_compute_state(state);
-         // handle_dispatch_base(cmd, state);
+         emit_compute_state(state);
+         handle_dispatch_base(cmd, state);
          break;
       case VK_CMD_DISPATCH_INDIRECT:
-         // emit_compute_state(state);
-         // handle_dispatch_indirect(cmd, state);
+         emit_compute_state(state);
+         handle_dispatch_indirect(cmd, state);
          break;
       case VK_CMD_COPY_BUFFER2:
          // handle_copy_buffer(cmd, state);
@@ -1637,6 +1928,7 @@ static void rvgpu_execute_cmd_buffer(struct rvgpu_cmd_buffer *cmd_buffer,
          // handle_resolve_image(cmd, state);
          break;
       case VK_CMD_PIPELINE_BARRIER2:
+         handle_image_barriers(cmd->u.pipeline_barrier2.dependency_info);
          /* skip flushes since every cmdbuf does a flush
             after iterating its cmds and so this is redundant
           */
@@ -1667,7 +1959,7 @@ static void rvgpu_execute_cmd_buffer(struct rvgpu_cmd_buffer *cmd_buffer,
          // handle_push_constants(cmd, state);
          break;
       case VK_CMD_EXECUTE_COMMANDS:
-         // handle_execute_commands(cmd, state, print_cmds);
+         handle_execute_commands(cmd, state, print_cmds);
          break;
       case VK_CMD_DRAW_INDIRECT_COUNT:
          // emit_state(state);
@@ -1757,7 +2049,7 @@ static void rvgpu_execute_cmd_buffer(struct rvgpu_cmd_buffer *cmd_buffer,
          handle_begin_rendering(cmd, state);
          break;
       case VK_CMD_END_RENDERING:
-         // handle_end_rendering(cmd, state);
+         handle_end_rendering(cmd, state);
          break;
       case VK_CMD_SET_DEVICE_MASK:
          /* no-op */
@@ -1835,6 +2127,8 @@ static void rvgpu_execute_cmd_buffer(struct rvgpu_cmd_buffer *cmd_buffer,
       first = false;
       did_flush = false;
    }
+
+   trace_end_cmd_buffer(state->trace);
 }
 
 VkResult rvgpu_execute_cmds(struct rvgpu_device *device,
@@ -1857,6 +2151,7 @@ VkResult rvgpu_execute_cmds(struct rvgpu_device *device,
    state->min_samples_dirty = true;
    state->sample_mask = UINT32_MAX;
    state->poison_mem = device->poison_mem;
+   state->trace = &queue->trace;
 
    /* default values */
    state->rs_state.line_width = 1.0;
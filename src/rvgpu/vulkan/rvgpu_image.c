@@ -27,6 +27,8 @@
 
 #include "drm-uapi/drm_fourcc.h"
 
+#include "util/u_pack_color.h"
+
 #include "vk_format.h"
 #include "vk_util.h"
 #include "vk_log.h"
@@ -96,6 +98,325 @@ rvgpu_image_layout_init(struct rvgpu_image_layout *layout)
    return true;
 }
 
+static uint8_t *
+rvgpu_image_map_layer(const struct rvgpu_image *image, unsigned level, unsigned layer)
+{
+   struct rvgpu_device *device = container_of(image->vk.base.device, struct rvgpu_device, vk);
+   const struct rvgpu_image_slice_layout *slice = &image->layout.slices[level];
+   uint8_t *map = device->ws->ops.bo_map(image->bo);
+
+   map += image->memory_offset + slice->offset;
+   if (image->layout.dim == RVGPU_TEXTURE_DIMENSION_3D)
+      return map + layer * slice->surface_stride;
+   return map + layer * image->layout.array_stride;
+}
+
+static void
+rvgpu_image_unmap(const struct rvgpu_image *image)
+{
+   struct rvgpu_device *device = container_of(image->vk.base.device, struct rvgpu_device, vk);
+
+   device->ws->ops.bo_unmap(image->bo);
+}
+
+static void
+rvgpu_image_fill_rect(const struct rvgpu_image *image, VkImageAspectFlags aspects,
+                      const VkClearValue *value, unsigned level, unsigned layer,
+                      unsigned x, unsigned y, unsigned width, unsigned height)
+{
+   enum pipe_format format = image->layout.format;
+   unsigned blocksize = util_format_get_blocksize(format);
+   unsigned row_stride = image->layout.slices[level].row_stride;
+   uint8_t packed[16] = {0};
+   uint64_t zs = 0, mask = UINT64_MAX;
+
+   if (util_format_is_depth_or_stencil(format)) {
+      zs = util_pack64_z_stencil(format, value->depthStencil.depth,
+                                 value->depthStencil.stencil);
+      if (aspects != image->vk.aspects) {
+         mask = (aspects & VK_IMAGE_ASPECT_DEPTH_BIT) ?
+                util_pack64_mask_z_stencil(format, UINT32_MAX, 0) :
+                util_pack64_mask_z_stencil(format, 0, UINT8_MAX);
+      }
+      memcpy(packed, &zs, MIN2(blocksize, sizeof(zs)));
+   } else {
+      util_format_pack_rgba(format, packed, value->color.uint32, 1);
+   }
+
+   uint8_t *map = rvgpu_image_map_layer(image, level, layer);
+   for (unsigned row = y; row < y + height; row++) {
+      uint8_t *dst = map + row * row_stride + x * blocksize;
+      for (unsigned col = 0; col < width; col++, dst += blocksize) {
+         if (mask == UINT64_MAX) {
+            memcpy(dst, packed, blocksize);
+         } else {
+            uint64_t texel = 0;
+            memcpy(&texel, dst, blocksize);
+            texel = (texel & ~mask) | (zs & mask);
+            memcpy(dst, &texel, blocksize);
+         }
+      }
+   }
+   rvgpu_image_unmap(image);
+}
+
+/* Computes the range of tiles [x0, x1) x [y0, y1) touched by area, or only
+ * those entirely inside it when covered is set.  Tiles on the right and
+ * bottom edges count as covered once the area reaches the image border.
+ */
+static bool
+fast_clear_tile_range(const struct rvgpu_image *image, const VkRect2D *area, bool covered,
+                      unsigned *x0, unsigned *y0, unsigned *x1, unsigned *y1)
+{
+   const struct rvgpu_image_fast_clear *fc = image->fast_clear;
+   const unsigned tile = RVGPU_FAST_CLEAR_TILE_SIZE;
+
+   if (!area) {
+      *x0 = *y0 = 0;
+      *x1 = fc->tiles_x;
+      *y1 = fc->tiles_y;
+      return true;
+   }
+
+   unsigned ax0 = area->offset.x, ay0 = area->offset.y;
+   unsigned ax1 = MIN2(ax0 + area->extent.width, image->layout.width);
+   unsigned ay1 = MIN2(ay0 + area->extent.height, image->layout.height);
+
+   if (covered) {
+      *x0 = DIV_ROUND_UP(ax0, tile);
+      *y0 = DIV_ROUND_UP(ay0, tile);
+      *x1 = ax1 == image->layout.width ? fc->tiles_x : ax1 / tile;
+      *y1 = ay1 == image->layout.height ? fc->tiles_y : ay1 / tile;
+   } else {
+      *x0 = ax0 / tile;
+      *y0 = ay0 / tile;
+      *x1 = MIN2(DIV_ROUND_UP(ax1, tile), fc->tiles_x);
+      *y1 = MIN2(DIV_ROUND_UP(ay1, tile), fc->tiles_y);
+   }
+   return *x0 < *x1 && *y0 < *y1;
+}
+
+static void
+fast_clear_materialize_tile(const struct rvgpu_image *image, unsigned layer,
+                            unsigned tx, unsigned ty)
+{
+   const unsigned tile = RVGPU_FAST_CLEAR_TILE_SIZE;
+   unsigned x = tx * tile, y = ty * tile;
+
+   rvgpu_image_fill_rect(image, image->vk.aspects, &image->fast_clear->value, 0, layer,
+                         x, y, MIN2(tile, image->layout.width - x),
+                         MIN2(tile, image->layout.height - y));
+}
+
+/* Writes out the pending clear of every tile touched by area, so that the
+ * memory can be read by something unaware of the clear metadata.
+ */
+void
+rvgpu_image_fast_clear_expand(struct rvgpu_image *image, const VkRect2D *area,
+                              unsigned base_layer, unsigned layer_count)
+{
+   struct rvgpu_image_fast_clear *fc = image->fast_clear;
+   unsigned x0, y0, x1, y1;
+
+   if (!fc || !fc->pending)
+      return;
+   if (!fast_clear_tile_range(image, area, false, &x0, &y0, &x1, &y1))
+      return;
+
+   unsigned last_layer = MIN2(base_layer + layer_count, fc->layers);
+   for (unsigned layer = base_layer; layer < last_layer; layer++) {
+      BITSET_WORD *cleared = fc->cleared + layer * BITSET_WORDS(fc->tiles_x * fc->tiles_y);
+      for (unsigned ty = y0; ty < y1; ty++) {
+         for (unsigned tx = x0; tx < x1; tx++) {
+            unsigned bit = ty * fc->tiles_x + tx;
+            if (!BITSET_TEST(cleared, bit))
+               continue;
+            fast_clear_materialize_tile(image, layer, tx, ty);
+            BITSET_CLEAR(cleared, bit);
+            fc->pending--;
+         }
+      }
+   }
+}
+
+/* Drops the pending clear of tiles entirely inside area, whose contents are
+ * about to be overwritten or became undefined: they are never written.
+ */
+void
+rvgpu_image_fast_clear_discard(struct rvgpu_image *image, const VkRect2D *area,
+                               unsigned base_layer, unsigned layer_count)
+{
+   struct rvgpu_image_fast_clear *fc = image->fast_clear;
+   unsigned x0, y0, x1, y1;
+
+   if (!fc || !fc->pending)
+      return;
+   if (!fast_clear_tile_range(image, area, true, &x0, &y0, &x1, &y1))
+      return;
+
+   unsigned last_layer = MIN2(base_layer + layer_count, fc->layers);
+   for (unsigned layer = base_layer; layer < last_layer; layer++) {
+      BITSET_WORD *cleared = fc->cleared + layer * BITSET_WORDS(fc->tiles_x * fc->tiles_y);
+      for (unsigned ty = y0; ty < y1; ty++) {
+         for (unsigned tx = x0; tx < x1; tx++) {
+            unsigned bit = ty * fc->tiles_x + tx;
+            if (BITSET_TEST(cleared, bit)) {
+               BITSET_CLEAR(cleared, bit);
+               fc->pending--;
+            }
+         }
+      }
+   }
+}
+
+static bool
+fast_clear_layout_is_attachment(VkImageLayout layout)
+{
+   switch (layout) {
+   case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
+   case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
+   case VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL:
+   case VK_IMAGE_LAYOUT_STENCIL_ATTACHMENT_OPTIMAL:
+   case VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL:
+      return true;
+   default:
+      return false;
+   }
+}
+
+/* Pending clears only exist for the tile loader of the draw path.  Anything
+ * else reading the image (descriptors, transfers, the presentation engine)
+ * is preceded by a barrier, which writes them out unless the image stays an
+ * attachment.  Transitions from UNDEFINED drop them instead.
+ */
+void
+rvgpu_image_fast_clear_barrier(struct rvgpu_image *image,
+                               const VkImageMemoryBarrier2 *barrier)
+{
+   struct rvgpu_image_fast_clear *fc = image->fast_clear;
+   const VkImageSubresourceRange *range = &barrier->subresourceRange;
+   const VkAccessFlags2 attachment_access =
+      VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT |
+      VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT |
+      VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+      VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+   if (!fc || !fc->pending || range->baseMipLevel != 0)
+      return;
+
+   /* the slices of 3D images are tracked as layers */
+   unsigned base_layer = 0, layer_count = fc->layers;
+   if (image->vk.image_type != VK_IMAGE_TYPE_3D) {
+      base_layer = range->baseArrayLayer;
+      layer_count = vk_image_subresource_layer_count(&image->vk, range);
+   }
+
+   if (barrier->oldLayout == VK_IMAGE_LAYOUT_UNDEFINED) {
+      rvgpu_image_fast_clear_discard(image, NULL, base_layer, layer_count);
+   } else if (!fast_clear_layout_is_attachment(barrier->newLayout) ||
+              (barrier->dstAccessMask & ~attachment_access)) {
+      rvgpu_image_fast_clear_expand(image, NULL, base_layer, layer_count);
+   }
+}
+
+/* Clears area of the given layers.  Tiles of level 0 entirely inside area
+ * are only flagged in the fast clear metadata; the remaining pixels are
+ * written right away.
+ */
+void
+rvgpu_image_clear(struct rvgpu_image *image, VkImageAspectFlags aspects,
+                  const VkClearValue *value, unsigned level, const VkRect2D *area,
+                  unsigned base_layer, unsigned layer_count)
+{
+   struct rvgpu_image_fast_clear *fc = image->fast_clear;
+   const unsigned tile = RVGPU_FAST_CLEAR_TILE_SIZE;
+   unsigned x0, y0, x1, y1, cx0, cy0, cx1, cy1;
+
+   if (!fc || level != 0 || aspects != image->vk.aspects) {
+      if (level == 0)
+         rvgpu_image_fast_clear_expand(image, area, base_layer, layer_count);
+      for (unsigned layer = base_layer; layer < base_layer + layer_count; layer++)
+         rvgpu_image_fill_rect(image, aspects, value, level, layer,
+                               area->offset.x, area->offset.y,
+                               area->extent.width, area->extent.height);
+      return;
+   }
+
+   /* There's a single clear value per image: tiles still holding a
+    * different one must be written out unless this clear covers them.
+    */
+   if (fc->pending && memcmp(&fc->value, value, sizeof(*value))) {
+      rvgpu_image_fast_clear_discard(image, area, base_layer, layer_count);
+      rvgpu_image_fast_clear_expand(image, NULL, 0, fc->layers);
+   }
+   fc->value = *value;
+
+   if (!fast_clear_tile_range(image, area, false, &x0, &y0, &x1, &y1))
+      return;
+   if (!fast_clear_tile_range(image, area, true, &cx0, &cy0, &cx1, &cy1))
+      cx0 = cx1 = cy0 = cy1 = 0;
+
+   unsigned ax0 = area->offset.x, ay0 = area->offset.y;
+   unsigned ax1 = MIN2(ax0 + area->extent.width, image->layout.width);
+   unsigned ay1 = MIN2(ay0 + area->extent.height, image->layout.height);
+   unsigned last_layer = MIN2(base_layer + layer_count, fc->layers);
+
+   for (unsigned layer = base_layer; layer < last_layer; layer++) {
+      BITSET_WORD *cleared = fc->cleared + layer * BITSET_WORDS(fc->tiles_x * fc->tiles_y);
+      for (unsigned ty = y0; ty < y1; ty++) {
+         for (unsigned tx = x0; tx < x1; tx++) {
+            unsigned bit = ty * fc->tiles_x + tx;
+            if (BITSET_TEST(cleared, bit))
+               continue;
+
+            if (tx >= cx0 && tx < cx1 && ty >= cy0 && ty < cy1) {
+               BITSET_SET(cleared, bit);
+               fc->pending++;
+               continue;
+            }
+
+            /* partially covered edge tile */
+            unsigned px0 = MAX2(tx * tile, ax0), py0 = MAX2(ty * tile, ay0);
+            unsigned px1 = MIN2((tx + 1) * tile, ax1), py1 = MIN2((ty + 1) * tile, ay1);
+            rvgpu_image_fill_rect(image, aspects, value, 0, layer,
+                                  px0, py0, px1 - px0, py1 - py0);
+         }
+      }
+   }
+}
+
+static struct rvgpu_image_fast_clear *
+rvgpu_image_fast_clear_create(struct rvgpu_device *device, const VkImageCreateInfo *pCreateInfo,
+                              const VkAllocationCallbacks *alloc)
+{
+   /* Host visible images must always hold their real contents, and MSAA
+    * surfaces are cleared through their resolves.
+    */
+   if (pCreateInfo->tiling != VK_IMAGE_TILING_OPTIMAL ||
+       pCreateInfo->samples != VK_SAMPLE_COUNT_1_BIT ||
+       !(pCreateInfo->usage & (VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                               VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT)))
+      return NULL;
+
+   unsigned tiles_x = DIV_ROUND_UP(pCreateInfo->extent.width, RVGPU_FAST_CLEAR_TILE_SIZE);
+   unsigned tiles_y = DIV_ROUND_UP(pCreateInfo->extent.height, RVGPU_FAST_CLEAR_TILE_SIZE);
+   unsigned layers = pCreateInfo->imageType == VK_IMAGE_TYPE_3D ?
+                     pCreateInfo->extent.depth : pCreateInfo->arrayLayers;
+   size_t bitset_size = BITSET_WORDS(tiles_x * tiles_y) * sizeof(BITSET_WORD) * layers;
+
+   struct rvgpu_image_fast_clear *fc =
+      vk_zalloc2(&device->vk.alloc, alloc, sizeof(*fc) + bitset_size, 8,
+                 VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+   if (!fc)
+      return NULL;
+
+   fc->tiles_x = tiles_x;
+   fc->tiles_y = tiles_y;
+   fc->layers = layers;
+   fc->cleared = (BITSET_WORD *)(fc + 1);
+   return fc;
+}
+
 static VkResult
 rvgpu_image_create(VkDevice _device, const VkImageCreateInfo *pCreateInfo,
                    const VkAllocationCallbacks *alloc, VkImage *pImage,
@@ -163,9 +484,30 @@ rvgpu_image_create(VkDevice _device, const VkImageCreateInfo *pCreateInfo,
       template.last_level = pCreateInfo->mipLevels - 1;
       template.nr_samples = pCreateInfo->samples;
       template.nr_storage_samples = pCreateInfo->samples;
+
+      image->layout = (struct rvgpu_image_layout) {
+         .modifier = modifier,
+         .format = template.format,
+         .width = template.width0,
+         .height = template.height0,
+         .depth = template.depth0,
+         .nr_samples = MAX2(template.nr_samples, 1),
+         .dim = pCreateInfo->imageType == VK_IMAGE_TYPE_1D ? RVGPU_TEXTURE_DIMENSION_1D :
+                pCreateInfo->imageType == VK_IMAGE_TYPE_3D ? RVGPU_TEXTURE_DIMENSION_3D :
+                                                             RVGPU_TEXTURE_DIMENSION_2D,
+         .nr_slices = pCreateInfo->mipLevels,
+         .array_size = template.array_size,
+      };
+      rvgpu_image_layout_init(&image->layout);
+      image->size = image->layout.data_size;
+      image->fast_clear = rvgpu_image_fast_clear_create(device, pCreateInfo, alloc);
+
       VkResult result = device->ws->ops.bo_create(device->ws, image->size, 0, &image->bo);
-      if (result != VK_SUCCESS)
+      if (result != VK_SUCCESS) {
+         vk_free2(&device->vk.alloc, alloc, image->fast_clear);
+         vk_image_destroy(&device->vk, alloc, &image->vk);
          return vk_error(device, VK_ERROR_OUT_OF_HOST_MEMORY);
+      }
    }
 
    *pImage = rvgpu_image_to_handle(image);
@@ -192,6 +534,20 @@ rvgpu_CreateImage(VkDevice _device, const VkImageCreateInfo *pCreateInfo,
    return rvgpu_image_create(_device, pCreateInfo, pAllocator, pImage, DRM_FORMAT_MOD_LINEAR);
 }
 
+VKAPI_ATTR void VKAPI_CALL
+rvgpu_DestroyImage(VkDevice _device, VkImage _image,
+                   const VkAllocationCallbacks *pAllocator)
+{
+   RVGPU_FROM_HANDLE(rvgpu_device, device, _device);
+   RVGPU_FROM_HANDLE(rvgpu_image, image, _image);
+
+   if (!image)
+      return;
+
+   vk_free2(&device->vk.alloc, pAllocator, image->fast_clear);
+   vk_image_destroy(&device->vk, pAllocator, &image->vk);
+}
+
 VKAPI_ATTR VkResult VKAPI_CALL
 rvgpu_CreateImageView(VkDevice _device, const VkImageViewCreateInfo *pCreateInfo,
                       const VkAllocationCallbacks *pAllocator, VkImageView *pView)
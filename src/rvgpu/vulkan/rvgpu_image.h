@@ -29,6 +29,7 @@
 #define RVGPU_IMAGE_H__
 
 #include "pipe/p_state.h"
+#include "util/bitset.h"
 #include "vk_image.h"
 
 #include "rvgpu_winsys.h"
@@ -81,6 +82,27 @@ struct rvgpu_image_layout {
    unsigned array_stride;
 };
 
+/* Fast clears of render targets are tracked at this granularity, in
+ * pixels, on mip level 0.
+ */
+#define RVGPU_FAST_CLEAR_TILE_SIZE 32
+
+struct rvgpu_image_fast_clear {
+   /* Value every tile flagged in cleared logically holds; the memory
+    * backing those tiles has not been written yet.
+    */
+   VkClearValue value;
+
+   unsigned tiles_x, tiles_y;
+   unsigned layers;
+
+   /* Number of bits set in cleared, 0 when nothing is pending. */
+   unsigned pending;
+
+   /* tiles_x * tiles_y bits per array layer */
+   BITSET_WORD *cleared;
+};
+
 struct rvgpu_image {
    struct vk_image vk;
    VkDeviceSize size;
@@ -88,11 +110,16 @@ struct rvgpu_image {
    struct pipe_memory_allocation *pmem;
    unsigned memory_offset;
    struct rvgpu_winsys_bo *bo;
+
+   struct rvgpu_image_layout layout;
+
+   /* NULL for images that can't be render targets or are host visible */
+   struct rvgpu_image_fast_clear *fast_clear;
 };
 
 struct rvgpu_image_view {
    struct vk_image_view vk;
-   const struct rvgpu_image *image; /**< VkImageViewCreateInfo::image */
+   struct rvgpu_image *image; /**< VkImageViewCreateInfo::image */
    
    enum pipe_format pformat;
 
@@ -103,6 +130,16 @@ struct rvgpu_image_view {
    struct rvgpu_image_view *multisampler; //VK_EXT_multisampled_render_to_single_sampled
 };
 
+void rvgpu_image_clear(struct rvgpu_image *image, VkImageAspectFlags aspects,
+                       const VkClearValue *value, unsigned level, const VkRect2D *area,
+                       unsigned base_layer, unsigned layer_count);
+void rvgpu_image_fast_clear_expand(struct rvgpu_image *image, const VkRect2D *area,
+                                   unsigned base_layer, unsigned layer_count);
+void rvgpu_image_fast_clear_discard(struct rvgpu_image *image, const VkRect2D *area,
+                                    unsigned base_layer, unsigned layer_count);
+void rvgpu_image_fast_clear_barrier(struct rvgpu_image *image,
+                                    const VkImageMemoryBarrier2 *barrier);
+
 static VkResult rvgpu_image_create(VkDevice _device, 
                                    const VkImageCreateInfo *pCreateInfo,
                                    const VkAllocationCallbacks *alloc, 
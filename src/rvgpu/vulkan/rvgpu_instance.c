@@ -25,6 +25,7 @@
  * IN THE SOFTWARE.
  */
 
+#include "util/u_call_once.h"
 #include "util/u_debug.h"
 
 #include "vk_log.h"
@@ -125,6 +126,11 @@ rvgpu_CreateInstance(const VkInstanceCreateInfo *pCreateInfo,
 
    *pInstance = rvgpu_instance_to_handle(instance);
 
+#ifdef HAVE_PERFETTO
+   static util_once_flag perfetto_once = UTIL_ONCE_FLAG_INIT;
+   util_call_once(&perfetto_once, rvgpu_perfetto_init);
+#endif
+
    return VK_SUCCESS;
 }
 
@@ -26,6 +26,7 @@
  */
 
 #include "nir/nir_builder.h"
+#include "util/perf/cpu_trace.h"
 
 #include "rvgpu_private.h"
 
@@ -77,50 +78,54 @@ rvgpu_nir_fixup_indirect_tex(nir_shader *shader)
 static void
 optimize(nir_shader *nir)
 {
+    nir_pass_loop loop;
     bool progress = false;
+
+    nir_pass_loop_init(&loop, nir);
     do {
         progress = false;
 
-        NIR_PASS(progress, nir, nir_lower_flrp, 32|64, true);
-        NIR_PASS(progress, nir, nir_split_array_vars, nir_var_function_temp);
-        NIR_PASS(progress, nir, nir_shrink_vec_array_vars, nir_var_function_temp);
-        NIR_PASS(progress, nir, nir_opt_deref);
-        NIR_PASS(progress, nir, nir_lower_vars_to_ssa);
+        NIR_LOOP_PASS(progress, &loop, nir_lower_flrp, 32|64, true);
+        NIR_LOOP_PASS(progress, &loop, nir_split_array_vars, nir_var_function_temp);
+        NIR_LOOP_PASS(progress, &loop, nir_shrink_vec_array_vars, nir_var_function_temp);
+        NIR_LOOP_PASS(progress, &loop, nir_opt_deref);
+        NIR_LOOP_PASS(progress, &loop, nir_lower_vars_to_ssa);
 
-        NIR_PASS(progress, nir, nir_opt_copy_prop_vars);
+        NIR_LOOP_PASS(progress, &loop, nir_opt_copy_prop_vars);
 
-        NIR_PASS(progress, nir, nir_copy_prop);
-        NIR_PASS(progress, nir, nir_opt_dce);
-        NIR_PASS(progress, nir, nir_opt_peephole_select, 8, true, true);
+        NIR_LOOP_PASS(progress, &loop, nir_copy_prop);
+        NIR_LOOP_PASS(progress, &loop, nir_opt_dce);
+        NIR_LOOP_PASS(progress, &loop, nir_opt_peephole_select, 8, true, true);
 
-        NIR_PASS(progress, nir, nir_opt_algebraic);
-        NIR_PASS(progress, nir, nir_opt_constant_folding);
+        NIR_LOOP_PASS(progress, &loop, nir_opt_algebraic);
+        NIR_LOOP_PASS(progress, &loop, nir_opt_constant_folding);
 
-        NIR_PASS(progress, nir, nir_opt_remove_phis);
+        NIR_LOOP_PASS(progress, &loop, nir_opt_remove_phis);
         bool trivial_continues = false;
-        NIR_PASS(trivial_continues, nir, nir_opt_trivial_continues);
+        NIR_LOOP_PASS(trivial_continues, &loop, nir_opt_trivial_continues);
         progress |= trivial_continues;
         if (trivial_continues) {
             /* If nir_opt_trivial_continues makes progress, then we need to clean
              * things up if we want any hope of nir_opt_if or nir_opt_loop_unroll
              * to make progress.
              */
-            NIR_PASS(progress, nir, nir_copy_prop);
-            NIR_PASS(progress, nir, nir_opt_dce);
-            NIR_PASS(progress, nir, nir_opt_remove_phis);
+            NIR_LOOP_PASS(progress, &loop, nir_copy_prop);
+            NIR_LOOP_PASS(progress, &loop, nir_opt_dce);
+            NIR_LOOP_PASS(progress, &loop, nir_opt_remove_phis);
         }
-        NIR_PASS(progress, nir, nir_opt_if, nir_opt_if_aggressive_last_continue | nir_opt_if_optimize_phi_true_false);
-        NIR_PASS(progress, nir, nir_opt_dead_cf);
-        NIR_PASS(progress, nir, nir_opt_conditional_discard);
-        NIR_PASS(progress, nir, nir_opt_remove_phis);
-        NIR_PASS(progress, nir, nir_opt_cse);
-        NIR_PASS(progress, nir, nir_opt_undef);
-
-        NIR_PASS(progress, nir, nir_opt_deref);
-        NIR_PASS(progress, nir, nir_lower_alu_to_scalar, NULL, NULL);
-        NIR_PASS(progress, nir, nir_opt_loop_unroll);
-        NIR_PASS(progress, nir, rvgpu_nir_fixup_indirect_tex);
-    } while (progress);
+        NIR_LOOP_PASS(progress, &loop, nir_opt_if, nir_opt_if_aggressive_last_continue | nir_opt_if_optimize_phi_true_false);
+        NIR_LOOP_PASS(progress, &loop, nir_opt_dead_cf);
+        NIR_LOOP_PASS(progress, &loop, nir_opt_conditional_discard);
+        NIR_LOOP_PASS(progress, &loop, nir_opt_remove_phis);
+        NIR_LOOP_PASS(progress, &loop, nir_opt_cse);
+        NIR_LOOP_PASS(progress, &loop, nir_opt_undef);
+
+        NIR_LOOP_PASS(progress, &loop, nir_opt_deref);
+        NIR_LOOP_PASS(progress, &loop, nir_lower_alu_to_scalar, NULL, NULL);
+        NIR_LOOP_PASS(progress, &loop, nir_opt_loop_unroll);
+        NIR_LOOP_PASS(progress, &loop, rvgpu_nir_fixup_indirect_tex);
+    } while (nir_pass_loop_continue(&loop, progress));
+    nir_pass_loop_finish(&loop);
 }
 
 void
@@ -384,6 +389,7 @@ create_pipeline_nir(nir_shader *nir)
    struct rvgpu_pipeline_nir *pipeline_nir = ralloc(NULL, struct rvgpu_pipeline_nir);
    pipeline_nir->nir = nir;
    pipeline_nir->ref_cnt = 1;
+   pipeline_nir->snapshot = NULL;
    return pipeline_nir;
 }
 
@@ -402,6 +408,8 @@ inline_variant_equals(const void *a, const void *b)
 void
 rvgpu_shader_lower(struct rvgpu_device *pdevice, nir_shader *nir, struct rvgpu_shader *shader, struct rvgpu_pipeline_layout *layout)
 {
+    MESA_TRACE_FUNC();
+
     if (nir->info.stage != MESA_SHADER_TESS_CTRL)
         NIR_PASS_V(nir, remove_scoped_barriers, nir->info.stage == MESA_SHADER_COMPUTE);
 
@@ -28,6 +28,7 @@
 #include <llvm-c/Core.h>
 
 #include "nir/nir.h"
+#include "util/perf/cpu_trace.h"
 
 #include "rc_llvm_util.h"
 #include "rc_llvm_build.h"
@@ -36,45 +37,76 @@
 #include "rvgpu_llvm_helper.h"
 #include "rc_nir_to_llvm.h"
 
-static LLVMModuleRef
-rc_translate_nir_to_llvm(struct rc_llvm_compiler *rc_llvm, struct nir_shader *nir)
+static void
+rc_translate_nir_to_llvm(struct rc_llvm_compiler *rc_llvm, struct nir_shader *nir,
+                         struct rc_llvm_context *rc)
 {
-   struct rc_llvm_context rc;
-   rc_llvm_context_init(&rc, rc_llvm);
+   MESA_TRACE_FUNC();
 
-   struct rc_llvm_pointer main_function;
-   // rc_build_main(rc_context, calling_convention, )
-   main_function = rc_build_main(&rc);
+   rc_llvm_context_init(rc, rc_llvm);
 
-    rc_nir_translate(&rc, nir);
-   // LLVMRunPassManager(rc_llvm->passmgr, rc.module);
-   LLVMDisposeBuilder(rc.builder);
+   // rc_build_main(rc_context, calling_convention, )
+   if (nir->info.stage == MESA_SHADER_COMPUTE)
+      rc_build_compute_main(rc);
+   else
+      rc_build_main(rc);
 
-   return rc.module;
+   rc_nir_translate(rc, nir);
+   // LLVMRunPassManager(rc_llvm->passmgr, rc->module);
 }
 
-void rvgpu_llvm_compile_shader(struct nir_shader *shader) {
+struct rvgpu_shader_binary *
+rvgpu_llvm_compile_shader(struct nir_shader *shader) {
    struct rc_llvm_compiler rc_llvm;
+   struct rc_llvm_context rc;
+   struct rvgpu_shader_binary *binary;
+
+   binary = calloc(1, sizeof(*binary));
+   if (!binary)
+      return NULL;
+
+   if (shader->info.stage == MESA_SHADER_COMPUTE) {
+      binary->shared_size = shader->info.shared_size;
+      for (unsigned i = 0; i < 3; i++)
+         binary->block[i] = shader->info.workgroup_size[i];
+   }
 
    rvgpu_init_llvm_compiler(&rc_llvm);
 
-   LLVMModuleRef llvm_module;
-   llvm_module = rc_translate_nir_to_llvm(&rc_llvm, shader);
+   rc_translate_nir_to_llvm(&rc_llvm, shader, &rc);
 
    printf("DUMP LLVMIR\n");
-   char *str = LLVMPrintModuleToString(llvm_module);
+   char *str = LLVMPrintModuleToString(rc.module);
    printf("%s", str);
+   LLVMDisposeMessage(str);
 
 #if 1
     printf("[LLVMIR TO Binary]\n");
 
    char *elf_buffer = NULL;
    size_t elf_size = 0;
-   LLVMContextRef llvm_ctx;
 
-   llvm_ctx = LLVMGetModuleContext(llvm_module);
-   rvgpu_compile_to_elf(&rc_llvm, llvm_module, &elf_buffer, &elf_size);
+   MESA_TRACE_BEGIN("rvgpu_compile_to_elf");
+   rvgpu_compile_to_elf(&rc_llvm, rc.module, &elf_buffer, &elf_size);
+   MESA_TRACE_END();
 
    rc_disassemble(elf_buffer, elf_size);
+   binary->elf = elf_buffer;
+   binary->elf_size = elf_size;
 #endif
+
+   /* hands the LLVM context back to this thread's pool */
+   rc_llvm_context_dispose(&rc);
+
+   return binary;
+}
+
+void
+rvgpu_shader_binary_destroy(struct rvgpu_shader_binary *binary)
+{
+   if (!binary)
+      return;
+
+   free(binary->elf);
+   free(binary);
 }
@@ -0,0 +1,297 @@
+/*
+ * Copyright © 2023 Sietium Semiconductor
+ *
+ * based in part on tu driver which is:
+ * Copyright © 2021 Google, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <perfetto.h>
+
+#include "rvgpu_perfetto.h"
+
+#include "util/perf/u_perfetto.h"
+#include "util/perf/u_perfetto_renderpass.h"
+
+#include "rvgpu_tracepoints.h"
+#include "rvgpu_tracepoints_perfetto.h"
+
+/**
+ * Queue-id's
+ */
+enum {
+   DEFAULT_HW_QUEUE_ID,
+};
+
+/**
+ * Render-stage id's
+ */
+enum rvgpu_stage_id {
+   CMD_BUFFER_STAGE_ID,
+   RENDER_PASS_STAGE_ID,
+   CLEAR_STAGE_ID,
+};
+
+static const struct {
+   const char *name;
+   const char *desc;
+} queues[] = {
+   [DEFAULT_HW_QUEUE_ID] = {"GPU Queue 0", "Default rvgpu Queue"},
+};
+
+static const struct {
+   const char *name;
+   const char *desc;
+} stages[] = {
+   [CMD_BUFFER_STAGE_ID]  = { "Command Buffer" },
+   [RENDER_PASS_STAGE_ID] = { "Render Pass" },
+   [CLEAR_STAGE_ID]       = { "Clear", "Render pass attachment clear" },
+};
+
+struct RvgpuRenderpassIncrementalState {
+   bool was_cleared = true;
+};
+
+struct RvgpuRenderpassTraits : public perfetto::DefaultDataSourceTraits {
+   using IncrementalStateType = RvgpuRenderpassIncrementalState;
+};
+
+class RvgpuRenderpassDataSource : public MesaRenderpassDataSource<RvgpuRenderpassDataSource,
+                                                                  RvgpuRenderpassTraits> {
+};
+
+PERFETTO_DECLARE_DATA_SOURCE_STATIC_MEMBERS(RvgpuRenderpassDataSource);
+PERFETTO_DEFINE_DATA_SOURCE_STATIC_MEMBERS(RvgpuRenderpassDataSource);
+
+static void
+send_descriptors(RvgpuRenderpassDataSource::TraceContext &ctx)
+{
+   PERFETTO_LOG("Sending renderstage descriptors");
+
+   auto packet = ctx.NewTracePacket();
+
+   packet->set_timestamp(0);
+
+   auto event = packet->set_gpu_render_stage_event();
+   event->set_gpu_id(0);
+
+   auto spec = event->set_specifications();
+
+   for (unsigned i = 0; i < ARRAY_SIZE(queues); i++) {
+      auto desc = spec->add_hw_queue();
+
+      desc->set_name(queues[i].name);
+      desc->set_description(queues[i].desc);
+   }
+
+   for (unsigned i = 0; i < ARRAY_SIZE(stages); i++) {
+      auto desc = spec->add_stage();
+
+      desc->set_name(stages[i].name);
+      if (stages[i].desc)
+         desc->set_description(stages[i].desc);
+   }
+}
+
+static struct rvgpu_perfetto_stage *
+stage_push(struct rvgpu_device *dev)
+{
+   struct rvgpu_perfetto_state *p = rvgpu_device_get_perfetto_state(dev);
+
+   if (p->stage_depth >= ARRAY_SIZE(p->stages)) {
+      p->skipped_depth++;
+      return NULL;
+   }
+
+   return &p->stages[p->stage_depth++];
+}
+
+typedef void (*trace_payload_as_extra_func)(perfetto::protos::pbzero::GpuRenderStageEvent *, const void*);
+
+static struct rvgpu_perfetto_stage *
+stage_pop(struct rvgpu_device *dev)
+{
+   struct rvgpu_perfetto_state *p = rvgpu_device_get_perfetto_state(dev);
+
+   if (!p->stage_depth)
+      return NULL;
+
+   if (p->skipped_depth) {
+      p->skipped_depth--;
+      return NULL;
+   }
+
+   return &p->stages[--p->stage_depth];
+}
+
+static void
+stage_start(struct rvgpu_device *dev,
+            uint64_t ts_ns,
+            enum rvgpu_stage_id stage_id,
+            const void *payload = nullptr,
+            size_t payload_size = 0,
+            trace_payload_as_extra_func payload_as_extra = nullptr)
+{
+   struct rvgpu_perfetto_stage *stage = stage_push(dev);
+
+   if (!stage) {
+      PERFETTO_ELOG("stage %d is nested too deep", stage_id);
+      return;
+   }
+
+   if (payload) {
+      void* new_payload = malloc(payload_size);
+      if (new_payload)
+         memcpy(new_payload, payload, payload_size);
+      else
+         PERFETTO_ELOG("Failed to allocate payload for stage %d", stage_id);
+      payload = new_payload;
+   }
+
+   *stage = (struct rvgpu_perfetto_stage) {
+      .stage_id = stage_id,
+      .start_ts = ts_ns,
+      .payload = payload,
+      .start_payload_function = (void *) payload_as_extra,
+   };
+}
+
+static void
+stage_end(struct rvgpu_device *dev, uint64_t ts_ns, enum rvgpu_stage_id stage_id,
+          uint32_t submission_id, const void* payload = nullptr,
+          trace_payload_as_extra_func payload_as_extra = nullptr)
+{
+   struct rvgpu_perfetto_stage *stage = stage_pop(dev);
+
+   if (!stage)
+      return;
+
+   if (stage->stage_id != stage_id) {
+      PERFETTO_ELOG("stage %d ended while stage %d is expected",
+            stage_id, stage->stage_id);
+      return;
+   }
+
+   RvgpuRenderpassDataSource::Trace([=](RvgpuRenderpassDataSource::TraceContext tctx) {
+      if (auto state = tctx.GetIncrementalState(); state->was_cleared) {
+         send_descriptors(tctx);
+         state->was_cleared = false;
+      }
+
+      auto packet = tctx.NewTracePacket();
+
+      /* Commands are executed on the CPU, so the stage timestamps are
+       * os_time_get_nano() samples and need no GPU clock sync.
+       */
+      packet->set_timestamp(stage->start_ts);
+      packet->set_timestamp_clock_id(perfetto::protos::pbzero::BUILTIN_CLOCK_MONOTONIC);
+
+      auto event = packet->set_gpu_render_stage_event();
+      event->set_event_id(0);
+      event->set_hw_queue_id(DEFAULT_HW_QUEUE_ID);
+      event->set_duration(ts_ns - stage->start_ts);
+      event->set_stage_id(stage->stage_id);
+      event->set_context((uintptr_t)dev);
+      event->set_submission_id(submission_id);
+
+      if (stage->payload) {
+         if (stage->start_payload_function)
+            ((trace_payload_as_extra_func) stage->start_payload_function)(
+               event, stage->payload);
+         free((void *)stage->payload);
+      }
+
+      if (payload && payload_as_extra)
+         payload_as_extra(event, payload);
+   });
+}
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void
+rvgpu_perfetto_init(void)
+{
+   util_perfetto_init();
+
+   perfetto::DataSourceDescriptor dsd;
+   dsd.set_name("gpu.renderstages.rvgpu");
+   RvgpuRenderpassDataSource::Register(dsd);
+}
+
+static void
+emit_submit_id(uint32_t submission_id)
+{
+   RvgpuRenderpassDataSource::Trace([=](RvgpuRenderpassDataSource::TraceContext tctx) {
+      auto packet = tctx.NewTracePacket();
+
+      packet->set_timestamp(perfetto::base::GetBootTimeNs().count());
+
+      auto event = packet->set_vulkan_api_event();
+      auto submit = event->set_vk_queue_submit();
+
+      submit->set_submission_id(submission_id);
+   });
+}
+
+void
+rvgpu_perfetto_submit(struct rvgpu_device *dev, uint32_t submission_id)
+{
+   if (!u_trace_perfetto_active(rvgpu_device_get_u_trace(dev)))
+      return;
+
+   emit_submit_id(submission_id);
+}
+
+/*
+ * Trace callbacks, called from u_trace once the submission has been flushed.
+ */
+
+#define CREATE_EVENT_CALLBACK(event_name, stage_id)                                 \
+   void rvgpu_perfetto_start_##event_name(                                          \
+      struct rvgpu_device *dev, uint64_t ts_ns, const void *flush_data,             \
+      const struct trace_start_##event_name *payload)                               \
+   {                                                                                \
+      stage_start(                                                                  \
+         dev, ts_ns, stage_id, payload,                                             \
+         sizeof(struct trace_start_##event_name),                                   \
+         (trace_payload_as_extra_func) &trace_payload_as_extra_start_##event_name); \
+   }                                                                                \
+                                                                                    \
+   void rvgpu_perfetto_end_##event_name(                                            \
+      struct rvgpu_device *dev, uint64_t ts_ns, const void *flush_data,             \
+      const struct trace_end_##event_name *payload)                                 \
+   {                                                                                \
+      auto trace_flush_data =                                                       \
+         (const struct rvgpu_u_trace_submission_data *) flush_data;                 \
+      stage_end(                                                                    \
+         dev, ts_ns, stage_id, trace_flush_data->submission_id, payload,            \
+         (trace_payload_as_extra_func) &trace_payload_as_extra_end_##event_name);   \
+   }
+
+CREATE_EVENT_CALLBACK(cmd_buffer, CMD_BUFFER_STAGE_ID)
+CREATE_EVENT_CALLBACK(render_pass, RENDER_PASS_STAGE_ID)
+CREATE_EVENT_CALLBACK(clear, CLEAR_STAGE_ID)
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,76 @@
+/*
+ * Copyright © 2023 Sietium Semiconductor
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __RVGPU_PERFETTO_H__
+#define __RVGPU_PERFETTO_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct rvgpu_device;
+
+/* Flush data handed to u_trace_flush() for each submission. */
+struct rvgpu_u_trace_submission_data {
+   uint32_t submission_id;
+};
+
+#ifdef HAVE_PERFETTO
+
+#define RVGPU_PERFETTO_MAX_STACK_DEPTH 8
+
+struct rvgpu_perfetto_stage {
+   int stage_id;
+   uint64_t start_ts;
+   const void *payload;
+   void *start_payload_function;
+};
+
+struct rvgpu_perfetto_state {
+   struct rvgpu_perfetto_stage stages[RVGPU_PERFETTO_MAX_STACK_DEPTH];
+   unsigned stage_depth;
+   unsigned skipped_depth;
+};
+
+void rvgpu_perfetto_init(void);
+
+void rvgpu_perfetto_submit(struct rvgpu_device *dev, uint32_t submission_id);
+
+/* Helpers, implemented in rvgpu_device.c since the driver headers are not
+ * C++ clean.
+ */
+struct rvgpu_perfetto_state *
+rvgpu_device_get_perfetto_state(struct rvgpu_device *dev);
+
+struct u_trace_context *
+rvgpu_device_get_u_trace(struct rvgpu_device *dev);
+
+#endif /* HAVE_PERFETTO */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __RVGPU_PERFETTO_H__ */
@@ -40,6 +40,7 @@ rvgpu_physical_device_get_supported_extensions(const struct rvgpu_physical_devic
                                                struct vk_device_extension_table *ext)
 {
    *ext = (struct vk_device_extension_table) {
+      .KHR_dynamic_rendering = true,
       .KHR_swapchain = true,
    };
 }
@@ -434,7 +435,7 @@ rvgpu_GetPhysicalDeviceProperties2(VkPhysicalDevice physicalDevice,
          /* Shader engines. */
          properties->shaderEngineCount = 1;
          properties->shaderArraysPerEngineCount = 1;
-         properties->computeUnitsPerShaderArray = 1;
+         properties->computeUnitsPerShaderArray = pdevice->ws->num_cores;
          properties->simdPerComputeUnit = 1;
          properties->wavefrontsPerSimd = 1;
          properties->wavefrontSize = 64;
@@ -446,7 +447,7 @@ rvgpu_GetPhysicalDeviceProperties2(VkPhysicalDevice physicalDevice,
             (VkPhysicalDeviceShaderCoreProperties2AMD *)ext;
 
          properties->shaderCoreFeatures = 0;
-         properties->activeComputeUnitCount = 1;
+         properties->activeComputeUnitCount = pdevice->ws->num_cores;
          break;
       }
       case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VERTEX_ATTRIBUTE_DIVISOR_PROPERTIES_EXT: {
@@ -852,6 +853,21 @@ rvgpu_GetPhysicalDeviceFeatures2(VkPhysicalDevice physicalDevice,
 {
    // RVGPU_FROM_HANDLE(rvgpu_physical_device, pdevice, physicalDevice);
    rvgpu_GetPhysicalDeviceFeatures(physicalDevice, &pFeatures->features);
+
+   vk_foreach_struct(ext, pFeatures->pNext)
+   {
+      switch (ext->sType) {
+      case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES: {
+         VkPhysicalDeviceDynamicRenderingFeatures *features =
+            (VkPhysicalDeviceDynamicRenderingFeatures *)ext;
+         features->dynamicRendering = true;
+         break;
+      }
+      default:
+         rvgpu_debug_ignored_stype(ext->sType);
+         break;
+      }
+   }
 }
 
 VKAPI_ATTR void VKAPI_CALL
@@ -37,6 +37,11 @@ void
 rvgpu_pipeline_destroy(struct rvgpu_device *device, struct rvgpu_pipeline *pipeline,
                        const VkAllocationCallbacks *allocator)
 {
+   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
+      rvgpu_shader_binary_destroy(pipeline->shaders[i].shader_cso);
+      rvgpu_shader_binary_destroy(pipeline->shaders[i].tess_ccw_cso);
+   }
+
    vk_object_base_finish(&pipeline->base);
    vk_free2(&device->vk.alloc, allocator, pipeline);
 }
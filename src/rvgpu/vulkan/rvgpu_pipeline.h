@@ -28,8 +28,10 @@
 #ifndef RVGPU_PIPELINE_H__
 #define RVGPU_PIPELINE_H__
 
+#include "nir/nir_serialize.h"
 #include "pipe/p_state.h"
 #include "spirv/nir_spirv.h"
+#include "util/u_atomic.h"
 
 #include "vk_pipeline_layout.h"
 
@@ -67,6 +69,20 @@ struct rvgpu_access_info {
 struct rvgpu_pipeline_nir {
     int ref_cnt;
     nir_shader *nir;
+    /* taken on the first rvgpu_pipeline_nir_fork() */
+    nir_shader_snapshot *snapshot;
+};
+
+/* Output of rvgpu_llvm_compile_shader(), stored as rvgpu_shader::shader_cso. */
+struct rvgpu_shader_binary {
+    char *elf;
+    size_t elf_size;
+
+    /* compute only: bytes of shared memory each workgroup needs, as laid
+     * out by shared_var_info(), and the workgroup size.
+     */
+    uint32_t shared_size;
+    uint16_t block[3];
 };
 
 struct rvgpu_shader {
@@ -109,6 +125,50 @@ struct rvgpu_pipeline {
     bool used;
 };
 
+static inline void
+rvgpu_pipeline_nir_ref(struct rvgpu_pipeline_nir **dst, struct rvgpu_pipeline_nir *src)
+{
+   struct rvgpu_pipeline_nir *old_dst = *dst;
+   if (old_dst == src || (old_dst && src && old_dst->nir == src->nir))
+      return;
+
+   if (old_dst && p_atomic_dec_zero(&old_dst->ref_cnt)) {
+      ralloc_free(old_dst->snapshot);
+      ralloc_free(old_dst->nir);
+      ralloc_free(old_dst);
+   }
+   if (src)
+      p_atomic_inc(&src->ref_cnt);
+   *dst = src;
+}
+
+/* Returns a copy of pipeline_nir->nir to compile a variant from.
+ *
+ * The first call takes a snapshot of the shader and every call deserializes
+ * a copy from it, which is a lot cheaper than nir_shader_clone() once the
+ * same shader is compiled more than once.  pipeline_nir->nir must not be
+ * changed after the first fork.
+ */
+static inline nir_shader *
+rvgpu_pipeline_nir_fork(struct rvgpu_pipeline_nir *pipeline_nir)
+{
+   nir_shader_snapshot *snapshot = p_atomic_read(&pipeline_nir->snapshot);
+   if (!snapshot) {
+      snapshot = nir_shader_snapshot_create(NULL, pipeline_nir->nir);
+      if (!snapshot)
+         return nir_shader_clone(NULL, pipeline_nir->nir);
+
+      nir_shader_snapshot *old =
+         p_atomic_cmpxchg_ptr(&pipeline_nir->snapshot, NULL, snapshot);
+      if (old) {
+         ralloc_free(snapshot);
+         snapshot = old;
+      }
+   }
+
+   return nir_shader_fork(NULL, snapshot);
+}
+
 bool rvgpu_find_inlinable_uniforms(struct rvgpu_shader *shader, nir_shader *nir);
 
 static inline const struct rvgpu_descriptor_set_layout *
@@ -148,6 +208,8 @@ VkResult vk_pipeline_shader_stage_to_nir(struct vk_device *device,
                                          const struct nir_shader_compiler_options *nir_options,
                                          void *mem_ctx, nir_shader **nir_out);
 
+VkResult rvgpu_shader_compile_to_ir(struct rvgpu_pipeline *pipeline,
+                                    const VkPipelineShaderStageCreateInfo *sinfo);
 void *rvgpu_shader_compile(struct rvgpu_device *device, struct rvgpu_shader *shader, struct nir_shader *nir);
 void rvgpu_pipeline_shaders_compile(struct rvgpu_pipeline *pipeline);
 
@@ -155,6 +217,7 @@ void rvgpu_pipeline_init(struct rvgpu_device *device, struct rvgpu_pipeline *pip
 void rvgpu_pipeline_destroy(struct rvgpu_device *device, struct rvgpu_pipeline *pipeline,
                        const VkAllocationCallbacks *allocator);
 
-void rvgpu_llvm_compile_shader(struct nir_shader *shader);
+struct rvgpu_shader_binary *rvgpu_llvm_compile_shader(struct nir_shader *shader);
+void rvgpu_shader_binary_destroy(struct rvgpu_shader_binary *binary);
 
 #endif // RVGPU_PIPELINE_H__
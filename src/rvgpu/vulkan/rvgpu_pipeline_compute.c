@@ -0,0 +1,138 @@
+/*
+ * Copyright © 2023 Sietium Semiconductor
+ *
+ * based in part on lavapipe driver which is:
+ * Copyright © 2019 Red Hat.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "util/os_time.h"
+#include "util/perf/cpu_trace.h"
+
+#include "vk_pipeline_cache.h"
+#include "rvgpu_private.h"
+
+static VkResult
+rvgpu_compute_pipeline_init(struct rvgpu_pipeline *pipeline,
+                            struct rvgpu_device *device,
+                            struct vk_pipeline_cache *cache,
+                            const VkComputePipelineCreateInfo *pCreateInfo)
+{
+   pipeline->device = device;
+   pipeline->layout = rvgpu_pipeline_layout_from_handle(pCreateInfo->layout);
+   vk_pipeline_layout_ref(&pipeline->layout->vk);
+   pipeline->force_min_sample = false;
+
+   pipeline->is_compute_pipeline = true;
+
+   VkResult result = rvgpu_shader_compile_to_ir(pipeline, &pCreateInfo->stage);
+   if (result != VK_SUCCESS)
+      return result;
+
+   struct rvgpu_shader *shader = &pipeline->shaders[MESA_SHADER_COMPUTE];
+   if (!shader->inlines.can_inline) {
+      shader->shader_cso = rvgpu_shader_compile(pipeline->device, shader,
+                                                nir_shader_clone(NULL, shader->pipeline_nir->nir));
+      if (!shader->shader_cso) {
+         rvgpu_pipeline_nir_ref(&shader->pipeline_nir, NULL);
+         return vk_error(device, VK_ERROR_OUT_OF_HOST_MEMORY);
+      }
+   }
+   pipeline->compiled = true;
+   return VK_SUCCESS;
+}
+
+static VkResult
+rvgpu_compute_pipeline_create(VkDevice _device, VkPipelineCache _cache,
+                              const VkComputePipelineCreateInfo *pCreateInfo,
+                              const VkAllocationCallbacks *pAllocator, VkPipeline *pPipeline)
+{
+   RVGPU_FROM_HANDLE(rvgpu_device, device, _device);
+   VK_FROM_HANDLE(vk_pipeline_cache, cache, _cache);
+   struct rvgpu_pipeline *pipeline;
+   VkResult result;
+
+   assert(pCreateInfo->sType == VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO);
+
+   MESA_TRACE_FUNC();
+
+   /* Dispatches can't run until the kernel driver has a job ioctl and the
+    * descriptors are uploaded for them, so don't hand out pipelines that
+    * would silently do nothing.
+    */
+   if (!device->ws->ops.cs_submit)
+      return vk_errorf(device, VK_ERROR_FEATURE_NOT_PRESENT,
+                       "compute dispatch isn't supported by this kernel driver yet");
+
+   pipeline = vk_zalloc(&device->vk.alloc, sizeof(*pipeline), 8,
+                         VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+   if (pipeline == NULL)
+      return vk_error(device, VK_ERROR_OUT_OF_HOST_MEMORY);
+
+   vk_object_base_init(&device->vk, &pipeline->base,
+                       VK_OBJECT_TYPE_PIPELINE);
+   uint64_t t0 = os_time_get_nano();
+   result = rvgpu_compute_pipeline_init(pipeline, device, cache, pCreateInfo);
+   if (result != VK_SUCCESS) {
+      vk_pipeline_layout_unref(&device->vk, &pipeline->layout->vk);
+      vk_object_base_finish(&pipeline->base);
+      vk_free(&device->vk.alloc, pipeline);
+      return result;
+   }
+
+   VkPipelineCreationFeedbackCreateInfo *feedback = (void*)vk_find_struct_const(pCreateInfo->pNext, PIPELINE_CREATION_FEEDBACK_CREATE_INFO);
+   if (feedback) {
+      feedback->pPipelineCreationFeedback->duration = os_time_get_nano() - t0;
+      feedback->pPipelineCreationFeedback->flags = VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT;
+      memset(feedback->pPipelineStageCreationFeedbacks, 0, sizeof(VkPipelineCreationFeedback) * feedback->pipelineStageCreationFeedbackCount);
+   }
+
+   *pPipeline = rvgpu_pipeline_to_handle(pipeline);
+
+   return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL
+rvgpu_CreateComputePipelines(VkDevice _device, VkPipelineCache pipelineCache, uint32_t count,
+                             const VkComputePipelineCreateInfo *pCreateInfos,
+                             const VkAllocationCallbacks *pAllocator, VkPipeline *pPipelines)
+{
+   VkResult result = VK_SUCCESS;
+   unsigned i = 0;
+
+   for (; i < count; i++) {
+      VkResult r = VK_PIPELINE_COMPILE_REQUIRED;
+      if (!(pCreateInfos[i].flags & VK_PIPELINE_CREATE_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT))
+         r = rvgpu_compute_pipeline_create(_device, pipelineCache, &pCreateInfos[i], pAllocator, &pPipelines[i]);
+      if (r != VK_SUCCESS) {
+         result = r;
+         pPipelines[i] = VK_NULL_HANDLE;
+
+         if (pCreateInfos[i].flags & VK_PIPELINE_CREATE_EARLY_RETURN_ON_FAILURE_BIT)
+            break;
+      }
+   }
+
+   for (; i < count; ++i)
+      pPipelines[i] = VK_NULL_HANDLE;
+
+   return result;
+}
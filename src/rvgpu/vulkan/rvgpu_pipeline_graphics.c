@@ -27,6 +27,7 @@
 
 #include "spirv/nir_spirv.h"
 #include "nir/nir_xfb_info.h"
+#include "util/perf/cpu_trace.h"
 
 #include "vk_pipeline_cache.h"
 #include "vk_shader_module.h"
@@ -314,7 +315,7 @@ fixup_tex_instr(struct nir_builder *b, nir_instr *instr, void *data_cb)
     return NIR_LOWER_INSTR_PROGRESS;
 }
 
-static VkResult
+VkResult
 rvgpu_shader_compile_to_ir(struct rvgpu_pipeline *pipeline,
                            const VkPipelineShaderStageCreateInfo *sinfo)
 {
@@ -323,6 +324,9 @@ rvgpu_shader_compile_to_ir(struct rvgpu_pipeline *pipeline,
    assert(stage <= MESA_SHADER_COMPUTE && stage != MESA_SHADER_NONE);
    struct rvgpu_shader *shader = &pipeline->shaders[stage];
    nir_shader *nir;
+
+   MESA_TRACE_FUNC();
+
    VkResult result = compile_spirv(pdevice, sinfo, &nir);
    if (result == VK_SUCCESS)
       rvgpu_shader_lower(pdevice, nir, shader, pipeline->layout);
@@ -373,25 +377,10 @@ static struct rvgpu_pipeline_nir *create_pipeline_nir(nir_shader *nir)
    struct rvgpu_pipeline_nir *pipeline_nir = ralloc(NULL, struct rvgpu_pipeline_nir);
    pipeline_nir->nir = nir;
    pipeline_nir->ref_cnt = 1;
+   pipeline_nir->snapshot = NULL;
    return pipeline_nir;
 }
 
-static inline void
-rvgpu_pipeline_nir_ref(struct rvgpu_pipeline_nir **dst, struct rvgpu_pipeline_nir *src)
-{
-   struct rvgpu_pipeline_nir *old_dst = *dst;
-   if (old_dst == src || (old_dst && src && old_dst->nir == src->nir))
-      return;
-
-   if (old_dst && p_atomic_dec_zero(&old_dst->ref_cnt)) {
-      ralloc_free(old_dst->nir);
-      ralloc_free(old_dst);
-   }
-   if (src)
-      p_atomic_inc(&src->ref_cnt);
-   *dst = src;
-}
-
 static void
 rvgpu_shader_xfb_init(struct rvgpu_shader *shader)
 {
@@ -633,11 +622,24 @@ rvgpu_graphics_pipeline_create(VkDevice _device, VkPipelineCache _cache,
   
 }
 
+/* Shaders from a pipeline library are compiled again for every pipeline
+ * linked against the library, so fork those instead of cloning them.
+ */
+static nir_shader *
+pipeline_nir_copy(struct rvgpu_pipeline_nir *pipeline_nir)
+{
+   if (p_atomic_read(&pipeline_nir->ref_cnt) > 1)
+      return rvgpu_pipeline_nir_fork(pipeline_nir);
+   return nir_shader_clone(NULL, pipeline_nir->nir);
+}
+
 void
 rvgpu_pipeline_shaders_compile(struct rvgpu_pipeline *pipeline)
 {
    if (pipeline->compiled)
       return;
+
+   MESA_TRACE_FUNC();
    for (uint32_t i = 0; i < ARRAY_SIZE(pipeline->shaders); i++) {
       if (!pipeline->shaders[i].pipeline_nir)
          continue;
@@ -647,10 +649,10 @@ rvgpu_pipeline_shaders_compile(struct rvgpu_pipeline *pipeline)
 
       if (!pipeline->shaders[stage].inlines.can_inline) {
          pipeline->shaders[stage].shader_cso = rvgpu_shader_compile(pipeline->device, &pipeline->shaders[stage],
-                                                            nir_shader_clone(NULL, pipeline->shaders[stage].pipeline_nir->nir));
+                                                            pipeline_nir_copy(pipeline->shaders[stage].pipeline_nir));
          if (pipeline->shaders[MESA_SHADER_TESS_EVAL].tess_ccw)
             pipeline->shaders[MESA_SHADER_TESS_EVAL].tess_ccw_cso = rvgpu_shader_compile(pipeline->device, &pipeline->shaders[stage],
-                                                          nir_shader_clone(NULL, pipeline->shaders[MESA_SHADER_TESS_EVAL].tess_ccw->nir));
+                                                          pipeline_nir_copy(pipeline->shaders[MESA_SHADER_TESS_EVAL].tess_ccw));
       }
    }
    pipeline->compiled = true;
@@ -25,6 +25,8 @@
  * SOFTWARE.
  */
 
+#include "util/perf/cpu_trace.h"
+
 #include "vk_queue.h"
 
 #include "rvgpu_private.h"
@@ -43,18 +45,46 @@ static VkResult
 rvgpu_queue_submit(struct vk_queue *vqueue, struct vk_queue_submit *submit)
 {
    struct rvgpu_queue *queue = container_of(vqueue, struct rvgpu_queue, vk);
+   struct rvgpu_device *device = queue->device;
+
+   MESA_TRACE_FUNC();
 
-   VkResult result = vk_sync_wait_many(&queue->device->vk,
-                                       submit->wait_count, submit->waits,
-                                       VK_SYNC_WAIT_COMPLETE, UINT64_MAX);
+   VkResult result;
+   {
+      MESA_TRACE_SCOPE("rvgpu_queue_wait");
+      result = vk_sync_wait_many(&device->vk,
+                                 submit->wait_count, submit->waits,
+                                 VK_SYNC_WAIT_COMPLETE, UINT64_MAX);
+   }
    if (result != VK_SUCCESS)
       return result;
 
+   uint32_t submission_id = p_atomic_inc_return(&device->submit_count);
+#ifdef HAVE_PERFETTO
+   rvgpu_perfetto_submit(device, submission_id);
+#endif
+
    for (uint32_t i = 0; i < submit->command_buffer_count; i++) {
       struct rvgpu_cmd_buffer *cmd_buffer =
          container_of(submit->command_buffers[i], struct rvgpu_cmd_buffer, vk);
 
-      rvgpu_execute_cmds(queue->device, queue, cmd_buffer);
+      rvgpu_execute_cmds(device, queue, cmd_buffer);
+   }
+
+   /* The timestamps were all written by the loop above, so the batch can
+    * be handed to the trace context right away.
+    */
+   if (u_trace_has_points(&queue->trace)) {
+      struct rvgpu_u_trace_submission_data *flush_data =
+         calloc(1, sizeof(*flush_data));
+      if (flush_data) {
+         flush_data->submission_id = submission_id;
+         u_trace_flush(&queue->trace, flush_data, true);
+      } else {
+         u_trace_fini(&queue->trace);
+         u_trace_init(&queue->trace, &device->trace_context);
+      }
+      u_trace_context_process(&device->trace_context, true);
    }
 
 #if 0
@@ -126,11 +156,16 @@ rvgpu_queue_init(struct rvgpu_device *device, struct rvgpu_queue *queue, int idx
 
    queue->state = rvgpu_init_queue_rendering_state();
    queue->vk.driver_submit = rvgpu_queue_submit;
+
+   u_trace_init(&queue->trace, &device->trace_context);
    return VK_SUCCESS;
 }
 
 void
 rvgpu_queue_finish(struct rvgpu_queue *queue)
 {
+   /* queues that failed vk_queue_init never got their u_trace set up */
+   if (queue->trace.utctx)
+      u_trace_fini(&queue->trace);
    vk_queue_finish(&queue->vk);
 }
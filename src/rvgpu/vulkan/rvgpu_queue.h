@@ -30,6 +30,8 @@
 
 #include "vk_queue.h"
 
+#include "util/perf/u_trace.h"
+
 #include "rvgpu_winsys.h"
 
 /* queue types */
@@ -56,6 +58,9 @@ struct rvgpu_queue {
 
    struct util_dynarray pipeline_destroys;
    simple_mtx_t pipeline_lock;
+
+   /* tracepoints emitted while executing a submission */
+   struct u_trace trace;
 };
 
 enum rvgpu_ctx_priority rvgpu_get_queue_global_priority(const VkDeviceQueueGlobalPriorityCreateInfoKHR *pObj);
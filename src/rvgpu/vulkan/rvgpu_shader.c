@@ -25,6 +25,8 @@
  * SOFTWARE.
  */
 
+#include "util/perf/cpu_trace.h"
+
 #include "rc_llvm_util.h"
 
 #include "rvgpu_private.h"
@@ -32,12 +34,13 @@
 void *
 rvgpu_shader_compile(struct rvgpu_device *device, struct rvgpu_shader *shader, struct nir_shader *nir)
 {
+   MESA_TRACE_FUNC();
+
    nir_print_shader(nir, stdout);
  
    rc_init_llvm_once();
 
-   rvgpu_llvm_compile_shader(nir);
-   return NULL;
+   return rvgpu_llvm_compile_shader(nir);
 }
 
 
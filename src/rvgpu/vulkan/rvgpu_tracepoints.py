@@ -0,0 +1,100 @@
+# Copyright © 2023 Sietium Inc.
+
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+
+# The above copyright notice and this permission notice (including the next
+# paragraph) shall be included in all copies or substantial portions of the
+# Software.
+
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+import argparse
+import sys
+
+parser = argparse.ArgumentParser()
+parser.add_argument('-p', '--import-path', required=True)
+parser.add_argument('--utrace-src', required=True)
+parser.add_argument('--utrace-hdr', required=True)
+parser.add_argument('--perfetto-hdr', required=True)
+args = parser.parse_args()
+sys.path.insert(0, args.import_path)
+
+
+from u_trace import Header, HeaderScope
+from u_trace import ForwardDecl
+from u_trace import Tracepoint
+from u_trace import TracepointArg as Arg
+from u_trace import TracepointArgStruct as ArgStruct
+from u_trace import utrace_generate
+from u_trace import utrace_generate_perfetto_utils
+
+Header('vk_enum_to_str.h', scope=HeaderScope.SOURCE|HeaderScope.PERFETTO)
+Header('vulkan/vulkan_core.h')
+Header('rvgpu_private.h', scope=HeaderScope.SOURCE)
+
+ForwardDecl('struct rvgpu_device')
+ForwardDecl('struct rvgpu_cmd_buffer')
+
+# List of the default tracepoints enabled. By default tracepoints are enabled,
+# set tp_default_enabled=False to disable them by default.
+rvgpu_default_tps = []
+
+#
+# Tracepoint definitions:
+#
+# rvgpu replays command buffers on the CPU at submit time, so there is no
+# command stream to emit timestamp writes into and none of the tracepoints
+# take a cs parameter.  The timestamps are sampled when the tracepoint runs.
+#
+
+def begin_end_tp(name, args=[], tp_struct=None, tp_print=None,
+                 tp_default_enabled=True):
+    global rvgpu_default_tps
+    if tp_default_enabled:
+        rvgpu_default_tps.append(name)
+    Tracepoint('start_{0}'.format(name),
+               toggle_name=name,
+               args=args,
+               tp_struct=tp_struct,
+               tp_perfetto='rvgpu_perfetto_start_{0}'.format(name),
+               tp_print=tp_print,
+               need_cs_param=False)
+    Tracepoint('end_{0}'.format(name),
+               toggle_name=name,
+               tp_perfetto='rvgpu_perfetto_end_{0}'.format(name),
+               need_cs_param=False)
+
+begin_end_tp('cmd_buffer',
+    args=[ArgStruct(type='const struct rvgpu_cmd_buffer *', var='cmd')],
+    tp_struct=[Arg(type='VkCommandBufferLevel', name='level', var='cmd->vk.level', c_format='%s', to_prim_type='vk_CommandBufferLevel_to_str({})'),
+               Arg(type='uint32_t', name='commands', var='list_length(&cmd->vk.cmd_queue.cmds)', c_format='%u')])
+
+begin_end_tp('render_pass',
+    args=[Arg(type='uint16_t', var='width',     c_format='%u'),
+          Arg(type='uint16_t', var='height',    c_format='%u'),
+          Arg(type='uint8_t',  var='layers',    c_format='%u'),
+          Arg(type='uint8_t',  var='MRTs',      c_format='%u'),
+          Arg(type='uint8_t',  var='has_depth', c_format='%u'),
+          Arg(type='uint8_t',  var='resuming',  c_format='%u')])
+
+begin_end_tp('clear',
+    args=[Arg(type='uint8_t', var='color_count', c_format='%u'),
+          Arg(type='uint8_t', var='depth_stencil', c_format='%u')])
+
+utrace_generate(cpath=args.utrace_src,
+                hpath=args.utrace_hdr,
+                ctx_param='struct rvgpu_device *dev',
+                trace_toggle_name='rvgpu_gpu_tracepoint',
+                trace_toggle_defaults=rvgpu_default_tps)
+utrace_generate_perfetto_utils(hpath=args.perfetto_hdr)
@@ -66,6 +66,8 @@ rvgpu_winsys_create(int fd, uint64_t debug_flags, uint64_t perftest_flags)
       goto fail;
 
    ws->dev = dev;
+   /* the kernel driver doesn't report the core count yet */
+   ws->num_cores = 1;
 
    ws->ops.get_fd = rvgpu_winsys_get_fd;
    ws->ops.destroy = rvgpu_winsys_destroy;
@@ -46,6 +46,26 @@ struct rvgpu_winsys_bo {
    uint64_t size;
 };
 
+/* A run of workgroups of one dispatch, executed by a single core.
+ * Workgroups are linearised with x varying fastest; each invocation calls
+ * the shader's main() with the compute ABI from rc_build_compute_main().
+ */
+struct rvgpu_winsys_cs_job {
+   const void *elf;
+   uint64_t elf_size;
+   uint64_t desc;
+
+   uint32_t block[3];
+   uint32_t grid[3];
+   uint32_t grid_base[3];
+   uint64_t first_group;
+   uint64_t group_count;
+
+   /* per workgroup, the core provides it */
+   uint32_t shared_size;
+   uint32_t core;
+};
+
 struct rvgpu_winsys;
 
 struct rvgpu_winsys_ops {
@@ -60,6 +80,9 @@ struct rvgpu_winsys_ops {
    void * (*bo_map)(struct rvgpu_winsys_bo *bo);
    void (*bo_unmap)(struct rvgpu_winsys_bo *bo);
 
+   // Compute Interface, NULL until the kernel driver has a job ioctl
+   VkResult (*cs_submit)(struct rvgpu_winsys *ws, const struct rvgpu_winsys_cs_job *jobs, uint32_t job_count);
+
    int (*get_fd)(struct rvgpu_winsys *ws);
 };
 
@@ -68,6 +91,8 @@ struct rvgpu_winsys {
 
    rvgpu_drm_device_handle dev;
 
+   uint32_t num_cores;
+
    const struct vk_sync_type *sync_types[3];
    struct vk_sync_type syncobj_sync_type;
    struct vk_sync_timeline_type emulated_timeline_sync_type;
@@ -26,6 +26,7 @@
  */
 
 #include "util/u_memory.h"
+#include "util/perf/cpu_trace.h"
 
 #include "rvgpu_winsys.h"
 
@@ -35,6 +36,8 @@ rvgpu_winsys_bo_create(struct rvgpu_winsys *ws, uint64_t size, uint32_t flags, s
    struct rvgpu_winsys_bo *bo;
    uint64_t va = 0;
 
+   MESA_TRACE_FUNC();
+
    *out_bo = NULL;
 
    bo = CALLOC_STRUCT(rvgpu_winsys_bo);
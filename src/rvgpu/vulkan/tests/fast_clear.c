@@ -0,0 +1,208 @@
+/*
+ * Copyright © 2023 Sietium Semiconductor
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Pending fast clears must be in memory whenever something other than the
+ * draw path's tile loader can see the image: after a pass stores it, and
+ * after barriers making it readable by descriptors, transfers or the
+ * presentation engine.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "rvgpu_private.h"
+
+#define ASSERT(cond)                                                    \
+   do {                                                                 \
+      if (!(cond)) {                                                    \
+         fprintf(stderr, "%s:%d: Test assertion `%s` failed.\n",        \
+                 __FILE__, __LINE__, # cond);                           \
+         abort();                                                       \
+      }                                                                 \
+   } while (false)
+
+#define WIDTH  100
+#define HEIGHT 70
+#define LAYERS 2
+
+struct test_bo {
+   struct rvgpu_winsys_bo base;
+   uint32_t *map;
+   int map_count;
+};
+
+static void *
+test_bo_map(struct rvgpu_winsys_bo *bo)
+{
+   ((struct test_bo *)bo)->map_count++;
+   return ((struct test_bo *)bo)->map;
+}
+
+static void
+test_bo_unmap(struct rvgpu_winsys_bo *bo)
+{
+   ((struct test_bo *)bo)->map_count--;
+}
+
+static struct rvgpu_device device;
+static struct rvgpu_winsys ws;
+static struct test_bo bo;
+static struct rvgpu_image image;
+
+static void
+test_image_init(void)
+{
+   const unsigned row_stride = WIDTH * 4;
+   const unsigned tiles_x = DIV_ROUND_UP(WIDTH, RVGPU_FAST_CLEAR_TILE_SIZE);
+   const unsigned tiles_y = DIV_ROUND_UP(HEIGHT, RVGPU_FAST_CLEAR_TILE_SIZE);
+
+   ws.ops.bo_map = test_bo_map;
+   ws.ops.bo_unmap = test_bo_unmap;
+   device.ws = &ws;
+
+   image.vk.base.device = &device.vk;
+   image.vk.image_type = VK_IMAGE_TYPE_2D;
+   image.vk.aspects = VK_IMAGE_ASPECT_COLOR_BIT;
+   image.vk.mip_levels = 1;
+   image.vk.array_layers = LAYERS;
+   image.bo = &bo.base;
+   image.layout = (struct rvgpu_image_layout) {
+      .format = PIPE_FORMAT_R8G8B8A8_UINT,
+      .width = WIDTH,
+      .height = HEIGHT,
+      .depth = 1,
+      .nr_samples = 1,
+      .dim = RVGPU_TEXTURE_DIMENSION_2D,
+      .nr_slices = 1,
+      .array_size = LAYERS,
+      .array_stride = row_stride * HEIGHT,
+   };
+   image.layout.slices[0].row_stride = row_stride;
+   image.layout.slices[0].surface_stride = row_stride * HEIGHT;
+   image.size = row_stride * HEIGHT * LAYERS;
+   bo.map = calloc(1, image.size);
+
+   size_t bitset_size = BITSET_WORDS(tiles_x * tiles_y) * sizeof(BITSET_WORD) * LAYERS;
+   image.fast_clear = calloc(1, sizeof(*image.fast_clear) + bitset_size);
+   image.fast_clear->tiles_x = tiles_x;
+   image.fast_clear->tiles_y = tiles_y;
+   image.fast_clear->layers = LAYERS;
+   image.fast_clear->cleared = (BITSET_WORD *)(image.fast_clear + 1);
+}
+
+static void
+test_image_finish(void)
+{
+   free(image.fast_clear);
+   free(bo.map);
+}
+
+/* Clears the whole image to value, which leaves all of it pending. */
+static void
+clear(uint32_t value)
+{
+   const VkClearValue clear_value = {
+      .color.uint32 = { value & 0xff, (value >> 8) & 0xff,
+                        (value >> 16) & 0xff, value >> 24 },
+   };
+   const VkRect2D area = { .extent = { WIDTH, HEIGHT } };
+
+   rvgpu_image_clear(&image, VK_IMAGE_ASPECT_COLOR_BIT, &clear_value, 0,
+                     &area, 0, LAYERS);
+}
+
+/* Reads the image back the way a copy to a buffer would. */
+static bool
+contents_are(uint32_t value)
+{
+   for (unsigned i = 0; i < WIDTH * HEIGHT * LAYERS; i++) {
+      if (bo.map[i] != value)
+         return false;
+   }
+   return true;
+}
+
+static void
+barrier(VkImageLayout old_layout, VkImageLayout new_layout, VkAccessFlags2 dst_access)
+{
+   const VkImageMemoryBarrier2 b = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+      .dstAccessMask = dst_access,
+      .oldLayout = old_layout,
+      .newLayout = new_layout,
+      .subresourceRange = {
+         .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+         .levelCount = VK_REMAINING_MIP_LEVELS,
+         .layerCount = VK_REMAINING_ARRAY_LAYERS,
+      },
+   };
+
+   rvgpu_image_fast_clear_barrier(&image, &b);
+}
+
+int main(void)
+{
+   const VkRect2D area = { .extent = { WIDTH, HEIGHT } };
+
+   test_image_init();
+
+   /* clear-only pass with STORE_OP_STORE, then a copy */
+   clear(0x11223344);
+   ASSERT(image.fast_clear->pending > 0);
+   ASSERT(contents_are(0));
+   rvgpu_image_fast_clear_expand(&image, &area, 0, LAYERS);
+   ASSERT(image.fast_clear->pending == 0);
+   ASSERT(contents_are(0x11223344));
+
+   /* staying an attachment keeps the clear pending */
+   clear(0x55667788);
+   barrier(VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+           VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+           VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT);
+   ASSERT(image.fast_clear->pending > 0);
+   ASSERT(contents_are(0x11223344));
+
+   /* sampled */
+   barrier(VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+           VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+           VK_ACCESS_2_SHADER_SAMPLED_READ_BIT);
+   ASSERT(image.fast_clear->pending == 0);
+   ASSERT(contents_are(0x55667788));
+
+   /* read by a storage descriptor in the GENERAL layout */
+   clear(0x01020304);
+   barrier(VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+           VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+   ASSERT(contents_are(0x01020304));
+
+   /* copied */
+   clear(0x0a0b0c0d);
+   barrier(VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+           VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+           VK_ACCESS_2_TRANSFER_READ_BIT);
+   ASSERT(contents_are(0x0a0b0c0d));
+
+   /* presented */
+   clear(0xdeadbeef);
+   barrier(VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+           VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_ACCESS_2_NONE);
+   ASSERT(contents_are(0xdeadbeef));
+
+   /* contents become undefined, nothing is written */
+   clear(0x12345678);
+   barrier(VK_IMAGE_LAYOUT_UNDEFINED,
+           VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+           VK_ACCESS_2_TRANSFER_READ_BIT);
+   ASSERT(image.fast_clear->pending == 0);
+   ASSERT(contents_are(0xdeadbeef));
+
+   /* every mapping taken to write out a clear is released again */
+   ASSERT(bo.map_count == 0);
+
+   test_image_finish();
+
+   return 0;
+}
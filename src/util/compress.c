@@ -36,8 +36,11 @@
 
 #ifdef HAVE_ZSTD
 #include "zstd.h"
+#include "zdict.h"
 #endif
 
+#include <stdlib.h>
+
 #include "util/compress.h"
 #include "macros.h"
 
@@ -163,4 +166,136 @@ util_compress_inflate(const uint8_t *in_data, size_t in_data_size,
 #endif
 }
 
+struct util_compress_dict {
+#ifdef HAVE_ZSTD
+   ZSTD_CDict *cdict;
+   ZSTD_DDict *ddict;
+#endif
+   uint32_t id;
+};
+
+struct util_compress_dict *
+util_compress_dict_create(const void *dict_data, size_t dict_size)
+{
+#ifdef HAVE_ZSTD
+   struct util_compress_dict *dict = calloc(1, sizeof(*dict));
+   if (!dict)
+      return NULL;
+
+   /* Raw content dictionaries have no id and we couldn't tell entries
+    * compressed with them apart, only accept trained ones.
+    */
+   dict->id = ZSTD_getDictID_fromDict(dict_data, dict_size);
+   if (!dict->id)
+      goto fail;
+
+   dict->cdict = ZSTD_createCDict(dict_data, dict_size,
+                                  ZSTD_COMPRESSION_LEVEL);
+   dict->ddict = ZSTD_createDDict(dict_data, dict_size);
+   if (!dict->cdict || !dict->ddict)
+      goto fail;
+
+   return dict;
+
+fail:
+   util_compress_dict_destroy(dict);
+   return NULL;
+#else
+   return NULL;
+#endif
+}
+
+void
+util_compress_dict_destroy(struct util_compress_dict *dict)
+{
+   if (!dict)
+      return;
+
+#ifdef HAVE_ZSTD
+   ZSTD_freeCDict(dict->cdict);
+   ZSTD_freeDDict(dict->ddict);
+#endif
+   free(dict);
+}
+
+uint32_t
+util_compress_dict_id(const struct util_compress_dict *dict)
+{
+   return dict ? dict->id : 0;
+}
+
+size_t
+util_compress_dict_train(void *dict_data, size_t dict_capacity,
+                         const void *samples, const size_t *sample_sizes,
+                         unsigned num_samples)
+{
+#ifdef HAVE_ZSTD
+   size_t ret = ZDICT_trainFromBuffer(dict_data, dict_capacity, samples,
+                                      sample_sizes, num_samples);
+   if (ZDICT_isError(ret))
+      return 0;
+
+   return ret;
+#else
+   return 0;
+#endif
+}
+
+size_t
+util_compress_deflate_dict(const struct util_compress_dict *dict,
+                           const uint8_t *in_data, size_t in_data_size,
+                           uint8_t *out_data, size_t out_buff_size)
+{
+#ifdef HAVE_ZSTD
+   if (!dict)
+      return util_compress_deflate(in_data, in_data_size, out_data,
+                                   out_buff_size);
+
+   ZSTD_CCtx *cctx = ZSTD_createCCtx();
+   if (!cctx)
+      return 0;
+
+   size_t ret = ZSTD_compress_usingCDict(cctx, out_data, out_buff_size,
+                                         in_data, in_data_size, dict->cdict);
+   ZSTD_freeCCtx(cctx);
+   if (ZSTD_isError(ret))
+      return 0;
+
+   return ret;
+#else
+   return util_compress_deflate(in_data, in_data_size, out_data,
+                                out_buff_size);
+#endif
+}
+
+bool
+util_compress_inflate_dict(const struct util_compress_dict *dict,
+                           const uint8_t *in_data, size_t in_data_size,
+                           uint8_t *out_data, size_t out_data_size)
+{
+#ifdef HAVE_ZSTD
+   /* The frame header records the id of the dictionary it needs, if any. */
+   unsigned id = ZSTD_getDictID_fromFrame(in_data, in_data_size);
+   if (!id)
+      return util_compress_inflate(in_data, in_data_size, out_data,
+                                   out_data_size);
+
+   if (!dict || dict->id != id)
+      return false;
+
+   ZSTD_DCtx *dctx = ZSTD_createDCtx();
+   if (!dctx)
+      return false;
+
+   size_t ret = ZSTD_decompress_usingDDict(dctx, out_data, out_data_size,
+                                           in_data, in_data_size, dict->ddict);
+   ZSTD_freeDCtx(dctx);
+
+   return !ZSTD_isError(ret);
+#else
+   return util_compress_inflate(in_data, in_data_size, out_data,
+                                out_data_size);
+#endif
+}
+
 #endif
@@ -93,6 +93,39 @@ disk_cache_init_queue(struct disk_cache *cache)
                           UTIL_QUEUE_INIT_SET_FULL_THREAD_AFFINITY, NULL);
 }
 
+/* Parse a size with an optional K/M/G suffix, sizes without a suffix are
+ * in GB. Returns 0 if the string isn't a number.
+ */
+static uint64_t
+disk_cache_parse_size(const char *str)
+{
+   uint64_t size;
+   char *end;
+
+   size = strtoul(str, &end, 10);
+   if (end == str)
+      return 0;
+
+   switch (*end) {
+   case 'K':
+   case 'k':
+      size *= 1024;
+      break;
+   case 'M':
+   case 'm':
+      size *= 1024*1024;
+      break;
+   case '\0':
+   case 'G':
+   case 'g':
+   default:
+      size *= 1024*1024*1024;
+      break;
+   }
+
+   return size;
+}
+
 static struct disk_cache *
 disk_cache_type_create(const char *gpu_name,
                        const char *driver_id,
@@ -181,30 +214,8 @@ disk_cache_type_create(const char *gpu_name,
    }
    #endif
 
-   if (max_size_str) {
-      char *end;
-      max_size = strtoul(max_size_str, &end, 10);
-      if (end == max_size_str) {
-         max_size = 0;
-      } else {
-         switch (*end) {
-         case 'K':
-         case 'k':
-            max_size *= 1024;
-            break;
-         case 'M':
-         case 'm':
-            max_size *= 1024*1024;
-            break;
-         case '\0':
-         case 'G':
-         case 'g':
-         default:
-            max_size *= 1024*1024*1024;
-            break;
-         }
-      }
-   }
+   if (max_size_str)
+      max_size = disk_cache_parse_size(max_size_str);
 
    /* Default to 1GB for maximum cache size. */
    if (max_size == 0) {
@@ -256,6 +267,12 @@ disk_cache_type_create(const char *gpu_name,
    /* Seed our rand function */
    s_rand_xorshift128plus(cache->seed_xorshift128plus, true);
 
+   /* Dictionaries are trained offline with mesa-cache-dict and dropped
+    * into the cache directory, use one if there is one for this driver.
+    */
+   if (!cache->path_init_failed && !cache->compression_disabled)
+      disk_cache_load_dict(local, cache);
+
    ralloc_free(local);
 
    return cache;
@@ -274,6 +291,7 @@ disk_cache_create(const char *gpu_name, const char *driver_id,
 {
    enum disk_cache_type cache_type;
    struct disk_cache *cache;
+   const char *ram_size_str;
 
    if (debug_get_bool_option("MESA_DISK_CACHE_SINGLE_FILE", false))
       cache_type = DISK_CACHE_SINGLE_FILE;
@@ -305,6 +323,16 @@ disk_cache_create(const char *gpu_name, const char *driver_id,
                                                    DISK_CACHE_SINGLE_FILE);
    }
 
+   /* The in-memory tier is per process and off by default. It also serves
+    * caches backed by the blob callbacks, so it doesn't depend on the path.
+    */
+   ram_size_str = getenv("MESA_SHADER_CACHE_RAM_SIZE");
+   if (ram_size_str) {
+      cache->ram_max_size = disk_cache_parse_size(ram_size_str);
+      if (cache->ram_max_size)
+         cache->ram = disk_cache_ram_create(cache, cache->ram_max_size);
+   }
+
    return cache;
 }
 
@@ -315,6 +343,13 @@ disk_cache_destroy(struct disk_cache *cache)
       printf("disk shader cache:  hits = %u, misses = %u\n",
              cache->stats.hits,
              cache->stats.misses);
+
+      if (cache->ram) {
+         printf("disk shader cache RAM tier:  hits = %"PRIu64", "
+                "misses = %"PRIu64", evictions = %"PRIu64"\n",
+                cache->ram->hits, cache->ram->misses,
+                cache->ram->evictions);
+      }
    }
 
    if (cache && util_queue_is_initialized(&cache->cache_queue)) {
@@ -333,6 +368,11 @@ disk_cache_destroy(struct disk_cache *cache)
       disk_cache_destroy_mmap(cache);
    }
 
+   if (cache) {
+      disk_cache_ram_destroy(cache->ram);
+      util_compress_dict_destroy(cache->dict);
+   }
+
    ralloc_free(cache);
 }
 
@@ -345,6 +385,9 @@ disk_cache_wait_for_idle(struct disk_cache *cache)
 void
 disk_cache_remove(struct disk_cache *cache, const cache_key key)
 {
+   if (cache->ram)
+      disk_cache_ram_remove(cache->ram, key);
+
    if (cache->type == DISK_CACHE_DATABASE) {
       mesa_cache_db_multipart_entry_remove(&cache->cache_db, key);
       return;
@@ -484,7 +527,8 @@ blob_put_compressed(struct disk_cache *cache, const cache_key key,
 
    MESA_TRACE_BEGIN("deflate");
    size_t compressed_size =
-         util_compress_deflate(data, size, entry->compressed_data, max_buf);
+         util_compress_deflate_dict(cache->dict, data, size,
+                                    entry->compressed_data, max_buf);
    MESA_TRACE_END();
    if (!compressed_size)
       goto out;
@@ -530,8 +574,9 @@ blob_get_compressed(struct disk_cache *cache, const cache_key key,
 
    unsigned compressed_size = entry_size - sizeof(*entry);
    MESA_TRACE_BEGIN("inflate");
-   bool ret = util_compress_inflate(entry->compressed_data, compressed_size,
-                                    data, entry->uncompressed_size);
+   bool ret = util_compress_inflate_dict(cache->dict, entry->compressed_data,
+                                         compressed_size, data,
+                                         entry->uncompressed_size);
    MESA_TRACE_END();
    if (!ret) {
       free(data);
@@ -555,6 +600,12 @@ disk_cache_put(struct disk_cache *cache, const cache_key key,
    if (!util_queue_is_initialized(&cache->cache_queue))
       return;
 
+   /* Entries become visible to disk_cache_get() right away, without
+    * waiting for the put queue to compress and write them.
+    */
+   if (cache->ram)
+      disk_cache_ram_put(cache->ram, key, data, size);
+
    struct disk_cache_put_job *dc_job =
       create_put_job(cache, key, (void*)data, size, cache_item_metadata, false);
 
@@ -575,6 +626,9 @@ disk_cache_put_nocopy(struct disk_cache *cache, const cache_key key,
       return;
    }
 
+   if (cache->ram)
+      disk_cache_ram_put(cache->ram, key, data, size);
+
    struct disk_cache_put_job *dc_job =
       create_put_job(cache, key, data, size, cache_item_metadata, true);
 
@@ -593,6 +647,12 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
    if (size)
       *size = 0;
 
+   if (cache->ram) {
+      buf = disk_cache_ram_get(cache->ram, key, size);
+      if (buf)
+         goto out;
+   }
+
    if (cache->foz_ro_cache)
       buf = disk_cache_load_item_foz(cache->foz_ro_cache, key, size);
 
@@ -610,6 +670,11 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
       }
    }
 
+   /* size is optional for the callers, but needed to populate the tier */
+   if (buf && cache->ram && size)
+      disk_cache_ram_put(cache->ram, key, buf, *size);
+
+out:
    if (unlikely(cache->stats.enabled)) {
       if (buf)
          p_atomic_inc(&cache->stats.hits);
@@ -680,6 +745,22 @@ disk_cache_compute_key(struct disk_cache *cache, const void *data, size_t size,
    _mesa_sha1_final(&ctx, key);
 }
 
+bool
+disk_cache_get_ram_stats(struct disk_cache *cache,
+                         struct disk_cache_ram_stats *stats)
+{
+   if (!cache->ram)
+      return false;
+
+   stats->hits = p_atomic_read(&cache->ram->hits);
+   stats->misses = p_atomic_read(&cache->ram->misses);
+   stats->evictions = p_atomic_read(&cache->ram->evictions);
+   stats->size = disk_cache_ram_size(cache->ram);
+   stats->max_size = cache->ram_max_size;
+
+   return true;
+}
+
 void
 disk_cache_set_callbacks(struct disk_cache *cache, disk_cache_put_cb put,
                          disk_cache_get_cb get)
@@ -77,6 +77,15 @@ struct cache_item_metadata {
    uint32_t num_keys;
 };
 
+struct disk_cache_ram_stats {
+   uint64_t hits;
+   uint64_t misses;
+   uint64_t evictions;
+   /* bytes currently held and the budget, both in decompressed sizes */
+   uint64_t size;
+   uint64_t max_size;
+};
+
 struct disk_cache;
 
 static inline char *
@@ -280,6 +289,16 @@ void
 disk_cache_set_callbacks(struct disk_cache *cache, disk_cache_put_cb put,
                          disk_cache_get_cb get);
 
+/**
+ * Query the counters of the in-memory tier, which is enabled by setting
+ * MESA_SHADER_CACHE_RAM_SIZE.
+ *
+ * \return false if the cache has no in-memory tier.
+ */
+bool
+disk_cache_get_ram_stats(struct disk_cache *cache,
+                         struct disk_cache_ram_stats *stats);
+
 #else
 
 static inline struct disk_cache *
@@ -342,6 +361,13 @@ disk_cache_set_callbacks(struct disk_cache *cache, disk_cache_put_cb put,
 {
 }
 
+static inline bool
+disk_cache_get_ram_stats(struct disk_cache *cache,
+                         struct disk_cache_ram_stats *stats)
+{
+   return false;
+}
+
 #endif /* ENABLE_SHADER_CACHE */
 
 #ifdef __cplusplus
@@ -97,6 +97,7 @@ disk_cache_get_function_identifier(void *ptr, struct mesa_sha1 *ctx)
 
 #include "util/blob.h"
 #include "util/crc32.h"
+#include "util/os_file.h"
 #include "util/u_debug.h"
 #include "util/ralloc.h"
 #include "util/rand_xor.h"
@@ -568,8 +569,9 @@ parse_and_validate_cache_item(struct disk_cache *cache, void *cache_item,
 
       memcpy(uncompressed_data, data, cache_data_size);
    } else {
-      if (!util_compress_inflate(data, cache_data_size, uncompressed_data,
-                                 cf_data->uncompressed_size))
+      if (!util_compress_inflate_dict(cache->dict, data, cache_data_size,
+                                      uncompressed_data,
+                                      cf_data->uncompressed_size))
          goto fail;
    }
 
@@ -668,8 +670,9 @@ create_cache_item_header_and_blob(struct disk_cache_put_job *dc_job,
       if (compressed_data == NULL)
          return false;
       compressed_size =
-         util_compress_deflate(dc_job->data, dc_job->size,
-                              compressed_data, max_buf);
+         util_compress_deflate_dict(dc_job->cache->dict,
+                                    dc_job->data, dc_job->size,
+                                    compressed_data, max_buf);
       if (compressed_size == 0)
          goto fail;
    }
@@ -1112,6 +1115,43 @@ disk_cache_db_load_cache_index(void *mem_ctx, struct disk_cache *cache)
 {
    return mesa_cache_db_multipart_open(&cache->cache_db, cache->path);
 }
+
+/* A cache directory can be shared by several drivers, so the dictionary
+ * name includes a hash of the driver keys of the entries it was trained on.
+ */
+char *
+disk_cache_get_dict_filename(void *mem_ctx, const char *path,
+                             const uint8_t *driver_keys_blob,
+                             size_t driver_keys_blob_size)
+{
+   unsigned char sha1[SHA1_DIGEST_LENGTH];
+   char buf[SHA1_DIGEST_STRING_LENGTH];
+
+   _mesa_sha1_compute(driver_keys_blob, driver_keys_blob_size, sha1);
+   _mesa_sha1_format(buf, sha1);
+
+   return ralloc_asprintf(mem_ctx, "%s/zstd_dict_v%u_%.16s", path,
+                          CACHE_DICT_VERSION, buf);
+}
+
+void
+disk_cache_load_dict(void *mem_ctx, struct disk_cache *cache)
+{
+   char *filename = disk_cache_get_dict_filename(mem_ctx, cache->path,
+                                                 cache->driver_keys_blob,
+                                                 cache->driver_keys_blob_size);
+   if (!filename)
+      return;
+
+   size_t size;
+   char *data = os_read_file(filename, &size);
+   if (!data)
+      return;
+
+   cache->dict = util_compress_dict_create(data, size);
+
+   free(data);
+}
 #endif
 
 #endif /* ENABLE_SHADER_CACHE */
@@ -35,6 +35,7 @@
 #include "util/fossilize_db.h"
 #include "util/mesa_cache_db.h"
 #include "util/mesa_cache_db_multipart.h"
+#include "util/disk_cache_ram.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -49,6 +50,11 @@ extern "C" {
 /* The number of keys that can be stored in the index. */
 #define CACHE_INDEX_MAX_KEYS (1 << CACHE_INDEX_KEY_BITS)
 
+/* Bumped whenever the way entries are compressed with the dictionary
+ * changes, dictionaries of other versions are ignored.
+ */
+#define CACHE_DICT_VERSION 1
+
 enum disk_cache_type {
    DISK_CACHE_NONE,
    DISK_CACHE_MULTI_FILE,
@@ -96,6 +102,9 @@ struct disk_cache {
    /* Don't compress cached data. This is for testing purposes only. */
    bool compression_disabled;
 
+   /* Compression dictionary trained on this driver's entries, if any. */
+   struct util_compress_dict *dict;
+
    struct {
       bool enabled;
       unsigned hits;
@@ -104,6 +113,10 @@ struct disk_cache {
 
    /* Internal RO FOZ cache for combined use of RO and RW caches. */
    struct disk_cache *foz_ro_cache;
+
+   /* Optional in-memory tier of decompressed entries, NULL if disabled. */
+   struct disk_cache_ram *ram;
+   uint64_t ram_max_size;
 };
 
 struct cache_entry_file_data {
@@ -178,6 +191,14 @@ disk_cache_db_write_item_to_disk(struct disk_cache_put_job *dc_job);
 bool
 disk_cache_db_load_cache_index(void *mem_ctx, struct disk_cache *cache);
 
+char *
+disk_cache_get_dict_filename(void *mem_ctx, const char *path,
+                             const uint8_t *driver_keys_blob,
+                             size_t driver_keys_blob_size);
+
+void
+disk_cache_load_dict(void *mem_ctx, struct disk_cache *cache);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,214 @@
+/*
+ * Copyright © 2023 Sietium Semiconductor
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "disk_cache.h"
+#include "disk_cache_ram.h"
+#include "hash_table.h"
+#include "ralloc.h"
+#include "u_atomic.h"
+
+struct disk_cache_ram_entry {
+   struct list_head link;
+   cache_key key;
+   size_t size;
+   uint8_t data[];
+};
+
+/* The keys are SHA-1 digests already, any part of them makes a good hash.
+ * The shard is picked from different bytes than the hash so the entries of
+ * a shard still spread over the whole table.
+ */
+static uint32_t
+ram_key_hash(const void *key)
+{
+   uint32_t hash;
+
+   memcpy(&hash, key, sizeof(hash));
+
+   return hash;
+}
+
+static bool
+ram_key_equals(const void *a, const void *b)
+{
+   return memcmp(a, b, CACHE_KEY_SIZE) == 0;
+}
+
+static struct disk_cache_ram_shard *
+ram_get_shard(struct disk_cache_ram *ram, const uint8_t *key)
+{
+   return &ram->shards[key[4] % DISK_CACHE_RAM_NUM_SHARDS];
+}
+
+static void
+ram_shard_remove_entry(struct disk_cache_ram_shard *shard,
+                       struct hash_entry *he)
+{
+   struct disk_cache_ram_entry *entry = he->data;
+
+   _mesa_hash_table_remove(shard->ht, he);
+   list_del(&entry->link);
+   shard->size -= entry->size;
+   free(entry);
+}
+
+struct disk_cache_ram *
+disk_cache_ram_create(void *mem_ctx, uint64_t max_size)
+{
+   struct disk_cache_ram *ram = rzalloc(mem_ctx, struct disk_cache_ram);
+   if (!ram)
+      return NULL;
+
+   ram->shard_max_size = max_size / DISK_CACHE_RAM_NUM_SHARDS;
+
+   for (unsigned i = 0; i < DISK_CACHE_RAM_NUM_SHARDS; i++) {
+      struct disk_cache_ram_shard *shard = &ram->shards[i];
+
+      shard->ht = _mesa_hash_table_create(ram, ram_key_hash, ram_key_equals);
+      if (!shard->ht) {
+         ralloc_free(ram);
+         return NULL;
+      }
+
+      simple_mtx_init(&shard->mtx, mtx_plain);
+      list_inithead(&shard->lru);
+   }
+
+   return ram;
+}
+
+void
+disk_cache_ram_destroy(struct disk_cache_ram *ram)
+{
+   if (!ram)
+      return;
+
+   for (unsigned i = 0; i < DISK_CACHE_RAM_NUM_SHARDS; i++) {
+      struct disk_cache_ram_shard *shard = &ram->shards[i];
+
+      list_for_each_entry_safe(struct disk_cache_ram_entry, entry,
+                               &shard->lru, link)
+         free(entry);
+
+      simple_mtx_destroy(&shard->mtx);
+   }
+
+   ralloc_free(ram);
+}
+
+void *
+disk_cache_ram_get(struct disk_cache_ram *ram, const uint8_t *key,
+                   size_t *size)
+{
+   struct disk_cache_ram_shard *shard = ram_get_shard(ram, key);
+   void *data = NULL;
+
+   simple_mtx_lock(&shard->mtx);
+
+   struct hash_entry *he = _mesa_hash_table_search(shard->ht, key);
+   if (he) {
+      struct disk_cache_ram_entry *entry = he->data;
+
+      list_del(&entry->link);
+      list_add(&entry->link, &shard->lru);
+
+      /* The caller owns and frees the returned buffer, like with every
+       * other disk_cache_get() path.
+       */
+      data = malloc(entry->size);
+      if (data) {
+         memcpy(data, entry->data, entry->size);
+         if (size)
+            *size = entry->size;
+      }
+   }
+
+   simple_mtx_unlock(&shard->mtx);
+
+   if (data)
+      p_atomic_inc(&ram->hits);
+   else
+      p_atomic_inc(&ram->misses);
+
+   return data;
+}
+
+void
+disk_cache_ram_put(struct disk_cache_ram *ram, const uint8_t *key,
+                   const void *data, size_t size)
+{
+   struct disk_cache_ram_shard *shard = ram_get_shard(ram, key);
+   unsigned evicted = 0;
+
+   /* Don't let a single entry flush the whole shard. */
+   if (size > ram->shard_max_size / 4)
+      return;
+
+   struct disk_cache_ram_entry *entry = malloc(sizeof(*entry) + size);
+   if (!entry)
+      return;
+
+   memcpy(entry->key, key, CACHE_KEY_SIZE);
+   memcpy(entry->data, data, size);
+   entry->size = size;
+
+   simple_mtx_lock(&shard->mtx);
+
+   struct hash_entry *he = _mesa_hash_table_search(shard->ht, key);
+   if (he)
+      ram_shard_remove_entry(shard, he);
+
+   while (shard->size + size > ram->shard_max_size) {
+      struct disk_cache_ram_entry *lru =
+         list_last_entry(&shard->lru, struct disk_cache_ram_entry, link);
+
+      ram_shard_remove_entry(shard,
+                             _mesa_hash_table_search(shard->ht, lru->key));
+      evicted++;
+   }
+
+   _mesa_hash_table_insert(shard->ht, entry->key, entry);
+   list_add(&entry->link, &shard->lru);
+   shard->size += size;
+
+   simple_mtx_unlock(&shard->mtx);
+
+   if (evicted)
+      p_atomic_add(&ram->evictions, evicted);
+}
+
+void
+disk_cache_ram_remove(struct disk_cache_ram *ram, const uint8_t *key)
+{
+   struct disk_cache_ram_shard *shard = ram_get_shard(ram, key);
+
+   simple_mtx_lock(&shard->mtx);
+
+   struct hash_entry *he = _mesa_hash_table_search(shard->ht, key);
+   if (he)
+      ram_shard_remove_entry(shard, he);
+
+   simple_mtx_unlock(&shard->mtx);
+}
+
+uint64_t
+disk_cache_ram_size(struct disk_cache_ram *ram)
+{
+   uint64_t size = 0;
+
+   for (unsigned i = 0; i < DISK_CACHE_RAM_NUM_SHARDS; i++) {
+      struct disk_cache_ram_shard *shard = &ram->shards[i];
+
+      simple_mtx_lock(&shard->mtx);
+      size += shard->size;
+      simple_mtx_unlock(&shard->mtx);
+   }
+
+   return size;
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright © 2023 Sietium Semiconductor
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef DISK_CACHE_RAM_H
+#define DISK_CACHE_RAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "util/list.h"
+#include "util/simple_mtx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Per-process tier of decompressed cache entries sitting in front of the
+ * on-disk cache. Entries are spread over shards by key so that concurrent
+ * lookups from compiler threads mostly take different locks. Each shard
+ * evicts in LRU order once it exceeds its share of the byte budget.
+ */
+#define DISK_CACHE_RAM_NUM_SHARDS 16
+
+struct disk_cache_ram_shard {
+   simple_mtx_t mtx;
+   struct hash_table *ht;
+   /* most recently used first */
+   struct list_head lru;
+   uint64_t size;
+};
+
+struct disk_cache_ram {
+   struct disk_cache_ram_shard shards[DISK_CACHE_RAM_NUM_SHARDS];
+   uint64_t shard_max_size;
+
+   uint64_t hits;
+   uint64_t misses;
+   uint64_t evictions;
+};
+
+struct disk_cache_ram *
+disk_cache_ram_create(void *mem_ctx, uint64_t max_size);
+
+void
+disk_cache_ram_destroy(struct disk_cache_ram *ram);
+
+void *
+disk_cache_ram_get(struct disk_cache_ram *ram, const uint8_t *key,
+                   size_t *size);
+
+void
+disk_cache_ram_put(struct disk_cache_ram *ram, const uint8_t *key,
+                   const void *data, size_t size);
+
+void
+disk_cache_ram_remove(struct disk_cache_ram *ram, const uint8_t *key);
+
+uint64_t
+disk_cache_ram_size(struct disk_cache_ram *ram);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DISK_CACHE_RAM_H */
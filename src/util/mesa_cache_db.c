@@ -16,6 +16,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "crc32.h"
@@ -31,6 +33,11 @@
 #define MESA_CACHE_DB_VERSION          1
 #define MESA_CACHE_DB_MAGIC            "MESA_DB"
 
+/* Number of lookups whose access time is kept in memory before the index
+ * file gets updated.
+ */
+#define MESA_CACHE_DB_ACCESS_WRITEBACK_COUNT 64
+
 struct PACKED mesa_db_file_header {
    char magic[8];
    uint32_t version;
@@ -56,6 +63,7 @@ struct mesa_index_db_hash_entry {
    uint64_t last_access_time;
    uint32_t size;
    bool evicted;
+   bool access_dirty;
 };
 
 static inline bool mesa_db_seek_end(FILE *file)
@@ -91,14 +99,14 @@ static inline bool mesa_db_truncate(FILE *file, long pos)
 }
 
 static bool
-mesa_db_lock(struct mesa_cache_db *db)
+mesa_db_flock(struct mesa_cache_db *db, int operation)
 {
    simple_mtx_lock(&db->flock_mtx);
 
-   if (flock(fileno(db->cache.file), LOCK_EX) == -1)
+   if (flock(fileno(db->cache.file), operation) == -1)
       goto unlock_mtx;
 
-   if (flock(fileno(db->index.file), LOCK_EX) == -1)
+   if (flock(fileno(db->index.file), operation) == -1)
       goto unlock_cache;
 
    return true;
@@ -111,6 +119,22 @@ unlock_mtx:
    return false;
 }
 
+static bool
+mesa_db_lock(struct mesa_cache_db *db)
+{
+   return mesa_db_flock(db, LOCK_EX);
+}
+
+/* Lookups only read the files, hence readers of different processes can
+ * hold the lock at the same time. Anything that modifies the files takes
+ * the exclusive lock.
+ */
+static bool
+mesa_db_lock_shared(struct mesa_cache_db *db)
+{
+   return mesa_db_flock(db, LOCK_SH);
+}
+
 static void
 mesa_db_unlock(struct mesa_cache_db *db)
 {
@@ -139,6 +163,16 @@ mesa_db_generate_uuid(void)
    return ((os_time_get() / 1000000) << 32) | rand();
 }
 
+static bool
+mesa_db_header_valid(const struct mesa_db_file_header *header)
+{
+   if (strncmp(header->magic, MESA_CACHE_DB_MAGIC, sizeof(header->magic)) ||
+       header->version != MESA_CACHE_DB_VERSION || !header->uuid)
+      return false;
+
+   return true;
+}
+
 static bool
 mesa_db_read_header(FILE *file, struct mesa_db_file_header *header)
 {
@@ -148,11 +182,7 @@ mesa_db_read_header(FILE *file, struct mesa_db_file_header *header)
    if (!mesa_db_read(file, header))
       return false;
 
-   if (strncmp(header->magic, MESA_CACHE_DB_MAGIC, sizeof(header->magic)) ||
-       header->version != MESA_CACHE_DB_VERSION || !header->uuid)
-      return false;
-
-   return true;
+   return mesa_db_header_valid(header);
 }
 
 static bool
@@ -182,6 +212,71 @@ static bool mesa_db_uuid_changed(struct mesa_cache_db *db)
    return false;
 }
 
+static void
+mesa_db_unmap_file(struct mesa_cache_db_file *db_file)
+{
+   if (db_file->map)
+      munmap(db_file->map, db_file->map_size);
+
+   db_file->map = NULL;
+   db_file->map_size = 0;
+}
+
+/* Keep the read-only mapping in sync with the file size. The size can't
+ * change while either lock is held, so the mapping stays valid until the
+ * lock is dropped; it's re-validated every time the lock is taken since
+ * other processes may grow or truncate the file in between.
+ */
+static bool
+mesa_db_map_file(struct mesa_cache_db_file *db_file)
+{
+   struct stat st;
+   void *map;
+
+   if (fstat(fileno(db_file->file), &st) == -1)
+      return false;
+
+   if (db_file->map_size == st.st_size)
+      return true;
+
+   mesa_db_unmap_file(db_file);
+
+   if (!st.st_size)
+      return true;
+
+   map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED,
+              fileno(db_file->file), 0);
+   if (map == MAP_FAILED)
+      return false;
+
+   db_file->map = map;
+   db_file->map_size = st.st_size;
+
+   return true;
+}
+
+static bool
+mesa_db_mapped_uuid_changed(struct mesa_cache_db *db)
+{
+   struct mesa_db_file_header cache_header;
+   struct mesa_db_file_header index_header;
+
+   if (db->cache.map_size < sizeof(cache_header) ||
+       db->index.map_size < sizeof(index_header))
+      return true;
+
+   memcpy(&cache_header, db->cache.map, sizeof(cache_header));
+   memcpy(&index_header, db->index.map, sizeof(index_header));
+
+   if (!mesa_db_header_valid(&cache_header) ||
+       !mesa_db_header_valid(&index_header) ||
+       cache_header.uuid != index_header.uuid ||
+       cache_header.uuid != db->uuid)
+      return true;
+
+   return false;
+}
+
 static bool
 mesa_db_write_header(struct mesa_cache_db_file *db_file,
                      uint64_t uuid, bool reset)
@@ -253,23 +348,20 @@ mesa_db_update_index(struct mesa_cache_db *db)
    struct mesa_index_db_file_entry index_entry;
    size_t file_length;
 
-   if (!mesa_db_seek_end(db->index.file))
+   if (!mesa_db_map_file(&db->index))
       return false;
 
-   file_length = ftell(db->index.file);
+   file_length = db->index.map_size;
 
-   if (!mesa_db_seek(db->index.file, db->index.offset))
-      return false;
-
-   while (db->index.offset < file_length) {
-      if (!mesa_db_read(db->index.file, &index_entry))
-         break;
+   while (db->index.offset + sizeof(index_entry) <= file_length) {
+      memcpy(&index_entry, (uint8_t *)db->index.map + db->index.offset,
+             sizeof(index_entry));
 
       /* Check whether the index entry looks valid or we have a corrupted DB */
       if (!mesa_db_index_entry_valid(&index_entry))
          break;
 
-      hash_entry = ralloc(db->mem_ctx, struct mesa_index_db_hash_entry);
+      hash_entry = rzalloc(db->mem_ctx, struct mesa_index_db_hash_entry);
       if (!hash_entry)
          break;
 
@@ -293,6 +385,7 @@ static void
 mesa_db_hash_table_reset(struct mesa_cache_db *db)
 {
    _mesa_hash_table_u64_clear(db->index_db);
+   util_dynarray_clear(&db->dirty_entries);
    ralloc_free(db->mem_ctx);
    db->mem_ctx = ralloc_context(NULL);
 }
@@ -389,12 +482,16 @@ mesa_db_open_file(struct mesa_cache_db_file *db_file,
       return false;
    }
 
+   db_file->map = NULL;
+   db_file->map_size = 0;
+
    return true;
 }
 
 static void
 mesa_db_close_file(struct mesa_cache_db_file *db_file)
 {
+   mesa_db_unmap_file(db_file);
    fclose(db_file->file);
    free(db_file->path);
 }
@@ -447,6 +544,68 @@ static uint32_t blob_file_size(uint32_t blob_size)
    return sizeof(struct mesa_cache_db_file_entry) + blob_size;
 }
 
+/* Write the batched last access times back to the index file. Must be
+ * called with the exclusive lock held and the in-memory index in sync
+ * with the files.
+ */
+static bool
+mesa_db_flush_access_times(struct mesa_cache_db *db)
+{
+   struct mesa_index_db_file_entry index_entry;
+   bool success = true;
+
+   util_dynarray_foreach(&db->dirty_entries,
+                         struct mesa_index_db_hash_entry *, entry) {
+      struct mesa_index_db_hash_entry *hash_entry = *entry;
+
+      hash_entry->access_dirty = false;
+
+      if (!success)
+         continue;
+
+      if (!mesa_db_seek(db->index.file, hash_entry->index_db_file_offset) ||
+          !mesa_db_read(db->index.file, &index_entry) ||
+          !mesa_db_index_entry_valid(&index_entry) ||
+          index_entry.cache_db_file_offset != hash_entry->cache_db_file_offset ||
+          index_entry.size != hash_entry->size) {
+         success = false;
+         continue;
+      }
+
+      index_entry.last_access_time = hash_entry->last_access_time;
+
+      if (!mesa_db_seek(db->index.file, hash_entry->index_db_file_offset) ||
+          !mesa_db_write(db->index.file, &index_entry))
+         success = false;
+   }
+
+   if (util_dynarray_num_elements(&db->dirty_entries,
+                                  struct mesa_index_db_hash_entry *))
+      fflush(db->index.file);
+
+   util_dynarray_clear(&db->dirty_entries);
+
+   return success;
+}
+
+static void
+mesa_db_writeback_access_times(struct mesa_cache_db *db)
+{
+   if (!mesa_db_lock(db))
+      return;
+
+   /* If the files were replaced meanwhile, the reload drops the stale
+    * access times together with the old index. */
+   if (db->alive &&
+       ((mesa_db_uuid_changed(db) && !mesa_db_reload(db)) ||
+        !mesa_db_flush_access_times(db)))
+      mesa_db_zap(db);
+
+   util_dynarray_clear(&db->dirty_entries);
+
+   mesa_db_unlock(db);
+}
+
 static bool
 mesa_db_compact(struct mesa_cache_db *db, int64_t blob_size,
                 struct mesa_index_db_hash_entry *remove_entry)
@@ -615,6 +774,7 @@ mesa_cache_db_open(struct mesa_cache_db *db, const char *cache_path)
       goto close_index;
 
    simple_mtx_init(&db->flock_mtx, mtx_plain);
+   util_dynarray_init(&db->dirty_entries, NULL);
 
    db->index_db = _mesa_hash_table_u64_create(NULL);
    if (!db->index_db)
@@ -628,6 +788,7 @@ mesa_cache_db_open(struct mesa_cache_db *db, const char *cache_path)
 destroy_hash:
    _mesa_hash_table_u64_destroy(db->index_db);
 destroy_mtx:
+   util_dynarray_fini(&db->dirty_entries);
    simple_mtx_destroy(&db->flock_mtx);
 
    ralloc_free(db->mem_ctx);
@@ -658,7 +819,12 @@ mesa_db_wipe_path(const char *cache_path)
 void
 mesa_cache_db_close(struct mesa_cache_db *db)
 {
+   if (util_dynarray_num_elements(&db->dirty_entries,
+                                  struct mesa_index_db_hash_entry *))
+      mesa_db_writeback_access_times(db);
+
    _mesa_hash_table_u64_destroy(db->index_db);
+   util_dynarray_fini(&db->dirty_entries);
    simple_mtx_destroy(&db->flock_mtx);
    ralloc_free(db->mem_ctx);
 
@@ -688,15 +854,21 @@ mesa_cache_db_read_entry(struct mesa_cache_db *db,
    struct mesa_cache_db_file_entry cache_entry;
    struct mesa_index_db_file_entry index_entry;
    struct mesa_index_db_hash_entry *hash_entry;
+   const uint8_t *cache_map, *blob;
+   bool writeback = false;
    void *data = NULL;
 
-   if (!mesa_db_lock(db))
+   if (!mesa_db_lock_shared(db))
       return NULL;
 
    if (!db->alive)
       goto fail;
 
-   if (mesa_db_uuid_changed(db) && !mesa_db_reload(db))
+   if (!mesa_db_map_file(&db->cache) ||
+       !mesa_db_map_file(&db->index))
+      goto fail_fatal;
+
+   if (mesa_db_mapped_uuid_changed(db) && !mesa_db_reload(db))
       goto fail_fatal;
 
    if (!mesa_db_update_index(db))
@@ -706,46 +878,83 @@ mesa_cache_db_read_entry(struct mesa_cache_db *db,
    if (!hash_entry)
       goto fail;
 
-   if (!mesa_db_seek(db->cache.file, hash_entry->cache_db_file_offset) ||
-       !mesa_db_read(db->cache.file, &cache_entry) ||
-       !mesa_db_cache_entry_valid(&cache_entry))
+   cache_map = db->cache.map;
+
+   if (hash_entry->cache_db_file_offset + sizeof(cache_entry) > db->cache.map_size)
+      goto fail_fatal;
+
+   memcpy(&cache_entry, cache_map + hash_entry->cache_db_file_offset,
+          sizeof(cache_entry));
+
+   if (!mesa_db_cache_entry_valid(&cache_entry) ||
+       hash_entry->cache_db_file_offset +
+       blob_file_size(cache_entry.size) > db->cache.map_size)
       goto fail_fatal;
 
    if (memcmp(cache_entry.key, cache_key_160bit, sizeof(cache_entry.key)))
       goto fail;
 
-   data = malloc(cache_entry.size);
-   if (!data)
-      goto fail;
+   blob = cache_map + hash_entry->cache_db_file_offset + sizeof(cache_entry);
+
+   if (util_hash_crc32(blob, cache_entry.size) != cache_entry.crc)
+      goto fail_fatal;
 
-   if (!mesa_db_read_data(db->cache.file, data, cache_entry.size) ||
-       util_hash_crc32(data, cache_entry.size) != cache_entry.crc)
+   if (hash_entry->index_db_file_offset + sizeof(index_entry) > db->index.map_size)
       goto fail_fatal;
 
-   if (!mesa_db_seek(db->index.file, hash_entry->index_db_file_offset) ||
-       !mesa_db_read(db->index.file, &index_entry) ||
-       !mesa_db_index_entry_valid(&index_entry) ||
+   memcpy(&index_entry,
+          (uint8_t *)db->index.map + hash_entry->index_db_file_offset,
+          sizeof(index_entry));
+
+   if (!mesa_db_index_entry_valid(&index_entry) ||
        index_entry.cache_db_file_offset != hash_entry->cache_db_file_offset ||
        index_entry.size != hash_entry->size)
       goto fail_fatal;
 
-   index_entry.last_access_time = os_time_get_nano();
-   hash_entry->last_access_time = index_entry.last_access_time;
+   data = malloc(cache_entry.size);
+   if (!data)
+      goto fail;
 
-   if (!mesa_db_seek(db->index.file, hash_entry->index_db_file_offset) ||
-       !mesa_db_write(db->index.file, &index_entry))
-      goto fail_fatal;
+   memcpy(data, blob, cache_entry.size);
 
-   fflush(db->index.file);
+   /* The access time is only needed for the eviction, so don't rewrite
+    * the index on every hit. The times are written back in batches. */
+   hash_entry->last_access_time = os_time_get_nano();
+
+   if (!hash_entry->access_dirty) {
+      hash_entry->access_dirty = true;
+      util_dynarray_append(&db->dirty_entries,
+                           struct mesa_index_db_hash_entry *, hash_entry);
+   }
+
+   writeback = util_dynarray_num_elements(&db->dirty_entries,
+                                          struct mesa_index_db_hash_entry *) >=
+               MESA_CACHE_DB_ACCESS_WRITEBACK_COUNT;
 
    mesa_db_unlock(db);
 
+   if (writeback)
+      mesa_db_writeback_access_times(db);
+
    *size = cache_entry.size;
 
    return data;
 
 fail_fatal:
-   mesa_db_zap(db);
+   mesa_db_unlock(db);
+
+   /* Zapping truncates the files, which requires the exclusive lock. No
+    * lock was held in between, so another process may have replaced the
+    * broken files meanwhile; then they only need to be reloaded.
+    */
+   if (mesa_db_lock(db)) {
+      if (!mesa_db_uuid_changed(db) || !mesa_db_reload(db))
+         mesa_db_zap(db);
+      mesa_db_unlock(db);
+   }
+
+   return NULL;
+
 fail:
    free(data);
 
@@ -786,6 +995,9 @@ mesa_cache_db_entry_write(struct mesa_cache_db *db,
    if (mesa_db_uuid_changed(db) && !mesa_db_reload(db))
       goto fail_fatal;
 
+   if (!mesa_db_flush_access_times(db))
+      goto fail_fatal;
+
    if (!mesa_db_seek_end(db->cache.file))
       goto fail_fatal;
 
@@ -817,7 +1029,7 @@ mesa_cache_db_entry_write(struct mesa_cache_db *db,
    index_entry.last_access_time = os_time_get_nano();
    index_entry.cache_db_file_offset = ftell(db->cache.file);
 
-   hash_entry = ralloc(db->mem_ctx, struct mesa_index_db_hash_entry);
+   hash_entry = rzalloc(db->mem_ctx, struct mesa_index_db_hash_entry);
    if (!hash_entry)
       goto fail;
 
@@ -870,6 +1082,9 @@ mesa_cache_db_entry_remove(struct mesa_cache_db *db,
    if (mesa_db_uuid_changed(db) && !mesa_db_reload(db))
       goto fail_fatal;
 
+   if (!mesa_db_flush_access_times(db))
+      goto fail_fatal;
+
    if (!mesa_db_update_index(db))
       goto fail_fatal;
 
@@ -953,6 +1168,10 @@ mesa_cache_db_eviction_score(struct mesa_cache_db *db)
    if (!db->alive)
       goto fail;
 
+   /* sync the last access times before reading them back */
+   if (!mesa_db_uuid_changed(db) && !mesa_db_flush_access_times(db))
+      goto fail_fatal;
+
    if (!mesa_db_reload(db))
       goto fail_fatal;
 
@@ -16,6 +16,7 @@
 
 #include "detect_os.h"
 #include "simple_mtx.h"
+#include "u_dynarray.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -26,6 +27,10 @@ struct mesa_cache_db_file {
    char *path;
    off_t offset;
    uint64_t uuid;
+
+   /* read-only mapping of the whole file, refreshed under the flock */
+   void *map;
+   size_t map_size;
 };
 
 struct mesa_cache_db {
@@ -34,6 +39,8 @@ struct mesa_cache_db {
    struct mesa_cache_db_file index;
    uint64_t max_cache_size;
    simple_mtx_t flock_mtx;
+   /* index entries whose last_access_time hasn't been written back yet */
+   struct util_dynarray dirty_entries;
    void *mem_ctx;
    uint64_t uuid;
    bool alive;
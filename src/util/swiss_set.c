@@ -0,0 +1,514 @@
+/*
+ * Copyright © 2023 Sietium Semiconductor
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include "bitscan.h"
+#include "detect_arch.h"
+#include "macros.h"
+#include "ralloc.h"
+#include "swiss_set.h"
+
+#if DETECT_ARCH_SSE
+#include <emmintrin.h>
+#elif DETECT_ARCH_AARCH64 || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SWISS_SET_NEON 1
+#endif
+
+/* Control bytes. Full slots store the low 7 bits of the mixed hash, so the
+ * high bit tells apart free and full slots.
+ */
+#define CTRL_EMPTY   0x80
+#define CTRL_DELETED 0xfe
+
+#define GROUP_SIZE 16
+
+/* Group matching returns a mask with one bit per matching slot, at bit
+ * (slot << GROUP_MASK_SHIFT).
+ */
+#if DETECT_ARCH_SSE
+
+typedef uint32_t group_mask;
+#define GROUP_MASK_SHIFT 0
+
+static inline group_mask
+group_match(const uint8_t *ctrl, uint8_t h2)
+{
+   __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+   return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(h2)));
+}
+
+static inline group_mask
+group_match_empty(const uint8_t *ctrl)
+{
+   return group_match(ctrl, CTRL_EMPTY);
+}
+
+static inline group_mask
+group_match_free(const uint8_t *ctrl)
+{
+   return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ctrl));
+}
+
+#elif defined(SWISS_SET_NEON)
+
+typedef uint64_t group_mask;
+#define GROUP_MASK_SHIFT 2
+
+/* There is no movemask on NEON. Narrowing the 0x00/0xff bytes by 4 bits
+ * gives a nibble per slot, of which we keep one bit.
+ */
+static inline group_mask
+neon_to_mask(uint8x16_t v)
+{
+   uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(v), 4);
+   return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0) &
+          0x8888888888888888ull;
+}
+
+static inline group_mask
+group_match(const uint8_t *ctrl, uint8_t h2)
+{
+   return neon_to_mask(vceqq_u8(vld1q_u8(ctrl), vdupq_n_u8(h2)));
+}
+
+static inline group_mask
+group_match_empty(const uint8_t *ctrl)
+{
+   return group_match(ctrl, CTRL_EMPTY);
+}
+
+static inline group_mask
+group_match_free(const uint8_t *ctrl)
+{
+   return neon_to_mask(vcltzq_s8(vreinterpretq_s8_u8(vld1q_u8(ctrl))));
+}
+
+#else
+
+typedef uint32_t group_mask;
+#define GROUP_MASK_SHIFT 0
+
+static inline group_mask
+group_match(const uint8_t *ctrl, uint8_t h2)
+{
+   group_mask mask = 0;
+   for (unsigned i = 0; i < GROUP_SIZE; i++)
+      mask |= (group_mask)(ctrl[i] == h2) << i;
+   return mask;
+}
+
+static inline group_mask
+group_match_empty(const uint8_t *ctrl)
+{
+   return group_match(ctrl, CTRL_EMPTY);
+}
+
+static inline group_mask
+group_match_free(const uint8_t *ctrl)
+{
+   group_mask mask = 0;
+   for (unsigned i = 0; i < GROUP_SIZE; i++)
+      mask |= (group_mask)(ctrl[i] >> 7) << i;
+   return mask;
+}
+
+#endif
+
+static inline unsigned
+group_mask_first(group_mask mask)
+{
+   return (ffsll(mask) - 1) >> GROUP_MASK_SHIFT;
+}
+
+/* The user hash functions range from XXH32 to pointer shifts, so mix the
+ * bits before splitting them into the group index and the 7 control bits.
+ */
+static inline uint32_t
+mix_hash(uint32_t hash)
+{
+   hash ^= hash >> 16;
+   hash *= 0x85ebca6b;
+   hash ^= hash >> 13;
+   hash *= 0xc2b2ae35;
+   hash ^= hash >> 16;
+   return hash;
+}
+
+static inline uint8_t
+hash_h2(uint32_t mixed)
+{
+   return mixed & 0x7f;
+}
+
+/* Groups are probed in triangular order, which visits every group once
+ * when the number of groups is a power of two.
+ */
+struct probe {
+   uint32_t group;
+   uint32_t mask;
+   uint32_t index;
+};
+
+static inline struct probe
+probe_start(const struct swiss_set *ht, uint32_t mixed)
+{
+   uint32_t mask = ht->size / GROUP_SIZE - 1;
+   return (struct probe) { (mixed >> 7) & mask, mask, 0 };
+}
+
+static inline bool
+probe_next(struct probe *p)
+{
+   if (p->index == p->mask)
+      return false;
+
+   p->index++;
+   p->group = (p->group + p->index) & p->mask;
+   return true;
+}
+
+static inline uint32_t
+max_growth(uint32_t size)
+{
+   /* Max load factor of 7/8 */
+   return size - size / 8;
+}
+
+static bool
+swiss_set_alloc(struct swiss_set *ht, uint32_t size)
+{
+   uint8_t *ctrl = ralloc_array(ht, uint8_t, size);
+   struct swiss_set_entry *table =
+      ralloc_array(ht, struct swiss_set_entry, size);
+
+   if (!ctrl || !table) {
+      ralloc_free(ctrl);
+      ralloc_free(table);
+      return false;
+   }
+
+   memset(ctrl, CTRL_EMPTY, size);
+
+   ht->ctrl = ctrl;
+   ht->table = table;
+   ht->size = size;
+   ht->growth_left = max_growth(size);
+   ht->entries = 0;
+   ht->deleted_entries = 0;
+
+   return true;
+}
+
+struct swiss_set *
+_mesa_swiss_set_create(void *mem_ctx,
+                       uint32_t (*key_hash_function)(const void *key),
+                       bool (*key_equals_function)(const void *a,
+                                                   const void *b))
+{
+   struct swiss_set *ht = ralloc(mem_ctx, struct swiss_set);
+   if (!ht)
+      return NULL;
+
+   ht->key_hash_function = key_hash_function;
+   ht->key_equals_function = key_equals_function;
+
+   if (!swiss_set_alloc(ht, GROUP_SIZE)) {
+      ralloc_free(ht);
+      return NULL;
+   }
+
+   return ht;
+}
+
+void
+_mesa_swiss_set_destroy(struct swiss_set *ht,
+                        void (*delete_function)(struct swiss_set_entry *entry))
+{
+   if (!ht)
+      return;
+
+   if (delete_function) {
+      swiss_set_foreach(ht, entry)
+         delete_function(entry);
+   }
+
+   ralloc_free(ht);
+}
+
+void
+_mesa_swiss_set_clear(struct swiss_set *ht,
+                      void (*delete_function)(struct swiss_set_entry *entry))
+{
+   if (!ht)
+      return;
+
+   if (delete_function) {
+      swiss_set_foreach(ht, entry)
+         delete_function(entry);
+   }
+
+   memset(ht->ctrl, CTRL_EMPTY, ht->size);
+   ht->growth_left = max_growth(ht->size);
+   ht->entries = 0;
+   ht->deleted_entries = 0;
+}
+
+static inline void
+set_ctrl(struct swiss_set *ht, uint32_t index, uint8_t ctrl)
+{
+   ht->ctrl[index] = ctrl;
+}
+
+/* Finds the first free slot for a key that isn't in the table. */
+static uint32_t
+find_free_slot(const struct swiss_set *ht, uint32_t mixed)
+{
+   struct probe p = probe_start(ht, mixed);
+
+   do {
+      group_mask mask = group_match_free(ht->ctrl + p.group * GROUP_SIZE);
+      if (mask)
+         return p.group * GROUP_SIZE + group_mask_first(mask);
+   } while (probe_next(&p));
+
+   unreachable("swiss set has no free slot");
+}
+
+static void
+swiss_set_rehash(struct swiss_set *ht, uint32_t new_size)
+{
+   struct swiss_set old = *ht;
+
+   if (!swiss_set_alloc(ht, new_size))
+      return;
+
+   for (uint32_t i = 0; i < old.size; i++) {
+      if (old.ctrl[i] & 0x80)
+         continue;
+
+      uint32_t index = find_free_slot(ht, mix_hash(old.table[i].hash));
+      set_ctrl(ht, index, old.ctrl[i]);
+      ht->table[index] = old.table[i];
+   }
+
+   ht->entries = old.entries;
+   ht->growth_left -= old.entries;
+
+   ralloc_free(old.ctrl);
+   ralloc_free(old.table);
+}
+
+/**
+ * Grows the set so that it can hold at least \p entries without rehashing.
+ */
+void
+_mesa_swiss_set_resize(struct swiss_set *ht, uint32_t entries)
+{
+   uint32_t size = GROUP_SIZE;
+
+   while (max_growth(size) < entries)
+      size *= 2;
+
+   if (size > ht->size)
+      swiss_set_rehash(ht, size);
+}
+
+struct swiss_set_entry *
+_mesa_swiss_set_search_pre_hashed(const struct swiss_set *ht,
+                                  uint32_t hash, const void *key)
+{
+   assert(ht->key_hash_function == NULL ||
+          hash == ht->key_hash_function(key));
+
+   uint32_t mixed = mix_hash(hash);
+   uint8_t h2 = hash_h2(mixed);
+   struct probe p = probe_start(ht, mixed);
+
+   do {
+      const uint8_t *ctrl = ht->ctrl + p.group * GROUP_SIZE;
+
+      for (group_mask mask = group_match(ctrl, h2); mask; mask &= mask - 1) {
+         struct swiss_set_entry *entry =
+            &ht->table[p.group * GROUP_SIZE + group_mask_first(mask)];
+
+         if (entry->hash == hash && ht->key_equals_function(key, entry->key))
+            return entry;
+      }
+
+      /* The key would have been put in the empty slot. */
+      if (group_match_empty(ctrl))
+         return NULL;
+   } while (probe_next(&p));
+
+   return NULL;
+}
+
+struct swiss_set_entry *
+_mesa_swiss_set_search(const struct swiss_set *ht, const void *key)
+{
+   assert(ht->key_hash_function);
+   return _mesa_swiss_set_search_pre_hashed(ht, ht->key_hash_function(key),
+                                            key);
+}
+
+struct swiss_set_entry *
+_mesa_swiss_set_search_or_add_pre_hashed(struct swiss_set *ht,
+                                         uint32_t hash, const void *key,
+                                         bool *found)
+{
+   assert(ht->key_hash_function == NULL ||
+          hash == ht->key_hash_function(key));
+
+   uint32_t mixed = mix_hash(hash);
+   uint8_t h2 = hash_h2(mixed);
+   struct probe p = probe_start(ht, mixed);
+   uint32_t free_slot = UINT32_MAX;
+
+   do {
+      const uint8_t *ctrl = ht->ctrl + p.group * GROUP_SIZE;
+
+      for (group_mask mask = group_match(ctrl, h2); mask; mask &= mask - 1) {
+         struct swiss_set_entry *entry =
+            &ht->table[p.group * GROUP_SIZE + group_mask_first(mask)];
+
+         if (entry->hash == hash && ht->key_equals_function(key, entry->key)) {
+            if (found)
+               *found = true;
+            return entry;
+         }
+      }
+
+      /* Reuse the first deleted slot on the way, if any. */
+      group_mask free_mask = group_match_free(ctrl);
+      if (free_mask && free_slot == UINT32_MAX)
+         free_slot = p.group * GROUP_SIZE + group_mask_first(free_mask);
+
+      if (group_match_empty(ctrl))
+         break;
+   } while (probe_next(&p));
+
+   if (found)
+      *found = false;
+
+   assert(free_slot != UINT32_MAX);
+
+   if (ht->ctrl[free_slot] == CTRL_EMPTY) {
+      if (ht->growth_left == 0) {
+         /* Only grow if the table is really getting full, not when it is
+          * just full of deleted slots.
+          */
+         if (ht->entries < max_growth(ht->size) / 2)
+            swiss_set_rehash(ht, ht->size);
+         else
+            swiss_set_rehash(ht, ht->size * 2);
+
+         if (unlikely(ht->growth_left == 0))
+            return NULL;
+
+         free_slot = find_free_slot(ht, mixed);
+      }
+      ht->growth_left--;
+   } else {
+      ht->deleted_entries--;
+   }
+
+   set_ctrl(ht, free_slot, h2);
+   ht->entries++;
+
+   struct swiss_set_entry *entry = &ht->table[free_slot];
+   entry->hash = hash;
+   entry->key = key;
+
+   return entry;
+}
+
+struct swiss_set_entry *
+_mesa_swiss_set_search_or_add(struct swiss_set *ht, const void *key,
+                              bool *found)
+{
+   assert(ht->key_hash_function);
+   return _mesa_swiss_set_search_or_add_pre_hashed(ht, ht->key_hash_function(key),
+                                                   key, found);
+}
+
+struct swiss_set_entry *
+_mesa_swiss_set_add_pre_hashed(struct swiss_set *ht, uint32_t hash,
+                               const void *key)
+{
+   struct swiss_set_entry *entry =
+      _mesa_swiss_set_search_or_add_pre_hashed(ht, hash, key, NULL);
+
+   if (unlikely(!entry))
+      return NULL;
+
+   entry->key = key;
+   return entry;
+}
+
+struct swiss_set_entry *
+_mesa_swiss_set_add(struct swiss_set *ht, const void *key)
+{
+   assert(ht->key_hash_function);
+   return _mesa_swiss_set_add_pre_hashed(ht, ht->key_hash_function(key), key);
+}
+
+/**
+ * This function deletes the given set entry.
+ *
+ * Note that deletion doesn't otherwise modify the table, so an iteration over
+ * the set deleting entries is safe.
+ */
+void
+_mesa_swiss_set_remove(struct swiss_set *ht, struct swiss_set_entry *entry)
+{
+   if (!entry)
+      return;
+
+   uint32_t index = entry - ht->table;
+   assert(index < ht->size && !(ht->ctrl[index] & 0x80));
+
+   /* Lookups stop at the first group with an empty slot. If this group has
+    * one, no key was ever placed past it while this slot was full, so the
+    * slot can become empty again instead of a tombstone.
+    */
+   if (group_match_empty(ht->ctrl + (index & ~(GROUP_SIZE - 1)))) {
+      set_ctrl(ht, index, CTRL_EMPTY);
+      ht->growth_left++;
+   } else {
+      set_ctrl(ht, index, CTRL_DELETED);
+      ht->deleted_entries++;
+   }
+
+   ht->entries--;
+}
+
+void
+_mesa_swiss_set_remove_key(struct swiss_set *ht, const void *key)
+{
+   _mesa_swiss_set_remove(ht, _mesa_swiss_set_search(ht, key));
+}
+
+/**
+ * This function is an iterator over the set.
+ *
+ * Pass in NULL for the first entry, as in the start of a for loop.
+ */
+struct swiss_set_entry *
+_mesa_swiss_set_next_entry(const struct swiss_set *ht,
+                           struct swiss_set_entry *entry)
+{
+   uint32_t i = entry ? entry - ht->table + 1 : 0;
+
+   for (; i < ht->size; i++) {
+      if (!(ht->ctrl[i] & 0x80))
+         return &ht->table[i];
+   }
+
+   return NULL;
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright © 2023 Sietium Semiconductor
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef _SWISS_SET_H
+#define _SWISS_SET_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Open addressing hash table in the style of Abseil's "Swiss tables".
+ *
+ * Next to the entries, the table keeps one control byte per slot which is
+ * either empty, deleted, or 7 bits of the hash of the entry in the slot.
+ * Lookups compare the control bytes of 16 slots at once with SSE2/NEON and
+ * only look at the entries whose hash bits match, so the entries of
+ * colliding keys are rarely touched and deleted slots cost almost nothing.
+ *
+ * The interface follows struct set. Entry pointers stay valid until the
+ * next insertion.
+ */
+struct swiss_set_entry {
+   uint32_t hash;
+   const void *key;
+};
+
+struct swiss_set {
+   uint8_t *ctrl;
+   struct swiss_set_entry *table;
+   uint32_t (*key_hash_function)(const void *key);
+   bool (*key_equals_function)(const void *a, const void *b);
+   uint32_t size;        /* number of slots, a power of two >= 16 */
+   uint32_t growth_left; /* empty slots that can be used before a rehash */
+   uint32_t entries;
+   uint32_t deleted_entries;
+};
+
+struct swiss_set *
+_mesa_swiss_set_create(void *mem_ctx,
+                       uint32_t (*key_hash_function)(const void *key),
+                       bool (*key_equals_function)(const void *a,
+                                                   const void *b));
+
+void
+_mesa_swiss_set_destroy(struct swiss_set *ht,
+                        void (*delete_function)(struct swiss_set_entry *entry));
+void
+_mesa_swiss_set_clear(struct swiss_set *ht,
+                      void (*delete_function)(struct swiss_set_entry *entry));
+void
+_mesa_swiss_set_resize(struct swiss_set *ht, uint32_t entries);
+
+/* Adds key, replacing the key of an existing entry with an equal key. */
+struct swiss_set_entry *
+_mesa_swiss_set_add(struct swiss_set *ht, const void *key);
+struct swiss_set_entry *
+_mesa_swiss_set_add_pre_hashed(struct swiss_set *ht, uint32_t hash,
+                               const void *key);
+
+/* Returns the entry with an equal key, or adds key. */
+struct swiss_set_entry *
+_mesa_swiss_set_search_or_add(struct swiss_set *ht, const void *key,
+                              bool *found);
+struct swiss_set_entry *
+_mesa_swiss_set_search_or_add_pre_hashed(struct swiss_set *ht,
+                                         uint32_t hash, const void *key,
+                                         bool *found);
+
+struct swiss_set_entry *
+_mesa_swiss_set_search(const struct swiss_set *ht, const void *key);
+struct swiss_set_entry *
+_mesa_swiss_set_search_pre_hashed(const struct swiss_set *ht,
+                                  uint32_t hash, const void *key);
+
+void
+_mesa_swiss_set_remove(struct swiss_set *ht, struct swiss_set_entry *entry);
+void
+_mesa_swiss_set_remove_key(struct swiss_set *ht, const void *key);
+
+struct swiss_set_entry *
+_mesa_swiss_set_next_entry(const struct swiss_set *ht,
+                           struct swiss_set_entry *entry);
+
+/**
+ * This foreach function is safe against deletion, but not against
+ * insertion (which may rehash the set, making entry a dangling
+ * pointer).
+ */
+#define swiss_set_foreach(ht, entry)                                     \
+   for (struct swiss_set_entry *entry = _mesa_swiss_set_next_entry(ht, NULL); \
+        entry != NULL;                                                     \
+        entry = _mesa_swiss_set_next_entry(ht, entry))
+
+#ifdef __cplusplus
+} /* extern C */
+#endif
+
+#endif /* _SWISS_SET_H */
@@ -37,6 +37,7 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "util/compress.h"
 #include "util/mesa-sha1.h"
 #include "util/disk_cache.h"
 #include "util/disk_cache_os.h"
@@ -670,6 +671,140 @@ test_put_and_get_between_instances_with_eviction(const char *driver_id)
    disk_cache_destroy(cache[0]);
    disk_cache_destroy(cache[1]);
 }
+
+#ifdef HAVE_ZSTD
+/* Fills buf with something that looks a bit like a shader, all samples of
+ * one flavour share most of their text so that a dictionary helps.
+ */
+static void
+make_dict_sample(char *buf, size_t size, char flavour, unsigned index)
+{
+   size_t len = 0;
+
+   memset(buf, 0, size);
+   for (unsigned i = 0; len + 64 < size; i++) {
+      len += snprintf(buf + len, size - len,
+                      "%c_ssa_%u = fmul %c_ssa_%u, %c_ssa_%u (%u)\n",
+                      flavour, index + i, flavour, i, flavour, i * 7, i % 5);
+   }
+}
+
+/* Trains a dictionary of the given flavour and installs it for the driver
+ * of cache, the next cache instance created for it picks it up.
+ */
+static void
+install_test_dict(void *mem_ctx, struct disk_cache *cache, char flavour)
+{
+   const unsigned num_samples = 256, sample_size = 512;
+   char *samples = (char *) ralloc_size(mem_ctx, num_samples * sample_size);
+   size_t *sample_sizes = ralloc_array(mem_ctx, size_t, num_samples);
+
+   for (unsigned i = 0; i < num_samples; i++) {
+      make_dict_sample(samples + i * sample_size, sample_size, flavour, i);
+      sample_sizes[i] = sample_size;
+   }
+
+   uint8_t dict[4096];
+   size_t dict_size = util_compress_dict_train(dict, sizeof(dict), samples,
+                                               sample_sizes, num_samples);
+   ASSERT_NE(dict_size, 0) << "util_compress_dict_train";
+
+   char *filename = disk_cache_get_dict_filename(mem_ctx, cache->path,
+                                                 cache->driver_keys_blob,
+                                                 cache->driver_keys_blob_size);
+   FILE *f = fopen(filename, "wb");
+   ASSERT_NE(f, nullptr) << "fopen " << filename;
+   EXPECT_EQ(fwrite(dict, 1, dict_size, f), dict_size);
+   fclose(f);
+}
+
+static void
+expect_entry(struct disk_cache *cache, const cache_key key,
+             const char *blob, size_t blob_size, const char *msg)
+{
+   size_t size;
+   char *result = (char *) disk_cache_get(cache, key, &size);
+
+   EXPECT_NE(result, nullptr) << msg << " (pointer)";
+   EXPECT_EQ(size, blob_size) << msg << " (size)";
+   if (result) {
+      EXPECT_EQ(memcmp(result, blob, blob_size), 0) << msg << " (data)";
+      free(result);
+   }
+}
+
+static void
+test_put_and_get_with_dict(void *mem_ctx, const char *driver_id)
+{
+   char plain_blob[1024], dict_blob[1024];
+   uint8_t plain_key[20], dict_key[20];
+   struct disk_cache *cache;
+   size_t size;
+
+#ifdef SHADER_CACHE_DISABLE_BY_DEFAULT
+   setenv("MESA_SHADER_CACHE_DISABLE", "false", 1);
+#endif /* SHADER_CACHE_DISABLE_BY_DEFAULT */
+
+   /* Earlier tests leave tiny size limits behind, don't evict anything. */
+   setenv("MESA_SHADER_CACHE_MAX_SIZE", "1M", 1);
+
+   make_dict_sample(plain_blob, sizeof(plain_blob), 'a', 1000);
+   make_dict_sample(dict_blob, sizeof(dict_blob), 'a', 2000);
+
+   /* Without a dictionary entries are compressed on their own. */
+   cache = disk_cache_create("test_dict", driver_id, 0);
+   EXPECT_EQ(cache->dict, nullptr) << "no dictionary installed yet";
+
+   disk_cache_compute_key(cache, plain_blob, sizeof(plain_blob), plain_key);
+   disk_cache_put(cache, plain_key, plain_blob, sizeof(plain_blob), NULL);
+   disk_cache_wait_for_idle(cache);
+   expect_entry(cache, plain_key, plain_blob, sizeof(plain_blob),
+                "disk_cache_get without a dictionary");
+
+   install_test_dict(mem_ctx, cache, 'a');
+   disk_cache_destroy(cache);
+
+   /* Round trip through the dictionary, the entry is read back by another
+    * instance so it really comes from disk.
+    */
+   cache = disk_cache_create("test_dict", driver_id, 0);
+   EXPECT_NE(cache->dict, nullptr) << "dictionary loaded";
+   uint32_t dict_a_id = util_compress_dict_id(cache->dict);
+
+   disk_cache_compute_key(cache, dict_blob, sizeof(dict_blob), dict_key);
+   disk_cache_put(cache, dict_key, dict_blob, sizeof(dict_blob), NULL);
+   disk_cache_wait_for_idle(cache);
+   disk_cache_destroy(cache);
+
+   cache = disk_cache_create("test_dict", driver_id, 0);
+   expect_entry(cache, dict_key, dict_blob, sizeof(dict_blob),
+                "disk_cache_get with the dictionary");
+   expect_entry(cache, plain_key, plain_blob, sizeof(plain_blob),
+                "disk_cache_get of an entry written without the dictionary");
+
+   /* Entries written with another dictionary are misses, not garbage. */
+   install_test_dict(mem_ctx, cache, 'b');
+   disk_cache_destroy(cache);
+
+   cache = disk_cache_create("test_dict", driver_id, 0);
+   EXPECT_NE(cache->dict, nullptr) << "second dictionary loaded";
+   EXPECT_NE(util_compress_dict_id(cache->dict), dict_a_id)
+      << "dictionaries of different content have different ids";
+
+   char *result = (char *) disk_cache_get(cache, dict_key, &size);
+   EXPECT_EQ(result, nullptr) << "disk_cache_get with another dictionary (pointer)";
+   EXPECT_EQ(size, 0) << "disk_cache_get with another dictionary (size)";
+   free(result);
+
+   expect_entry(cache, plain_key, plain_blob, sizeof(plain_blob),
+                "disk_cache_get of an entry written without a dictionary");
+
+   disk_cache_destroy(cache);
+
+   unsetenv("MESA_SHADER_CACHE_MAX_SIZE");
+}
+#endif /* HAVE_ZSTD */
+
 #endif /* ENABLE_SHADER_CACHE */
 
 class Cache : public ::testing::Test {
@@ -1276,3 +1411,96 @@ TEST_F(Cache, DatabaseMultipartEviction)
    EXPECT_EQ(err, 0) << "Removing " CACHE_TEST_TMP " again";
 #endif
 }
+
+static void
+test_ram_tier(const char *driver_id)
+{
+   const unsigned int entry_size = 2048;
+   const unsigned int num_entries = 200;
+   struct disk_cache_ram_stats stats;
+   uint8_t blob[entry_size];
+   cache_key key, first_key;
+   char *result;
+   size_t size;
+
+   setenv("MESA_SHADER_CACHE_RAM_SIZE", "256K", 1);
+
+   struct disk_cache *cache = disk_cache_create("test", driver_id, 0);
+   EXPECT_NE(cache, nullptr) << "disk_cache_create with RAM tier";
+
+   EXPECT_TRUE(disk_cache_get_ram_stats(cache, &stats));
+   EXPECT_EQ(stats.max_size, 256 * 1024);
+
+   /* A put is visible through the RAM tier before the queue wrote it. */
+   memset(blob, 0x42, entry_size);
+   disk_cache_compute_key(cache, blob, entry_size, first_key);
+   disk_cache_put(cache, first_key, blob, entry_size, NULL);
+
+   result = (char *) disk_cache_get(cache, first_key, &size);
+   EXPECT_NE(result, nullptr) << "disk_cache_get from RAM tier (pointer)";
+   EXPECT_EQ(size, entry_size) << "disk_cache_get from RAM tier (size)";
+   EXPECT_EQ(memcmp(result, blob, entry_size), 0) << "RAM tier data";
+   free(result);
+
+   disk_cache_get_ram_stats(cache, &stats);
+   EXPECT_EQ(stats.hits, 1);
+   EXPECT_EQ(stats.size, entry_size);
+
+   /* Going over the budget evicts entries. */
+   for (unsigned i = 0; i < num_entries; i++) {
+      memset(blob, i, entry_size);
+      disk_cache_compute_key(cache, blob, entry_size, key);
+      disk_cache_put(cache, key, blob, entry_size, NULL);
+   }
+   disk_cache_wait_for_idle(cache);
+
+   disk_cache_get_ram_stats(cache, &stats);
+   EXPECT_GT(stats.evictions, 0);
+   EXPECT_LE(stats.size, stats.max_size);
+
+   /* Removed entries don't linger in the RAM tier. */
+   disk_cache_remove(cache, first_key);
+   result = (char *) disk_cache_get(cache, first_key, &size);
+   EXPECT_EQ(result, nullptr) << "disk_cache_get after remove";
+
+   disk_cache_get_ram_stats(cache, &stats);
+   EXPECT_GE(stats.misses, 1);
+
+   disk_cache_destroy(cache);
+
+   unsetenv("MESA_SHADER_CACHE_RAM_SIZE");
+}
+
+TEST_F(Cache, RamTier)
+{
+   const char *driver_id = "make_check";
+
+#ifndef ENABLE_SHADER_CACHE
+   GTEST_SKIP() << "ENABLE_SHADER_CACHE not defined.";
+#else
+   test_disk_cache_create(mem_ctx, CACHE_DIR_NAME, driver_id);
+
+   test_ram_tier(driver_id);
+
+   int err = rmrf_local(CACHE_TEST_TMP);
+   EXPECT_EQ(err, 0) << "Removing " CACHE_TEST_TMP " again";
+#endif
+}
+
+TEST_F(Cache, Dictionary)
+{
+   const char *driver_id = "make_check";
+
+#ifndef ENABLE_SHADER_CACHE
+   GTEST_SKIP() << "ENABLE_SHADER_CACHE not defined.";
+#elif !defined(HAVE_ZSTD)
+   GTEST_SKIP() << "HAVE_ZSTD not defined.";
+#else
+   test_disk_cache_create(mem_ctx, CACHE_DIR_NAME, driver_id);
+
+   test_put_and_get_with_dict(mem_ctx, driver_id);
+
+   int err = rmrf_local(CACHE_TEST_TMP);
+   EXPECT_EQ(err, 0) << "Removing " CACHE_TEST_TMP " again";
+#endif
+}
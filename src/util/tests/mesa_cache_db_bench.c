@@ -0,0 +1,144 @@
+/*
+ * Copyright © 2023 Sietium Semiconductor
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Lookup throughput of mesa_cache_db with concurrent reader processes.
+ *
+ * The cache is populated once, then 1, 2, 4, ... processes each open the
+ * same db and look up random entries for a fixed time. The aggregate
+ * number of lookups per second is printed for every process count.
+ *
+ * Usage: mesa_cache_db_bench [max_processes] [seconds_per_run]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "util/mesa_cache_db.h"
+#include "util/os_time.h"
+
+#define NUM_ENTRIES 4096
+#define ENTRY_SIZE  2048
+
+static void
+make_key(uint8_t key[20], unsigned i)
+{
+   memset(key, 0, 20);
+   for (unsigned b = 0; b < 20; b++)
+      key[b] = (uint8_t)((i * 2654435761u) >> (b % 4 * 8)) ^ b;
+   memcpy(key, &i, sizeof(i));
+}
+
+static uint64_t
+run_reader(const char *path, unsigned seed, int64_t duration_ns)
+{
+   struct mesa_cache_db db = {0};
+   uint64_t lookups = 0;
+   uint8_t key[20];
+
+   if (!mesa_cache_db_open(&db, path))
+      return 0;
+
+   int64_t end = os_time_get_nano() + duration_ns;
+
+   while (os_time_get_nano() < end) {
+      for (unsigned n = 0; n < 64; n++) {
+         size_t size;
+
+         seed = seed * 1103515245u + 12345u;
+         make_key(key, (seed >> 8) % NUM_ENTRIES);
+
+         void *data = mesa_cache_db_read_entry(&db, key, &size);
+         if (data) {
+            lookups++;
+            free(data);
+         }
+      }
+   }
+
+   mesa_cache_db_close(&db);
+
+   return lookups;
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned max_processes = argc > 1 ? atoi(argv[1]) : 8;
+   unsigned seconds = argc > 2 ? atoi(argv[2]) : 2;
+   char path[] = "/tmp/mesa_cache_db_bench_XXXXXX";
+   struct mesa_cache_db db = {0};
+   uint8_t key[20];
+   uint8_t blob[ENTRY_SIZE];
+
+   if (!mkdtemp(path)) {
+      perror("mkdtemp");
+      return EXIT_FAILURE;
+   }
+
+   if (!mesa_cache_db_open(&db, path)) {
+      fprintf(stderr, "failed to open cache db in %s\n", path);
+      return EXIT_FAILURE;
+   }
+
+   mesa_cache_db_set_size_limit(&db, 1024 * 1024 * 1024);
+
+   for (unsigned i = 0; i < NUM_ENTRIES; i++) {
+      memset(blob, i, sizeof(blob));
+      make_key(key, i);
+
+      if (!mesa_cache_db_entry_write(&db, key, blob, sizeof(blob))) {
+         fprintf(stderr, "failed to write entry %u\n", i);
+         return EXIT_FAILURE;
+      }
+   }
+
+   mesa_cache_db_close(&db);
+
+   uint64_t *results = mmap(NULL, max_processes * sizeof(*results),
+                            PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+   if (results == MAP_FAILED) {
+      perror("mmap");
+      return EXIT_FAILURE;
+   }
+
+   printf("%-10s %16s %16s\n", "processes", "lookups/s", "per process");
+
+   for (unsigned procs = 1; procs <= max_processes; procs *= 2) {
+      int64_t duration_ns = seconds * 1000000000ll;
+
+      for (unsigned p = 0; p < procs; p++) {
+         pid_t pid = fork();
+
+         if (pid == 0) {
+            results[p] = run_reader(path, p + 1, duration_ns);
+            _exit(0);
+         } else if (pid < 0) {
+            perror("fork");
+            return EXIT_FAILURE;
+         }
+      }
+
+      while (wait(NULL) > 0);
+
+      uint64_t total = 0;
+      for (unsigned p = 0; p < procs; p++)
+         total += results[p];
+
+      double rate = (double)total / seconds;
+      printf("%-10u %16.0f %16.0f\n", procs, rate, rate / procs);
+   }
+
+   munmap(results, max_processes * sizeof(*results));
+   mesa_db_wipe_path(path);
+   rmdir(path);
+
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,166 @@
+/*
+ * Copyright © 2023 Sietium Semiconductor
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Compares struct set and struct swiss_set on insert/search/delete mixes.
+ *
+ * Keys are distinct pointers hashed with _mesa_hash_pointer, so the numbers
+ * are dominated by probing rather than by the hash and compare callbacks.
+ * For every table size, each workload runs the same pseudo-random sequence
+ * of operations on both tables and prints million operations per second.
+ *
+ * Usage: swiss_set_bench [operations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "util/hash_table.h"
+#include "util/os_time.h"
+#include "util/set.h"
+#include "util/swiss_set.h"
+
+enum op { OP_INSERT, OP_SEARCH, OP_REMOVE };
+
+struct workload {
+   const char *name;
+   unsigned insert, search, remove; /* percentages */
+};
+
+static const struct workload workloads[] = {
+   { "insert",            100,   0,  0 },
+   { "search",              0, 100,  0 },
+   { "50ins/50search",     50,  50,  0 },
+   { "25ins/50search/25rm", 25, 50, 25 },
+   { "45ins/10search/45rm", 45, 10, 45 },
+};
+
+static bool
+pointer_equals(const void *a, const void *b)
+{
+   return a == b;
+}
+
+static inline enum op
+pick_op(const struct workload *w, uint32_t r)
+{
+   r %= 100;
+   if (r < w->insert)
+      return OP_INSERT;
+   if (r < w->insert + w->search)
+      return OP_SEARCH;
+   return OP_REMOVE;
+}
+
+static const void *
+key_for(uint8_t *keys, uint32_t r, unsigned num_keys)
+{
+   return keys + (r >> 8) % num_keys;
+}
+
+static double
+run_set(const struct workload *w, uint8_t *keys, unsigned num_keys,
+        unsigned num_ops, unsigned *hits)
+{
+   struct set *set = _mesa_set_create(NULL, _mesa_hash_pointer, pointer_equals);
+   uint32_t r = 1;
+
+   /* Searches and removes start from a half full table. */
+   for (unsigned i = 0; i < num_keys; i += 2)
+      _mesa_set_add(set, keys + i);
+
+   int64_t start = os_time_get_nano();
+   for (unsigned i = 0; i < num_ops; i++) {
+      r = r * 1103515245u + 12345u;
+      const void *key = key_for(keys, r, num_keys);
+
+      switch (pick_op(w, r >> 16)) {
+      case OP_INSERT:
+         _mesa_set_add(set, key);
+         break;
+      case OP_SEARCH:
+         *hits += _mesa_set_search(set, key) != NULL;
+         break;
+      case OP_REMOVE:
+         _mesa_set_remove_key(set, key);
+         break;
+      }
+   }
+   int64_t elapsed = os_time_get_nano() - start;
+
+   _mesa_set_destroy(set, NULL);
+   return num_ops / (elapsed / 1e3);
+}
+
+static double
+run_swiss(const struct workload *w, uint8_t *keys, unsigned num_keys,
+          unsigned num_ops, unsigned *hits)
+{
+   struct swiss_set *ht =
+      _mesa_swiss_set_create(NULL, _mesa_hash_pointer, pointer_equals);
+   uint32_t r = 1;
+
+   for (unsigned i = 0; i < num_keys; i += 2)
+      _mesa_swiss_set_add(ht, keys + i);
+
+   int64_t start = os_time_get_nano();
+   for (unsigned i = 0; i < num_ops; i++) {
+      r = r * 1103515245u + 12345u;
+      const void *key = key_for(keys, r, num_keys);
+
+      switch (pick_op(w, r >> 16)) {
+      case OP_INSERT:
+         _mesa_swiss_set_add(ht, key);
+         break;
+      case OP_SEARCH:
+         *hits += _mesa_swiss_set_search(ht, key) != NULL;
+         break;
+      case OP_REMOVE:
+         _mesa_swiss_set_remove_key(ht, key);
+         break;
+      }
+   }
+   int64_t elapsed = os_time_get_nano() - start;
+
+   _mesa_swiss_set_destroy(ht, NULL);
+   return num_ops / (elapsed / 1e3);
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned num_ops = argc > 1 ? atoi(argv[1]) : 4000000;
+   static const unsigned sizes[] = { 64, 4096, 262144 };
+
+   printf("%-10s %-22s %12s %12s %8s\n", "keys", "workload", "set Mops/s",
+          "swiss Mops/s", "speedup");
+
+   for (unsigned s = 0; s < ARRAY_SIZE(sizes); s++) {
+      uint8_t *keys = malloc(sizes[s]);
+      if (!keys)
+         return EXIT_FAILURE;
+
+      for (unsigned w = 0; w < ARRAY_SIZE(workloads); w++) {
+         unsigned set_hits = 0, swiss_hits = 0;
+         double set_rate = run_set(&workloads[w], keys, sizes[s], num_ops,
+                                   &set_hits);
+         double swiss_rate = run_swiss(&workloads[w], keys, sizes[s], num_ops,
+                                       &swiss_hits);
+
+         if (set_hits != swiss_hits) {
+            fprintf(stderr, "mismatch: %u vs %u hits\n", set_hits, swiss_hits);
+            return EXIT_FAILURE;
+         }
+
+         printf("%-10u %-22s %12.1f %12.1f %7.2fx\n", sizes[s],
+                workloads[w].name, set_rate, swiss_rate,
+                swiss_rate / set_rate);
+      }
+
+      free(keys);
+   }
+
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright © 2023 Sietium Semiconductor
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <gtest/gtest.h>
+
+#include "util/hash_table.h"
+#include "util/set.h"
+#include "util/swiss_set.h"
+
+static uint32_t
+key_value(const void *key)
+{
+   return (uint32_t)(uintptr_t)key;
+}
+
+/* A deliberately bad hash so that many keys collide. */
+static uint32_t
+bad_hash(const void *key)
+{
+   return key_value(key) & 0xf;
+}
+
+static bool
+key_equals(const void *a, const void *b)
+{
+   return a == b;
+}
+
+#define KEY(i) ((const void *)(uintptr_t)(i))
+
+TEST(SwissSet, InsertSearchRemove)
+{
+   struct swiss_set *ht =
+      _mesa_swiss_set_create(NULL, _mesa_hash_pointer, key_equals);
+
+   /* Inserting after resizing doesn't rehash. */
+   _mesa_swiss_set_resize(ht, 1000);
+   uint32_t size = ht->size;
+
+   for (uintptr_t i = 1; i <= 1000; i++)
+      _mesa_swiss_set_add(ht, KEY(i));
+   EXPECT_EQ(ht->entries, 1000);
+   EXPECT_EQ(ht->size, size);
+
+   for (uintptr_t i = 1; i <= 1000; i++) {
+      struct swiss_set_entry *entry = _mesa_swiss_set_search(ht, KEY(i));
+      ASSERT_NE(entry, nullptr);
+      EXPECT_EQ(entry->key, KEY(i));
+   }
+   EXPECT_EQ(_mesa_swiss_set_search(ht, KEY(1001)), nullptr);
+
+   /* Adding an existing key keeps one entry. */
+   _mesa_swiss_set_add(ht, KEY(7));
+   EXPECT_EQ(ht->entries, 1000);
+
+   for (uintptr_t i = 1; i <= 1000; i += 2)
+      _mesa_swiss_set_remove_key(ht, KEY(i));
+   EXPECT_EQ(ht->entries, 500);
+
+   for (uintptr_t i = 1; i <= 1000; i++)
+      EXPECT_EQ(_mesa_swiss_set_search(ht, KEY(i)) != NULL, i % 2 == 0);
+
+   unsigned count = 0;
+   swiss_set_foreach(ht, entry) {
+      EXPECT_EQ(key_value(entry->key) % 2, 0);
+      count++;
+   }
+   EXPECT_EQ(count, 500);
+
+   _mesa_swiss_set_clear(ht, NULL);
+   EXPECT_EQ(ht->entries, 0);
+   EXPECT_EQ(_mesa_swiss_set_next_entry(ht, NULL), nullptr);
+
+   _mesa_swiss_set_destroy(ht, NULL);
+}
+
+TEST(SwissSet, SearchOrAdd)
+{
+   struct swiss_set *ht =
+      _mesa_swiss_set_create(NULL, bad_hash, key_equals);
+   bool found;
+
+   struct swiss_set_entry *entry =
+      _mesa_swiss_set_search_or_add(ht, KEY(42), &found);
+   EXPECT_FALSE(found);
+   EXPECT_EQ(entry->key, KEY(42));
+
+   entry = _mesa_swiss_set_search_or_add(ht, KEY(42), &found);
+   EXPECT_TRUE(found);
+   EXPECT_EQ(ht->entries, 1);
+
+   _mesa_swiss_set_destroy(ht, NULL);
+}
+
+/* Random mix of operations checked against struct set, with colliding hashes
+ * and many deletions to exercise tombstones and rehashing.
+ */
+TEST(SwissSet, MatchesSet)
+{
+   for (unsigned pass = 0; pass < 2; pass++) {
+      uint32_t (*hash)(const void *) = pass ? bad_hash : _mesa_hash_pointer;
+      struct swiss_set *ht = _mesa_swiss_set_create(NULL, hash, key_equals);
+      struct set *set = _mesa_set_create(NULL, hash, key_equals);
+      uint32_t seed = 1;
+
+      for (unsigned i = 0; i < 20000; i++) {
+         seed = seed * 1103515245u + 12345u;
+         const void *key = KEY(((seed >> 8) % 512) + 1);
+
+         switch ((seed >> 4) % 3) {
+         case 0:
+            _mesa_swiss_set_add(ht, key);
+            _mesa_set_add(set, key);
+            break;
+         case 1:
+            _mesa_swiss_set_remove_key(ht, key);
+            _mesa_set_remove_key(set, key);
+            break;
+         case 2:
+            EXPECT_EQ(_mesa_swiss_set_search(ht, key) != NULL,
+                      _mesa_set_search(set, key) != NULL);
+            break;
+         }
+
+         ASSERT_EQ(ht->entries, set->entries);
+      }
+
+      swiss_set_foreach(ht, entry)
+         EXPECT_NE(_mesa_set_search(set, entry->key), nullptr);
+
+      _mesa_set_destroy(set, NULL);
+      _mesa_swiss_set_destroy(ht, NULL);
+   }
+}
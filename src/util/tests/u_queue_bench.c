@@ -0,0 +1,154 @@
+/*
+ * Copyright © 2023 Sietium Semiconductor
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Job throughput of util_queue with the shared ring buffer and with
+ * UTIL_QUEUE_INIT_WORK_STEALING.
+ *
+ * "flat" adds all jobs from the main thread and waits for their fences,
+ * like a shader compiler queue. "fan-out" adds a few jobs that each add
+ * many small jobs from inside the queue, then calls util_queue_finish.
+ * Each job spins for about job_ns nanoseconds.
+ *
+ * Usage: u_queue_bench [max_threads] [num_jobs] [job_ns]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "util/os_time.h"
+#include "util/u_atomic.h"
+#include "util/u_queue.h"
+
+#define FAN_OUT 64
+
+struct bench_job {
+   struct util_queue *queue;
+   struct util_queue_fence fence;
+   unsigned num_children;
+};
+
+static unsigned spin_iterations;
+static unsigned sink;
+
+static void
+spin_execute(void *data, void *gdata, int thread_index)
+{
+   unsigned x = thread_index + 1;
+
+   for (unsigned i = 0; i < spin_iterations; i++)
+      x = x * 1664525u + 1013904223u;
+
+   p_atomic_add(&sink, x & 1);
+}
+
+static void
+fan_out_execute(void *data, void *gdata, int thread_index)
+{
+   struct bench_job *job = data;
+
+   for (unsigned i = 0; i < job->num_children; i++)
+      util_queue_add_job(job->queue, job, NULL, spin_execute, NULL, 0);
+}
+
+static void
+calibrate(unsigned job_ns)
+{
+   spin_iterations = 1 << 20;
+
+   int64_t start = os_time_get_nano();
+   spin_execute(NULL, NULL, 0);
+   int64_t elapsed = MAX2(os_time_get_nano() - start, 1);
+
+   spin_iterations = MAX2((uint64_t)spin_iterations * job_ns / elapsed, 1);
+}
+
+static double
+run_flat(struct util_queue *queue, struct bench_job *jobs, unsigned num_jobs)
+{
+   int64_t start = os_time_get_nano();
+
+   for (unsigned i = 0; i < num_jobs; i++)
+      util_queue_add_job(queue, &jobs[i], &jobs[i].fence, spin_execute,
+                         NULL, 0);
+
+   for (unsigned i = 0; i < num_jobs; i++)
+      util_queue_fence_wait(&jobs[i].fence);
+
+   return num_jobs / ((os_time_get_nano() - start) / 1e9);
+}
+
+static double
+run_fan_out(struct util_queue *queue, struct bench_job *jobs,
+            unsigned num_jobs)
+{
+   unsigned num_parents = MAX2(num_jobs / FAN_OUT, 1);
+   int64_t start = os_time_get_nano();
+
+   for (unsigned i = 0; i < num_parents; i++) {
+      jobs[i].queue = queue;
+      jobs[i].num_children = FAN_OUT;
+      util_queue_add_job(queue, &jobs[i], NULL, fan_out_execute, NULL, 0);
+   }
+
+   util_queue_finish(queue);
+
+   return num_parents * (FAN_OUT + 1) /
+          ((os_time_get_nano() - start) / 1e9);
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned max_threads = argc > 1 ? atoi(argv[1]) : 8;
+   unsigned num_jobs = argc > 2 ? atoi(argv[2]) : 200000;
+   unsigned job_ns = argc > 3 ? atoi(argv[3]) : 1000;
+   static const struct {
+      const char *name;
+      unsigned flags;
+   } modes[] = {
+      { "ring", UTIL_QUEUE_INIT_RESIZE_IF_FULL },
+      { "work-stealing", UTIL_QUEUE_INIT_WORK_STEALING },
+   };
+
+   struct bench_job *jobs = calloc(num_jobs, sizeof(*jobs));
+   if (!jobs)
+      return EXIT_FAILURE;
+
+   for (unsigned i = 0; i < num_jobs; i++)
+      util_queue_fence_init(&jobs[i].fence);
+
+   calibrate(job_ns);
+
+   printf("%u jobs of ~%u ns\n", num_jobs, job_ns);
+   printf("%-14s %-8s %16s %16s\n", "mode", "threads", "flat jobs/s",
+          "fan-out jobs/s");
+
+   for (unsigned m = 0; m < ARRAY_SIZE(modes); m++) {
+      for (unsigned threads = 1; threads <= max_threads; threads *= 2) {
+         struct util_queue queue;
+
+         if (!util_queue_init(&queue, "bench", 1024, threads, modes[m].flags,
+                              NULL)) {
+            fprintf(stderr, "failed to create the queue\n");
+            return EXIT_FAILURE;
+         }
+
+         double flat = run_flat(&queue, jobs, num_jobs);
+         double fan_out = run_fan_out(&queue, jobs, num_jobs);
+
+         printf("%-14s %-8u %16.0f %16.0f\n", modes[m].name, threads, flat,
+                fan_out);
+
+         util_queue_destroy(&queue);
+      }
+   }
+
+   for (unsigned i = 0; i < num_jobs; i++)
+      util_queue_fence_destroy(&jobs[i].fence);
+   free(jobs);
+
+   return EXIT_SUCCESS;
+}
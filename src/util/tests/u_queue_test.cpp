@@ -0,0 +1,172 @@
+/*
+ * Copyright © 2023 Sietium Semiconductor
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <gtest/gtest.h>
+
+#include "util/u_atomic.h"
+#include "util/u_queue.h"
+
+#define NUM_JOBS 2000
+
+struct counter_job {
+   unsigned *counter;
+   struct util_queue *queue;
+   struct util_queue_fence fence;
+   unsigned num_children;
+};
+
+static void
+count_execute(void *data, void *gdata, int thread_index)
+{
+   struct counter_job *job = (struct counter_job *)data;
+   p_atomic_inc(job->counter);
+}
+
+static void
+fan_out_execute(void *data, void *gdata, int thread_index)
+{
+   struct counter_job *job = (struct counter_job *)data;
+
+   for (unsigned i = 0; i < job->num_children; i++) {
+      util_queue_add_job(job->queue, job, NULL, count_execute, NULL, 0);
+   }
+   p_atomic_inc(job->counter);
+}
+
+class QueueTest : public ::testing::TestWithParam<unsigned> {};
+
+TEST_P(QueueTest, Fences)
+{
+   struct util_queue queue;
+   static struct counter_job jobs[NUM_JOBS];
+   unsigned counter = 0;
+
+   ASSERT_TRUE(util_queue_init(&queue, "test", 8, 4,
+                               GetParam() | UTIL_QUEUE_INIT_RESIZE_IF_FULL,
+                               NULL));
+
+   for (unsigned i = 0; i < NUM_JOBS; i++) {
+      jobs[i].counter = &counter;
+      util_queue_fence_init(&jobs[i].fence);
+      util_queue_add_job(&queue, &jobs[i], &jobs[i].fence, count_execute,
+                         NULL, 0);
+   }
+
+   for (unsigned i = 0; i < NUM_JOBS; i++) {
+      util_queue_fence_wait(&jobs[i].fence);
+      util_queue_fence_destroy(&jobs[i].fence);
+   }
+
+   EXPECT_EQ(p_atomic_read(&counter), NUM_JOBS);
+   util_queue_destroy(&queue);
+}
+
+TEST_P(QueueTest, NestedJobs)
+{
+   struct util_queue queue;
+   static struct counter_job jobs[NUM_JOBS / 20];
+   unsigned counter = 0;
+
+   ASSERT_TRUE(util_queue_init(&queue, "test", 64, 4,
+                               GetParam() | UTIL_QUEUE_INIT_RESIZE_IF_FULL,
+                               NULL));
+
+   for (unsigned i = 0; i < ARRAY_SIZE(jobs); i++) {
+      jobs[i].counter = &counter;
+      jobs[i].queue = &queue;
+      jobs[i].num_children = 19;
+      util_queue_add_job(&queue, &jobs[i], NULL, fan_out_execute, NULL, 0);
+   }
+
+   /* This must also wait for the jobs added by jobs. */
+   util_queue_finish(&queue);
+   EXPECT_EQ(p_atomic_read(&counter), NUM_JOBS);
+
+   util_queue_destroy(&queue);
+}
+
+struct order_job {
+   unsigned *order;
+   unsigned *num_done;
+   unsigned id;
+   struct util_queue_fence *blocker;
+};
+
+static void
+order_execute(void *data, void *gdata, int thread_index)
+{
+   struct order_job *job = (struct order_job *)data;
+
+   if (job->blocker) {
+      util_queue_fence_wait(job->blocker);
+      return;
+   }
+   job->order[p_atomic_inc_return(job->num_done) - 1] = job->id;
+}
+
+TEST_P(QueueTest, Priorities)
+{
+   struct util_queue queue;
+   struct util_queue_fence blocker, done;
+   unsigned order[3], num_done = 0;
+
+   ASSERT_TRUE(util_queue_init(&queue, "test", 8, 1, GetParam(), NULL));
+
+   /* Keep the only thread busy until all jobs are queued. */
+   util_queue_fence_init(&blocker);
+   util_queue_fence_reset(&blocker);
+   struct order_job block = { NULL, NULL, 0, &blocker };
+   util_queue_add_job(&queue, &block, NULL, order_execute, NULL, 0);
+
+   struct order_job low = { order, &num_done, 0, NULL };
+   struct order_job normal = { order, &num_done, 1, NULL };
+   struct order_job high = { order, &num_done, 2, NULL };
+
+   util_queue_fence_init(&done);
+   util_queue_add_job_prio(&queue, &normal, &done, order_execute, NULL, 0,
+                           UTIL_QUEUE_PRIORITY_NORMAL);
+   util_queue_add_job_prio(&queue, &high, NULL, order_execute, NULL, 0,
+                           UTIL_QUEUE_PRIORITY_HIGH);
+
+   util_queue_fence_signal(&blocker);
+   util_queue_fence_wait(&done);
+   util_queue_finish(&queue);
+
+   EXPECT_EQ(num_done, 2);
+   EXPECT_EQ(order[0], 2);
+   EXPECT_EQ(order[1], 1);
+
+   /* Only work-stealing queues order LOW after NORMAL. */
+   if (GetParam() & UTIL_QUEUE_INIT_WORK_STEALING) {
+      num_done = 0;
+      util_queue_fence_reset(&blocker);
+      util_queue_add_job(&queue, &block, NULL, order_execute, NULL, 0);
+      util_queue_add_job_prio(&queue, &low, NULL, order_execute, NULL, 0,
+                              UTIL_QUEUE_PRIORITY_LOW);
+      util_queue_add_job_prio(&queue, &normal, NULL, order_execute, NULL, 0,
+                              UTIL_QUEUE_PRIORITY_NORMAL);
+      util_queue_add_job_prio(&queue, &high, NULL, order_execute, NULL, 0,
+                              UTIL_QUEUE_PRIORITY_HIGH);
+      util_queue_fence_signal(&blocker);
+      util_queue_finish(&queue);
+
+      EXPECT_EQ(num_done, 3);
+      EXPECT_EQ(order[0], 2);
+      EXPECT_EQ(order[1], 1);
+      EXPECT_EQ(order[2], 0);
+   }
+
+   util_queue_destroy(&queue);
+   util_queue_fence_destroy(&done);
+   util_queue_fence_destroy(&blocker);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+   UtilQueue, QueueTest,
+   ::testing::Values(0u, (unsigned)UTIL_QUEUE_INIT_WORK_STEALING),
+   [](const ::testing::TestParamInfo<unsigned> &info) {
+      return std::string(info.param ? "WorkStealing" : "Ring");
+   });
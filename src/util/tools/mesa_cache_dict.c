@@ -0,0 +1,470 @@
+/*
+ * Copyright © 2023 Sietium Semiconductor
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Trains zstd dictionaries for the entries of a multi-file shader cache
+ * and reports the compression ratio and decompression speed with and
+ * without them. Entries are grouped by the driver keys stored in their
+ * header, each driver gets its own dictionary.
+ *
+ * The dictionary is trained on three quarters of the entries and measured
+ * on the rest. With --write the dictionaries are trained on all entries
+ * and stored in the cache directory, where disk_cache_create() picks them
+ * up.
+ */
+
+#include <ftw.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "util/compress.h"
+#include "util/crc32.h"
+#include "util/macros.h"
+#include "util/disk_cache.h"
+#include "util/disk_cache_os.h"
+#include "util/os_file.h"
+#include "util/os_time.h"
+#include "util/ralloc.h"
+#include "util/u_dynarray.h"
+
+#define DEFAULT_DICT_SIZE (64 * 1024)
+
+/* Minimum time spent decompressing per measurement */
+#define MEASURE_TIME_NS 200000000ll
+
+struct sample {
+   uint8_t *data;
+   size_t size;
+};
+
+struct driver_group {
+   uint8_t *keys_blob;
+   size_t keys_blob_size;
+   const char *driver_id;
+   const char *gpu_name;
+
+   /* the dictionary the cache currently uses for this driver, if any */
+   struct util_compress_dict *current_dict;
+
+   /* struct sample */
+   struct util_dynarray samples;
+   uint64_t on_disk_size;
+};
+
+struct measurement {
+   uint64_t uncompressed_size;
+   uint64_t compressed_size;
+   double decompress_mbps;
+};
+
+static void *mem_ctx;
+static const char *cache_path;
+/* struct driver_group * */
+static struct util_dynarray groups;
+static unsigned num_skipped;
+
+static struct driver_group *
+get_group(const uint8_t *keys_blob, size_t keys_blob_size)
+{
+   util_dynarray_foreach(&groups, struct driver_group *, g) {
+      if ((*g)->keys_blob_size == keys_blob_size &&
+          !memcmp((*g)->keys_blob, keys_blob, keys_blob_size))
+         return *g;
+   }
+
+   struct driver_group *group = rzalloc(mem_ctx, struct driver_group);
+   group->keys_blob = ralloc_size(group, keys_blob_size);
+   memcpy(group->keys_blob, keys_blob, keys_blob_size);
+   group->keys_blob_size = keys_blob_size;
+   /* cache version, driver id and gpu name, see disk_cache_type_create() */
+   group->driver_id = (const char *)group->keys_blob + 1;
+   group->gpu_name = group->driver_id + strlen(group->driver_id) + 1;
+   util_dynarray_init(&group->samples, group);
+
+   char *filename = disk_cache_get_dict_filename(group, cache_path,
+                                                 group->keys_blob,
+                                                 group->keys_blob_size);
+   size_t dict_size;
+   char *dict_data = os_read_file(filename, &dict_size);
+   if (dict_data) {
+      group->current_dict = util_compress_dict_create(dict_data, dict_size);
+      free(dict_data);
+   }
+
+   util_dynarray_append(&groups, struct driver_group *, group);
+
+   return group;
+}
+
+/* Parses an entry written by create_cache_item_header_and_blob() and
+ * stores its decompressed payload in the group of its driver.
+ */
+static bool
+add_entry(const uint8_t *data, size_t size)
+{
+   const uint8_t *end = data + size;
+   const uint8_t *p = data;
+   struct cache_entry_file_data cf_data;
+   uint32_t md_type;
+
+   /* cache version, driver id, gpu name, pointer size, driver flags */
+   p++;
+   for (unsigned i = 0; i < 2; i++) {
+      const uint8_t *nul = p < end ? memchr(p, 0, end - p) : NULL;
+      if (!nul)
+         return false;
+      p = nul + 1;
+   }
+   p += 1 + sizeof(uint64_t);
+
+   size_t keys_blob_size = p - data;
+
+   /* blob_write_uint32() aligns the metadata */
+   p = data + ALIGN_POT(keys_blob_size, sizeof(uint32_t));
+
+   if (p + sizeof(md_type) > end)
+      return false;
+   memcpy(&md_type, p, sizeof(md_type));
+   p += sizeof(md_type);
+
+   if (md_type == CACHE_ITEM_TYPE_GLSL) {
+      uint32_t num_keys;
+
+      if (p + sizeof(num_keys) > end)
+         return false;
+      memcpy(&num_keys, p, sizeof(num_keys));
+      p += sizeof(num_keys) + (size_t)num_keys * sizeof(cache_key);
+   }
+
+   if (p + sizeof(cf_data) > end)
+      return false;
+   memcpy(&cf_data, p, sizeof(cf_data));
+   p += sizeof(cf_data);
+
+   if (cf_data.crc32 != util_hash_crc32(p, end - p))
+      return false;
+
+   struct driver_group *group = get_group(data, keys_blob_size);
+   struct sample sample = {
+      .data = ralloc_size(group, cf_data.uncompressed_size),
+      .size = cf_data.uncompressed_size,
+   };
+
+   /* Entries written with an older dictionary can't be decompressed
+    * anymore, skip them like disk_cache_get() would.
+    */
+   if (!sample.data ||
+       !util_compress_inflate_dict(group->current_dict, p, end - p,
+                                   sample.data, sample.size))
+      return false;
+
+   util_dynarray_append(&group->samples, struct sample, sample);
+   group->on_disk_size += size;
+
+   return true;
+}
+
+static int
+visit_entry(const char *path, const struct stat *sb, int typeflag,
+            struct FTW *ftwbuf)
+{
+   /* Entries are stored as <cache dir>/xx/yyyy... */
+   if (typeflag != FTW_F || ftwbuf->level != 2)
+      return 0;
+
+   size_t size;
+   char *data = os_read_file(path, &size);
+   if (!data || !add_entry((const uint8_t *)data, size))
+      num_skipped++;
+
+   free(data);
+
+   return 0;
+}
+
+static void *
+train(struct driver_group *group, size_t dict_capacity, bool holdout,
+      size_t *dict_size)
+{
+   unsigned num_samples = 0;
+   size_t total_size = 0;
+
+   util_dynarray_foreach(&group->samples, struct sample, s)
+      total_size += s->size;
+
+   uint8_t *buffer = malloc(total_size);
+   size_t *sizes = calloc(util_dynarray_num_elements(&group->samples,
+                                                     struct sample),
+                          sizeof(*sizes));
+   void *dict = malloc(dict_capacity);
+   if (!buffer || !sizes || !dict)
+      goto fail;
+
+   total_size = 0;
+   util_dynarray_foreach(&group->samples, struct sample, s) {
+      unsigned i = s - (struct sample *)group->samples.data;
+
+      if (holdout && i % 4 == 3)
+         continue;
+
+      memcpy(buffer + total_size, s->data, s->size);
+      total_size += s->size;
+      sizes[num_samples++] = s->size;
+   }
+
+   *dict_size = util_compress_dict_train(dict, dict_capacity, buffer, sizes,
+                                         num_samples);
+   if (!*dict_size)
+      goto fail;
+
+   free(buffer);
+   free(sizes);
+   return dict;
+
+fail:
+   free(buffer);
+   free(sizes);
+   free(dict);
+   return NULL;
+}
+
+static bool
+measure(struct driver_group *group, const struct util_compress_dict *dict,
+        struct measurement *m)
+{
+   struct sample *compressed;
+   unsigned num_samples = 0;
+   bool ret = false;
+
+   compressed = calloc(util_dynarray_num_elements(&group->samples,
+                                                  struct sample),
+                       sizeof(*compressed));
+   if (!compressed)
+      return false;
+
+   memset(m, 0, sizeof(*m));
+
+   /* Only the held out entries, the others were used for training. */
+   util_dynarray_foreach(&group->samples, struct sample, s) {
+      unsigned i = s - (struct sample *)group->samples.data;
+      struct sample *c = &compressed[num_samples];
+
+      if (i % 4 != 3)
+         continue;
+
+      c->data = malloc(util_compress_max_compressed_len(s->size));
+      if (!c->data)
+         goto out;
+
+      num_samples++;
+
+      c->size = util_compress_deflate_dict(dict, s->data, s->size, c->data,
+                                           util_compress_max_compressed_len(s->size));
+      if (!c->size)
+         goto out;
+
+      m->uncompressed_size += s->size;
+      m->compressed_size += c->size;
+   }
+
+   if (!num_samples)
+      goto out;
+
+   uint8_t *out = malloc(m->uncompressed_size);
+   if (!out)
+      goto out;
+
+   uint64_t decompressed = 0;
+   int64_t start = os_time_get_nano(), elapsed;
+
+   do {
+      unsigned n = 0;
+
+      util_dynarray_foreach(&group->samples, struct sample, s) {
+         unsigned i = s - (struct sample *)group->samples.data;
+
+         if (i % 4 != 3)
+            continue;
+
+         if (!util_compress_inflate_dict(dict, compressed[n].data,
+                                         compressed[n].size, out, s->size)) {
+            free(out);
+            goto out;
+         }
+
+         decompressed += s->size;
+         n++;
+      }
+
+      elapsed = os_time_get_nano() - start;
+   } while (elapsed < MEASURE_TIME_NS);
+
+   free(out);
+
+   m->decompress_mbps = decompressed / (elapsed / 1e9) / (1024 * 1024);
+   ret = true;
+
+out:
+   for (unsigned i = 0; i < num_samples; i++)
+      free(compressed[i].data);
+   free(compressed);
+
+   return ret;
+}
+
+static bool
+write_dict(struct driver_group *group, size_t dict_capacity)
+{
+   char *filename = disk_cache_get_dict_filename(mem_ctx, cache_path,
+                                                 group->keys_blob,
+                                                 group->keys_blob_size);
+   char *tmp = ralloc_asprintf(mem_ctx, "%s.tmp", filename);
+   size_t dict_size;
+   bool ret = false;
+
+   void *dict = train(group, dict_capacity, false, &dict_size);
+   if (!dict)
+      return false;
+
+   /* Processes may be loading the dictionary right now, replace it
+    * atomically.
+    */
+   FILE *f = fopen(tmp, "wb");
+   if (f) {
+      ret = fwrite(dict, dict_size, 1, f) == 1;
+      ret &= fclose(f) == 0;
+      ret = ret && rename(tmp, filename) == 0;
+      if (!ret)
+         unlink(tmp);
+   }
+
+   if (ret)
+      printf("  wrote %s (%zu bytes)\n", filename, dict_size);
+
+   free(dict);
+
+   return ret;
+}
+
+static void
+print_usage(const char *name)
+{
+   fprintf(stderr,
+           "Usage: %s [options] <cache dir>\n"
+           "\n"
+           "Trains zstd dictionaries on the entries of a multi-file shader\n"
+           "cache and reports ratio and decompression speed with and\n"
+           "without them.\n"
+           "\n"
+           "Options:\n"
+           "  -s, --size <bytes>  dictionary size (default %u)\n"
+           "  -w, --write         store the dictionaries in the cache\n"
+           "  -h, --help          show this help\n",
+           name, DEFAULT_DICT_SIZE);
+}
+
+int
+main(int argc, char **argv)
+{
+   static const struct option opts[] = {
+      { "size",  required_argument, NULL, 's' },
+      { "write", no_argument,       NULL, 'w' },
+      { "help",  no_argument,       NULL, 'h' },
+      { NULL, 0, NULL, 0 },
+   };
+   size_t dict_capacity = DEFAULT_DICT_SIZE;
+   bool write = false;
+   int ret = EXIT_SUCCESS;
+   int c;
+
+   while ((c = getopt_long(argc, argv, "s:wh", opts, NULL)) != -1) {
+      switch (c) {
+      case 's':
+         dict_capacity = strtoul(optarg, NULL, 0);
+         break;
+      case 'w':
+         write = true;
+         break;
+      case 'h':
+         print_usage(argv[0]);
+         return EXIT_SUCCESS;
+      default:
+         print_usage(argv[0]);
+         return EXIT_FAILURE;
+      }
+   }
+
+   if (optind + 1 != argc || !dict_capacity) {
+      print_usage(argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   cache_path = argv[optind];
+
+   mem_ctx = ralloc_context(NULL);
+   util_dynarray_init(&groups, mem_ctx);
+
+   if (nftw(cache_path, visit_entry, 64, FTW_PHYS) == -1) {
+      perror(cache_path);
+      ralloc_free(mem_ctx);
+      return EXIT_FAILURE;
+   }
+
+   if (num_skipped)
+      printf("skipped %u unreadable or foreign files\n", num_skipped);
+
+   util_dynarray_foreach(&groups, struct driver_group *, g) {
+      struct driver_group *group = *g;
+      unsigned num_entries = util_dynarray_num_elements(&group->samples,
+                                                        struct sample);
+      struct measurement before, after;
+      size_t dict_size;
+
+      printf("%s (%s): %u entries, %" PRIu64 " bytes on disk\n",
+             group->driver_id, group->gpu_name, num_entries,
+             group->on_disk_size);
+
+      void *dict_data = train(group, dict_capacity, true, &dict_size);
+      struct util_compress_dict *dict =
+         dict_data ? util_compress_dict_create(dict_data, dict_size) : NULL;
+      free(dict_data);
+
+      if (!dict) {
+         printf("  dictionary training failed, too few entries?\n");
+         continue;
+      }
+
+      if (measure(group, NULL, &before) && measure(group, dict, &after)) {
+         printf("  %-16s %12s %10s %14s\n", "", "compressed", "ratio",
+                "decompress");
+         printf("  %-16s %12" PRIu64 " %9.2fx %9.1f MB/s\n", "no dictionary",
+                before.compressed_size,
+                (double)before.uncompressed_size / before.compressed_size,
+                before.decompress_mbps);
+         printf("  %-16s %12" PRIu64 " %9.2fx %9.1f MB/s\n", "dictionary",
+                after.compressed_size,
+                (double)after.uncompressed_size / after.compressed_size,
+                after.decompress_mbps);
+      } else {
+         printf("  too few entries to measure\n");
+      }
+
+      util_compress_dict_destroy(dict);
+      util_compress_dict_destroy(group->current_dict);
+
+      if (write && !write_dict(group, dict_capacity)) {
+         fprintf(stderr, "  failed to write the dictionary\n");
+         ret = EXIT_FAILURE;
+      }
+   }
+
+   ralloc_free(mem_ctx);
+
+   return ret;
+}
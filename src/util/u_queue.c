@@ -39,6 +39,10 @@
 #include <sys/syscall.h>
 #endif
 
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
 
 /* Define 256MB */
 #define S_256MB (256 * 1024 * 1024)
@@ -237,6 +241,489 @@ util_queue_fence_destroy(struct util_queue_fence *fence)
 }
 #endif
 
+/****************************************************************************
+ * Work-stealing scheduler (UTIL_QUEUE_INIT_WORK_STEALING)
+ *
+ * Every thread owns one Chase-Lev deque per priority. The owner pushes and
+ * takes jobs at the bottom without any locking, idle threads steal from the
+ * top with a compare-and-swap. See "Correct and Efficient Work-Stealing for
+ * Weak Memory Models", Lê et al., PPoPP 2013.
+ *
+ * Jobs added by threads that don't belong to the queue go to a locked list
+ * per priority. A thread that finds it non-empty moves a batch of them to
+ * its own deque, where the other threads can steal them without the lock.
+ *
+ * util_queue::lock is only taken for those lists and for sleeping/waking up
+ * threads when there is no work.
+ */
+
+#define UTIL_QUEUE_WS_INITIAL_SIZE 256
+#define UTIL_QUEUE_WS_INJECT_BATCH 16
+
+struct util_queue_ws_job {
+   struct util_queue_job base;
+   struct list_head link; /* in util_queue_ws::injected */
+};
+
+struct util_queue_ws_array {
+   uint32_t mask;
+   /* Thieves may still read from an array after it has been replaced by
+    * a larger one, so old arrays are only freed with the queue.
+    */
+   struct util_queue_ws_array *prev;
+   struct util_queue_ws_job *slots[];
+};
+
+struct util_queue_ws_deque {
+   /* Free-running indices, the deque holds the jobs in [top, bottom). */
+   uint32_t top;
+   uint32_t bottom;
+   struct util_queue_ws_array *array;
+};
+
+struct util_queue_ws_worker {
+   struct util_queue *queue;
+   unsigned index;
+   uint32_t seed; /* for picking steal victims */
+   struct util_queue_ws_deque deques[UTIL_QUEUE_NUM_PRIORITIES];
+};
+
+struct util_queue_ws {
+   struct util_queue_ws_worker *workers; /* util_queue::max_threads */
+
+   /* Jobs added from outside the queue, protected by util_queue::lock. */
+   struct list_head injected[UTIL_QUEUE_NUM_PRIORITIES];
+   unsigned num_injected[UTIL_QUEUE_NUM_PRIORITIES];
+
+   unsigned num_queued;     /* jobs that no thread has picked up yet */
+   unsigned num_unfinished; /* jobs that haven't completed yet */
+   unsigned num_sleeping;   /* threads waiting for has_queued_cond */
+   cnd_t idle_cond;         /* signalled when num_unfinished drops to 0 */
+};
+
+/* The worker of the calling thread if it's a work-stealing queue thread. */
+static __THREAD_INITIAL_EXEC struct util_queue_ws_worker *ws_current_worker;
+
+static inline void
+ws_full_barrier(void)
+{
+#if defined(_MSC_VER)
+   MemoryBarrier();
+#else
+   __sync_synchronize();
+#endif
+}
+
+static struct util_queue_ws_array *
+ws_array_create(uint32_t size)
+{
+   struct util_queue_ws_array *array =
+      calloc(1, sizeof(*array) + size * sizeof(array->slots[0]));
+
+   if (array)
+      array->mask = size - 1;
+   return array;
+}
+
+/* Owner only. Returns false if the deque was full and couldn't grow. */
+static bool
+ws_deque_push(struct util_queue_ws_deque *dq, struct util_queue_ws_job *job)
+{
+   uint32_t b = p_atomic_read_relaxed(&dq->bottom);
+   uint32_t t = p_atomic_read(&dq->top);
+   struct util_queue_ws_array *array = dq->array;
+
+   if (b - t > array->mask) {
+      struct util_queue_ws_array *grown = ws_array_create((array->mask + 1) * 2);
+      if (!grown)
+         return false;
+
+      for (uint32_t i = t; i != b; i++)
+         grown->slots[i & grown->mask] = array->slots[i & array->mask];
+
+      grown->prev = array;
+      p_atomic_set(&dq->array, grown);
+      array = grown;
+   }
+
+   p_atomic_set(&array->slots[b & array->mask], job);
+   p_atomic_set(&dq->bottom, b + 1);
+   return true;
+}
+
+/* Owner only. Takes the most recently pushed job. */
+static struct util_queue_ws_job *
+ws_deque_take(struct util_queue_ws_deque *dq)
+{
+   struct util_queue_ws_array *array = dq->array;
+   struct util_queue_ws_job *job = NULL;
+   uint32_t b = p_atomic_read_relaxed(&dq->bottom);
+
+   /* top never passes bottom, so this can't miss any job. */
+   if (b == p_atomic_read_relaxed(&dq->top))
+      return NULL;
+
+   b--;
+   p_atomic_set(&dq->bottom, b);
+   ws_full_barrier();
+   uint32_t t = p_atomic_read_relaxed(&dq->top);
+
+   if ((int32_t)(b - t) >= 0) {
+      job = p_atomic_read_relaxed(&array->slots[b & array->mask]);
+
+      if (t == b) {
+         /* The last job, thieves may be trying to get it too. */
+         if (p_atomic_cmpxchg(&dq->top, t, t + 1) != t)
+            job = NULL;
+         p_atomic_set(&dq->bottom, b + 1);
+      }
+   } else {
+      p_atomic_set(&dq->bottom, b + 1);
+   }
+
+   return job;
+}
+
+/* Any thread. Takes the oldest job, or returns NULL if the deque is empty
+ * or another thread won the race for it.
+ */
+static struct util_queue_ws_job *
+ws_deque_steal(struct util_queue_ws_deque *dq)
+{
+   uint32_t t = p_atomic_read(&dq->top);
+   ws_full_barrier();
+   uint32_t b = p_atomic_read(&dq->bottom);
+
+   if ((int32_t)(b - t) <= 0)
+      return NULL;
+
+   struct util_queue_ws_array *array = p_atomic_read(&dq->array);
+   struct util_queue_ws_job *job =
+      p_atomic_read_relaxed(&array->slots[t & array->mask]);
+
+   if (p_atomic_cmpxchg(&dq->top, t, t + 1) != t)
+      return NULL;
+
+   return job;
+}
+
+static void
+ws_destroy(struct util_queue_ws *ws, unsigned num_workers)
+{
+   if (ws->workers) {
+      for (unsigned i = 0; i < num_workers; i++) {
+         for (unsigned p = 0; p < UTIL_QUEUE_NUM_PRIORITIES; p++) {
+            struct util_queue_ws_array *array = ws->workers[i].deques[p].array;
+
+            while (array) {
+               struct util_queue_ws_array *prev = array->prev;
+               free(array);
+               array = prev;
+            }
+         }
+      }
+      free(ws->workers);
+   }
+
+   cnd_destroy(&ws->idle_cond);
+   free(ws);
+}
+
+static struct util_queue_ws *
+ws_create(struct util_queue *queue)
+{
+   struct util_queue_ws *ws = calloc(1, sizeof(*ws));
+   if (!ws)
+      return NULL;
+
+   cnd_init(&ws->idle_cond);
+   for (unsigned p = 0; p < UTIL_QUEUE_NUM_PRIORITIES; p++)
+      list_inithead(&ws->injected[p]);
+
+   ws->workers = calloc(queue->max_threads, sizeof(*ws->workers));
+   if (!ws->workers)
+      goto fail;
+
+   for (unsigned i = 0; i < queue->max_threads; i++) {
+      struct util_queue_ws_worker *w = &ws->workers[i];
+
+      w->queue = queue;
+      w->index = i;
+      w->seed = i * 2654435761u + 1;
+
+      for (unsigned p = 0; p < UTIL_QUEUE_NUM_PRIORITIES; p++) {
+         w->deques[p].array = ws_array_create(UTIL_QUEUE_WS_INITIAL_SIZE);
+         if (!w->deques[p].array)
+            goto fail;
+      }
+   }
+
+   return ws;
+
+fail:
+   ws_destroy(ws, queue->max_threads);
+   return NULL;
+}
+
+/* Pop an injected job and move a batch of the following ones into the
+ * worker's deque.
+ */
+static struct util_queue_ws_job *
+ws_take_injected(struct util_queue *queue, struct util_queue_ws_worker *w,
+                 unsigned prio)
+{
+   struct util_queue_ws *ws = queue->ws;
+   struct list_head *list = &ws->injected[prio];
+   struct util_queue_ws_job *job = NULL;
+
+   mtx_lock(&queue->lock);
+   if (!list_is_empty(list)) {
+      unsigned num_taken = 1;
+
+      job = list_first_entry(list, struct util_queue_ws_job, link);
+      list_del(&job->link);
+
+      unsigned batch = MIN2((ws->num_injected[prio] - 1) / 2,
+                            UTIL_QUEUE_WS_INJECT_BATCH);
+      for (unsigned i = 0; i < batch; i++) {
+         struct util_queue_ws_job *next =
+            list_first_entry(list, struct util_queue_ws_job, link);
+
+         /* Unlink first, other threads may run it as soon as it's pushed. */
+         list_del(&next->link);
+         if (!ws_deque_push(&w->deques[prio], next)) {
+            list_add(&next->link, list);
+            break;
+         }
+         num_taken++;
+      }
+
+      p_atomic_set(&ws->num_injected[prio], ws->num_injected[prio] - num_taken);
+   }
+   mtx_unlock(&queue->lock);
+
+   return job;
+}
+
+static struct util_queue_ws_job *
+ws_find_job(struct util_queue *queue, struct util_queue_ws_worker *w)
+{
+   struct util_queue_ws *ws = queue->ws;
+   struct util_queue_ws_job *job;
+
+   for (int prio = UTIL_QUEUE_NUM_PRIORITIES - 1; prio >= 0; prio--) {
+      job = ws_deque_take(&w->deques[prio]);
+      if (job)
+         return job;
+
+      if (p_atomic_read_relaxed(&ws->num_injected[prio])) {
+         job = ws_take_injected(queue, w, prio);
+         if (job)
+            return job;
+      }
+
+      /* Also steal from threads that have been terminated, their deques
+       * may still have jobs.
+       */
+      w->seed ^= w->seed << 13;
+      w->seed ^= w->seed >> 17;
+      w->seed ^= w->seed << 5;
+
+      unsigned n = queue->max_threads;
+      for (unsigned i = 0, victim = w->seed % n; i < n; i++, victim = (victim + 1) % n) {
+         if (victim == w->index)
+            continue;
+
+         job = ws_deque_steal(&ws->workers[victim].deques[prio]);
+         if (job)
+            return job;
+      }
+   }
+
+   return NULL;
+}
+
+static void
+ws_execute_job(struct util_queue *queue, struct util_queue_ws_job *wj,
+               int thread_index)
+{
+   struct util_queue_ws *ws = queue->ws;
+   struct util_queue_job job = wj->base;
+
+   free(wj);
+
+   job.execute(job.job, job.global_data, thread_index);
+   if (job.fence)
+      util_queue_fence_signal(job.fence);
+   if (job.cleanup)
+      job.cleanup(job.job, job.global_data, thread_index);
+
+   if (p_atomic_dec_zero(&ws->num_unfinished)) {
+      mtx_lock(&queue->lock);
+      cnd_broadcast(&ws->idle_cond);
+      mtx_unlock(&queue->lock);
+   }
+}
+
+static void
+ws_thread_loop(struct util_queue *queue, int thread_index)
+{
+   struct util_queue_ws *ws = queue->ws;
+   struct util_queue_ws_worker *w = &ws->workers[thread_index];
+
+   ws_current_worker = w;
+
+   /* only kill threads that are above "num_threads" */
+   while (thread_index < p_atomic_read_relaxed(&queue->num_threads)) {
+      struct util_queue_ws_job *job = ws_find_job(queue, w);
+
+      if (job) {
+         p_atomic_dec(&ws->num_queued);
+         ws_execute_job(queue, job, thread_index);
+         continue;
+      }
+
+      /* Nothing to do. Producers check num_sleeping after increasing
+       * num_queued, so one of the two sides always sees the other.
+       */
+      mtx_lock(&queue->lock);
+      p_atomic_inc(&ws->num_sleeping);
+      ws_full_barrier();
+      while (thread_index < queue->num_threads &&
+             p_atomic_read(&ws->num_queued) == 0)
+         cnd_wait(&queue->has_queued_cond, &queue->lock);
+      p_atomic_dec(&ws->num_sleeping);
+      mtx_unlock(&queue->lock);
+   }
+
+   ws_current_worker = NULL;
+}
+
+static void
+ws_add_job(struct util_queue *queue,
+           void *job,
+           struct util_queue_fence *fence,
+           util_queue_execute_func execute,
+           util_queue_execute_func cleanup,
+           const size_t job_size,
+           enum util_queue_priority priority)
+{
+   struct util_queue_ws *ws = queue->ws;
+   struct util_queue_ws_worker *w = ws_current_worker;
+   struct util_queue_ws_job *wj;
+
+   /* Nested jobs go to the deque of the current thread without locking. */
+   if (w && w->queue == queue) {
+      wj = malloc(sizeof(*wj));
+      if (!wj)
+         return;
+
+      if (fence)
+         util_queue_fence_reset(fence);
+
+      wj->base = (struct util_queue_job) {
+         .job = job,
+         .global_data = queue->global_data,
+         .job_size = job_size,
+         .fence = fence,
+         .execute = execute,
+         .cleanup = cleanup,
+      };
+
+      p_atomic_inc(&ws->num_unfinished);
+      if (ws_deque_push(&w->deques[priority], wj)) {
+         p_atomic_inc(&ws->num_queued);
+         ws_full_barrier();
+         if (p_atomic_read_relaxed(&ws->num_sleeping)) {
+            mtx_lock(&queue->lock);
+            cnd_signal(&queue->has_queued_cond);
+            mtx_unlock(&queue->lock);
+         }
+         return;
+      }
+
+      /* Out of memory for a larger deque, use the injection list. */
+      mtx_lock(&queue->lock);
+   } else {
+      /* Scale the number of threads up if there's already one job waiting. */
+      if (queue->flags & UTIL_QUEUE_INIT_SCALE_THREADS &&
+          p_atomic_read(&ws->num_queued) > 0 &&
+          p_atomic_read_relaxed(&queue->num_threads) < queue->max_threads)
+         util_queue_adjust_num_threads(queue, queue->num_threads + 1);
+
+      mtx_lock(&queue->lock);
+      if (queue->num_threads == 0) {
+         mtx_unlock(&queue->lock);
+         /* well no good option here, but any leaks will be
+          * short-lived as things are shutting down..
+          */
+         return;
+      }
+
+      wj = malloc(sizeof(*wj));
+      if (!wj) {
+         mtx_unlock(&queue->lock);
+         return;
+      }
+
+      if (fence)
+         util_queue_fence_reset(fence);
+
+      wj->base = (struct util_queue_job) {
+         .job = job,
+         .global_data = queue->global_data,
+         .job_size = job_size,
+         .fence = fence,
+         .execute = execute,
+         .cleanup = cleanup,
+      };
+
+      p_atomic_inc(&ws->num_unfinished);
+   }
+
+   /* Sleeping threads check num_queued with the lock held. */
+   list_addtail(&wj->link, &ws->injected[priority]);
+   p_atomic_inc(&ws->num_injected[priority]);
+   p_atomic_inc(&ws->num_queued);
+   if (ws->num_sleeping)
+      cnd_signal(&queue->has_queued_cond);
+   mtx_unlock(&queue->lock);
+}
+
+/* Called with all threads terminated. Like the ring buffer, signal the
+ * fences of the jobs that will never run.
+ */
+static void
+ws_signal_remaining_jobs(struct util_queue *queue)
+{
+   struct util_queue_ws *ws = queue->ws;
+
+   for (unsigned p = 0; p < UTIL_QUEUE_NUM_PRIORITIES; p++) {
+      struct util_queue_ws_job *job;
+
+      for (unsigned i = 0; i < queue->max_threads; i++) {
+         while ((job = ws_deque_steal(&ws->workers[i].deques[p]))) {
+            if (job->base.fence)
+               util_queue_fence_signal(job->base.fence);
+            free(job);
+         }
+      }
+
+      list_for_each_entry_safe(struct util_queue_ws_job, job,
+                               &ws->injected[p], link) {
+         if (job->base.fence)
+            util_queue_fence_signal(job->base.fence);
+         free(job);
+      }
+      list_inithead(&ws->injected[p]);
+      ws->num_injected[p] = 0;
+   }
+
+   ws->num_queued = 0;
+   ws->num_unfinished = 0;
+   cnd_broadcast(&ws->idle_cond);
+}
+
 /****************************************************************************
  * util_queue implementation
  */
@@ -279,6 +766,11 @@ util_queue_thread_func(void *input)
       u_thread_setname(name);
    }
 
+   if (queue->ws) {
+      ws_thread_loop(queue, thread_index);
+      return 0;
+   }
+
    while (1) {
       struct util_queue_job job;
 
@@ -453,6 +945,12 @@ util_queue_init(struct util_queue *queue,
    if (!queue->jobs)
       goto fail;
 
+   if (flags & UTIL_QUEUE_INIT_WORK_STEALING) {
+      queue->ws = ws_create(queue);
+      if (!queue->ws)
+         goto fail;
+   }
+
    queue->threads = (thrd_t*) calloc(queue->max_threads, sizeof(thrd_t));
    if (!queue->threads)
       goto fail;
@@ -477,6 +975,9 @@ util_queue_init(struct util_queue *queue,
 fail:
    free(queue->threads);
 
+   if (queue->ws)
+      ws_destroy(queue->ws, queue->max_threads);
+
    if (queue->jobs) {
       cnd_destroy(&queue->has_space_cond);
       cnd_destroy(&queue->has_queued_cond);
@@ -515,6 +1016,12 @@ util_queue_kill_threads(struct util_queue *queue, unsigned keep_num_threads,
    for (i = keep_num_threads; i < old_num_threads; i++)
       thrd_join(queue->threads[i], NULL);
 
+   if (queue->ws && keep_num_threads == 0) {
+      mtx_lock(&queue->lock);
+      ws_signal_remaining_jobs(queue);
+      mtx_unlock(&queue->lock);
+   }
+
    if (!finish_locked)
       simple_mtx_unlock(&queue->finish_lock);
 }
@@ -540,6 +1047,8 @@ util_queue_destroy(struct util_queue *queue)
    cnd_destroy(&queue->has_queued_cond);
    simple_mtx_destroy(&queue->finish_lock);
    mtx_destroy(&queue->lock);
+   if (queue->ws)
+      ws_destroy(queue->ws, queue->max_threads);
    free(queue->jobs);
    free(queue->threads);
 }
@@ -551,9 +1060,29 @@ util_queue_add_job(struct util_queue *queue,
                    util_queue_execute_func execute,
                    util_queue_execute_func cleanup,
                    const size_t job_size)
+{
+   util_queue_add_job_prio(queue, job, fence, execute, cleanup, job_size,
+                           UTIL_QUEUE_PRIORITY_NORMAL);
+}
+
+void
+util_queue_add_job_prio(struct util_queue *queue,
+                        void *job,
+                        struct util_queue_fence *fence,
+                        util_queue_execute_func execute,
+                        util_queue_execute_func cleanup,
+                        const size_t job_size,
+                        enum util_queue_priority priority)
 {
    struct util_queue_job *ptr;
 
+   assert(priority < UTIL_QUEUE_NUM_PRIORITIES);
+
+   if (queue->ws) {
+      ws_add_job(queue, job, fence, execute, cleanup, job_size, priority);
+      return;
+   }
+
    mtx_lock(&queue->lock);
    if (queue->num_threads == 0) {
       mtx_unlock(&queue->lock);
@@ -611,7 +1140,15 @@ util_queue_add_job(struct util_queue *queue,
       }
    }
 
-   ptr = &queue->jobs[queue->write_idx];
+   if (priority == UTIL_QUEUE_PRIORITY_HIGH) {
+      /* Put it in front of everything else. */
+      queue->read_idx = (queue->read_idx + queue->max_jobs - 1) % queue->max_jobs;
+      ptr = &queue->jobs[queue->read_idx];
+   } else {
+      ptr = &queue->jobs[queue->write_idx];
+      queue->write_idx = (queue->write_idx + 1) % queue->max_jobs;
+   }
+
    assert(ptr->job == NULL);
    ptr->job = job;
    ptr->global_data = queue->global_data;
@@ -620,7 +1157,6 @@ util_queue_add_job(struct util_queue *queue,
    ptr->cleanup = cleanup;
    ptr->job_size = job_size;
 
-   queue->write_idx = (queue->write_idx + 1) % queue->max_jobs;
    queue->total_jobs_size += ptr->job_size;
 
    queue->num_queued++;
@@ -646,6 +1182,14 @@ util_queue_drop_job(struct util_queue *queue, struct util_queue_fence *fence)
    if (util_queue_fence_is_signalled(fence))
       return;
 
+   /* Jobs can't be removed from the middle of the deques, the job runs
+    * normally and we only wait for it.
+    */
+   if (queue->ws) {
+      util_queue_fence_wait(fence);
+      return;
+   }
+
    mtx_lock(&queue->lock);
    for (unsigned i = queue->read_idx; i != queue->write_idx;
         i = (i + 1) % queue->max_jobs) {
@@ -688,6 +1232,19 @@ util_queue_finish(struct util_queue *queue)
       return;
    }
 
+   /* Threads don't execute jobs in order, so barrier jobs wouldn't wait
+    * for all previous jobs. Wait for the queue to become idle instead,
+    * which also covers jobs added by jobs.
+    */
+   if (queue->ws) {
+      mtx_lock(&queue->lock);
+      while (p_atomic_read(&queue->ws->num_unfinished))
+         cnd_wait(&queue->ws->idle_cond, &queue->lock);
+      mtx_unlock(&queue->lock);
+      simple_mtx_unlock(&queue->finish_lock);
+      return;
+   }
+
    fences = malloc(queue->num_threads * sizeof(*fences));
    util_barrier_init(&barrier, queue->num_threads);
 
@@ -51,6 +51,13 @@ extern "C" {
 #define UTIL_QUEUE_INIT_RESIZE_IF_FULL            (1 << 1)
 #define UTIL_QUEUE_INIT_SET_FULL_THREAD_AFFINITY  (1 << 2)
 #define UTIL_QUEUE_INIT_SCALE_THREADS             (1 << 3)
+/* Give every thread its own job deque and let idle threads steal from the
+ * others instead of all threads sharing one locked ring buffer. Jobs added
+ * from inside a job of the same queue go to the current thread's deque
+ * without taking any lock. max_jobs and RESIZE_IF_FULL are ignored, the
+ * deques grow as needed.
+ */
+#define UTIL_QUEUE_INIT_WORK_STEALING             (1 << 4)
 
 #if UTIL_FUTEX_SUPPORTED
 #define UTIL_QUEUE_FENCE_FUTEX
@@ -193,6 +200,18 @@ util_queue_fence_wait_timeout(struct util_queue_fence *fence,
 
 typedef void (*util_queue_execute_func)(void *job, void *gdata, int thread_index);
 
+/* Higher priority jobs are executed first. Work-stealing queues honour all
+ * levels, ring buffer queues only move HIGH jobs to the front of the ring.
+ */
+enum util_queue_priority {
+   UTIL_QUEUE_PRIORITY_LOW,
+   UTIL_QUEUE_PRIORITY_NORMAL,
+   UTIL_QUEUE_PRIORITY_HIGH,
+   UTIL_QUEUE_NUM_PRIORITIES,
+};
+
+struct util_queue_ws;
+
 struct util_queue_job {
    void *job;
    void *global_data;
@@ -219,6 +238,7 @@ struct util_queue {
    size_t total_jobs_size;  /* memory use of all jobs in the queue */
    struct util_queue_job *jobs;
    void *global_data;
+   struct util_queue_ws *ws; /* only with UTIL_QUEUE_INIT_WORK_STEALING */
 
    /* for cleanup at exit(), protected by exit_mutex */
    struct list_head head;
@@ -239,6 +259,13 @@ void util_queue_add_job(struct util_queue *queue,
                         util_queue_execute_func execute,
                         util_queue_execute_func cleanup,
                         const size_t job_size);
+void util_queue_add_job_prio(struct util_queue *queue,
+                             void *job,
+                             struct util_queue_fence *fence,
+                             util_queue_execute_func execute,
+                             util_queue_execute_func cleanup,
+                             const size_t job_size,
+                             enum util_queue_priority priority);
 void util_queue_drop_job(struct util_queue *queue,
                          struct util_queue_fence *fence);
 
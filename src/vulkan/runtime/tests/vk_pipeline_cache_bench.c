@@ -0,0 +1,184 @@
+/*
+ * Copyright © 2023 Sietium Semiconductor
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Lock contention in vk_pipeline_cache.
+ *
+ * Every thread does a mix of vk_pipeline_cache_lookup_object() on a set of
+ * hot keys that are already in the cache and vk_pipeline_cache_add_object()
+ * of keys nobody has seen before, like several threads compiling pipelines
+ * against one application cache.  There is no driver behind the cache, only
+ * enough of a vk_device to create it.
+ *
+ * Usage: vk_pipeline_cache_bench [max_threads] [ops_per_thread] [insert_pct]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "c11/threads.h"
+#include "util/os_time.h"
+
+#include "vk_alloc.h"
+#include "vk_device.h"
+#include "vk_physical_device.h"
+#include "vk_pipeline_cache.h"
+
+#define NUM_HOT_KEYS 4096
+
+struct bench_object {
+   struct vk_pipeline_cache_object base;
+   uint64_t key[2];
+};
+
+struct bench_thread {
+   struct vk_pipeline_cache *cache;
+   unsigned index;
+   unsigned num_ops;
+   unsigned insert_pct;
+   unsigned misses;
+   thrd_t thread;
+};
+
+static void
+bench_object_destroy(struct vk_device *device,
+                     struct vk_pipeline_cache_object *object)
+{
+   vk_pipeline_cache_object_finish(object);
+   free(object);
+}
+
+static const struct vk_pipeline_cache_object_ops bench_object_ops = {
+   .destroy = bench_object_destroy,
+};
+
+static VKAPI_ATTR void VKAPI_CALL
+bench_GetPhysicalDeviceProperties(VkPhysicalDevice physicalDevice,
+                                  VkPhysicalDeviceProperties *pProperties)
+{
+   memset(pProperties, 0, sizeof(*pProperties));
+}
+
+static void
+add_object(struct vk_pipeline_cache *cache, uint64_t k0, uint64_t k1)
+{
+   struct bench_object *obj = calloc(1, sizeof(*obj));
+   if (!obj)
+      abort();
+
+   obj->key[0] = k0;
+   obj->key[1] = k1;
+   vk_pipeline_cache_object_init(cache->base.device, &obj->base,
+                                 &bench_object_ops, obj->key,
+                                 sizeof(obj->key));
+
+   vk_pipeline_cache_object_unref(cache->base.device,
+                                  vk_pipeline_cache_add_object(cache,
+                                                               &obj->base));
+}
+
+static int
+bench_thread_func(void *data)
+{
+   struct bench_thread *t = data;
+   uint32_t rng = t->index * 2654435761u + 1;
+   uint64_t next_new = 0;
+
+   for (unsigned i = 0; i < t->num_ops; i++) {
+      rng ^= rng << 13;
+      rng ^= rng >> 17;
+      rng ^= rng << 5;
+
+      if (rng % 100 < t->insert_pct) {
+         add_object(t->cache, t->index + 1, next_new++);
+      } else {
+         uint64_t key[2] = { 0, rng % NUM_HOT_KEYS };
+         struct vk_pipeline_cache_object *obj =
+            vk_pipeline_cache_lookup_object(t->cache, key, sizeof(key),
+                                            &bench_object_ops, NULL);
+         if (obj)
+            vk_pipeline_cache_object_unref(t->cache->base.device, obj);
+         else
+            t->misses++;
+      }
+   }
+
+   return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned max_threads = argc > 1 ? atoi(argv[1]) : 64;
+   unsigned num_ops = argc > 2 ? atoi(argv[2]) : 200000;
+   unsigned insert_pct = argc > 3 ? atoi(argv[3]) : 10;
+
+   struct vk_physical_device pdevice = { 0 };
+   pdevice.base.type = VK_OBJECT_TYPE_PHYSICAL_DEVICE;
+   pdevice.dispatch_table.GetPhysicalDeviceProperties =
+      bench_GetPhysicalDeviceProperties;
+
+   struct vk_device device = { 0 };
+   device.base.type = VK_OBJECT_TYPE_DEVICE;
+   device.alloc = *vk_default_allocator();
+   device.physical = &pdevice;
+
+   struct bench_thread *threads = calloc(max_threads, sizeof(*threads));
+   if (!threads)
+      return EXIT_FAILURE;
+
+   printf("%u ops per thread, %u%% inserts\n", num_ops, insert_pct);
+   printf("%-8s %16s %16s\n", "threads", "ops/s", "ops/s/thread");
+
+   for (unsigned num_threads = 1; num_threads <= max_threads;
+        num_threads *= 2) {
+      struct vk_pipeline_cache_create_info info = { .force_enable = true };
+      struct vk_pipeline_cache *cache =
+         vk_pipeline_cache_create(&device, &info, NULL);
+      if (!cache)
+         return EXIT_FAILURE;
+
+      for (uint64_t k = 0; k < NUM_HOT_KEYS; k++)
+         add_object(cache, 0, k);
+
+      int64_t start = os_time_get_nano();
+
+      for (unsigned i = 0; i < num_threads; i++) {
+         threads[i] = (struct bench_thread) {
+            .cache = cache,
+            .index = i,
+            .num_ops = num_ops,
+            .insert_pct = insert_pct,
+         };
+         if (thrd_create(&threads[i].thread, bench_thread_func,
+                         &threads[i]) != thrd_success)
+            return EXIT_FAILURE;
+      }
+
+      unsigned misses = 0;
+      for (unsigned i = 0; i < num_threads; i++) {
+         thrd_join(threads[i].thread, NULL);
+         misses += threads[i].misses;
+      }
+
+      /* Every hot key was added up front, so all lookups must hit. */
+      if (misses) {
+         fprintf(stderr, "%u lookups of hot keys missed\n", misses);
+         return EXIT_FAILURE;
+      }
+
+      double secs = (os_time_get_nano() - start) / 1e9;
+      double ops = (double)num_ops * num_threads / secs;
+
+      printf("%-8u %16.0f %16.0f\n", num_threads, ops, ops / num_threads);
+
+      vk_pipeline_cache_destroy(cache, NULL);
+   }
+
+   free(threads);
+
+   return EXIT_SUCCESS;
+}
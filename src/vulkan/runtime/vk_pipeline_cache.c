@@ -35,7 +35,7 @@
 #include "util/u_debug.h"
 #include "util/disk_cache.h"
 #include "util/hash_table.h"
-#include "util/set.h"
+#include "util/swiss_set.h"
 
 struct raw_data_object {
    struct vk_pipeline_cache_object base;
@@ -142,19 +142,35 @@ object_key_hash(const void *void_object)
    return _mesa_hash_data(object->key_data, object->key_size);
 }
 
-static void
-vk_pipeline_cache_lock(struct vk_pipeline_cache *cache)
+static bool
+vk_pipeline_cache_is_enabled(const struct vk_pipeline_cache *cache)
 {
+   return cache->shards[0].object_cache != NULL;
+}
 
+/* The swiss_set probes with the low bits of the hash, so pick the shard
+ * from the high bits.
+ */
+static struct vk_pipeline_cache_shard *
+vk_pipeline_cache_get_shard(struct vk_pipeline_cache *cache, uint32_t hash)
+{
+   return &cache->shards[(hash >> 24) % VK_PIPELINE_CACHE_NUM_SHARDS];
+}
+
+static void
+vk_pipeline_cache_lock(struct vk_pipeline_cache *cache,
+                       struct vk_pipeline_cache_shard *shard)
+{
    if (!(cache->flags & VK_PIPELINE_CACHE_CREATE_EXTERNALLY_SYNCHRONIZED_BIT))
-      simple_mtx_lock(&cache->lock);
+      simple_mtx_lock(&shard->lock);
 }
 
 static void
-vk_pipeline_cache_unlock(struct vk_pipeline_cache *cache)
+vk_pipeline_cache_unlock(struct vk_pipeline_cache *cache,
+                         struct vk_pipeline_cache_shard *shard)
 {
    if (!(cache->flags & VK_PIPELINE_CACHE_CREATE_EXTERNALLY_SYNCHRONIZED_BIT))
-      simple_mtx_unlock(&cache->lock);
+      simple_mtx_unlock(&shard->lock);
 }
 
 static void
@@ -162,16 +178,19 @@ vk_pipeline_cache_remove_object(struct vk_pipeline_cache *cache,
                                 uint32_t hash,
                                 struct vk_pipeline_cache_object *object)
 {
-   vk_pipeline_cache_lock(cache);
-   struct set_entry *entry =
-      _mesa_set_search_pre_hashed(cache->object_cache, hash, object);
+   struct vk_pipeline_cache_shard *shard =
+      vk_pipeline_cache_get_shard(cache, hash);
+
+   vk_pipeline_cache_lock(cache, shard);
+   struct swiss_set_entry *entry =
+      _mesa_swiss_set_search_pre_hashed(shard->object_cache, hash, object);
    if (entry && entry->key == (const void *)object) {
       /* Drop the reference owned by the cache */
       vk_pipeline_cache_object_unref(cache->base.device, object);
 
-      _mesa_set_remove(cache->object_cache, entry);
+      _mesa_swiss_set_remove(shard->object_cache, entry);
    }
-   vk_pipeline_cache_unlock(cache);
+   vk_pipeline_cache_unlock(cache, shard);
 
    /* Drop our reference */
    vk_pipeline_cache_object_unref(cache->base.device, object);
@@ -186,9 +205,12 @@ vk_pipeline_cache_replace_object(struct vk_pipeline_cache *cache,
 {
    assert(object_keys_equal(search, replace));
 
-   vk_pipeline_cache_lock(cache);
-   struct set_entry *entry =
-      _mesa_set_search_pre_hashed(cache->object_cache, hash, search);
+   struct vk_pipeline_cache_shard *shard =
+      vk_pipeline_cache_get_shard(cache, hash);
+
+   vk_pipeline_cache_lock(cache, shard);
+   struct swiss_set_entry *entry =
+      _mesa_swiss_set_search_pre_hashed(shard->object_cache, hash, search);
 
    struct vk_pipeline_cache_object *found = NULL;
    if (entry) {
@@ -203,9 +225,9 @@ vk_pipeline_cache_replace_object(struct vk_pipeline_cache *cache,
    } else {
       /* I guess the object was purged?  Re-add it to the cache */
       vk_pipeline_cache_object_ref(replace);
-      _mesa_set_add_pre_hashed(cache->object_cache, hash, replace);
+      _mesa_swiss_set_add_pre_hashed(shard->object_cache, hash, replace);
    }
-   vk_pipeline_cache_unlock(cache);
+   vk_pipeline_cache_unlock(cache, shard);
 
    vk_pipeline_cache_object_unref(cache->base.device, search);
 
@@ -306,15 +328,17 @@ vk_pipeline_cache_insert_object(struct vk_pipeline_cache *cache,
 {
    assert(object->ops != NULL);
 
-   if (cache->object_cache == NULL)
+   if (!vk_pipeline_cache_is_enabled(cache))
       return object;
 
    uint32_t hash = object_key_hash(object);
+   struct vk_pipeline_cache_shard *shard =
+      vk_pipeline_cache_get_shard(cache, hash);
 
-   vk_pipeline_cache_lock(cache);
+   vk_pipeline_cache_lock(cache, shard);
    bool found = false;
-   struct set_entry *entry = _mesa_set_search_or_add_pre_hashed(
-       cache->object_cache, hash, object, &found);
+   struct swiss_set_entry *entry = _mesa_swiss_set_search_or_add_pre_hashed(
+       shard->object_cache, hash, object, &found);
 
    struct vk_pipeline_cache_object *result = NULL;
    /* add reference to either the found or inserted object */
@@ -323,7 +347,7 @@ vk_pipeline_cache_insert_object(struct vk_pipeline_cache *cache,
    } else {
       result = vk_pipeline_cache_object_ref(object);
    }
-   vk_pipeline_cache_unlock(cache);
+   vk_pipeline_cache_unlock(cache, shard);
 
    if (found) {
       vk_pipeline_cache_object_unref(cache->base.device, object);
@@ -351,22 +375,25 @@ vk_pipeline_cache_lookup_object(struct vk_pipeline_cache *cache,
 
    struct vk_pipeline_cache_object *object = NULL;
 
-   if (cache != NULL && cache->object_cache != NULL) {
-      vk_pipeline_cache_lock(cache);
-      struct set_entry *entry =
-         _mesa_set_search_pre_hashed(cache->object_cache, hash, &key);
+   if (cache != NULL && vk_pipeline_cache_is_enabled(cache)) {
+      struct vk_pipeline_cache_shard *shard =
+         vk_pipeline_cache_get_shard(cache, hash);
+
+      vk_pipeline_cache_lock(cache, shard);
+      struct swiss_set_entry *entry =
+         _mesa_swiss_set_search_pre_hashed(shard->object_cache, hash, &key);
       if (entry) {
          object = vk_pipeline_cache_object_ref((void *)entry->key);
          if (cache_hit != NULL)
             *cache_hit = true;
       }
-      vk_pipeline_cache_unlock(cache);
+      vk_pipeline_cache_unlock(cache, shard);
    }
 
    if (object == NULL) {
 #ifdef ENABLE_SHADER_CACHE
       struct disk_cache *disk_cache = cache->base.device->physical->disk_cache;
-      if (disk_cache != NULL && cache->object_cache != NULL) {
+      if (disk_cache != NULL && vk_pipeline_cache_is_enabled(cache)) {
          cache_key cache_key;
          disk_cache_compute_key(disk_cache, key_data, key_size, cache_key);
 
@@ -641,15 +668,27 @@ vk_pipeline_cache_create(struct vk_device *device,
    };
    memcpy(cache->header.uuid, pdevice_props.pipelineCacheUUID, VK_UUID_SIZE);
 
-   simple_mtx_init(&cache->lock, mtx_plain);
+   for (unsigned i = 0; i < VK_PIPELINE_CACHE_NUM_SHARDS; i++)
+      simple_mtx_init(&cache->shards[i].lock, mtx_plain);
 
    if (info->force_enable ||
        debug_get_bool_option("VK_ENABLE_PIPELINE_CACHE", true)) {
-      cache->object_cache = _mesa_set_create(NULL, object_key_hash,
-                                             object_keys_equal);
+      for (unsigned i = 0; i < VK_PIPELINE_CACHE_NUM_SHARDS; i++) {
+         cache->shards[i].object_cache =
+            _mesa_swiss_set_create(NULL, object_key_hash, object_keys_equal);
+         if (cache->shards[i].object_cache == NULL) {
+            /* Leave the cache disabled rather than partially sharded */
+            for (unsigned j = 0; j < i; j++) {
+               _mesa_swiss_set_destroy(cache->shards[j].object_cache, NULL);
+               cache->shards[j].object_cache = NULL;
+            }
+            break;
+         }
+      }
    }
 
-   if (cache->object_cache && pCreateInfo->initialDataSize > 0) {
+   if (vk_pipeline_cache_is_enabled(cache) &&
+       pCreateInfo->initialDataSize > 0) {
       vk_pipeline_cache_load(cache, pCreateInfo->pInitialData,
                              pCreateInfo->initialDataSize);
    }
@@ -661,17 +700,40 @@ void
 vk_pipeline_cache_destroy(struct vk_pipeline_cache *cache,
                           const VkAllocationCallbacks *pAllocator)
 {
-   if (cache->object_cache) {
-      set_foreach_remove(cache->object_cache, entry) {
-         vk_pipeline_cache_object_unref(cache->base.device,
-                                        (void *)entry->key);
+   for (unsigned i = 0; i < VK_PIPELINE_CACHE_NUM_SHARDS; i++) {
+      struct vk_pipeline_cache_shard *shard = &cache->shards[i];
+
+      if (shard->object_cache) {
+         swiss_set_foreach(shard->object_cache, entry) {
+            vk_pipeline_cache_object_unref(cache->base.device,
+                                           (void *)entry->key);
+         }
+         _mesa_swiss_set_destroy(shard->object_cache, NULL);
       }
-      _mesa_set_destroy(cache->object_cache, NULL);
+      simple_mtx_destroy(&shard->lock);
    }
-   simple_mtx_destroy(&cache->lock);
    vk_object_free(cache->base.device, pAllocator, cache);
 }
 
+uint32_t
+vk_pipeline_cache_num_objects(struct vk_pipeline_cache *cache)
+{
+   uint32_t count = 0;
+
+   if (!vk_pipeline_cache_is_enabled(cache))
+      return 0;
+
+   for (unsigned i = 0; i < VK_PIPELINE_CACHE_NUM_SHARDS; i++) {
+      struct vk_pipeline_cache_shard *shard = &cache->shards[i];
+
+      vk_pipeline_cache_lock(cache, shard);
+      count += shard->object_cache->entries;
+      vk_pipeline_cache_unlock(cache, shard);
+   }
+
+   return count;
+}
+
 VKAPI_ATTR VkResult VKAPI_CALL
 vk_common_CreatePipelineCache(VkDevice _device,
                               const VkPipelineCacheCreateInfo *pCreateInfo,
@@ -733,49 +795,55 @@ vk_common_GetPipelineCacheData(VkDevice _device,
       return VK_INCOMPLETE;
    }
 
-   vk_pipeline_cache_lock(cache);
-
    VkResult result = VK_SUCCESS;
-   if (cache->object_cache != NULL) {
-      set_foreach(cache->object_cache, entry) {
-         struct vk_pipeline_cache_object *object = (void *)entry->key;
+   if (vk_pipeline_cache_is_enabled(cache)) {
+      for (unsigned i = 0; i < VK_PIPELINE_CACHE_NUM_SHARDS &&
+                           result == VK_SUCCESS; i++) {
+         struct vk_pipeline_cache_shard *shard = &cache->shards[i];
 
-         if (object->ops->serialize == NULL)
-            continue;
+         vk_pipeline_cache_lock(cache, shard);
 
-         size_t blob_size_save = blob.size;
+         swiss_set_foreach(shard->object_cache, entry) {
+            struct vk_pipeline_cache_object *object = (void *)entry->key;
 
-         int32_t type = find_type_for_ops(device->physical, object->ops);
-         blob_write_uint32(&blob, type);
-         blob_write_uint32(&blob, object->key_size);
-         intptr_t data_size_resv = blob_reserve_uint32(&blob);
-         blob_write_bytes(&blob, object->key_data, object->key_size);
+            if (object->ops->serialize == NULL)
+               continue;
 
-         blob_align(&blob, VK_PIPELINE_CACHE_BLOB_ALIGN);
+            size_t blob_size_save = blob.size;
 
-         uint32_t data_size;
-         if (!vk_pipeline_cache_object_serialize(cache, object,
-                                                 &blob, &data_size)) {
-            blob.size = blob_size_save;
-            if (blob.out_of_memory) {
-               result = VK_INCOMPLETE;
-               break;
+            int32_t type = find_type_for_ops(device->physical, object->ops);
+            blob_write_uint32(&blob, type);
+            blob_write_uint32(&blob, object->key_size);
+            intptr_t data_size_resv = blob_reserve_uint32(&blob);
+            blob_write_bytes(&blob, object->key_data, object->key_size);
+
+            blob_align(&blob, VK_PIPELINE_CACHE_BLOB_ALIGN);
+
+            uint32_t data_size;
+            if (!vk_pipeline_cache_object_serialize(cache, object,
+                                                    &blob, &data_size)) {
+               blob.size = blob_size_save;
+               if (blob.out_of_memory) {
+                  result = VK_INCOMPLETE;
+                  break;
+               }
+
+               /* Failed for some other reason; keep going */
+               continue;
             }
 
-            /* Failed for some other reason; keep going */
-            continue;
-         }
+            /* vk_pipeline_cache_object_serialize should have failed */
+            assert(!blob.out_of_memory);
 
-         /* vk_pipeline_cache_object_serialize should have failed */
-         assert(!blob.out_of_memory);
+            assert(data_size_resv >= 0);
+            blob_overwrite_uint32(&blob, data_size_resv, data_size);
+            count++;
+         }
 
-         assert(data_size_resv >= 0);
-         blob_overwrite_uint32(&blob, data_size_resv, data_size);
+         vk_pipeline_cache_unlock(cache, shard);
       }
    }
 
-   vk_pipeline_cache_unlock(cache);
-
    blob_overwrite_uint32(&blob, count_offset, count);
 
    *pDataSize = blob.size;
@@ -795,53 +863,66 @@ vk_common_MergePipelineCaches(VkDevice _device,
    VK_FROM_HANDLE(vk_device, device, _device);
    assert(dst->base.device == device);
 
-   if (!dst->object_cache)
+   if (!vk_pipeline_cache_is_enabled(dst))
       return VK_SUCCESS;
 
-   vk_pipeline_cache_lock(dst);
+   /* An object lands in the same shard of every cache, so each shard can be
+    * merged on its own.
+    */
+   for (unsigned s = 0; s < VK_PIPELINE_CACHE_NUM_SHARDS; s++) {
+      struct vk_pipeline_cache_shard *dst_shard = &dst->shards[s];
 
-   for (uint32_t i = 0; i < srcCacheCount; i++) {
-      VK_FROM_HANDLE(vk_pipeline_cache, src, pSrcCaches[i]);
-      assert(src->base.device == device);
+      vk_pipeline_cache_lock(dst, dst_shard);
 
-      if (!src->object_cache)
-         continue;
+      for (uint32_t i = 0; i < srcCacheCount; i++) {
+         VK_FROM_HANDLE(vk_pipeline_cache, src, pSrcCaches[i]);
+         assert(src->base.device == device);
 
-      assert(src != dst);
-      if (src == dst)
-         continue;
+         if (!vk_pipeline_cache_is_enabled(src))
+            continue;
+
+         assert(src != dst);
+         if (src == dst)
+            continue;
 
-      vk_pipeline_cache_lock(src);
-
-      set_foreach(src->object_cache, src_entry) {
-         struct vk_pipeline_cache_object *src_object = (void *)src_entry->key;
-
-         bool found_in_dst = false;
-         struct set_entry *dst_entry =
-            _mesa_set_search_or_add_pre_hashed(dst->object_cache,
-                                               src_entry->hash,
-                                               src_object, &found_in_dst);
-         if (found_in_dst) {
-            struct vk_pipeline_cache_object *dst_object = (void *)dst_entry->key;
-            if (dst_object->ops == &raw_data_object_ops &&
-                src_object->ops != &raw_data_object_ops) {
-               /* Even though dst has the object, it only has the blob version
-                * which isn't as useful.  Replace it with the real object.
-                */
-               vk_pipeline_cache_object_unref(device, dst_object);
-               dst_entry->key = vk_pipeline_cache_object_ref(src_object);
+         struct vk_pipeline_cache_shard *src_shard = &src->shards[s];
+
+         vk_pipeline_cache_lock(src, src_shard);
+
+         swiss_set_foreach(src_shard->object_cache, src_entry) {
+            struct vk_pipeline_cache_object *src_object =
+               (void *)src_entry->key;
+
+            bool found_in_dst = false;
+            struct swiss_set_entry *dst_entry =
+               _mesa_swiss_set_search_or_add_pre_hashed(dst_shard->object_cache,
+                                                        src_entry->hash,
+                                                        src_object,
+                                                        &found_in_dst);
+            if (found_in_dst) {
+               struct vk_pipeline_cache_object *dst_object =
+                  (void *)dst_entry->key;
+               if (dst_object->ops == &raw_data_object_ops &&
+                   src_object->ops != &raw_data_object_ops) {
+                  /* Even though dst has the object, it only has the blob
+                   * version which isn't as useful.  Replace it with the real
+                   * object.
+                   */
+                  vk_pipeline_cache_object_unref(device, dst_object);
+                  dst_entry->key = vk_pipeline_cache_object_ref(src_object);
+               }
+            } else {
+               /* We inserted src_object in dst so it needs a reference */
+               assert(dst_entry->key == (const void *)src_object);
+               vk_pipeline_cache_object_ref(src_object);
             }
-         } else {
-            /* We inserted src_object in dst so it needs a reference */
-            assert(dst_entry->key == (const void *)src_object);
-            vk_pipeline_cache_object_ref(src_object);
          }
+
+         vk_pipeline_cache_unlock(src, src_shard);
       }
 
-      vk_pipeline_cache_unlock(src);
+      vk_pipeline_cache_unlock(dst, dst_shard);
    }
 
-   vk_pipeline_cache_unlock(dst);
-
    return VK_SUCCESS;
 }
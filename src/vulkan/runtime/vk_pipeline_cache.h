@@ -36,8 +36,8 @@ extern "C" {
 struct blob;
 struct blob_reader;
 
-/* #include "util/set.h" */
-struct set;
+/* #include "util/swiss_set.h" */
+struct swiss_set;
 
 /* #include "compiler/nir/nir.h" */
 struct nir_shader;
@@ -151,6 +151,15 @@ vk_pipeline_cache_object_unref(struct vk_device *device,
       object->ops->destroy(device, object);
 }
 
+#define VK_PIPELINE_CACHE_NUM_SHARDS 16
+
+struct vk_pipeline_cache_shard {
+   /** Protects object_cache */
+   simple_mtx_t lock;
+
+   struct swiss_set *object_cache;
+};
+
 /** A generic implementation of VkPipelineCache */
 struct vk_pipeline_cache {
    struct vk_object_base base;
@@ -160,10 +169,12 @@ struct vk_pipeline_cache {
 
    struct vk_pipeline_cache_header header;
 
-   /** Protects object_cache */
-   simple_mtx_t lock;
-
-   struct set *object_cache;
+   /** Objects are spread over the shards by key hash, so that threads
+    * compiling different pipelines against the same cache rarely take the
+    * same lock.  The object_cache of all shards is NULL if the cache is
+    * disabled.
+    */
+   struct vk_pipeline_cache_shard shards[VK_PIPELINE_CACHE_NUM_SHARDS];
 };
 
 VK_DEFINE_NONDISP_HANDLE_CASTS(vk_pipeline_cache, base, VkPipelineCache,
@@ -188,6 +199,10 @@ void
 vk_pipeline_cache_destroy(struct vk_pipeline_cache *cache,
                           const VkAllocationCallbacks *pAllocator);
 
+/** Returns the number of objects in the cache */
+uint32_t
+vk_pipeline_cache_num_objects(struct vk_pipeline_cache *cache);
+
 /** Attempts to look up an object in the cache by key
  *
  * If an object is found in the cache matching the given key, *cache_hit is